@@ -6,6 +6,7 @@
 #include <tilck/common/page_size.h>
 #include <tilck/common/assert.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/fatz.h>
 #include <tilck/common/utils.h>
 
 #include "defs.h"
@@ -21,6 +22,7 @@ struct load_ramdisk_ctx {
    UINT32 tot_used_bytes;
    UINT32 rounded_tot_used_bytes;   /* Rounded up at PAGE_SIZE */
 
+   bool compressed;                 /* FATZ image (see fatz.h) */
    void *fat_hdr;
 };
 
@@ -43,9 +45,20 @@ LoadRamdisk_GetTotFatSize(struct load_ramdisk_ctx *ctx)
    status = ReadAlignedBlock(ctx->blockio, initrd_off, PAGE_SIZE, fat_hdr);
    HANDLE_EFI_ERROR("ReadAlignedBlock");
 
-   fat_sec_sz = fat_get_sector_size(fat_hdr);
-   ctx->total_fat_size = (fat_get_first_data_sector(fat_hdr) + 1) * fat_sec_sz;
-   ctx->rounded_tot_fat_sz = round_up_at(ctx->total_fat_size, PAGE_SIZE);
+   if (fatz_is_image(fat_hdr)) {
+
+      /* Compressed ramdisk: we already know how much we have to read */
+      ctx->compressed = true;
+      ctx->tot_used_bytes = ((struct fatz_hdr *)fat_hdr)->image_size;
+      ctx->rounded_tot_used_bytes = round_up_at(ctx->tot_used_bytes, PAGE_SIZE);
+
+   } else {
+
+      fat_sec_sz = fat_get_sector_size(fat_hdr);
+      ctx->total_fat_size =
+         (fat_get_first_data_sector(fat_hdr) + 1) * fat_sec_sz;
+      ctx->rounded_tot_fat_sz = round_up_at(ctx->total_fat_size, PAGE_SIZE);
+   }
 
    status = BS->FreePages(paddr, 1);
    HANDLE_EFI_ERROR("FreePages");
@@ -249,8 +262,10 @@ LoadRamdisk(EFI_HANDLE image,
    status = LoadRamdisk_GetTotFatSize(&ctx);
    HANDLE_EFI_ERROR("LoadRamdisk_GetTotFatSize");
 
-   status = LoadRamdisk_GetTotUsedBytes(&ctx);
-   HANDLE_EFI_ERROR("LoadRamdisk_GetTotUsedBytes");
+   if (!ctx.compressed) {
+      status = LoadRamdisk_GetTotUsedBytes(&ctx);
+      HANDLE_EFI_ERROR("LoadRamdisk_GetTotUsedBytes");
+   }
 
    status = LoadRamdisk_AllocMem(&ctx);
    HANDLE_EFI_ERROR("LoadRamdisk_AllocMem");
@@ -271,8 +286,10 @@ LoadRamdisk(EFI_HANDLE image,
    Print(LOADING_INITRD_STR_U);
    write_ok_msg();
 
-   status = LoadRamdisk_CompactClusters(&ctx);
-   HANDLE_EFI_ERROR("LoadRamdisk_CompactClusters");
+   if (!ctx.compressed) {
+      status = LoadRamdisk_CompactClusters(&ctx);
+      HANDLE_EFI_ERROR("LoadRamdisk_CompactClusters");
+   }
 
    /*
     * Pass via multiboot 'used bytes' as RAMDISK size instead of the real
@@ -4,6 +4,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/fatz.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/color_defs.h>
 
@@ -63,6 +64,9 @@ rd_compact_clusters(void *ramdisk, u32 rd_size)
 {
    u32 ff_clu_off;         /* offset of ramdisk's first free cluster */
 
+   if (fatz_is_image(ramdisk))
+      return rd_size; /* Compressed ramdisk: there are no free clusters */
+
    ff_clu_off = fat_get_first_free_cluster_off(ramdisk);
 
    if (ff_clu_off < rd_size) {
@@ -181,24 +185,32 @@ load_fat_ramdisk(const char *load_str,
    // Read FAT's header
    read_sectors(free_mem, first_sec, 1 /* read just 1 sector */);
 
-   // Do some sanity checks against data corruption
-   if (!check_fat_header((void *)free_mem))
-      goto corrupted;
+   if (fatz_is_image((void *)free_mem)) {
 
-   // Determine FAT's metadata size
-   rd_metadata_sz = calc_fat_ramdisk_metadata_sz((void *)free_mem);
+      // Compressed ramdisk (see fatz.h): its size is in the header
+      rd_size = ((struct fatz_hdr *)free_mem)->image_size;
 
-   // Get a free mem area big enough for it
-   free_mem = get_usable_mem(&g_meminfo, min_paddr, rd_metadata_sz);
+   } else {
 
-   if (!free_mem || overlap_with_kernel_file(free_mem, rd_metadata_sz))
-      goto oom;
+      // Do some sanity checks against data corruption
+      if (!check_fat_header((void *)free_mem))
+         goto corrupted;
+
+      // Determine FAT's metadata size
+      rd_metadata_sz = calc_fat_ramdisk_metadata_sz((void *)free_mem);
 
-   // Now read all the meta-data up to the first data sector.
-   read_sectors(free_mem, first_sec, rd_metadata_sz / SECTOR_SIZE);
+      // Get a free mem area big enough for it
+      free_mem = get_usable_mem(&g_meminfo, min_paddr, rd_metadata_sz);
 
-   // Finally we're able to determine how big is the fatpart (pure data)
-   rd_size = fat_calculate_used_bytes((void *)free_mem);
+      if (!free_mem || overlap_with_kernel_file(free_mem, rd_metadata_sz))
+         goto oom;
+
+      // Now read all the meta-data up to the first data sector.
+      read_sectors(free_mem, first_sec, rd_metadata_sz / SECTOR_SIZE);
+
+      // Finally we're able to determine how big is the fatpart (pure data)
+      rd_size = fat_calculate_used_bytes((void *)free_mem);
+   }
 
    /* Calculate rd_size in sectors, rounding up at SECTOR_SIZE */
    rd_sectors = (rd_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
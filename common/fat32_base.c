@@ -4,6 +4,7 @@
 #include <tilck/common/assert.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/fatz.h>
 
 
 /*
@@ -269,7 +270,9 @@ fat_walk(struct fat_walk_static_params *p, u32 cluster)
           * In that case, fat_get_rootdir() returns 0 as cluster. In all the
           * other cases, we need only the cluster.
           */
-         dentries = fat_get_pointer_to_cluster_data(p->h, cluster);
+         dentries = p->zh
+            ? fatz_get_dir_cluster(p->zh, cluster)
+            : fat_get_pointer_to_cluster_data(p->h, cluster);
       }
 
       ASSERT(dentries != NULL);
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/fat32_base.h>
+#include <tilck/common/fatz.h>
+#include <tilck/common/lz4.h>
+
+bool fatz_check_image(struct fatz_hdr *zh, size_t size)
+{
+   const u32 *index = fatz_get_index(zh);
+   struct fat_hdr *hdr;
+   enum fat_type ft;
+   u32 begin, end, root_clu;
+
+   if (size < sizeof(*zh) || zh->magic != FATZ_MAGIC)
+      return false;
+
+   if (zh->version != FATZ_VERSION || zh->image_size > size)
+      return false;
+
+   if (zh->clusters >= zh->image_size / sizeof(u32))
+      return false;
+
+   if (zh->meta_off < sizeof(*zh) + (zh->clusters + 1) * sizeof(u32))
+      return false;
+
+   if (zh->meta_off > zh->image_size ||
+       zh->meta_size > zh->image_size - zh->meta_off ||
+       zh->meta_size < sizeof(struct fat_hdr) + sizeof(struct fat32_header2))
+   {
+      return false;
+   }
+
+   hdr = fatz_get_fat_hdr(zh);
+
+   if (!hdr->BPB_BytsPerSec || !zh->cluster_size)
+      return false;
+
+   if (fat_get_cluster_size(hdr) != zh->cluster_size)
+      return false;
+
+   if (fat_get_first_data_sector(hdr) * hdr->BPB_BytsPerSec != zh->meta_size)
+      return false;
+
+   ft = fat_get_type(hdr);
+
+   if (ft != fat16_type && ft != fat32_type)
+      return false;
+
+   end = zh->meta_off + zh->meta_size;
+
+   for (u32 i = 0; i < zh->clusters; i++) {
+
+      begin = index[i] & ~FATZ_RAW_BLOCK;
+
+      if (begin != end)
+         return false; /* The blocks must be contiguous */
+
+      end = index[i + 1] & ~FATZ_RAW_BLOCK;
+
+      if (end < begin || end > zh->image_size)
+         return false;
+
+      if ((index[i] & FATZ_RAW_BLOCK) && end - begin != zh->cluster_size)
+         return false;
+   }
+
+   if (ft == fat32_type) {
+
+      /* FAT32's root dir is a regular cluster chain: it must be raw */
+      fat_get_rootdir(hdr, ft, &root_clu);
+
+      if (root_clu < 2 || root_clu - 2 >= zh->clusters)
+         return false;
+
+      if (!(index[root_clu - 2] & FATZ_RAW_BLOCK))
+         return false;
+   }
+
+   return true;
+}
+
+bool fatz_read_cluster(struct fatz_hdr *zh, u32 clu, void *buf)
+{
+   u32 size;
+   void *block = fatz_get_block(zh, clu, &size);
+
+   if (fatz_is_raw_block(zh, clu)) {
+      memcpy(buf, block, zh->cluster_size);
+      return true;
+   }
+
+   return lz4_decompress(block, size, buf, zh->cluster_size) ==
+          (long)zh->cluster_size;
+}
+
+struct fatz_build_ctx {
+
+   struct fat_hdr *hdr;
+   enum fat_type ft;
+   u32 *index;
+   u32 clusters;
+};
+
+static void fatz_mark_raw_chain(struct fatz_build_ctx *ctx, u32 clu)
+{
+   while (true) {
+
+      if (clu >= 2 && clu - 2 < ctx->clusters)
+         ctx->index[clu - 2] |= FATZ_RAW_BLOCK;
+
+      clu = fat_read_fat_entry(ctx->hdr, ctx->ft, 0, clu);
+
+      if (fat_is_end_of_clusterchain(ctx->ft, clu) || clu < 2)
+         break;
+   }
+}
+
+static void fatz_mark_dir(struct fatz_build_ctx *ctx, u32 clu);
+
+static int
+fatz_mark_dir_cb(struct fat_hdr *hdr,
+                 enum fat_type ft,
+                 struct fat_entry *e,
+                 const char *long_name,
+                 void *arg)
+{
+   const u32 clu = fat_get_first_cluster(e);
+
+   /* Skip the files, "." and ".." (the root dir has cluster 0 there) */
+   if (!e->directory || e->DIR_Name[0] == '.' || clu < 2)
+      return 0;
+
+   fatz_mark_dir(arg, clu);
+   return 0;
+}
+
+/* Mark as raw the clusters of the dir at `clu` and of all its sub-dirs */
+static void fatz_mark_dir(struct fatz_build_ctx *ctx, u32 clu)
+{
+   struct fat_walk_static_params walk_params = {
+      .ctx = NULL,
+      .h = ctx->hdr,
+      .ft = ctx->ft,
+      .cb = &fatz_mark_dir_cb,
+      .arg = ctx,
+   };
+
+   if (!clu)
+      fat_get_rootdir(ctx->hdr, ctx->ft, &clu); /* FAT32: root dir's chain */
+
+   if (clu)
+      fatz_mark_raw_chain(ctx, clu);
+
+   fat_walk(&walk_params, clu);
+}
+
+static u32 fatz_get_clusters(struct fat_hdr *hdr)
+{
+   const u32 meta_size = fat_get_first_data_sector(hdr) * hdr->BPB_BytsPerSec;
+   const u32 used = fat_calculate_used_bytes(hdr);
+
+   return used > meta_size ? (used - meta_size) / fat_get_cluster_size(hdr) : 0;
+}
+
+u32 fatz_get_max_overhead(struct fat_hdr *hdr)
+{
+   return sizeof(struct fatz_hdr) + (fatz_get_clusters(hdr) + 1) * sizeof(u32);
+}
+
+u32 fatz_build(struct fat_hdr *hdr, void *buf, u32 buf_size, void *wrkmem)
+{
+   const u32 cs = fat_get_cluster_size(hdr);
+   const u32 meta_size = fat_get_first_data_sector(hdr) * hdr->BPB_BytsPerSec;
+   const u32 clusters = fatz_get_clusters(hdr);
+   struct fatz_hdr *zh = buf;
+   u32 *index = fatz_get_index(zh);
+   u32 off = fatz_get_max_overhead(hdr);
+   u32 sz, rem;
+
+   struct fatz_build_ctx ctx = {
+      .hdr = hdr,
+      .ft = fat_get_type(hdr),
+      .index = index,
+      .clusters = clusters,
+   };
+
+   if (buf_size < off + meta_size)
+      return 0;
+
+   *zh = (struct fatz_hdr) {
+      .magic = FATZ_MAGIC,
+      .version = FATZ_VERSION,
+      .image_size = 0,
+      .fat_size = meta_size + clusters * cs,
+      .meta_off = off,
+      .meta_size = meta_size,
+      .cluster_size = cs,
+      .clusters = clusters,
+   };
+
+   memcpy((char *)buf + off, hdr, meta_size);
+   off += meta_size;
+
+   /* First, mark the blocks of all the directories as raw */
+   bzero(index, clusters * sizeof(u32));
+   fatz_mark_dir(&ctx, 0);
+
+   /* Then, compress all the other ones, when it's worth */
+   for (u32 i = 0; i < clusters; i++) {
+
+      void *data = fat_get_pointer_to_cluster_data(hdr, i + 2);
+      char *dest = (char *)buf + off;
+
+      rem = buf_size - off;
+      sz = 0;
+
+      if (!(index[i] & FATZ_RAW_BLOCK))
+         sz = (u32)lz4_compress(data, cs, dest, MIN(rem, cs - 1), wrkmem);
+
+      if (sz) {
+
+         index[i] = off;
+
+      } else {
+
+         if (rem < cs)
+            return 0;
+
+         memcpy(dest, data, cs);
+         index[i] = off | FATZ_RAW_BLOCK;
+         sz = cs;
+      }
+
+      off += sz;
+   }
+
+   index[clusters] = off;
+   zh->image_size = off;
+   return off;
+}
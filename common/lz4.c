@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/lz4.h>
+
+/*
+ * The LZ4 block format
+ * ----------------------
+ *
+ * A block is a sequence of sequences. Each sequence starts with a token byte:
+ * its high nibble is the number of literals and its low one the match length
+ * minus LZ4_MIN_MATCH. A nibble equal to 15 means that more length bytes
+ * follow, each one added to the length, until a byte != 255. Then come the
+ * literals and the little-endian 16-bit offset of the match, back from the
+ * current position. The last sequence has only the literals: it ends the block.
+ *
+ * The format requires the last LZ4_LAST_LITERALS bytes of the block to be
+ * literals and the last match to start at least LZ4_MFLIMIT bytes before the
+ * end of the block.
+ */
+
+#define LZ4_MIN_MATCH                                      4
+#define LZ4_LAST_LITERALS                                  5
+#define LZ4_MFLIMIT                                       12
+#define LZ4_MAX_OFFSET                                 65535
+#define LZ4_SKIP_TRIGGER                                   6
+
+static ALWAYS_INLINE u32 lz4_read32(const u8 *p)
+{
+   u32 v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static ALWAYS_INLINE u32 lz4_hash(u32 v)
+{
+   return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static u8 *lz4_write_len(u8 *op, u8 *oend, size_t len)
+{
+   for (; len >= 255; len -= 255) {
+
+      if (op >= oend)
+         return NULL;
+
+      *op++ = 255;
+   }
+
+   if (op >= oend)
+      return NULL;
+
+   *op++ = (u8)len;
+   return op;
+}
+
+/*
+ * Write a sequence with `lit_len` literals from `lit`, followed by a match of
+ * `match_len` bytes at `off` bytes back. A `match_len` of 0 means that's the
+ * last sequence. Returns the new output position or NULL if it does not fit.
+ */
+static u8 *
+lz4_write_seq(u8 *op,
+              u8 *oend,
+              const u8 *lit,
+              size_t lit_len,
+              size_t off,
+              size_t match_len)
+{
+   u8 *token;
+
+   if (op >= oend)
+      return NULL;
+
+   token = op++;
+   *token = (u8)(MIN(lit_len, 15u) << 4);
+
+   if (lit_len >= 15 && !(op = lz4_write_len(op, oend, lit_len - 15)))
+      return NULL;
+
+   if ((size_t)(oend - op) < lit_len)
+      return NULL;
+
+   memcpy(op, lit, lit_len);
+   op += lit_len;
+
+   if (!match_len)
+      return op;
+
+   if (oend - op < 2)
+      return NULL;
+
+   *op++ = (u8)(off & 0xff);
+   *op++ = (u8)(off >> 8);
+
+   match_len -= LZ4_MIN_MATCH;
+   *token |= (u8)MIN(match_len, 15u);
+
+   if (match_len >= 15 && !(op = lz4_write_len(op, oend, match_len - 15)))
+      return NULL;
+
+   return op;
+}
+
+size_t
+lz4_compress(const void *src,
+             size_t len,
+             void *dst,
+             size_t dst_cap,
+             void *wrkmem)
+{
+   const u8 *const base = src;
+   const u8 *const iend = base + len;
+   const u8 *ip = base;
+   const u8 *anchor = base;
+   u8 *op = dst;
+   u8 *const oend = op + dst_cap;
+   u32 *const ht = wrkmem;
+   u32 misses = 0;
+
+   bzero(ht, LZ4_WRKMEM_SIZE);
+
+   while (len > LZ4_MFLIMIT && ip < iend - LZ4_MFLIMIT) {
+
+      const u8 *const mlimit = iend - LZ4_LAST_LITERALS;
+      const u32 seq = lz4_read32(ip);
+      const u32 h = lz4_hash(seq);
+      const u8 *ref = base + ht[h];
+      const u8 *mp;
+
+      ht[h] = (u32)(ip - base);
+
+      if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != seq) {
+
+         /* No match: skip faster and faster on incompressible data */
+         ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+         continue;
+      }
+
+      /* Extend the match forwards, then backwards over the literals */
+      for (mp = ip + LZ4_MIN_MATCH; mp < mlimit; mp++) {
+         if (*mp != ref[mp - ip])
+            break;
+      }
+
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+         ip--;
+         ref--;
+      }
+
+      op = lz4_write_seq(op,
+                         oend,
+                         anchor,
+                         (size_t)(ip - anchor),
+                         (size_t)(ip - ref),
+                         (size_t)(mp - ip));
+
+      if (!op)
+         return 0;
+
+      ip = anchor = mp;
+      misses = 0;
+   }
+
+   op = lz4_write_seq(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+   return op ? (size_t)(op - (u8 *)dst) : 0;
+}
+
+static bool lz4_read_len(const u8 **ipp, const u8 *iend, size_t *len)
+{
+   u8 b;
+
+   do {
+
+      if (*ipp >= iend)
+         return false;
+
+      b = *(*ipp)++;
+      *len += b;
+
+   } while (b == 255);
+
+   return true;
+}
+
+long
+lz4_decompress(const void *src, size_t len, void *dst, size_t dst_cap)
+{
+   const u8 *ip = src;
+   const u8 *const iend = ip + len;
+   u8 *op = dst;
+   u8 *const oend = op + dst_cap;
+   const u8 *match;
+   size_t n, off;
+   u8 token;
+
+   while (ip < iend) {
+
+      token = *ip++;
+      n = token >> 4;
+
+      if (n == 15 && !lz4_read_len(&ip, iend, &n))
+         return -1;
+
+      if ((size_t)(iend - ip) < n || (size_t)(oend - op) < n)
+         return -1;
+
+      memcpy(op, ip, n);
+      op += n;
+      ip += n;
+
+      if (ip == iend)
+         break; /* The last sequence has no match */
+
+      if (iend - ip < 2)
+         return -1;
+
+      off = (size_t)ip[0] | (size_t)ip[1] << 8;
+      ip += 2;
+
+      if (!off || off > (size_t)(op - (u8 *)dst))
+         return -1;
+
+      n = token & 15;
+
+      if (n == 15 && !lz4_read_len(&ip, iend, &n))
+         return -1;
+
+      n += LZ4_MIN_MATCH;
+
+      if ((size_t)(oend - op) < n)
+         return -1;
+
+      match = op - off;
+
+      if (off >= n) {
+
+         memcpy(op, match, n);
+
+      } else {
+
+         /* Overlapping match: it repeats the last `off` bytes */
+         for (size_t i = 0; i < n; i++)
+            op[i] = match[i];
+      }
+
+      op += n;
+   }
+
+   return (long)(op - (u8 *)dst);
+}
@@ -39,9 +39,11 @@
 #define USERMODE_VADDR_END   (KERNEL_BASE_VA) /* biggest user vaddr + 1 */
 #define MAX_BRK                  (0x40000000) /* +1 GB (virtual memory) */
 #define USER_MMAP_BEGIN               MAX_BRK /* +1 GB (virtual memory) */
-#define USER_MMAP_MIN_SZ            (16 * MB)
-#define USER_MMAP_MAX_SZ          (1024 * MB)
 #define USERMODE_STACK_ALIGN              16u
 
+/* mmap() can use everything up to the stack, leaving a guard page */
+#define USER_MMAP_END \
+   (USERMODE_VADDR_END - (USER_STACK_PAGES + 1) * PAGE_SIZE)
+
 #define USERMODE_STACK_MAX \
    ((USERMODE_VADDR_END - 1) & ALIGNED_MASK(USERMODE_STACK_ALIGN))
@@ -35,6 +35,9 @@
  */
 #define MAX_SCRIPT_REC                                          2
 
+/* Max number of SQ entries of an io_uring (the CQ can have twice as many) */
+#define IO_URING_MAX_ENTRIES                                  256
+
 /*
  * Per-task I/O buffer size (pages).
  * Note it is linked with USER_ARGS_PAGE_COUNT.
@@ -26,6 +26,8 @@
 #define MSR_IA32_SYSENTER_ESP           0x175
 #define MSR_IA32_SYSENTER_EIP           0x176
 
+#define MSR_IA32_APIC_BASE              0x01b
+
 #define MSR_IA32_MTRRCAP                0x0fe
 #define MSR_IA32_MTRR_DEF_TYPE          0x2ff
 
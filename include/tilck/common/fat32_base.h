@@ -255,6 +255,8 @@ typedef int (*fat_dentry_cb)(struct fat_hdr *,
                              const char *,         /* long name */
                              void *);              /* user data pointer */
 
+struct fatz_hdr;
+
 struct fat_walk_static_params {
 
    struct fat_walk_long_name_ctx *ctx;
@@ -262,6 +264,9 @@ struct fat_walk_static_params {
    enum fat_type ft;
    fat_dentry_cb cb;
    void *arg;
+
+   /* Optional: the FATZ image containing the dir clusters (see fatz.h) */
+   struct fatz_hdr *zh;
 };
 
 /*
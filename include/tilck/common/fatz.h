@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/fat32_base.h>
+
+/*
+ * Compressed FAT images (FATZ)
+ * ------------------------------
+ *
+ * A FATZ image contains a FAT partition having each one of its data clusters
+ * compressed on its own with LZ4, so that any cluster can be decompressed on
+ * demand, without touching the others. The layout of the image is:
+ *
+ *    [struct fatz_hdr] [u32 index[clusters + 1]] [metadata] [blocks]
+ *
+ * The metadata (the reserved sectors, the FATs and, on FAT16, the root dir) is
+ * stored as it is, so that the FAT tables can be read directly from the image.
+ * Then, there's one block for each data cluster: the block of the cluster N
+ * starts at the image offset `index[N - 2]` (without the FATZ_RAW_BLOCK flag)
+ * and ends where the next one starts. The blocks of the directories are always
+ * stored uncompressed (raw), because the FAT code needs stable pointers to the
+ * dir entries. So are also the clusters not compressible at all.
+ */
+
+#define FATZ_MAGIC                                0x5a544146  /* "FATZ" */
+#define FATZ_VERSION                                       1
+#define FATZ_RAW_BLOCK                               (1u << 31)
+
+struct fatz_hdr {
+
+   u32 magic;              /* FATZ_MAGIC */
+   u32 version;            /* FATZ_VERSION */
+   u32 image_size;         /* size of the whole image, in bytes */
+   u32 fat_size;           /* size of the uncompressed FAT partition */
+   u32 meta_off;           /* offset of the metadata in the image */
+   u32 meta_size;          /* size of the metadata */
+   u32 cluster_size;
+   u32 clusters;           /* number of data clusters in the image */
+};
+
+static inline bool fatz_is_image(void *p)
+{
+   return ((struct fatz_hdr *)p)->magic == FATZ_MAGIC;
+}
+
+static inline u32 *fatz_get_index(struct fatz_hdr *zh)
+{
+   return (u32 *)(zh + 1);
+}
+
+static inline struct fat_hdr *fatz_get_fat_hdr(struct fatz_hdr *zh)
+{
+   return (struct fat_hdr *)((char *)zh + zh->meta_off);
+}
+
+static inline bool fatz_is_raw_block(struct fatz_hdr *zh, u32 clu)
+{
+   ASSERT(clu >= 2 && clu - 2 < zh->clusters);
+   return !!(fatz_get_index(zh)[clu - 2] & FATZ_RAW_BLOCK);
+}
+
+/* Get the block of the cluster `clu`, and its size in `*size` */
+static inline void *fatz_get_block(struct fatz_hdr *zh, u32 clu, u32 *size)
+{
+   u32 *index = fatz_get_index(zh);
+   u32 begin, end;
+
+   ASSERT(clu >= 2 && clu - 2 < zh->clusters);
+
+   begin = index[clu - 2] & ~FATZ_RAW_BLOCK;
+   end = index[clu - 1] & ~FATZ_RAW_BLOCK;
+
+   *size = end - begin;
+   return (char *)zh + begin;
+}
+
+/* Get a pointer to the (always raw) data of the directory cluster `clu` */
+static inline void *fatz_get_dir_cluster(struct fatz_hdr *zh, u32 clu)
+{
+   u32 size;
+   ASSERT(fatz_is_raw_block(zh, clu));
+   return fatz_get_block(zh, clu, &size);
+}
+
+/*
+ * Check the consistency of the FATZ image at `zh`, loaded in a buffer of
+ * `size` bytes. Must be called before using any other fatz_* function.
+ */
+bool fatz_check_image(struct fatz_hdr *zh, size_t size);
+
+/*
+ * Read the data of the cluster `clu` into `buf`, `cluster_size` bytes long.
+ * Returns false if the block is corrupted.
+ */
+bool fatz_read_cluster(struct fatz_hdr *zh, u32 clu, void *buf);
+
+/*
+ * Create a FATZ image in `buf` from the FAT partition at `hdr`, using `wrkmem`
+ * (LZ4_WRKMEM_SIZE bytes) as working memory. Returns the size of the image or
+ * 0 if it does not fit in `buf_size` bytes. A `buf_size` equal to the one of
+ * the partition + fatz_get_max_overhead() is always enough.
+ */
+u32 fatz_build(struct fat_hdr *hdr, void *buf, u32 buf_size, void *wrkmem);
+u32 fatz_get_max_overhead(struct fat_hdr *hdr);
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Linux's io_uring userspace interface, limited to the subset supported by
+ * Tilck. The kernel headers of the toolchain predate io_uring, therefore the
+ * structs and the constants are defined here, with exactly the same layout and
+ * values as in Linux's <linux/io_uring.h>.
+ */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/* Submission Queue Entry */
+struct io_uring_sqe {
+
+   u8 opcode;                 /* IORING_OP_* */
+   u8 flags;                  /* IOSQE_* flags */
+   u16 ioprio;
+   s32 fd;
+
+   union {
+      u64 off;                /* file offset, (u64)-1 for the current one */
+      u64 addr2;
+   };
+
+   u64 addr;                  /* buffer, iovecs, path or timespec pointer */
+   u32 len;                   /* buffer size or number of iovecs */
+
+   union {
+      u32 rw_flags;
+      u32 fsync_flags;
+      u16 poll_events;
+      u32 poll32_events;
+      u32 timeout_flags;
+      u32 open_flags;
+   };
+
+   u64 user_data;             /* copied as-is in the completion */
+   u16 buf_index;
+   u16 personality;
+   s32 splice_fd_in;
+   u64 __pad2[2];
+};
+
+/* Completion Queue Entry */
+struct io_uring_cqe {
+
+   u64 user_data;
+   s32 res;                   /* the result, like a syscall's return value */
+   u32 flags;
+};
+
+STATIC_ASSERT(sizeof(struct io_uring_sqe) == 64);
+STATIC_ASSERT(sizeof(struct io_uring_cqe) == 16);
+
+/* sqe->flags (none of them is supported yet) */
+#define IOSQE_FIXED_FILE                     (1u << 0)
+#define IOSQE_IO_DRAIN                       (1u << 1)
+#define IOSQE_IO_LINK                        (1u << 2)
+#define IOSQE_IO_HARDLINK                    (1u << 3)
+#define IOSQE_ASYNC                          (1u << 4)
+
+/* io_uring_setup() flags */
+#define IORING_SETUP_CQSIZE                  (1u << 3)
+#define IORING_SETUP_CLAMP                   (1u << 4)
+
+enum io_uring_op {
+
+   IORING_OP_NOP                 = 0,
+   IORING_OP_READV               = 1,
+   IORING_OP_WRITEV              = 2,
+   IORING_OP_FSYNC               = 3,
+   IORING_OP_POLL_ADD            = 6,
+   IORING_OP_TIMEOUT             = 11,
+   IORING_OP_OPENAT              = 18,
+   IORING_OP_CLOSE               = 19,
+   IORING_OP_READ                = 22,
+   IORING_OP_WRITE               = 23,
+};
+
+/* sqe->fsync_flags */
+#define IORING_FSYNC_DATASYNC                (1u << 0)
+
+/* sqe->timeout_flags */
+#define IORING_TIMEOUT_ABS                   (1u << 0)
+
+/* Magic offsets for mmap() on the io_uring fd */
+#define IORING_OFF_SQ_RING                   0ull
+#define IORING_OFF_CQ_RING                   0x8000000ull
+#define IORING_OFF_SQES                      0x10000000ull
+
+struct io_sqring_offsets {
+
+   u32 head;
+   u32 tail;
+   u32 ring_mask;
+   u32 ring_entries;
+   u32 flags;
+   u32 dropped;
+   u32 array;
+   u32 resv1;
+   u64 resv2;
+};
+
+struct io_cqring_offsets {
+
+   u32 head;
+   u32 tail;
+   u32 ring_mask;
+   u32 ring_entries;
+   u32 overflow;
+   u32 cqes;
+   u32 flags;
+   u32 resv1;
+   u64 resv2;
+};
+
+/* io_uring_enter() flags */
+#define IORING_ENTER_GETEVENTS               (1u << 0)
+
+struct io_uring_params {
+
+   u32 sq_entries;
+   u32 cq_entries;
+   u32 flags;
+   u32 sq_thread_cpu;
+   u32 sq_thread_idle;
+   u32 features;
+   u32 wq_fd;
+   u32 resv[3];
+   struct io_sqring_offsets sq_off;
+   struct io_cqring_offsets cq_off;
+};
+
+/* io_uring_params->features */
+#define IORING_FEAT_SINGLE_MMAP              (1u << 0)
+#define IORING_FEAT_NODROP                   (1u << 1)
+
+/* io_uring_register() opcodes */
+#define IORING_REGISTER_EVENTFD              4
+#define IORING_UNREGISTER_EVENTFD            5
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Minimal LZ4 codec, supporting only the raw block format (no frames).
+ *
+ * The compressor is a simple greedy one, with a single-entry hash table, made
+ * for the build apps: it's far from the best ratio possible, but it's fast.
+ * The decompressor validates its whole input and never writes past `dst_cap`:
+ * it's safe to use on corrupted data.
+ */
+
+#define LZ4_HASH_BITS                                     12
+#define LZ4_WRKMEM_SIZE             (sizeof(u32) << LZ4_HASH_BITS)
+
+/*
+ * Compress `len` bytes from `src` into `dst`, using `wrkmem` (LZ4_WRKMEM_SIZE
+ * bytes) as working memory. Returns the compressed size or 0, if it does not
+ * fit in `dst_cap` bytes.
+ */
+size_t
+lz4_compress(const void *src,
+             size_t len,
+             void *dst,
+             size_t dst_cap,
+             void *wrkmem);
+
+/*
+ * Decompress the block of `len` bytes at `src` into `dst`. Returns the size of
+ * the decompressed data or -1, if the block is malformed or its decompressed
+ * data does not fit in `dst_cap` bytes.
+ */
+long
+lz4_decompress(const void *src, size_t len, void *dst, size_t dst_cap);
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * IDT entry of the LAPIC's spurious interrupt. On P6 and Pentium CPUs, its
+ * bits 0-3 are hard-wired to 1.
+ */
+#define APIC_SPUR_VECTOR                                  0xff
+
+/*
+ * Set up the local APIC of the current CPU and the first I/O APIC, using the
+ * info read from ACPI's MADT. The IRQs keep being routed through the 8259
+ * PICs: the LAPIC runs in virtual wire mode and all the I/O APIC's pins are
+ * masked. Does nothing if MADT is not available.
+ */
+void init_apic(void);
@@ -38,6 +38,7 @@ struct x86_arch_proc_members {
 
 struct x86_arch_task_members {
    u16 fpu_regs_size;
+   u16 tls_gdt_entry; /* Index in gdt of the CLONE_SETTLS entry, if > 0 */
    void *aligned_fpu_regs;
 };
 
@@ -65,6 +65,17 @@ bintree_find_internal(void *root_obj,
                       long bintree_offset);
 
 
+/*
+ * Like bintree_find_internal(), but in case there's no object equal to
+ * `value_ptr`, it returns the smallest object bigger than it, or NULL.
+ */
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,  // cmp(root_obj, value_ptr)
+                         long bintree_offset);
+
+
 /*
  * returns a pointer to the removed object (if found) or NULL.
  */
@@ -140,6 +151,15 @@ bintree_remove_ptr_internal(void **root_obj_ref,
                          (value), (objval_cmpfun),                            \
                          OFFSET_OF(struct_type, elem_name))
 
+/*
+ * Find the object with key `value` or, if there's none, the smallest object
+ * with a key bigger than `value`. Same conventions as bintree_find().
+ */
+#define bintree_find_ge(root_obj, value, objval_cmpfun, struct_type, elem_name)\
+   bintree_find_ge_internal((void*)(root_obj),                                \
+                            (value), (objval_cmpfun),                         \
+                            OFFSET_OF(struct_type, elem_name))
+
 /*
  * Find the object with key `value`, where value is a pointer-sized integer.
  * The comparison function is hard-coded and it just compares the given field
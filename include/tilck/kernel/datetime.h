@@ -36,6 +36,8 @@ bool clock_in_resync(void);
 bool clock_in_full_resync(void);
 void ticks_to_timespec(u64 ticks, struct k_timespec64 *tp);
 u64 timespec_to_ticks(const struct k_timespec64 *tp);
+void ticks_to_timeval(u64 ticks, struct timeval *tv);
+u64 timeval_to_ticks(const struct timeval *tv);
 void real_time_get_timespec(struct k_timespec64 *tp);
 void monotonic_time_get_timespec(struct k_timespec64 *tp);
 void clock_get_resync_stats(struct clock_resync_stats *s);
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/* Returns NULL in case of out-of-memory */
+fs_handle create_epoll_handle(void);
+
+/* Removes `h` from the interest sets of all the epoll objects watching it */
+void epoll_on_handle_close(fs_handle h);
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/* Returns NULL in case of out-of-memory. `flags` are eventfd2()'s flags */
+fs_handle create_eventfd_handle(u32 initval, int flags);
+
+/*
+ * Add `n` to the counter of an eventfd, from the kernel, without blocking: in
+ * case of overflow, the counter is left unchanged. Returns -EINVAL if `h` is
+ * not an eventfd.
+ */
+int eventfd_signal(fs_handle h, u64 n);
@@ -9,7 +9,7 @@ typedef int (*func_create_per_handle_extra)(int minor, void *extra);
 typedef int (*func_on_dup_per_handle_extra)(int minor, void *extra);
 typedef void (*func_destroy_per_handle_extra)(int minor, void *extra);
 
-#define DEVFS_EXTRA_SIZE            (7 * sizeof(void *))
+#define DEVFS_EXTRA_SIZE            (6 * sizeof(void *))
 
 struct devfs_file_info {
 
@@ -9,9 +9,14 @@
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/fs/vfs_base.h>
 
+struct fat_chain_index;
+struct fat_dir_cache;
+struct fat_zcache;
+
 struct fat_fs_device_data {
 
    struct fat_hdr *hdr; /* vaddr of the beginning of the FAT partition */
+   struct fatz_hdr *zhdr; /* the FATZ image containing it, if compressed */
    enum fat_type type;
    u32 cluster_size;
    u32 root_cluster;
@@ -28,8 +33,33 @@ struct fat_fs_device_data {
     * regular fat_entry.
     */
    struct fat_entry *root_dir_entries;
+
+   /* Per-file cluster-chain indexes (see fat32_chain.c) */
+   struct fat_chain_index *chain_indexes;
+
+   /* Per-directory hash tables of entries (see fat32_dcache.c) */
+   struct fat_dir_cache *dir_caches;
+
+   /* Cache of decompressed clusters, for FATZ ramdisks (see fat32_zcache.c) */
+   struct fat_zcache *zcache;
 };
 
+/*
+ * Special fat_walk() wrapper handling the special case where `e` is NOT a dir
+ * entry but a pointer to the entries in the root directory.
+ */
+
+static inline int
+fat_fs_walk_generic(struct fat_fs_device_data *d,
+                    struct fat_walk_static_params *static_walk_params,
+                    struct fat_entry *e)
+{
+   return fat_walk(static_walk_params,
+                   e == d->root_dir_entries
+                     ? d->root_cluster
+                     : fat_get_first_cluster(e));
+}
+
 struct fatfs_handle {
 
    /* struct fs_handle_base */
@@ -45,6 +75,24 @@ STATIC_ASSERT(sizeof(struct fatfs_handle) <= MAX_FS_HANDLE_SIZE);
 struct fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags);
 void fat_umount_ramdisk(struct fs *fs);
 
+u32
+fat_get_file_cluster(struct fat_fs_device_data *d, struct fat_entry *e, u32 n);
+void fat_destroy_chain_indexes(struct fat_fs_device_data *d);
+
+int
+fat_dcache_lookup(struct fat_fs_device_data *d,
+                  struct fat_entry *dir,
+                  const char *name,
+                  size_t name_len,
+                  struct fat_entry **res);
+
+void fat_destroy_dir_caches(struct fat_fs_device_data *d);
+
+int fat_zcache_init(struct fat_fs_device_data *d);
+void fat_zcache_destroy(struct fat_fs_device_data *d);
+int fat_zcache_get(struct fat_fs_device_data *d, u32 clu, char **data);
+void fat_zcache_put(struct fat_fs_device_data *d, u32 clu);
+
 struct datetime
 fat_datetime_to_regular_datetime(u16 date, u16 time, u8 timetenth);
 
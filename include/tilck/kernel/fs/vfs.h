@@ -22,6 +22,7 @@ struct vfs_dent64 {
    enum vfs_entry_type type;
    u8 name_len;               /* NODE: includes the final '\0' */
    const char *name;
+   offt next_off;             /* offset of the next entry, 0 = ordinal */
 };
 
 typedef int (*get_dents_func_cb) (struct vfs_dent64 *, void *);
@@ -66,6 +67,7 @@ typedef int     (*func_exlock_noblk) (struct fs *, vfs_inode_ptr_t);
 /* file ops */
 typedef ssize_t        (*func_read)         (fs_handle, char *, size_t);
 typedef ssize_t        (*func_write)        (fs_handle, char *, size_t);
+typedef ssize_t        (*func_pread)        (fs_handle, char *, size_t, offt);
 typedef offt           (*func_seek)         (fs_handle, offt, int);
 typedef int            (*func_ioctl)        (fs_handle, ulong, void *);
 
@@ -95,6 +97,12 @@ typedef ssize_t        (*func_writev)       (fs_handle,
                                              int);
 
 typedef int            (*func_fsync)        (fs_handle);
+
+typedef ssize_t        (*func_copy_range)   (fs_handle,
+                                             offt,
+                                             fs_handle,
+                                             offt,
+                                             size_t);
 typedef void           (*func_syncfs)       (struct fs *);
 
 /*
@@ -159,8 +167,22 @@ struct file_ops {
    func_fsync sync;                    /* if NULL -> -EROFS or 0 */
    func_fsync datasync;                /* if NULL -> -EROFS or 0 */
 
+   /*
+    * Scatter/gather I/O: the buffers in the iovecs are ALWAYS in user space and
+    * must be accessed with copy_to_user() and copy_from_user(). When present,
+    * they're used by sys_read() and sys_write() as well, in order to avoid
+    * bouncing the data through the per-task io_copybuf.
+    */
    func_readv readv;                   /* if NULL, emulated in non-atomic way */
    func_writev writev;                 /* if NULL, emulated in non-atomic way */
+   func_pread pread;                   /* if NULL, emulated with seek + read */
+
+   /*
+    * In-kernel copy between two files of the same fs having the same file_ops,
+    * used by vfs_transfer(). It's allowed to copy less than requested and to
+    * return -EXDEV to make the VFS fall back to the generic copy.
+    */
+   func_copy_range copy_range;         /* if NULL, generic copy */
 
    func_handle_fault handle_fault;     /* if NULL -> false     */
 
@@ -216,6 +238,15 @@ ssize_t vfs_read(fs_handle h, void *buf, size_t buf_size);
 ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size);
 ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt);
 ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt);
+ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off);
+ssize_t vfs_preadv(fs_handle h, const struct iovec *iov, int iovcnt, offt off);
+
+ssize_t
+vfs_transfer(fs_handle in,
+             offt *in_off,
+             fs_handle out,
+             offt *out_off,
+             size_t len);
 
 int vfs_exlock_noblock(struct fs *fs, vfs_inode_ptr_t i);
 int vfs_exunlock(struct fs *fs, vfs_inode_ptr_t i);
@@ -290,6 +321,23 @@ fs_handle vfs_create_new_handle(struct fs *fs, const struct file_ops *fops);
 void vfs_syncfs(struct fs *fs);
 void vfs_sync(void);
 
+/* ------------ Dentry cache ------------- */
+
+struct vfs_dcache_stats {
+
+   u32 hits;
+   u32 misses;
+   u32 evictions;
+};
+
+/*
+ * Drops all the dentries cached for `fs`. Must be called by the filesystems
+ * after adding, removing or renaming any directory entry outside of the VFS
+ * path functions (mkdir, unlink, rename etc.), which already take care of that.
+ */
+void vfs_dcache_invalidate(struct fs *fs);
+void vfs_dcache_get_stats(struct vfs_dcache_stats *stats);
+
 /* ------------ Current mount point interface ------------- */
 
 /*
@@ -12,6 +12,7 @@ struct process;
 struct user_mapping;
 struct fs_ops;
 struct locked_file;
+struct epoll_item;
 
 /*
  * Opaque type for file handles.
@@ -82,6 +83,7 @@ struct fs {
    u32 flags;
    void *device_data;
    const struct fs_ops *fsops;
+   u32 dcache_gen;                     /* See vfs_dcache_invalidate() */
 };
 
 
@@ -101,6 +103,7 @@ struct fs {
    u16 fd_flags;                 \
    u16 spec_flags;               \
    struct locked_file *lf;       \
+   struct epoll_item *epitems;   \
    offt pos;                        /* file: offset, dir: opaque entry index */
 
 struct fs_handle_base {
@@ -128,9 +131,17 @@ struct fs_handle_base {
  * VFS_MM_DONT_MMAP flag play a role. At the same way, in other exceptional
  * situations we might not want the FS to register the mapping, but to do it
  * anyway.
+ *
+ * File-systems supporting handle_fault() are not required to map anything
+ * in mmap(): they can map each page on the first access to it, making large
+ * (and sparse) mappings almost free to create. VFS_MM_POPULATE asks them to
+ * map all the pages immediately instead (MAP_POPULATE). Note: a mapping not
+ * registered with the process (e.g. the ELF segments) cannot be faulted-in,
+ * therefore it always needs VFS_MM_POPULATE.
  */
 #define VFS_MM_DONT_MMAP            (1 << 0)
 #define VFS_MM_DONT_REGISTER        (1 << 1)
+#define VFS_MM_POPULATE             (1 << 2)
 
 int vfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags);
 int vfs_munmap(struct user_mapping *um, void *vaddr, size_t len);
@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+void init_futex(void);
+int futex_wake_addr(u32 *uaddr, u32 nr);
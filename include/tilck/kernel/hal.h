@@ -59,6 +59,10 @@ int get_int_num(regs_t *context);
 void on_first_pdir_update(void);
 void hw_read_clock(struct datetime *out);
 u32 hw_timer_setup(u32 hz);
+u32 hw_timer_oneshot_max_ticks(void);
+u32 hw_timer_oneshot(u32 ticks);
+u32 hw_timer_oneshot_cut(void);
+void hw_timer_periodic(void);
 
 bool allocate_fpu_regs(arch_task_members_t *arch_fields);
 void copy_main_tss_on_regs(regs_t *ctx);
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+#include <tilck/common/io_uring.h>
+
+/*
+ * Create a new io_uring with (at least) `entries` SQ entries, as described by
+ * `p`, which gets filled with the actual sizes and the offsets to mmap().
+ * Returns 0 or a negative errno, like io_uring_setup().
+ */
+int create_io_uring_handle(u32 entries,
+                           struct io_uring_params *p,
+                           fs_handle *out);
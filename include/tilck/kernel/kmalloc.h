@@ -3,6 +3,7 @@
 #pragma once
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
 
 #define KMALLOC_METADATA_BLOCK_NODE_SIZE      1
 #define KMALLOC_HEAPS_COUNT                  32
@@ -99,6 +100,74 @@ kmalloc_accelerator_get_elem(struct kmalloc_acc *a);
 void
 kmalloc_destroy_accelerator(struct kmalloc_acc *a);
 
+/*
+ * Object caches
+ * ----------------
+ *
+ * A cache hands out objects of a fixed size, carved from bigger chunks called
+ * slabs, allocated with kmalloc(). Each slab has its own list of free objects
+ * and slabs are kept in per-cache lists (partial, full and empty), making both
+ * the allocation and the free O(1) for the hot kernel objects, while kmalloc()
+ * is called only when a whole new slab is needed.
+ *
+ * The optional constructor is called only once, when a new slab is created, on
+ * each of its objects: objects are expected to be returned to the cache in the
+ * same constructed state.
+ */
+
+typedef void (*kmalloc_cache_ctor)(void *obj);
+
+struct kmalloc_cache {
+
+   const char *name;
+   u32 obj_size;
+   kmalloc_cache_ctor ctor;
+
+   /* Internal fields, initialized on the first allocation */
+   bool initialized;
+   bool dynamic;               /* created by kmalloc_create_cache() */
+   u32 slab_size;
+   u32 objs_per_slab;
+   u32 first_obj_off;
+
+   struct list partial_slabs;
+   struct list full_slabs;
+   struct list empty_slabs;
+   struct list_node node;      /* node in the global list of caches */
+
+   /* Stats */
+   u32 slabs_count;
+   u32 objs_in_use;
+   u32 peak_objs_in_use;
+   u32 allocs_count;
+};
+
+#define KMALLOC_CACHE_INIT(var, cname, size, ctor_func) {              \
+   .name = (cname),                                                     \
+   .obj_size = (size),                                                  \
+   .ctor = (ctor_func),                                                 \
+   .partial_slabs = STATIC_LIST_INIT((var).partial_slabs),              \
+   .full_slabs = STATIC_LIST_INIT((var).full_slabs),                    \
+   .empty_slabs = STATIC_LIST_INIT((var).empty_slabs),                  \
+   .node = STATIC_LIST_NODE_INIT((var).node),                           \
+}
+
+/* Define a statically allocated object cache */
+#define DEFINE_KMALLOC_CACHE(var, cname, size, ctor_func)              \
+   struct kmalloc_cache var = KMALLOC_CACHE_INIT(var, cname, size, ctor_func)
+
+struct kmalloc_cache *
+kmalloc_create_cache(const char *name, u32 obj_size, kmalloc_cache_ctor ctor);
+
+void
+kmalloc_destroy_cache(struct kmalloc_cache *c);
+
+void *
+kmalloc_cache_alloc(struct kmalloc_cache *c);
+
+void
+kmalloc_cache_free(struct kmalloc_cache *c, void *obj);
+
 #ifndef UNIT_TEST_ENVIRONMENT
 
 static inline void *
@@ -132,6 +201,9 @@ kmalloc_get_heap_struct_size(void);
 size_t
 kmalloc_get_max_tot_heap_free(void);
 
+bool
+kmalloc_get_unused_range(int n, ulong *va, ulong *end);
+
 void *
 aligned_kmalloc(size_t size, u32 align);
 
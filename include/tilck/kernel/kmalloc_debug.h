@@ -28,6 +28,18 @@ struct debug_kmalloc_chunks_ctx {
    struct bintree_walk_ctx ctx;
 };
 
+struct debug_kmalloc_cache_info {
+
+   const char *name;
+   size_t obj_size;
+   size_t slab_size;
+   size_t objs_per_slab;
+   size_t slabs_count;
+   size_t objs_in_use;
+   size_t peak_objs_in_use;
+   size_t allocs_count;
+};
+
 struct debug_kmalloc_stats {
 
    struct kmalloc_small_heaps_stats small_heaps;
@@ -44,6 +56,9 @@ debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
 void
 debug_kmalloc_get_stats(struct debug_kmalloc_stats *stats);
 
+bool
+debug_kmalloc_get_cache_info(int n, struct debug_kmalloc_cache_info *i);
+
 void
 debug_kmalloc_chunks_stats_start_read(struct debug_kmalloc_chunks_ctx *ctx);
 
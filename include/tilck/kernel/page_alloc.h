@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Page-frame allocator
+ * ----------------------
+ *
+ * Physical page frames for page tables and user memory are handed out by a
+ * dedicated buddy allocator with per-order free lists, instead of going
+ * through the kmalloc heaps and their metadata trees. Its memory comes from
+ * the parts of the system memory map that kmalloc could not turn into heaps
+ * and, on demand, from kmalloc itself in batches of PF_KMALLOC_ORDER-sized
+ * blocks which are given back once completely free again.
+ *
+ * All the functions deal with kernel virtual addresses in the linear mapping,
+ * exactly like kmalloc() does, and can be used only after init_pf_alloc().
+ */
+
+#define PF_MAX_ORDER                          10    /* 4 MB blocks */
+#define PF_ORDERS                             (PF_MAX_ORDER + 1)
+#define PF_KMALLOC_ORDER                       4    /* 64 KB blocks */
+
+struct pf_alloc_stats {
+
+   size_t managed_pages;        /* pages owned by the allocator */
+   size_t kmalloc_pages;        /* pages borrowed from kmalloc */
+   size_t free_pages;
+   size_t free_blocks[PF_ORDERS];
+};
+
+void init_pf_alloc(void);
+
+void *pf_alloc(u32 order);
+void pf_free(void *va, u32 order);
+size_t pf_alloc_batch(void **vec, size_t count);
+
+void pf_get_stats(struct pf_alloc_stats *stats);
+
+static ALWAYS_INLINE void *pf_alloc_page(void)
+{
+   return pf_alloc(0);
+}
+
+static ALWAYS_INLINE void pf_free_page(void *va)
+{
+   pf_free(va, 0);
+}
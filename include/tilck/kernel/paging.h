@@ -8,6 +8,9 @@
 
 #ifdef __i386__
    #define PAGE_DIR_SIZE (PAGE_SIZE)
+   #define BIG_PAGE_SIZE (4 * MB)
+#elif defined(__x86_64__)
+   #define BIG_PAGE_SIZE (2 * MB)
 #endif
 
 #define OFFSET_IN_PAGE_MASK                        (PAGE_SIZE - 1)
@@ -24,6 +27,7 @@
 #define PAGING_FL_SHARED                                  (1 << 3)
 #define PAGING_FL_DO_ALLOC                                (1 << 4)
 #define PAGING_FL_ZERO_PG                                 (1 << 5)
+#define PAGING_FL_COW                                     (1 << 6)
 
 /* Combo values */
 #define PAGING_FL_RWUS               (PAGING_FL_RW | PAGING_FL_US)
@@ -40,6 +44,7 @@ extern char zero_page[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 void early_init_paging();
 bool handle_potential_cow(void *r);
+bool handle_user_copy_fault(void *r);
 
 /*
  * Map a pageframe at `paddr` at the virtual address `vaddr` in the page
@@ -93,6 +98,7 @@ void invalidate_page(ulong vaddr);
 void set_page_rw(pdir_t *pdir, void *vaddr, bool rw);
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
+bool are_pageframes_shared(pdir_t *pdir, void *vaddr, size_t len);
 
 static ALWAYS_INLINE pdir_t *get_kernel_pdir(void)
 {
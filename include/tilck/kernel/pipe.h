@@ -9,3 +9,9 @@ struct pipe *create_pipe(void);
 void destroy_pipe(struct pipe *p);
 fs_handle pipe_create_read_handle(struct pipe *p);
 fs_handle pipe_create_write_handle(struct pipe *p);
+
+/* Returns NULL when `h` is not a pipe handle */
+struct pipe *get_pipe_of_handle(fs_handle h);
+
+/* Like read(), but leaves the data in the pipe */
+ssize_t pipe_peek(fs_handle h, char *buf, size_t size);
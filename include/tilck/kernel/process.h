@@ -8,6 +8,7 @@
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/timer.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/bintree.h>
 #include <tilck/kernel/kmalloc.h>
@@ -28,9 +29,10 @@ struct kernel_alloc {
 
 struct mappings_info {
 
-   struct kmalloc_heap *mmap_heap;
-   size_t mmap_heap_size;
-   struct list mappings;
+   struct list mappings;                   /* all the user mappings */
+   struct user_mapping *mappings_tree;     /* same mappings, by vaddr */
+   struct user_vaddr_gap *gaps_by_addr;    /* free ranges, by vaddr */
+   struct user_vaddr_gap *gaps_by_size;    /* free ranges, by (len, vaddr) */
 };
 
 struct process {
@@ -47,7 +49,13 @@ struct process {
    void *initial_brk;
    struct mappings_info *mi;
 
+   ulong minor_faults;            /* page faults resolved without any I/O */
+   ulong resident_pages;          /* anonymous pages backed by actual memory */
+   ulong peak_resident_pages;
+
    struct list children;
+   struct list threads;          /* all the user tasks sharing this process */
+   struct sched_ticks exited_threads_ticks;  /* ticks of the exited threads */
 
    void *proc_tty;
    bool did_call_execve;
@@ -55,8 +63,10 @@ struct process {
    bool vforked;                 /* after vfork(), before execve() */
    bool inherited_mmap_heap;
    bool did_set_tty_medium_raw;
+   bool group_exiting;           /* exit_group() or a fatal signal, see exit.c */
 
-   int *set_child_tid;                    /* NOTE: this is an user pointer */
+   s32 group_wstatus;                     /* wstatus for the group exit */
+   struct ktimer alarm_timer;             /* alarm() and ITIMER_REAL */
 
    struct kmutex fslock;                  /* protects `handles` and `cwd` */
    mode_t umask;
@@ -111,13 +121,38 @@ get_process_task(struct process *pi)
    return ((struct task *)pi) - 1;
 }
 
+static ALWAYS_INLINE void
+process_inc_resident_pages(struct process *pi, size_t n)
+{
+   pi->resident_pages += n;
+   pi->peak_resident_pages = MAX(pi->peak_resident_pages, pi->resident_pages);
+}
+
+static ALWAYS_INLINE void
+process_dec_resident_pages(struct process *pi, size_t n)
+{
+   /* A vfork-ed child might unmap memory accounted only by its parent */
+   pi->resident_pages -= MIN(n, pi->resident_pages);
+}
+
 static ALWAYS_INLINE bool
 task_is_parent(struct task *parent, struct task *child)
 {
    return child->pi->parent_pid == parent->pi->pid;
 }
 
+static ALWAYS_INLINE bool
+process_is_multithreaded(struct process *pi)
+{
+   return pi->threads.first != pi->threads.last;
+}
+
 int do_fork(bool vfork);
+int do_clone(ulong flags,
+             void *newsp,
+             int *parent_tid,
+             void *tls,
+             int *child_tid);
 void handle_vforked_child_move_on(struct process *pi);
 int first_execve(const char *abs_path, const char *const *argv);
 
@@ -139,6 +174,7 @@ allocate_new_thread(struct process *pi, int tid, bool alloc_bufs);
 void free_task(struct task *ti);
 void free_mem_for_zombie_task(struct task *ti);
 bool arch_specific_new_task_setup(struct task *ti, struct task *parent);
+int arch_specific_clone_setup(struct task *ti, void *user_stack, void *u_tls);
 void arch_specific_free_task(struct task *ti);
 void arch_specific_new_proc_setup(struct process *pi, struct process *parent);
 void arch_specific_free_proc(struct process *pi);
@@ -148,6 +184,8 @@ void init_process_lists(struct process *pi);
 void process_set_cwd2_nolock(struct vfs_path *tp);
 void process_set_cwd2_nolock_raw(struct process *pi, struct vfs_path *tp);
 void terminate_process(int exit_code, int term_sig);
+void terminate_thread(int exit_code);
+int terminate_other_threads(void);
 void close_cloexec_handles(struct process *pi);
 void setup_sig_handler(struct task *ti,
                        enum sig_state sig_state,
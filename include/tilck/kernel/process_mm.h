@@ -5,11 +5,13 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/list.h>
+#include <tilck/kernel/bintree.h>
 
 struct user_mapping {
 
    struct list_node pi_node;
    struct list_node inode_node;
+   struct bintree_node tree_node;    /* node in pi->mi->mappings_tree */
    struct process *pi;
 
    fs_handle h;
@@ -22,11 +24,31 @@ struct user_mapping {
    };
 
    int prot;
+   int flags;                        /* MAP_SHARED/PRIVATE [| MAP_HUGETLB] */
 
 };
 
+/*
+ * A free range in the [USER_MMAP_BEGIN, USER_MMAP_END) part of the user
+ * address space. Each gap belongs to two trees: the one ordered by address,
+ * used to merge adjacent gaps on munmap(), and the one ordered by size, used
+ * to find the smallest gap big enough for a new mapping in O(log n).
+ */
+struct user_vaddr_gap {
+
+   struct bintree_node addr_node;
+   struct bintree_node size_node;
+   ulong vaddr;
+   size_t len;
+};
+
 struct user_mapping *
-process_add_user_mapping(fs_handle h, void *v, size_t ln, size_t off, int prot);
+process_add_user_mapping(fs_handle h,
+                         void *v,
+                         size_t ln,
+                         size_t off,
+                         int prot,
+                         int flags);
 void process_remove_user_mapping(struct user_mapping *um);
 void full_remove_user_mapping(struct process *pi, struct user_mapping *um);
 void remove_all_mappings_of_handle(struct process *pi, fs_handle h);
@@ -35,6 +57,8 @@ struct user_mapping *process_get_user_mapping(void *vaddr);
 void remove_all_file_mappings(struct process *pi);
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi);
+struct mappings_info *alloc_mappings_info(void);
+void free_mappings_info(struct mappings_info *mi);
 
 
 /* Internal functions */
@@ -42,7 +66,13 @@ bool user_valloc_and_map(ulong user_vaddr, size_t page_count);
 void user_vfree_and_unmap(ulong user_vaddr, size_t page_count);
 void user_unmap_zero_page(ulong user_vaddr, size_t page_count);
 bool user_map_zero_page(ulong user_vaddr, size_t page_count);
+bool user_map_anon_mem(ulong user_vaddr, size_t page_count);
+void user_unmap_anon_mem(ulong user_vaddr, size_t page_count);
 int generic_fs_munmap(struct user_mapping *um, void *vaddrp, size_t len);
+ulong user_vaddr_alloc(struct mappings_info *mi, size_t len);
+ulong
+user_vaddr_alloc_aligned(struct mappings_info *mi, size_t len, size_t align);
+void user_vaddr_free(struct mappings_info *mi, ulong vaddr, size_t len);
 
 /* Special one-time funcs */
 void set_kernel_process_pdir(pdir_t *pdir);
@@ -41,6 +41,11 @@ bool ringbuf_unwrite_elem(struct ringbuf *rb, void *elem_ptr /* out */);
 size_t ringbuf_write_bytes(struct ringbuf *rb, u8 *buf, size_t len);
 size_t ringbuf_read_bytes(struct ringbuf *rb, u8 *buf, size_t len);
 
+size_t ringbuf_get_read_chunk(struct ringbuf *rb, u8 **ptr);
+size_t ringbuf_get_write_chunk(struct ringbuf *rb, u8 **ptr);
+void ringbuf_consume_bytes(struct ringbuf *rb, size_t len);
+void ringbuf_commit_bytes(struct ringbuf *rb, size_t len);
+
 
 inline bool ringbuf_write_elem1(struct ringbuf *rb, u8 val)
 {
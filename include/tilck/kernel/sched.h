@@ -15,6 +15,15 @@
 
 #define TIME_SLICE_TICKS (TIMER_HZ / 20)
 
+/*
+ * Nice values, with the same range and meaning as in Linux. Each nice value
+ * maps to one priority level of the run-queue: level 0 (nice -20) is the
+ * highest priority, level SCHED_PRIO_LEVELS-1 (nice 19) is the lowest.
+ */
+#define MIN_NICE                                  -20
+#define MAX_NICE                                   19
+#define SCHED_PRIO_LEVELS    (MAX_NICE - MIN_NICE + 1)
+
 enum task_state {
    TASK_STATE_INVALID   = 0,
    TASK_STATE_RUNNABLE  = 1,
@@ -45,6 +54,8 @@ struct sched_ticks {
 
 STATIC_ASSERT(sizeof(enum sig_state) == 1);
 
+struct runqueue;
+
 struct task {
 
    union {
@@ -81,11 +92,14 @@ struct task {
    struct list_node zombie_node;
    struct list_node wakeup_timer_node;
    struct list_node siblings_node;    /* nodes in parent's pi's children list */
+   struct list_node threads_node;     /* node in pi's threads list */
 
    struct list tasks_waiting_list;    /* tasks waiting this task to end */
 
    s32 wstatus;                       /* waitpid's wstatus  */
    struct sched_ticks ticks;          /* scheduler counters */
+   int nice;                          /* nice value, MIN_NICE..MAX_NICE */
+   struct runqueue *rq;               /* run-queue containing the task */
 
    void *kernel_stack;
    void *args_copybuf;
@@ -96,7 +110,7 @@ struct task {
    };
 
    struct wait_obj wobj;
-   u32 ticks_before_wake_up;
+   u32 wakeup_timer_tick;             /* expiry tick of the wakeup timer */
 
    /* List of callbacks to call on exit */
    struct list on_exit;
@@ -122,6 +136,9 @@ struct task {
    /* Kernel thread name, NULL for user tasks */
    const char *kthread_name;
 
+   /* Reset and futex-woken on exit (CLONE_CHILD_CLEARTID). User pointer. */
+   int *clear_child_tid;
+
    /* Pending signals bitset */
    ulong sa_pending[K_SIGACTION_MASK_WORDS];
 
@@ -138,7 +155,6 @@ struct task {
 extern struct task *kernel_process;
 extern struct process *kernel_process_pi;
 
-extern struct list runnable_tasks_list;
 extern struct list sleeping_tasks_list;
 extern struct list zombie_tasks_list;
 extern const char *const task_state_str[5];
@@ -156,6 +172,8 @@ struct task *get_task(int tid);
 struct process *get_process(int pid);
 void task_change_state(struct task *ti, enum task_state new_state);
 void task_change_state_idempotent(struct task *ti, enum task_state new_state);
+void task_set_stopped(struct task *ti, bool stopped);
+u32 sched_get_timeslice(struct task *ti);
 
 static ALWAYS_INLINE void sched_set_need_resched(void)
 {
@@ -24,6 +24,22 @@ bool process_signals(void *curr, enum sig_state new_sig_state, void *regs);
 void drop_all_pending_signals(void *curr);
 void reset_all_custom_signal_handlers(void *curr);
 
+/*
+ * Dequeue (or just get, when `peek` is true) the first pending signal of the
+ * current task in `mask`, a K_SIGACTION_MASK_WORDS-long bitmask. Used by the
+ * signalfds. Returns -1 if there's no such signal.
+ */
+int dequeue_pending_sig_in(const ulong *mask, bool peek);
+
+/*
+ * Temporarily replace the signal mask of the current task, like sigsuspend()
+ * does, for the p-variants of the waiting syscalls (e.g. epoll_pwait). In case
+ * the wait got interrupted, the old mask is restored by sys_rt_sigreturn()
+ * after running the signal handler, otherwise it's restored immediately.
+ */
+int set_temp_sigmask(const sigset_t *u_mask, size_t sigsetsize);
+void restore_temp_sigmask(bool interrupted);
+
 static inline int send_signal(int tid, int signum, bool whole_process)
 {
    return send_signal2(tid, tid, signum, whole_process);
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Returns NULL in case of out-of-memory. `mask` is K_SIGACTION_MASK_WORDS
+ * long and `flags` are signalfd4()'s flags.
+ */
+fs_handle create_signalfd_handle(const ulong *mask, int flags);
+
+/* Replace the mask of a signalfd. Returns -EINVAL if `h` is not a signalfd */
+int signalfd_set_mask(fs_handle h, const ulong *mask);
+
+/* Called by signal.c, with preemption disabled, when a signal gets pending */
+void signalfd_notify(void);
@@ -15,6 +15,7 @@ enum wo_type {
    WOBJ_KCOND,
    WOBJ_TASK,
    WOBJ_SEM,
+   WOBJ_FUTEX,      /* ptr is a struct futex_waiter, see kernel/futex.c */
 
    /* Special "meta-object" types */
 
@@ -190,13 +191,27 @@ bool kmutex_is_curr_task_holding_lock(struct kmutex *m);
 struct kcond {
 
    struct list wait_list;
+   struct list watchers;         /* see struct kcond_watcher */
 };
 
 #define STATIC_KCOND_INIT(s)                     \
    {                                             \
       .wait_list = STATIC_LIST_INIT(s.wait_list),\
+      .watchers = STATIC_LIST_INIT(s.watchers),  \
    }
 
+/*
+ * A watcher gets its callback called, with preemption disabled, every time
+ * its kcond is signaled, no matter if there are waiting tasks or not. It's
+ * meant for objects like epoll, which need to know about the events without
+ * having a task sleeping on each single kcond.
+ */
+struct kcond_watcher {
+
+   struct list_node node;
+   void (*cb)(struct kcond_watcher *w);
+};
+
 #define KCOND_WAIT_FOREVER 0
 
 void kcond_init(struct kcond *c);
@@ -205,3 +220,5 @@ void kcond_signal_one(struct kcond *c);
 void kcond_signal_all(struct kcond *c);
 bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks);
 bool kcond_is_anyone_waiting(struct kcond *c);
+void kcond_add_watcher(struct kcond *c, struct kcond_watcher *w);
+void kcond_remove_watcher(struct kcond_watcher *w);
@@ -17,6 +17,10 @@
 #include <sys/select.h> // system header
 #include <time.h>       // system header
 #include <poll.h>       // system header
+#include <sys/epoll.h>  // system header
+#include <sys/eventfd.h>   // system header
+#include <sys/timerfd.h>   // system header
+#include <sys/signalfd.h>  // system header
 #include <utime.h>      // system header
 
 #ifndef __GLIBC__
@@ -99,6 +103,42 @@ struct k_timespec64 {
    long tv_nsec;
 };
 
+struct k_itimerspec32 {
+
+   struct k_timespec32 it_interval;
+   struct k_timespec32 it_value;
+};
+
+/* Linux's struct __kernel_timespec: tv_nsec is 64-bit on 32-bit archs too */
+struct k_kernel_timespec {
+
+   s64 tv_sec;
+   s64 tv_nsec;
+};
+
+struct k_itimerspec64 {
+
+   struct k_kernel_timespec it_interval;
+   struct k_kernel_timespec it_value;
+};
+
+/* From the man page of clone3(): all the pointers are stored as u64 */
+struct k_clone_args {
+   u64 flags;        /* Flags bit mask */
+   u64 pidfd;        /* Where to store PID file descriptor */
+   u64 child_tid;    /* Where to store child TID, in child's memory */
+   u64 parent_tid;   /* Where to store child TID, in parent's memory */
+   u64 exit_signal;  /* Signal to deliver to parent on child termination */
+   u64 stack;        /* Pointer to lowest byte of stack */
+   u64 stack_size;   /* Size of stack */
+   u64 tls;          /* Location of new TLS */
+   u64 set_tid;      /* Pointer to a pid_t array (since Linux 5.5) */
+   u64 set_tid_size; /* Number of elements in set_tid (since Linux 5.5) */
+   u64 cgroup;       /* File descriptor for target cgroup (since Linux 5.7) */
+};
+
+#define K_CLONE_ARGS_SIZE_VER0                                            64
+
 #ifndef O_DIRECTORY
    #define O_DIRECTORY __O_DIRECTORY
 #endif
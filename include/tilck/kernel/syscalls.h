@@ -74,15 +74,14 @@ int sys_getuid16(void);
 
 CREATE_STUB_SYSCALL_IMPL(sys_stime)
 CREATE_STUB_SYSCALL_IMPL(sys_ptrace)
-CREATE_STUB_SYSCALL_IMPL(sys_alarm)
 CREATE_STUB_SYSCALL_IMPL(sys_oldfstat)
 
+int sys_alarm(unsigned int seconds);
+
 int sys_pause(void);
 int sys_utime(const char *u_path, const struct utimbuf *u_times);
 int sys_access(const char *u_path, mode_t mode);
-
-CREATE_STUB_SYSCALL_IMPL(sys_nice)
-
+int sys_nice(int inc);
 int sys_sync(void);
 int sys_kill(int pid, int sig);
 int sys_rename(const char *u_oldpath, const char *u_newpath);
@@ -134,7 +133,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_sigpending)
 CREATE_STUB_SYSCALL_IMPL(sys_sethostname)
 CREATE_STUB_SYSCALL_IMPL(sys_setrlimit)
 CREATE_STUB_SYSCALL_IMPL(sys_old_getrlimit)
-CREATE_STUB_SYSCALL_IMPL(sys_getrusage)
+int sys_getrusage(int who, struct k_rusage *u_usage);
 
 int sys_gettimeofday(struct timeval *tv, struct timezone *tz);
 
@@ -165,8 +164,10 @@ CREATE_STUB_SYSCALL_IMPL(sys_ftruncate)
 int sys_fchmod(int fd, mode_t mode);
 
 CREATE_STUB_SYSCALL_IMPL(sys_fchown16)
-CREATE_STUB_SYSCALL_IMPL(sys_getpriority)
-CREATE_STUB_SYSCALL_IMPL(sys_setpriority)
+
+int sys_getpriority(int which, int who);
+int sys_setpriority(int which, int who, int prio);
+
 CREATE_STUB_SYSCALL_IMPL(sys_statfs)
 CREATE_STUB_SYSCALL_IMPL(sys_fstatfs)
 CREATE_STUB_SYSCALL_IMPL(sys_ioperm)
@@ -174,8 +175,13 @@ CREATE_STUB_SYSCALL_IMPL(sys_ioperm)
 int sys_socketcall(int call, ulong *args);
 
 CREATE_STUB_SYSCALL_IMPL(sys_syslog)
-CREATE_STUB_SYSCALL_IMPL(sys_setitimer)
-CREATE_STUB_SYSCALL_IMPL(sys_getitimer)
+
+int sys_setitimer(int which,
+                  const struct itimerval *u_new,
+                  struct itimerval *u_old);
+
+int sys_getitimer(int which, struct itimerval *u_val);
+
 CREATE_STUB_SYSCALL_IMPL(sys_newstat)
 CREATE_STUB_SYSCALL_IMPL(sys_newlstat)
 CREATE_STUB_SYSCALL_IMPL(sys_newfstat)
@@ -193,7 +199,12 @@ CREATE_STUB_SYSCALL_IMPL(sys_ipc)
 int sys_fsync(int fd);
 CREATE_STUB_SYSCALL_IMPL(sys_sigreturn);
 
-CREATE_STUB_SYSCALL_IMPL(sys_clone)
+int sys_clone(ulong flags,
+              void *newsp,
+              int *parent_tidptr,
+              void *tls,
+              int *child_tidptr);
+
 CREATE_STUB_SYSCALL_IMPL(sys_setdomainname)
 
 int sys_newuname(struct utsname *buf);
@@ -283,7 +294,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_rt_sigqueueinfo)
 
 int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize);
 
-CREATE_STUB_SYSCALL_IMPL(sys_pread64)
+int sys_pread64(int fd, void *u_buf, size_t count, s64 off);
 CREATE_STUB_SYSCALL_IMPL(sys_pwrite64)
 CREATE_STUB_SYSCALL_IMPL(sys_chown16)
 
@@ -292,7 +303,8 @@ int sys_getcwd(char *buf, size_t size);
 CREATE_STUB_SYSCALL_IMPL(sys_capget)
 CREATE_STUB_SYSCALL_IMPL(sys_capset)
 CREATE_STUB_SYSCALL_IMPL(sys_sigaltstack)
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile)
+
+int sys_sendfile(int out_fd, int in_fd, long *u_offset, size_t count);
 
 int sys_vfork(void);
 
@@ -355,8 +367,12 @@ CREATE_STUB_SYSCALL_IMPL(sys_fremovexattr)
 
 int sys_tkill(int tid, int sig);
 
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile64)
-CREATE_STUB_SYSCALL_IMPL(sys_futex_time32)
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_offset, size_t count);
+
+int sys_futex_time32(u32 *uaddr, int futex_op, u32 val,
+                     const struct k_timespec32 *u_timeout,
+                     u32 *uaddr2, u32 val3);
+
 CREATE_STUB_SYSCALL_IMPL(sys_sched_setaffinity)
 CREATE_STUB_SYSCALL_IMPL(sys_sched_getaffinity)
 
@@ -373,12 +389,14 @@ CREATE_STUB_SYSCALL_IMPL(sys_fadvise64)
 NORETURN int sys_exit_group(int status);
 
 CREATE_STUB_SYSCALL_IMPL(sys_lookup_dcookie)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_ctl)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_wait)
+
+int sys_epoll_create(int size);
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *u_event);
+int sys_epoll_wait(int epfd, struct epoll_event *u_events,
+                   int maxevents, int timeout);
+
 CREATE_STUB_SYSCALL_IMPL(sys_remap_file_pages)
 
-// TODO: complete the implementation when thread creation is implemented.
 int sys_set_tid_address(int *tidptr);
 
 CREATE_STUB_SYSCALL_IMPL(sys_timer_create)
@@ -440,32 +458,48 @@ CREATE_STUB_SYSCALL_IMPL(sys_ppoll)
 CREATE_STUB_SYSCALL_IMPL(sys_unshare)
 CREATE_STUB_SYSCALL_IMPL(sys_set_robust_list)
 CREATE_STUB_SYSCALL_IMPL(sys_get_robust_list)
-CREATE_STUB_SYSCALL_IMPL(sys_splice)
+
+int sys_splice(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+               size_t len, u32 flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_sync_file_range)
-CREATE_STUB_SYSCALL_IMPL(sys_tee)
-CREATE_STUB_SYSCALL_IMPL(sys_vmsplice)
+
+int sys_tee(int fd_in, int fd_out, size_t len, u32 flags);
+
+int sys_vmsplice(int fd, const struct iovec *u_iov, ulong nr_segs, u32 flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_move_pages)
 CREATE_STUB_SYSCALL_IMPL(sys_getcpu)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_pwait)
+
+int sys_epoll_pwait(int epfd, struct epoll_event *u_events, int maxevents,
+                    int timeout, const sigset_t *u_sigmask, size_t sigsetsize);
 
 int sys_utimensat_time32(int dirfd, const char *u_path,
                          const struct k_timespec32 times[2], int flags);
 
-CREATE_STUB_SYSCALL_IMPL(sys_signalfd)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_create)
-CREATE_STUB_SYSCALL_IMPL(sys_eventfd)
+int sys_signalfd(int fd, const sigset_t *u_mask, size_t sizemask);
+int sys_timerfd_create(int clockid, int flags);
+int sys_eventfd(unsigned int initval);
+
 CREATE_STUB_SYSCALL_IMPL(sys_fallocate)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_settime32)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_gettime32)
-CREATE_STUB_SYSCALL_IMPL(sys_signalfd4)
-CREATE_STUB_SYSCALL_IMPL(sys_eventfd2)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create1)
+
+int sys_timerfd_settime32(int fd, int flags,
+                          const struct k_itimerspec32 *u_new,
+                          struct k_itimerspec32 *u_old);
+
+int sys_timerfd_gettime32(int fd, struct k_itimerspec32 *u_curr);
+
+int sys_signalfd4(int fd, const sigset_t *u_mask, size_t sizemask, int flags);
+int sys_eventfd2(unsigned int initval, int flags);
+
+int sys_epoll_create1(int flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_dup3)
 
 int sys_pipe2(int u_pipefd[2], int flags);
 
 CREATE_STUB_SYSCALL_IMPL(sys_inotify_init1)
-CREATE_STUB_SYSCALL_IMPL(sys_preadv)
+int sys_preadv(int fd, const struct iovec *u_iov, int u_iovcnt, s64 off);
 CREATE_STUB_SYSCALL_IMPL(sys_pwritev)
 CREATE_STUB_SYSCALL_IMPL(sys_rt_tgsigqueueinfo)
 CREATE_STUB_SYSCALL_IMPL(sys_perf_event_open)
@@ -512,7 +546,10 @@ CREATE_STUB_SYSCALL_IMPL(sys_shutdown)
 CREATE_STUB_SYSCALL_IMPL(sys_userfaultfd)
 CREATE_STUB_SYSCALL_IMPL(sys_membarrier)
 CREATE_STUB_SYSCALL_IMPL(sys_mlock2)
-CREATE_STUB_SYSCALL_IMPL(sys_copy_file_range)
+
+int sys_copy_file_range(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                        size_t len, u32 flags);
+
 CREATE_STUB_SYSCALL_IMPL(sys_preadv2)
 CREATE_STUB_SYSCALL_IMPL(sys_pwritev2)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_mprotect)
@@ -544,8 +581,13 @@ int sys_clock_getres(clockid_t clk_id, struct k_timespec64 *user_res);
 CREATE_STUB_SYSCALL_IMPL(sys_clock_nanosleep)
 CREATE_STUB_SYSCALL_IMPL(sys_timer_gettime)
 CREATE_STUB_SYSCALL_IMPL(sys_timer_settime)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_gettime)
-CREATE_STUB_SYSCALL_IMPL(sys_timerfd_settime)
+
+int sys_timerfd_gettime(int fd, struct k_itimerspec64 *u_curr);
+
+int sys_timerfd_settime(int fd, int flags,
+                        const struct k_itimerspec64 *u_new,
+                        struct k_itimerspec64 *u_old);
+
 CREATE_STUB_SYSCALL_IMPL(sys_utimensat)
 CREATE_STUB_SYSCALL_IMPL(sys_pselect6_time32)
 CREATE_STUB_SYSCALL_IMPL(sys_ppoll_time32)
@@ -555,12 +597,22 @@ CREATE_STUB_SYSCALL_IMPL(sys_mq_timedsend)
 CREATE_STUB_SYSCALL_IMPL(sys_mq_timedreceive)
 CREATE_STUB_SYSCALL_IMPL(sys_semtimedop)
 CREATE_STUB_SYSCALL_IMPL(sys_rt_sigtimedwait)
-CREATE_STUB_SYSCALL_IMPL(sys_futex)
+
+int sys_futex(u32 *uaddr, int futex_op, u32 val,
+              const struct k_timespec64 *u_timeout,
+              u32 *uaddr2, u32 val3);
+
 CREATE_STUB_SYSCALL_IMPL(sys_sched_rr_get_interval)
 CREATE_STUB_SYSCALL_IMPL(sys_pidfd_send_signal)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_setup)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_enter)
-CREATE_STUB_SYSCALL_IMPL(sys_io_uring_register)
+
+struct io_uring_params;
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params);
+
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags,
+                       const void *u_sig, size_t sigsz);
+
+int sys_io_uring_register(int fd, u32 opcode, void *u_arg, u32 nr_args);
+
 CREATE_STUB_SYSCALL_IMPL(sys_open_tree)
 CREATE_STUB_SYSCALL_IMPL(sys_move_mount)
 CREATE_STUB_SYSCALL_IMPL(sys_fsopen)
@@ -568,6 +620,6 @@ CREATE_STUB_SYSCALL_IMPL(sys_fsconfig)
 CREATE_STUB_SYSCALL_IMPL(sys_fsmount)
 CREATE_STUB_SYSCALL_IMPL(sys_fspick)
 CREATE_STUB_SYSCALL_IMPL(sys_pidfd_open)
-CREATE_STUB_SYSCALL_IMPL(sys_clone3)
+int sys_clone3(struct k_clone_args *u_args, size_t size);
 
 int sys_tilck_cmd(int cmd_n, ulong a1, ulong a2, ulong a3, ulong a4);
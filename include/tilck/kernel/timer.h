@@ -3,6 +3,7 @@
 #pragma once
 #include <tilck_gen_headers/config_sched.h>
 #include <tilck/common/basic_defs.h>
+#include <tilck/kernel/list.h>
 
 void kernel_sleep(u64 ticks);  /* sleep for `ticks` timer ticks (jiffies) */
 void kernel_sleep_ms(u64 ms);  /* sleep for `ms` milliseconds */
@@ -16,3 +17,42 @@ ms_to_ticks(u64 ms)
 
 u64 get_ticks(void);
 void init_timer(void);
+
+/*
+ * Kernel timers with a callback. The callbacks run in the `ktimers` kthread,
+ * with preemption enabled and the ktimers lock held: they can block on other
+ * locks and signal kconds, but must NOT call the ktimer_* functions.
+ */
+struct ktimer {
+
+   struct list_node node;     /* in the list of armed timers, by expiry tick */
+   u64 expire;                /* absolute expiry tick, see get_ticks() */
+   u64 interval;              /* re-arm period in ticks, 0 for one-shot ones */
+   void (*cb)(struct ktimer *t);
+};
+
+void ktimer_init(struct ktimer *t, void (*cb)(struct ktimer *));
+
+/*
+ * Arm the timer to expire in `ticks` ticks and then every `interval` ticks,
+ * or disarm it, if `ticks` is 0. Returns the ticks remaining before the old
+ * expiry, 0 if the timer was not armed. After disarming a timer, its callback
+ * is guaranteed to not be running.
+ */
+u64 ktimer_set(struct ktimer *t, u64 ticks, u64 interval);
+
+/* Get the ticks remaining before the next expiry (0: not armed) */
+u64 ktimer_get(struct ktimer *t, u64 *interval);
+
+extern u32 __oneshot_ticks;
+extern u64 __skipped_ticks;
+
+void timer_idle_enter(void);
+void timer_oneshot_catch_up(void);
+
+/* Called on every IRQ, with interrupts disabled, before running any handler */
+static ALWAYS_INLINE void timer_irq_enter(void)
+{
+   if (KRN_TICKLESS_IDLE && UNLIKELY(__oneshot_ticks))
+      timer_oneshot_catch_up();
+}
@@ -0,0 +1,7 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+/* Returns NULL in case of out-of-memory. `flags` are timerfd_create()'s flags */
+fs_handle create_timerfd_handle(int clockid, int flags);
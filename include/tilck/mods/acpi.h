@@ -35,6 +35,18 @@ void acpi_set_root_pointer(ulong);
 
 #endif
 
+#define ACPI_MAX_CPUS                      32
+
+struct acpi_madt_info {
+
+   ulong lapic_paddr;         /* Physical address of the local APICs */
+   ulong ioapic_paddr;        /* Physical address of the first I/O APIC */
+   u32 cpu_count;             /* Number of usable CPUs */
+   u32 ioapic_count;          /* Number of I/O APICs */
+   bool has_8259;             /* The dual 8259 PICs are present as well */
+   u8 lapic_ids[ACPI_MAX_CPUS];  /* Local APIC IDs of the usable CPUs */
+};
+
 enum tristate acpi_is_8042_present(void);
 enum tristate acpi_is_vga_text_mode_avail(void);
 
@@ -100,5 +112,8 @@ void acpi_reboot(void);
 /* Power-off the machine (transition to state ACPI S5) */
 void acpi_poweroff(void);
 
+/* Get the CPUs and the interrupt controllers from MADT. NULL if not found */
+const struct acpi_madt_info *acpi_get_madt_info(void);
+
 /* Get the average charge per mille of all batteries */
 int acpi_get_all_batteries_charge_per_mille(ulong *ret);
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/arch/generic_x86/cpu_features.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/arch/generic_x86/apic.h>
+#include <tilck/mods/acpi.h>
+
+#define APIC_BASE_MSR_ENABLE         (1u << 11)
+
+/* Local APIC registers (offsets in its MMIO page) */
+#define LAPIC_ID                        0x020
+#define LAPIC_VER                       0x030
+#define LAPIC_TPR                       0x080
+#define LAPIC_SVR                       0x0f0
+#define LAPIC_ESR                       0x280
+#define LAPIC_LVT_TIMER                 0x320
+#define LAPIC_LVT_THERMAL               0x330
+#define LAPIC_LVT_PERF                  0x340
+#define LAPIC_LVT_LINT0                 0x350
+#define LAPIC_LVT_LINT1                 0x360
+#define LAPIC_LVT_ERROR                 0x370
+
+#define LAPIC_SVR_ENABLE             (1u << 8)
+#define LAPIC_LVT_MASKED             (1u << 16)
+#define LAPIC_DM_NMI                 (4u << 8)
+#define LAPIC_DM_EXTINT              (7u << 8)
+
+/* I/O APIC registers: selected through IOREGSEL, accessed through IOWIN */
+#define IOAPIC_IOREGSEL                 0x00
+#define IOAPIC_IOWIN                    0x10
+
+#define IOAPIC_REG_ID                   0x00
+#define IOAPIC_REG_VER                  0x01
+#define IOAPIC_REG_REDTBL(n)            (0x10 + 2 * (n))
+
+#define IOAPIC_REDIR_MASKED          (1u << 16)
+
+static volatile u32 *lapic;
+static volatile u32 *ioapic;
+
+static void *apic_map_regs(ulong paddr)
+{
+   void *va;
+
+   if (!(va = hi_vmem_reserve(PAGE_SIZE)))
+      return NULL;
+
+   if (map_kernel_pages(va, paddr & PAGE_MASK, 1, PAGING_FL_RW) != 1) {
+      hi_vmem_release(va, PAGE_SIZE);
+      return NULL;
+   }
+
+   return (char *)va + (paddr & OFFSET_IN_PAGE_MASK);
+}
+
+static ALWAYS_INLINE u32 lapic_read(u32 reg)
+{
+   return lapic[reg / sizeof(u32)];
+}
+
+static ALWAYS_INLINE void lapic_write(u32 reg, u32 val)
+{
+   lapic[reg / sizeof(u32)] = val;
+}
+
+static u32 ioapic_read(u32 reg)
+{
+   ioapic[IOAPIC_IOREGSEL / sizeof(u32)] = reg;
+   return ioapic[IOAPIC_IOWIN / sizeof(u32)];
+}
+
+static void ioapic_write(u32 reg, u32 val)
+{
+   ioapic[IOAPIC_IOREGSEL / sizeof(u32)] = reg;
+   ioapic[IOAPIC_IOWIN / sizeof(u32)] = val;
+}
+
+static bool is_known_lapic_id(const struct acpi_madt_info *mi, u32 id)
+{
+   for (u32 i = 0; i < mi->cpu_count; i++)
+      if (mi->lapic_ids[i] == id)
+         return true;
+
+   return false;
+}
+
+static void init_lapic(const struct acpi_madt_info *mi)
+{
+   u32 id, ver, max_lvt;
+
+   if (!(rdmsr(MSR_IA32_APIC_BASE) & APIC_BASE_MSR_ENABLE)) {
+      printk("APIC: the local APIC has been disabled by the firmware\n");
+      return;
+   }
+
+   if (!(lapic = apic_map_regs(mi->lapic_paddr))) {
+      printk("APIC: unable to map the local APIC\n");
+      return;
+   }
+
+   id = lapic_read(LAPIC_ID) >> 24;
+   ver = lapic_read(LAPIC_VER);
+   max_lvt = (ver >> 16) & 0xff;
+
+   if (!is_known_lapic_id(mi, id))
+      printk("APIC: WARNING: LAPIC ID %u not listed in MADT\n", id);
+
+   /*
+    * Keep the PICs working through LINT0 (virtual wire mode), route the NMIs
+    * to LINT1 and mask everything else. The ExtINT interrupts don't need any
+    * EOI to the LAPIC: pic_send_eoi() keeps being enough.
+    */
+   lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+   lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+
+   if (max_lvt >= 4)
+      lapic_write(LAPIC_LVT_PERF, LAPIC_LVT_MASKED);
+
+   if (max_lvt >= 5)
+      lapic_write(LAPIC_LVT_THERMAL, LAPIC_LVT_MASKED);
+
+   lapic_write(LAPIC_LVT_LINT0, LAPIC_DM_EXTINT);
+   lapic_write(LAPIC_LVT_LINT1, LAPIC_DM_NMI);
+
+   /* The ESR must be written before being read */
+   lapic_write(LAPIC_ESR, 0);
+   lapic_write(LAPIC_ESR, 0);
+
+   lapic_write(LAPIC_TPR, 0);
+   lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPUR_VECTOR);
+
+   printk("APIC: LAPIC ID: %u, version: %#x, LVT entries: %u\n",
+          id, ver & 0xff, max_lvt + 1);
+}
+
+static void init_ioapic(const struct acpi_madt_info *mi)
+{
+   u32 id, ver, pins;
+
+   if (!mi->ioapic_count)
+      return;
+
+   if (!(ioapic = apic_map_regs(mi->ioapic_paddr))) {
+      printk("APIC: unable to map the I/O APIC\n");
+      return;
+   }
+
+   id = (ioapic_read(IOAPIC_REG_ID) >> 24) & 0xf;
+   ver = ioapic_read(IOAPIC_REG_VER);
+   pins = ((ver >> 16) & 0xff) + 1;
+
+   /* The IRQs are still delivered by the PICs: mask all the pins */
+   for (u32 i = 0; i < pins; i++) {
+      ioapic_write(IOAPIC_REG_REDTBL(i), IOAPIC_REDIR_MASKED);
+      ioapic_write(IOAPIC_REG_REDTBL(i) + 1, 0);
+   }
+
+   printk("APIC: I/O APIC ID: %u, version: %#x, pins: %u\n",
+          id, ver & 0xff, pins);
+}
+
+void init_apic(void)
+{
+   const struct acpi_madt_info *mi = NULL;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (!x86_cpu_features.edx1.apic)
+      return;
+
+   if (MOD_acpi)
+      mi = acpi_get_madt_info();
+
+   if (!mi || !mi->lapic_paddr)
+      return;
+
+   if (!mi->has_8259)
+      printk("APIC: WARNING: MADT reports no 8259 PICs\n");
+
+   init_lapic(mi);
+   init_ioapic(mi);
+}
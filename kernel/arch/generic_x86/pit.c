@@ -32,6 +32,27 @@
 
 #define PIT_READ_BACK   0b11000000   // read-back command (8254 only)
 
+#define PIT_RB_NO_COUNT 0b00100000   // read-back: don't latch the count
+#define PIT_RB_NO_STAT  0b00010000   // read-back: don't latch the status
+#define PIT_RB_CH0      0b00000010   // read-back: select channel 0
+
+#define PIT_STAT_OUT    0b10000000   // status: state of the OUT pin
+#define PIT_STAT_NULL   0b01000000   // status: null count (not loaded yet)
+
+static u32 pit_divisor;         /* PIT counts per tick */
+static u32 pit_oneshot_ticks;   /* ticks covered by the one-shot timer */
+static u32 pit_oneshot_counts;  /* PIT counts programmed in one-shot mode */
+
+static void pit_program_ch0(u8 mode, u32 counts)
+{
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(IN_RANGE_INC(counts, 1, 0xffff));
+
+   outb(PIT_CMD_PORT, PIT_MODE_BIN | mode | PIT_ACC_LOHI | PIT_CH0);
+   outb(PIT_CH0_PORT, counts & 0xff);             /* Set low byte of count */
+   outb(PIT_CH0_PORT, (counts >> 8) & 0xff);      /* Set high byte of count */
+}
+
 /*
  * Set the time between ticks to be `interval`, where 1 means 1/TS_SCALE sec.
  * Typically, TS_SCALE = 1,000,000,000 which means `interval` is expected to be
@@ -82,5 +103,67 @@ u32 hw_timer_setup(u32 interval)
    outb(PIT_CH0_PORT, divisor & 0xff);            /* Set low byte of divisor */
    outb(PIT_CH0_PORT, (divisor >> 8) & 0xff);     /* Set high byte of divisor */
 
+   pit_divisor = divisor;
    return (u32)actual_interval;
 }
+
+/*
+ * One-shot mode, used for the tickless idle. The PIT counter is just 16-bit
+ * wide, therefore a single one-shot cannot cover more than ~55 ms.
+ */
+u32 hw_timer_oneshot_max_ticks(void)
+{
+   return 0xffff / pit_divisor;
+}
+
+/*
+ * Program the timer to fire once, `ticks` ticks from now. Returns the number
+ * of ticks actually programmed, which might be less than `ticks`.
+ */
+u32 hw_timer_oneshot(u32 ticks)
+{
+   ticks = CLAMP(ticks, 1u, hw_timer_oneshot_max_ticks());
+
+   pit_oneshot_ticks = ticks;
+   pit_oneshot_counts = ticks * pit_divisor;
+   pit_program_ch0(PIT_MODE_0, pit_oneshot_counts);
+   return ticks;
+}
+
+/*
+ * Returns the number of whole ticks elapsed since the one-shot timer has been
+ * programmed. If it already fired, that's the number of ticks it covered.
+ * Otherwise, the one-shot timer is re-programmed to fire at the end of the
+ * current tick, which from now on is the only tick it covers.
+ */
+u32 hw_timer_oneshot_cut(void)
+{
+   u32 count, elapsed, rem;
+   u8 status;
+
+   outb(PIT_CMD_PORT, PIT_READ_BACK | PIT_RB_CH0);
+   status = inb(PIT_CH0_PORT);
+   count = inb(PIT_CH0_PORT);
+   count |= (u32)inb(PIT_CH0_PORT) << 8;
+
+   if (status & PIT_STAT_OUT)
+      return pit_oneshot_ticks;    /* reached the terminal count */
+
+   if (status & PIT_STAT_NULL)
+      count = pit_oneshot_counts;  /* didn't even start counting */
+
+   elapsed = pit_oneshot_counts - MIN(count, pit_oneshot_counts);
+   rem = elapsed % pit_divisor;
+
+   pit_oneshot_ticks = 1;
+   pit_oneshot_counts = pit_divisor - rem;
+   pit_program_ch0(PIT_MODE_0, pit_oneshot_counts);
+   return elapsed / pit_divisor;
+}
+
+/* Go back to the periodic mode, after a one-shot */
+void hw_timer_periodic(void)
+{
+   pit_oneshot_ticks = 0;
+   pit_program_ch0(PIT_MODE_2, pit_divisor);
+}
@@ -381,6 +381,66 @@ static void gdt_set_slot(struct process *pi, u16 slot, u16 gdt_index)
    get_proc_arch_fields(pi)->gdt_entries[slot] = gdt_index;
 }
 
+static bool user_desc_is_empty(struct user_desc *dc)
+{
+   return dc->flags == USER_DESC_FLAGS_EMPTY && !dc->base_addr && !dc->limit;
+}
+
+static void user_desc_to_gdt_entry(struct user_desc *dc, struct gdt_entry *e)
+{
+   gdt_set_entry(e, dc->base_addr, dc->limit, 0, 0);
+   e->s = 1;
+   e->dpl = 3;
+   e->d = dc->seg_32bit;
+   e->type |= (dc->contents << 2);
+   e->type |= !dc->read_exec_only ? GDT_ACCESS_RW : 0;
+   e->g = dc->limit_in_pages;
+   e->avl = dc->useable;
+   e->p = !dc->seg_not_present;
+}
+
+/*
+ * Add a GDT entry for the TLS of a thread created by clone(CLONE_SETTLS).
+ *
+ * On Linux, each thread has its own copy of the TLS entries, reloaded in the
+ * GDT at every context switch: that's why threads can use the same selector
+ * with a different base address. Tilck has a single GDT, therefore here we
+ * ignore `entry_number` and always allocate a new entry for the thread. The
+ * caller will set the thread's %gs accordingly.
+ *
+ * Returns the index of the new entry or a negative errno value.
+ */
+int gdt_add_user_tls_entry(void *u_info)
+{
+   struct gdt_entry e = {0};
+   struct user_desc dc;
+   int rc;
+
+   if (copy_from_user(&dc, u_info, sizeof(struct user_desc)))
+      return -EFAULT;
+
+   if (user_desc_is_empty(&dc))
+      return -EINVAL;
+
+   user_desc_to_gdt_entry(&dc, &e);
+   disable_preemption();
+   {
+      rc = gdt_add_entry(&e);
+
+      if (rc < 0) {
+
+         if (gdt_expand() < 0) {
+            rc = -ESRCH;
+         } else {
+            rc = gdt_add_entry(&e);
+            ASSERT(rc > 0);
+         }
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
 int sys_set_thread_area(void *arg)
 {
    int rc = 0;
@@ -395,16 +455,8 @@ int sys_set_thread_area(void *arg)
 
    disable_preemption();
 
-   if (!(dc.flags == USER_DESC_FLAGS_EMPTY && !dc.base_addr && !dc.limit)) {
-      gdt_set_entry(&e, dc.base_addr, dc.limit, 0, 0);
-      e.s = 1;
-      e.dpl = 3;
-      e.d = dc.seg_32bit;
-      e.type |= (dc.contents << 2);
-      e.type |= !dc.read_exec_only ? GDT_ACCESS_RW : 0;
-      e.g = dc.limit_in_pages;
-      e.avl = dc.useable;
-      e.p = !dc.seg_not_present;
+   if (!user_desc_is_empty(&dc)) {
+      user_desc_to_gdt_entry(&dc, &e);
    } else {
       /* The user passed an empty descriptor: entry_number cannot be -1 */
       if (dc.entry_number == INVALID_ENTRY_NUM) {
@@ -138,6 +138,7 @@ void gdt_set_entry(struct gdt_entry *e, ulong base, ulong lim, u8 accs, u8 fl);
 int gdt_add_entry(struct gdt_entry *e);
 void gdt_clear_entry(u32 index);
 void gdt_entry_inc_ref_count(u32 n);
+int gdt_add_user_tls_entry(void *u_info);
 
 #define TSS_MAIN                   0
 #define TSS_DOUBLE_FAULT           1
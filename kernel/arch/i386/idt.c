@@ -126,15 +126,16 @@ void handle_fault(regs_t *r)
 
    if (LIKELY(int_num == FAULT_PAGE_FAULT)) {
 
-      bool was_cow;
+      bool handled;
 
       enable_interrupts_forced();
       {
-         was_cow = handle_potential_cow(r);
+         handled = handle_potential_cow(r) ||
+                   (is_fault_resumable(int_num) && handle_user_copy_fault(r));
       }
       disable_interrupts_forced();
 
-      if (was_cow)
+      if (handled)
          return;
    }
 
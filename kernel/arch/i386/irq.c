@@ -11,11 +11,13 @@
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/timer.h>
+#include <tilck/kernel/arch/generic_x86/apic.h>
 
 #include "idt_int.h"
 #include "pic.h"
 
 extern void (*irq_entry_points[16])(void);
+extern void apic_spur_irq_entry(void);
 
 static struct list irq_handlers_lists[16] = {
    STATIC_LIST_INIT(irq_handlers_lists[ 0]),
@@ -87,6 +89,13 @@ void init_irq_handling(void)
 
       irq_set_mask(i);
    }
+
+   idt_set_entry(APIC_SPUR_VECTOR,
+                 apic_spur_irq_entry,
+                 X86_KERNEL_CODE_SEL,
+                 IDT_FLAG_PRESENT | IDT_FLAG_INT_GATE | IDT_FLAG_DPL0);
+
+   init_apic();
 }
 
 static inline void handle_irq_set_mask_and_eoi(int irq)
@@ -136,6 +145,7 @@ void arch_irq_handling(regs_t *r)
    }
 
    push_nested_interrupt(r->int_num);
+   timer_irq_enter();
    handle_irq_set_mask_and_eoi(irq);
    enable_interrupts_forced();
    {
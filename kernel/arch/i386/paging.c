@@ -11,6 +11,7 @@
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/hal.h>
@@ -42,6 +43,27 @@
  */
 #define PAGE_SHARED                            (1 << 1)
 
+/*
+ * When this flag is set in the 'avail' bits of a page directory entry, it
+ * means that its page table is shared with other pdirs (after fork) and that
+ * the entry has been made read-only for that reason: on a write attempt, the
+ * page table has to be copied (copy-on-write at the page-table level). The
+ * ref-count of a shared page table is the number of pdirs using it, while
+ * the one of a private page table is always 0.
+ */
+#define PDE_PT_COW                             (1 << 0)
+
+/*
+ * User-space 4 MB pages (page directory entries with psize = 1) use their
+ * 'avail' bits exactly like page_t does: PAGE_COW_ORIG_RW and PAGE_SHARED.
+ * Each 4 KB pageframe in them has its own ref-count, like when it's mapped
+ * through a page table, so that a 4 MB page can be split at any moment.
+ */
+#define BIG_PAGE_FRAMES                (BIG_PAGE_SIZE / PAGE_SIZE)
+
+STATIC_ASSERT(BIG_PAGE_SIZE == (1u << BIG_PAGE_SHIFT));
+STATIC_ASSERT((PAGE_SIZE << PF_MAX_ORDER) == BIG_PAGE_SIZE);
+
 
 /* ---------------------------------------------- */
 
@@ -55,13 +77,32 @@ static u16 *pageframes_refcount;
 static ulong phys_mem_lim;
 static struct kmalloc_heap *hi_vmem_heap;
 
+/*
+ * The zero page backs all the not-yet-written anonymous memory and, therefore,
+ * can be mapped way more times than a 16-bit counter can track. Because of
+ * that, its ref-count is not tracked at all: it's pinned to a value > 1, so
+ * that the zero page is always considered as shared and never freed.
+ */
+#define ZERO_PAGE_REF_COUNT                                 2
+
+static ALWAYS_INLINE bool is_zero_page(u32 paddr)
+{
+   return paddr == KERNEL_VA_TO_PA(zero_page);
+}
+
 static ALWAYS_INLINE u32 __pf_ref_count_inc(u32 paddr)
 {
+   if (UNLIKELY(is_zero_page(paddr)))
+      return ZERO_PAGE_REF_COUNT;
+
    return ++pageframes_refcount[paddr >> PAGE_SHIFT];
 }
 
 static ALWAYS_INLINE u32 __pf_ref_count_dec(u32 paddr)
 {
+   if (UNLIKELY(is_zero_page(paddr)))
+      return ZERO_PAGE_REF_COUNT;
+
    ASSERT(pageframes_refcount[paddr >> PAGE_SHIFT] > 0);
    return --pageframes_refcount[paddr >> PAGE_SHIFT];
 }
@@ -87,6 +128,9 @@ static ALWAYS_INLINE u32 pf_ref_count_get(u32 paddr)
    if (UNLIKELY(paddr >= phys_mem_lim))
       return 0;
 
+   if (UNLIKELY(is_zero_page(paddr)))
+      return ZERO_PAGE_REF_COUNT;
+
    return pageframes_refcount[paddr >> PAGE_SHIFT];
 }
 
@@ -96,6 +140,163 @@ pdir_get_page_table(pdir_t *pdir, u32 i)
    return KERNEL_PA_TO_VA(pdir->entries[i].ptaddr << PAGE_SHIFT);
 }
 
+static ALWAYS_INLINE ulong
+pdir_get_big_page_paddr(pdir_t *pdir, u32 i)
+{
+   return (ulong)pdir->entries[i].big_4mb_page.paddr << BIG_PAGE_SHIFT;
+}
+
+static void big_page_ref_count_inc(ulong paddr)
+{
+   for (u32 j = 0; j < BIG_PAGE_FRAMES; j++, paddr += PAGE_SIZE)
+      pf_ref_count_inc(paddr);
+}
+
+static void big_page_release(ulong paddr, bool free_pageframes)
+{
+   for (u32 j = 0; j < BIG_PAGE_FRAMES; j++, paddr += PAGE_SIZE) {
+
+      if (pf_ref_count_dec(paddr) || !free_pageframes)
+         continue;
+
+      if (paddr < phys_mem_lim)
+         pf_free_page(KERNEL_PA_TO_VA(paddr));
+   }
+}
+
+static bool big_page_is_private(ulong paddr)
+{
+   for (u32 j = 0; j < BIG_PAGE_FRAMES; j++, paddr += PAGE_SIZE)
+      if (pf_ref_count_get(paddr) != 1)
+         return false;
+
+   return true;
+}
+
+/*
+ * Replace the 4 MB page at the i-th entry of `pdir` with a page table mapping
+ * the same pageframes with the same flags. Returns NULL in the out-of-memory
+ * case.
+ */
+static page_table_t *
+pdir_split_big_page(pdir_t *pdir, u32 i)
+{
+   page_dir_entry_t *e = &pdir->entries[i];
+   const page_dir_entry_t be = *e;
+   ulong paddr = pdir_get_big_page_paddr(pdir, i);
+   page_table_t *pt;
+   page_t p;
+
+   ASSERT(be.present && be.psize);
+   ASSERT(i < KERNEL_BASE_PD_IDX);
+
+   if (!(pt = pf_alloc_page()))
+      return NULL;
+
+   p.raw = PG_PRESENT_BIT;
+   p.rw = be.rw;
+   p.us = be.us;
+   p.wt = be.wt;
+   p.cd = be.cd;
+   p.pat = be.big_4mb_page.pat;
+   p.avail = be.avail;
+
+   for (u32 j = 0; j < BIG_PAGE_FRAMES; j++, paddr += PAGE_SIZE) {
+      p.pageAddr = SHR_BITS(paddr, PAGE_SHIFT, u32);
+      pt->pages[j] = p;
+   }
+
+   e->raw = PG_PRESENT_BIT | PG_RW_BIT | (be.raw & PG_US_BIT);
+   e->ptaddr = SHR_BITS(KERNEL_VA_TO_PA(pt), PAGE_SHIFT, u32);
+   invalidate_page_hw(i << BIG_PAGE_SHIFT);
+   return pt;
+}
+
+/*
+ * Make the page table of the i-th entry of `pdir` private, before changing
+ * any of its entries. If the table is still shared with other pdirs, copy it:
+ * each page in the copy gets its own reference and all the non-shared pages
+ * become COW in both the copies, exactly as a classic fork would have done.
+ * Returns NULL in the out-of-memory case.
+ */
+static page_table_t *
+pdir_unshare_page_table(pdir_t *pdir, u32 i)
+{
+   page_dir_entry_t *e = &pdir->entries[i];
+   page_table_t *pt = pdir_get_page_table(pdir, i);
+   page_table_t *new_pt;
+   const ulong pt_paddr = KERNEL_VA_TO_PA(pt);
+
+   if (LIKELY(!(e->avail & PDE_PT_COW)))
+      return pt;
+
+   ASSERT(e->present && !e->psize);
+
+   if (pf_ref_count_get(pt_paddr) > 1) {
+
+      if (!(new_pt = pf_alloc_page()))
+         return NULL;
+
+      for (u32 j = 0; j < 1024; j++) {
+
+         page_t *const p = &pt->pages[j];
+
+         if (!p->present)
+            continue;
+
+         if (!(p->avail & PAGE_SHARED)) {
+
+            if (p->rw)
+               p->avail |= PAGE_COW_ORIG_RW;
+
+            p->rw = false;
+         }
+
+         pf_ref_count_inc((ulong)p->pageAddr << PAGE_SHIFT);
+      }
+
+      memcpy32(new_pt, pt, sizeof(page_table_t) / 4);
+      pf_ref_count_dec(pt_paddr);
+      e->ptaddr = SHR_BITS(KERNEL_VA_TO_PA(new_pt), PAGE_SHIFT, u32);
+
+   } else {
+
+      /* All the other pdirs sharing the table are gone: just take it */
+      pf_ref_count_dec(pt_paddr);
+      new_pt = pt;
+   }
+
+   ASSERT(pf_ref_count_get(KERNEL_VA_TO_PA(new_pt)) == 0);
+   e->avail &= ~PDE_PT_COW;
+   e->rw = true;
+
+   /*
+    * The TLB might contain read-only entries for any page in the 4 MB range
+    * covered by the table: just flush it all, as that happens at most once
+    * per page table, after each fork.
+    */
+   if (pdir == get_curr_pdir())
+      set_curr_pdir(pdir);
+
+   return new_pt;
+}
+
+static ALWAYS_INLINE page_table_t *
+pdir_get_private_page_table(pdir_t *pdir, u32 i)
+{
+   page_table_t *pt;
+
+   if (UNLIKELY(pdir->entries[i].psize))
+      pt = pdir_split_big_page(pdir, i);
+   else
+      pt = pdir_unshare_page_table(pdir, i);
+
+   if (UNLIKELY(!pt))
+      panic("Out-of-memory: can't get a private page table");
+
+   return pt;
+}
+
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
 {
    ASSERT(IS_PAGE_ALIGNED(vaddrp));
@@ -132,11 +333,122 @@ void release_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
    }
 }
 
+/*
+ * Check if any of the pageframes mapped at [vaddr, vaddr + len) has more than
+ * one reference, i.e. if it's mapped somewhere else too.
+ */
+bool are_pageframes_shared(pdir_t *pdir, void *vaddrp, size_t len)
+{
+   ASSERT(IS_PAGE_ALIGNED(vaddrp));
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   ulong paddr;
+   ulong vaddr = (ulong)vaddrp;
+   const ulong vaddr_end = vaddr + len;
+
+   for (; vaddr < vaddr_end; vaddr += PAGE_SIZE) {
+
+      if (get_mapping2(pdir, (void *)vaddr, &paddr) < 0)
+         continue; /* not mapped, that's fine */
+
+      if (pf_ref_count_get(paddr) > 1)
+         return true;
+   }
+
+   return false;
+}
+
 void invalidate_page(ulong vaddr)
 {
    invalidate_page_hw(vaddr);
 }
 
+static void cow_out_of_memory(const char *what)
+{
+   struct task *curr = get_curr_task();
+
+   if (!curr->running_in_kernel) {
+
+      // The task was not running in kernel: we can safely kill it.
+      printk("Out-of-memory: killing pid %d\n", get_curr_pid());
+      exit_fault_handler_state();
+      terminate_process(0, SIGKILL);
+
+   } else {
+
+      // We cannot kill a task running in kernel during a CoW page fault
+      // In this case (but in the one above too), Linux puts the process to
+      // sleep, while the OOM killer runs and frees some memory.
+      panic("Out-of-memory: can't copy %s [pid %d]", what, get_curr_pid());
+   }
+}
+
+/*
+ * Big pages for anonymous memory are opt-in, through mmap(MAP_HUGETLB): the
+ * first write to a promoted range allocates and zeroes 4 MB at once, while a
+ * program might touch just a few pages of a large mapping (think of malloc()
+ * arenas). Also, the whole 4 MB range must belong to a single such mapping.
+ */
+static bool anon_range_wants_big_page(u32 i)
+{
+   const ulong va = (ulong)i << BIG_PAGE_SHIFT;
+   struct user_mapping *um = process_get_user_mapping(TO_PTR(va));
+
+   if (!um || um->h || !(um->flags & MAP_HUGETLB))
+      return false;
+
+   return va + BIG_PAGE_SIZE <= um->vaddr + um->len;
+}
+
+/*
+ * On the first write to anonymous memory mapped with MAP_HUGETLB, check if the
+ * whole 4 MB range covered by the page table is still mapped to the zero page
+ * and, in that case, replace the page table with a single zeroed 4 MB page, if
+ * there's a free physically-contiguous block for it. Everywhere else, demand
+ * paging works one 4 KB page at a time.
+ */
+static bool pdir_promote_zero_page_table(pdir_t *pdir, u32 i)
+{
+   const u32 ign_bits = PG_ACC_BIT | PG_DIRTY_BIT;
+   page_dir_entry_t *e = &pdir->entries[i];
+   page_table_t *pt = pdir_get_page_table(pdir, i);
+   const page_t first = pt->pages[0];
+   void *block;
+
+   if (i >= KERNEL_BASE_PD_IDX || (e->avail & PDE_PT_COW))
+      return false;
+
+   if (!first.present || !first.us || !(first.avail & PAGE_COW_ORIG_RW))
+      return false;
+
+   if (!is_zero_page((u32)first.pageAddr << PAGE_SHIFT))
+      return false;
+
+   if (!anon_range_wants_big_page(i))
+      return false;
+
+   for (u32 j = 1; j < 1024; j++)
+      if ((pt->pages[j].raw ^ first.raw) & ~ign_bits)
+         return false;
+
+   if (!(block = pf_alloc(PF_MAX_ORDER)))
+      return false;
+
+   bzero(block, BIG_PAGE_SIZE);
+   big_page_ref_count_inc(KERNEL_VA_TO_PA(block));
+
+   /* The zero page's ref-count is not tracked: just drop the page table */
+   e->raw = PG_PRESENT_BIT | PG_RW_BIT | PG_US_BIT | PG_4MB_BIT |
+            KERNEL_VA_TO_PA(block);
+
+   pf_free_page(pt);
+
+   /* Flush the TLB entries of all the 1024 pages in the range */
+   set_curr_pdir(pdir);
+   process_inc_resident_pages(get_curr_proc(), BIG_PAGE_FRAMES);
+   return true;
+}
+
 bool handle_potential_cow(void *context)
 {
    regs_t *r = context;
@@ -150,7 +462,54 @@ bool handle_potential_cow(void *context)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
    const void *const page_vaddr = (void *)(vaddr & PAGE_MASK);
-   page_table_t *pt = pdir_get_page_table(get_curr_pdir(), pd_index);
+   pdir_t *const pdir = get_curr_pdir();
+   page_dir_entry_t *const e = &pdir->entries[pd_index];
+   page_table_t *pt = pdir_get_page_table(pdir, pd_index);
+
+   if (e->psize) {
+
+      if (!(e->avail & PAGE_COW_ORIG_RW))
+         return false; /* Not a COW page */
+
+      get_curr_proc()->minor_faults++;
+
+      if (big_page_is_private(pdir_get_big_page_paddr(pdir, pd_index))) {
+
+         /* Not shared anymore: no need for copying or splitting it */
+         e->rw = true;
+         e->avail = 0;
+         invalidate_page_hw(vaddr);
+         return true;
+      }
+
+      /*
+       * Don't copy 4 MB on a write: split the big page in regular COW pages
+       * and let the write to be retried, so that only one page gets copied.
+       */
+      if (!pdir_split_big_page(pdir, pd_index))
+         cow_out_of_memory("a shared 4 MB page");
+
+      return true;
+   }
+
+   if (e->avail & PDE_PT_COW) {
+
+      const page_t p = pt->pages[pt_index];
+
+      if (!p.rw && !(p.avail & PAGE_COW_ORIG_RW))
+         return false; /* The page is read-only anyway */
+
+      /*
+       * Write to a page table shared after fork: get our own copy of it and
+       * let the write to be retried. In case the page itself is COW, that
+       * will cause another fault, handled below.
+       */
+      if (!pdir_unshare_page_table(pdir, pd_index))
+         cow_out_of_memory("a shared page table");
+
+      get_curr_proc()->minor_faults++;
+      return true;
+   }
 
    if (!(pt->pages[pt_index].avail & PAGE_COW_ORIG_RW))
       return false; /* Not a COW page */
@@ -158,6 +517,12 @@ bool handle_potential_cow(void *context)
    const u32 orig_page_paddr = (u32)
       pt->pages[pt_index].pageAddr << PAGE_SHIFT;
 
+   get_curr_proc()->minor_faults++;
+
+   if (is_zero_page(orig_page_paddr))
+      if (pdir_promote_zero_page_table(pdir, pd_index))
+         return true;
+
    if (pf_ref_count_get(orig_page_paddr) == 1) {
 
       /* This page is not shared anymore. No need for copying it. */
@@ -168,34 +533,28 @@ bool handle_potential_cow(void *context)
    }
 
    // Allocate a new page.
-   void *new_page_vaddr = kmalloc(PAGE_SIZE);
+   void *new_page_vaddr = pf_alloc_page();
 
-   if (!new_page_vaddr) {
+   if (!new_page_vaddr)
+      cow_out_of_memory("a CoW page");
 
-      // Out-of-memory case
-      struct task *curr = get_curr_task();
+   ASSERT(IS_PAGE_ALIGNED(new_page_vaddr));
 
-      if (!curr->running_in_kernel) {
+   if (is_zero_page(orig_page_paddr)) {
 
-         // The task was not running in kernel: we can safely kill it.
-         printk("Out-of-memory: killing pid %d\n", get_curr_pid());
-         exit_fault_handler_state();
-         terminate_process(0, SIGKILL);
+      /*
+       * First write to a page of anonymous memory: that's where the actual
+       * allocation happens (demand paging). No need to read the zero page.
+       */
+      bzero(new_page_vaddr, PAGE_SIZE);
+      process_inc_resident_pages(get_curr_proc(), 1);
 
-      } else {
+   } else {
 
-         // We cannot kill a task running in kernel during a CoW page fault
-         // In this case (but in the one above too), Linux puts the process to
-         // sleep, while the OOM killer runs and frees some memory.
-         panic("Out-of-memory: can't copy a CoW page [pid %d]", get_curr_pid());
-      }
+      // Copy page's contents
+      memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
    }
 
-   ASSERT(IS_PAGE_ALIGNED(new_page_vaddr));
-
-   // Copy page's contents
-   memcpy32(new_page_vaddr, page_vaddr, PAGE_SIZE / 4);
-
    // Get the paddr of the new page
    const ulong paddr = KERNEL_VA_TO_PA(new_page_vaddr);
 
@@ -229,6 +588,43 @@ static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
          r->eip, sym_name ? sym_name : "???", off);
 }
 
+/*
+ * The pages of the file mappings are mapped on demand, on the first access
+ * (see vfs_handle_fault()), and that first access might be made by the kernel
+ * itself, while copying data from or to the user space (e.g. a read() into a
+ * buffer in a file mapping, not touched yet). Give the fs the chance to map
+ * the page before letting the fault-resumable code (copy_to_user() etc.) fail.
+ */
+bool handle_user_copy_fault(void *context)
+{
+   regs_t *r = context;
+   struct user_mapping *um;
+   u32 vaddr;
+
+   const bool p  = !!(r->err_code & PAGE_FAULT_FL_PRESENT);
+   const bool rw = !!(r->err_code & PAGE_FAULT_FL_RW);
+
+   if (r->err_code & PAGE_FAULT_FL_US)
+      return false; /* Faults in user code are handled below */
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr >= KERNEL_BASE_VA)
+      return false;
+
+   if (!(um = process_get_user_mapping((void *)vaddr)) || !um->h)
+      return false;
+
+   if (rw && !(um->prot & PROT_WRITE))
+      return false;
+
+   if (!vfs_handle_fault(um, (void *)vaddr, p, rw))
+      return false;
+
+   get_curr_proc()->minor_faults++;
+   return true;
+}
+
 void handle_page_fault_int(regs_t *r)
 {
    u32 vaddr;
@@ -260,8 +656,10 @@ void handle_page_fault_int(regs_t *r)
        */
       if (!!(um->prot & PROT_WRITE) || !rw) {
 
-         if (vfs_handle_fault(um, (void *)vaddr, p, rw))
+         if (vfs_handle_fault(um, (void *)vaddr, p, rw)) {
+            get_curr_proc()->minor_faults++;
             return;
+         }
 
          sig = SIGBUS;
       }
@@ -289,7 +687,7 @@ void handle_page_fault_int(regs_t *r)
    );
 
    exit_fault_handler_state();
-   send_signal(get_curr_tid(), sig, true);
+   send_signal2(get_curr_pid(), get_curr_tid(), sig, false);
    NOT_REACHED();
 }
 
@@ -355,8 +753,8 @@ void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
-   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   ASSERT(KERNEL_VA_TO_PA(pt) != 0);
+   ASSERT(pdir->entries[pd_index].present);
+   pt = pdir_get_private_page_table(pdir, pd_index);
    pt->pages[pt_index].rw = rw;
    invalidate_page_hw(vaddr);
 }
@@ -369,6 +767,11 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
    const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
    const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
 
+   if (UNLIKELY(pdir->entries[pd_index].psize)) {
+      /* Unmapping a single page of a 4 MB page: split it first */
+      pdir_get_private_page_table(pdir, pd_index);
+   }
+
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
 
    if (permissive) {
@@ -384,6 +787,8 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       ASSERT(pt->pages[pt_index].present);
    }
 
+   pt = pdir_get_private_page_table(pdir, pd_index);
+
    const ulong paddr = (ulong)
       pt->pages[pt_index].pageAddr << PAGE_SHIFT;
 
@@ -392,7 +797,7 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
 
    if (!pf_ref_count_dec(paddr) && free_pageframe) {
       ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      pf_free_page(KERNEL_PA_TO_VA(paddr));
    }
 
    return 0;
@@ -410,6 +815,32 @@ unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
    return __unmap_page(pdir, vaddrp, free_pageframe, true);
 }
 
+/*
+ * When the range to unmap covers a whole 4 MB page, drop it at once instead of
+ * splitting it first in 1024 regular pages.
+ */
+static bool
+try_unmap_big_page(pdir_t *pdir, ulong vaddr, size_t page_count, bool do_free)
+{
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   page_dir_entry_t *e = &pdir->entries[pd_index];
+   ulong paddr;
+
+   if ((vaddr & (BIG_PAGE_SIZE - 1)) || page_count < BIG_PAGE_FRAMES)
+      return false;
+
+   if (!e->present || !e->psize)
+      return false;
+
+   ASSERT(pd_index < KERNEL_BASE_PD_IDX);
+   paddr = pdir_get_big_page_paddr(pdir, pd_index);
+
+   e->raw = 0;
+   invalidate_page_hw(vaddr);
+   big_page_release(paddr, do_free);
+   return true;
+}
+
 void
 unmap_pages(pdir_t *pdir,
             void *vaddr,
@@ -417,7 +848,15 @@ unmap_pages(pdir_t *pdir,
             bool do_free)
 {
    for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
+
+      char *va = (char *)vaddr + (i << PAGE_SHIFT);
+
+      if (try_unmap_big_page(pdir, (ulong)va, page_count - i, do_free)) {
+         i += BIG_PAGE_FRAMES - 1;
+         continue;
+      }
+
+      unmap_page(pdir, va, do_free);
    }
 }
 
@@ -431,11 +870,16 @@ unmap_pages_permissive(pdir_t *pdir,
    int rc;
 
    for (size_t i = 0; i < page_count; i++) {
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+
+      char *va = (char *)vaddr + (i << PAGE_SHIFT);
+
+      if (try_unmap_big_page(pdir, (ulong)va, page_count - i, do_free)) {
+         i += BIG_PAGE_FRAMES - 1;
+         unmapped_pages += BIG_PAGE_FRAMES;
+         continue;
+      }
+
+      rc = unmap_page_permissive(pdir, va, do_free);
       unmapped_pages += (rc == 0);
    }
 
@@ -459,6 +903,12 @@ ulong get_mapping(pdir_t *pdir, void *vaddrp)
 
    e.raw = pdir->entries[pd_index].raw;
    ASSERT(e.present);
+
+   if (e.psize) {
+      return ((ulong) e.big_4mb_page.paddr << BIG_PAGE_SHIFT) |
+             (vaddr & (BIG_PAGE_SIZE - 1));
+   }
+
    ASSERT(e.ptaddr != 0);
 
    pt = KERNEL_PA_TO_VA(e.ptaddr << PAGE_SHIFT);
@@ -512,6 +962,25 @@ int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref)
    return 0;
 }
 
+/*
+ * The page tables of the user pdirs come from the page-frame allocator. The
+ * kernel's ones are never freed and some of them are created while kmalloc
+ * itself is being initialized (before the page-frame allocator): get them
+ * from kmalloc.
+ */
+static page_table_t *alloc_page_table(pdir_t *pdir)
+{
+   page_table_t *pt;
+
+   if (pdir == __kernel_pdir)
+      return kzalloc_obj(page_table_t);
+
+   if ((pt = pf_alloc_page()))
+      bzero(pt, sizeof(page_table_t));
+
+   return pt;
+}
+
 NODISCARD int
 map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
 {
@@ -523,13 +992,16 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
    ASSERT(!(vaddr & OFFSET_IN_PAGE_MASK)); // the vaddr must be page-aligned
    ASSERT(!(paddr & OFFSET_IN_PAGE_MASK)); // the paddr must be page-aligned
 
+   if (UNLIKELY(pdir->entries[pd_index].psize))
+      return -EADDRINUSE; /* vaddr is in a 4 MB page */
+
    pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
    ASSERT(IS_PAGE_ALIGNED(pt));
 
    if (UNLIKELY(KERNEL_VA_TO_PA(pt) == 0)) {
 
       // we have to create a page table for mapping 'vaddr'.
-      pt = kzalloc_obj(page_table_t);
+      pt = alloc_page_table(pdir);
 
       if (UNLIKELY(!pt))
          return -ENOMEM;
@@ -546,6 +1018,9 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
    if (pt->pages[pt_index].present)
       return -EADDRINUSE;
 
+   if (UNLIKELY(!(pt = pdir_unshare_page_table(pdir, pd_index))))
+      return -ENOMEM;
+
    pt->pages[pt_index].raw = PG_PRESENT_BIT | hw_flags | paddr;
    pf_ref_count_inc(paddr);
    invalidate_page_hw(vaddr);
@@ -590,6 +1065,10 @@ map_pages_int(pdir_t *pdir,
       big_page_flags &= ~PG_GLOBAL_BIT;
 
       for (; big_pages < (rem_pages >> 10); big_pages++) {
+
+         if (pdir->entries[(ulong)vaddr >> BIG_PAGE_SHIFT].present)
+            break; /* There's a page table here: use regular pages */
+
          map_4mb_page_int(pdir, vaddr, paddr, big_page_flags);
          vaddr += (4 * MB);
          paddr += (4 * MB);
@@ -616,20 +1095,28 @@ out:
 NODISCARD int
 map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
 {
-   const bool rw = !!(pg_flags & PAGING_FL_RW);
    const bool us = !!(pg_flags & PAGING_FL_US);
+   bool rw = !!(pg_flags & PAGING_FL_RW);
    u32 avail_bits = 0;
    int rc;
 
    if (pg_flags & PAGING_FL_SHARED)
       avail_bits |= PAGE_SHARED;
 
+   if (pg_flags & PAGING_FL_COW) {
+
+      /* Map the page read-only and copy it on the first write */
+      ASSERT(!(pg_flags & PAGING_FL_SHARED));
+      avail_bits |= PAGE_COW_ORIG_RW;
+      rw = false;
+   }
+
    if (pg_flags & PAGING_FL_DO_ALLOC) {
 
       void *va;
       ASSERT(paddr == 0);
 
-      if (!(va = kmalloc(PAGE_SIZE)))
+      if (!(va = pf_alloc_page()))
          return -ENOMEM;
 
       if (pg_flags & PAGING_FL_ZERO_PG)
@@ -654,7 +1141,7 @@ map_page(pdir_t *pdir, void *vaddrp, ulong paddr, u32 pg_flags)
                    /* Kernel pages are global */
 
    if (UNLIKELY(rc != 0) && (pg_flags & PAGING_FL_DO_ALLOC)) {
-      kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+      pf_free_page(KERNEL_PA_TO_VA(paddr));
    }
 
    return rc;
@@ -731,75 +1218,58 @@ map_pages(pdir_t *pdir,
 
 pdir_t *pdir_clone(pdir_t *pdir)
 {
-   pdir_t *new_pdir = kalloc_obj(pdir_t);
+   STATIC_ASSERT(sizeof(page_table_t) == PAGE_SIZE);
+
+   pdir_t *new_pdir;
 
-   if (!new_pdir)
+   if (!(new_pdir = pf_alloc_page()))
       return NULL;
 
    ASSERT(IS_PAGE_ALIGNED(new_pdir));
-   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
 
+   /*
+    * Don't copy the page tables: share them between the two pdirs, making
+    * their entries read-only. The first write to any page in the 4 MB range
+    * covered by a shared table will make the writer to get its own copy of
+    * the table (see pdir_unshare_page_table()), while the tables never
+    * written again (e.g. because the child calls execve() soon) won't be
+    * copied at all.
+    */
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
+      page_dir_entry_t *const e = &pdir->entries[i];
 
-      if (!pdir->entries[i].present)
+      if (!e->present)
          continue;
 
-      page_table_t *pt = kalloc_obj(page_table_t);
-
-      if (UNLIKELY(!pt)) {
+      if (e->psize) {
 
-         for (; i > 0; i--) {
-            if (pdir->entries[i - 1].present)
-               kfree_obj(pdir_get_page_table(pdir, i - 1), page_table_t);
-         }
+         /* 4 MB pages have no page table to share: just make them COW */
+         if (!(e->avail & PAGE_SHARED)) {
 
-         kfree_obj(new_pdir, pdir_t);
-         return NULL;
-      }
-
-      ASSERT(IS_PAGE_ALIGNED(pt));
-      new_pdir->entries[i].ptaddr=SHR_BITS(KERNEL_VA_TO_PA(pt),PAGE_SHIFT,u32);
-   }
+            if (e->rw)
+               e->avail |= PAGE_COW_ORIG_RW;
 
-   for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
+            e->rw = false;
+         }
 
-      if (!pdir->entries[i].present)
+         big_page_ref_count_inc(pdir_get_big_page_paddr(pdir, i));
          continue;
+      }
 
-      page_table_t *orig_pt = pdir_get_page_table(pdir, i);
-      page_table_t *new_pt = pdir_get_page_table(new_pdir, i);
-
-      /* Mark all the non-shared pages in that page-table as COW. */
-      for (u32 j = 0; j < 1024; j++) {
-
-         page_t *const p = &orig_pt->pages[j];
-
-         if (!p->present)
-            continue;
-
-         const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
-
-         /* Sanity-check: a mapped page MUST have ref-count > 0 */
-         ASSERT(pf_ref_count_get(orig_paddr) > 0);
-
-         if (!(p->avail & PAGE_SHARED)) {
-
-            if (p->rw)
-               p->avail |= PAGE_COW_ORIG_RW;
-
-            p->rw = false;
-         }
+      const ulong pt_paddr = (ulong)e->ptaddr << PAGE_SHIFT;
 
-         pf_ref_count_inc(orig_paddr);
+      if (!(e->avail & PDE_PT_COW)) {
+         ASSERT(pf_ref_count_get(pt_paddr) == 0);
+         pf_ref_count_inc(pt_paddr);
       }
 
-      // copy the page table
-      memcpy(new_pt, orig_pt, sizeof(page_table_t));
+      pf_ref_count_inc(pt_paddr);
+      e->avail |= PDE_PT_COW;
+      e->rw = false;
    }
 
+   memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
    return new_pdir;
 }
 
@@ -809,42 +1279,63 @@ pdir_deep_clone(pdir_t *pdir)
    STATIC_ASSERT(sizeof(pdir_t) == PAGE_SIZE);
    STATIC_ASSERT(sizeof(page_table_t) == PAGE_SIZE);
 
-   struct kmalloc_acc acc;
-   kmalloc_create_accelerator(&acc, PAGE_SIZE, 4);
-
-   pdir_t *new_pdir = kmalloc_accelerator_get_elem(&acc);
+   pdir_t *new_pdir = pf_alloc_page();
 
    if (UNLIKELY(!new_pdir))
       goto oom_exit;
 
    ASSERT(IS_PAGE_ALIGNED(new_pdir));
+   bzero(new_pdir, sizeof(pdir_t));
 
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
-      new_pdir->entries[i].raw = pdir->entries[i].raw;
+      if (!pdir->entries[i].present)
+         continue;
 
-      /* User-space cannot use 4-MB pages */
-      ASSERT(!pdir->entries[i].psize);
+      if (pdir->entries[i].psize) {
 
-      if (!pdir->entries[i].present)
+         const ulong orig_paddr = pdir_get_big_page_paddr(pdir, i);
+         ulong new_paddr = orig_paddr;
+
+         if (!(pdir->entries[i].avail & PAGE_SHARED)) {
+
+            void *block = pf_alloc(PF_MAX_ORDER);
+
+            if (UNLIKELY(!block))
+               goto oom_exit;
+
+            memcpy32(block, KERNEL_PA_TO_VA(orig_paddr), BIG_PAGE_SIZE / 4);
+            new_paddr = KERNEL_VA_TO_PA(block);
+         }
+
+         big_page_ref_count_inc(new_paddr);
+         new_pdir->entries[i].raw = pdir->entries[i].raw;
+         new_pdir->entries[i].big_4mb_page.paddr =
+            SHR_BITS(new_paddr, BIG_PAGE_SHIFT, u32);
          continue;
+      }
 
       page_table_t *orig_pt = pdir_get_page_table(pdir, i);
-      page_table_t *new_pt = kmalloc_accelerator_get_elem(&acc);
+      page_table_t *new_pt = pf_alloc_page();
 
       if (UNLIKELY(!new_pt))
          goto oom_exit;
 
       ASSERT(IS_PAGE_ALIGNED(new_pt));
+      bzero(new_pt, sizeof(page_table_t));
 
-      for (u32 j = 0; j < 1024; j++) {
+      new_pdir->entries[i].raw = pdir->entries[i].raw;
+      new_pdir->entries[i].ptaddr =
+         SHR_BITS(KERNEL_VA_TO_PA(new_pt), PAGE_SHIFT, u32);
+      new_pdir->entries[i].avail &= ~PDE_PT_COW;
+      new_pdir->entries[i].rw = true;
 
-         new_pt->pages[j].raw = orig_pt->pages[j].raw;
+      for (u32 j = 0; j < 1024; j++) {
 
          if (!orig_pt->pages[j].present)
             continue;
 
-         void *new_page = kmalloc_accelerator_get_elem(&acc);
+         void *new_page = pf_alloc_page();
 
          if (!new_page)
             goto oom_exit;
@@ -861,24 +1352,19 @@ pdir_deep_clone(pdir_t *pdir)
          pf_ref_count_inc(new_page_paddr);
 
          memcpy32(new_page, orig_page, PAGE_SIZE / 4);
+         new_pt->pages[j].raw = orig_pt->pages[j].raw;
          new_pt->pages[j].pageAddr = SHR_BITS(new_page_paddr, PAGE_SHIFT, u32);
       }
-
-      new_pdir->entries[i].ptaddr =
-         SHR_BITS(KERNEL_VA_TO_PA(new_pt), PAGE_SHIFT, u32);
    }
 
    for (u32 i = KERNEL_BASE_PD_IDX; i < 1024; i++) {
       new_pdir->entries[i].raw = pdir->entries[i].raw;
    }
 
-   kmalloc_destroy_accelerator(&acc);
    return new_pdir;
 
 oom_exit:
 
-   kmalloc_destroy_accelerator(&acc);
-
    if (new_pdir)
       pdir_destroy(new_pdir);
 
@@ -895,8 +1381,18 @@ void pdir_destroy(pdir_t *pdir)
       if (!pdir->entries[i].present)
          continue;
 
+      if (pdir->entries[i].psize) {
+         big_page_release(pdir_get_big_page_paddr(pdir, i), true);
+         continue;
+      }
+
       page_table_t *pt = pdir_get_page_table(pdir, i);
 
+      /* Shared page table: just drop our reference, unless it's the last */
+      if (pdir->entries[i].avail & PDE_PT_COW)
+         if (pf_ref_count_dec(KERNEL_VA_TO_PA(pt)) > 0)
+            continue;
+
       for (u32 j = 0; j < 1024; j++) {
 
          if (!pt->pages[j].present)
@@ -905,15 +1401,15 @@ void pdir_destroy(pdir_t *pdir)
          const ulong paddr = (ulong)pt->pages[j].pageAddr << PAGE_SHIFT;
 
          if (pf_ref_count_dec(paddr) == 0)
-            kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+            pf_free_page(KERNEL_PA_TO_VA(paddr));
       }
 
       // We freed all the pages, now free the whole page-table.
-      kfree_obj(pt, page_table_t);
+      pf_free_page(pt);
    }
 
    // We freed all pages and all the page-tables, now free pdir.
-   kfree_obj(pdir, pdir_t);
+   pf_free_page(pdir);
 }
 
 
@@ -969,9 +1465,8 @@ static void set_4kb_page_pat_wc(pdir_t *pdir, void *vaddrp)
 
    ASSERT(!(vaddr & OFFSET_IN_PAGE_MASK)); // the vaddr must be page-aligned
 
-   pt = KERNEL_PA_TO_VA(pdir->entries[pd_index].ptaddr << PAGE_SHIFT);
-   ASSERT(IS_PAGE_ALIGNED(pt));
-   ASSERT(pt != NULL);
+   ASSERT(pdir->entries[pd_index].present);
+   pt = pdir_get_private_page_table(pdir, pd_index);
 
    // 111 => entry[7] in the PAT MSR. See init_pat()
    pt->pages[pt_index].pat = 1;
@@ -1073,8 +1568,6 @@ void init_paging(void)
       panic("Unable to allocate pageframes_refcount");
    }
 
-   pf_ref_count_inc(KERNEL_VA_TO_PA(zero_page));
-
    /* Initialize the kmalloc heap used for the "hi virtual mem" area */
    init_hi_vmem_heap();
 
@@ -1140,7 +1633,8 @@ map_framebuffer(pdir_t *pdir,
    const size_t page_count = pow2_round_up_at(size, PAGE_SIZE) / PAGE_SIZE;
    const u32 pg_flags = PAGING_FL_RW                     |
                         PAGING_FL_SHARED                 |
-                        (user_mmap ? PAGING_FL_US : 0);
+                        (user_mmap ? PAGING_FL_US : 0)   |
+                        (user_mmap ? PAGING_FL_BIG_PAGES_ALLOWED : 0);
 
    if (!vaddr) {
 
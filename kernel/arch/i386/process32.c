@@ -526,6 +526,7 @@ int setup_process(struct elf_program_info *pinfo,
       }
 
       pi->pdir = pinfo->pdir;
+      pi->resident_pages = 0;
       old_pdir = NULL;
 
       /* NOTE: not calling arch_specific_free_task() */
@@ -710,14 +711,54 @@ sys_set_tid_address(int *tidptr)
     * is not valid, we'll send SIGSEGV to the just created thread.
     */
 
-   get_curr_proc()->set_child_tid = tidptr;
+   get_curr_task()->clear_child_tid = tidptr;
    return get_curr_task()->tid;
 }
 
+int
+arch_specific_clone_setup(struct task *ti, void *user_stack, void *u_tls)
+{
+   arch_task_members_t *arch = get_task_arch_fields(ti);
+   u16 tls_entry = get_task_arch_fields(get_curr_task())->tls_gdt_entry;
+   regs_t *r = ti->state_regs;
+   int rc;
+
+   if (u_tls) {
+
+      if ((rc = gdt_add_user_tls_entry(u_tls)) < 0)
+         return rc;
+
+      tls_entry = (u16)rc;
+      r->gs = X86_SELECTOR(tls_entry, TABLE_GDT, 3);
+
+   } else if (tls_entry) {
+
+      /* Same %gs as the task calling clone(): share its TLS entry */
+      gdt_entry_inc_ref_count(tls_entry);
+   }
+
+   if (arch->tls_gdt_entry)
+      gdt_clear_entry(arch->tls_gdt_entry);
+
+   arch->tls_gdt_entry = tls_entry;
+
+   if (user_stack)
+      r->useresp = (ulong)user_stack;
+
+   return 0;
+}
+
 bool
 arch_specific_new_task_setup(struct task *ti, struct task *parent)
 {
    arch_task_members_t *arch = get_task_arch_fields(ti);
+   u16 tls_entry = parent ? get_task_arch_fields(parent)->tls_gdt_entry : 0;
+
+   if (!parent && arch->tls_gdt_entry) {
+      /* execve(): %gs gets reset, drop the CLONE_SETTLS entry */
+      gdt_clear_entry(arch->tls_gdt_entry);
+      arch->tls_gdt_entry = 0;
+   }
 
    if (FORK_NO_COW) {
 
@@ -765,6 +806,12 @@ arch_specific_new_task_setup(struct task *ti, struct task *parent)
       }
    }
 
+   if (tls_entry) {
+      /* The new task has a copy of the parent's %gs: share its TLS entry */
+      gdt_entry_inc_ref_count(tls_entry);
+      arch->tls_gdt_entry = tls_entry;
+   }
+
    return true;
 }
 
@@ -775,6 +822,11 @@ arch_specific_free_task(struct task *ti)
    aligned_kfree2(arch->aligned_fpu_regs, arch->fpu_regs_size);
    arch->aligned_fpu_regs = NULL;
    arch->fpu_regs_size = 0;
+
+   if (arch->tls_gdt_entry) {
+      gdt_clear_entry(arch->tls_gdt_entry);
+      arch->tls_gdt_entry = 0;
+   }
 }
 
 void
@@ -793,8 +845,6 @@ arch_specific_new_proc_setup(struct process *pi, struct process *parent)
    for (int i = 0; i < ARRAY_SIZE(arch->gdt_entries); i++)
       if (arch->gdt_entries[i])
          gdt_entry_inc_ref_count(arch->gdt_entries[i]);
-
-   pi->set_child_tid = NULL;
 }
 
 void
@@ -822,7 +872,7 @@ void handle_gpf(regs_t *r)
       panic("General protection fault. Error: %p\n", r->err_code);
 
    exit_fault_handler_state();
-   send_signal(get_curr_tid(), SIGSEGV, true);
+   send_signal2(get_curr_pid(), get_curr_tid(), SIGSEGV, false);
    NOT_REACHED();
 }
 
@@ -833,7 +883,7 @@ void handle_ill(regs_t *r)
       panic("Illegal instruction fault. Error: %p\n", r->err_code);
 
    exit_fault_handler_state();
-   send_signal(get_curr_tid(), SIGILL, true);
+   send_signal2(get_curr_pid(), get_curr_tid(), SIGILL, false);
    NOT_REACHED();
 }
 
@@ -844,7 +894,7 @@ void handle_div0(regs_t *r)
       panic("Division by zero fault. Error: %p\n", r->err_code);
 
    exit_fault_handler_state();
-   send_signal(get_curr_tid(), SIGFPE, true);
+   send_signal2(get_curr_pid(), get_curr_tid(), SIGFPE, false);
    NOT_REACHED();
 }
 
@@ -855,6 +905,6 @@ void handle_cpf(regs_t *r)
       panic("Co-processor (fpu) fault. Error: %p\n", r->err_code);
 
    exit_fault_handler_state();
-   send_signal(get_curr_tid(), SIGFPE, true);
+   send_signal2(get_curr_pid(), get_curr_tid(), SIGFPE, false);
    NOT_REACHED();
 }
@@ -217,6 +217,31 @@ bintree_get_last_obj_internal(void *root_obj, long bintree_offset)
    return root_obj;
 }
 
+void *
+bintree_find_ge_internal(void *root_obj,
+                         const void *value_ptr,
+                         cmpfun_ptr objval_cmpfun,
+                         long bintree_offset)
+{
+   void *res = NULL;
+   long c;
+
+   while (root_obj) {
+
+      if (!(c = objval_cmpfun(root_obj, value_ptr)))
+         return root_obj;
+
+      if (c < 0) {
+         root_obj = RIGHT_OF(root_obj);
+      } else {
+         res = root_obj;      /* root_obj > value: candidate for the result */
+         root_obj = LEFT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
 static ALWAYS_INLINE long
 bintree_insrem_ptr_cmp(const void *a, const void *b, long field_off)
 {
@@ -459,6 +459,25 @@ u64 timespec_to_ticks(const struct k_timespec64 *tp)
    return ticks;
 }
 
+void ticks_to_timeval(u64 ticks, struct timeval *tv)
+{
+   struct k_timespec64 ts;
+   ticks_to_timespec(ticks, &ts);
+
+   tv->tv_sec = (time_t)ts.tv_sec;
+   tv->tv_usec = ts.tv_nsec / 1000;
+}
+
+u64 timeval_to_ticks(const struct timeval *tv)
+{
+   const struct k_timespec64 ts = {
+      .tv_sec = tv->tv_sec,
+      .tv_nsec = tv->tv_usec * 1000,
+   };
+
+   return timespec_to_ticks(&ts);
+}
+
 void real_time_get_timespec(struct k_timespec64 *tp)
 {
    const u64 t = get_sys_time();
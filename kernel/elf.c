@@ -11,6 +11,7 @@
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/elf_utils.h>
@@ -64,11 +65,13 @@ load_segment_by_copy(fs_handle *elf_h,
 
       if (!is_mapped(pdir, vaddr)) {
 
-         if (!(p = kzmalloc(PAGE_SIZE)))
+         if (!(p = pf_alloc_page()))
             return -ENOMEM;
 
+         bzero(p, PAGE_SIZE);
+
          if ((rc = map_page(pdir, vaddr, KERNEL_VA_TO_PA(p), PAGING_FL_RWUS))) {
-            kfree2(p, PAGE_SIZE);
+            pf_free_page(p);
             return (int)rc;
          }
 
@@ -204,9 +207,10 @@ load_segment_by_mmap(fs_handle *elf_h,
    um.vaddr = phdr->p_vaddr & PAGE_MASK;
    um.len = round_up_at(phdr->p_vaddr + phdr->p_memsz - um.vaddr, PAGE_SIZE);
    um.prot = PROT_READ;
+   um.flags = MAP_PRIVATE;
 
    *end_vaddr_ref = um.vaddr + um.len;
-   return vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER);
+   return vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER | VFS_MM_POPULATE);
 }
 
 struct elf_headers {
@@ -291,16 +295,21 @@ static int
 alloc_and_map_stack_page(pdir_t *pdir, void *stack_top, u32 i)
 {
    int rc;
-   void *p = kzmalloc(PAGE_SIZE);
+   void *p = pf_alloc_page();
 
    if (!p)
       return -ENOMEM;
 
+   bzero(p, PAGE_SIZE);
+
    rc = map_page(pdir,
                  (void *)stack_top + (i << PAGE_SHIFT),
                  KERNEL_VA_TO_PA(p),
                  PAGING_FL_RW | PAGING_FL_US);
 
+   if (rc)
+      pf_free_page(p);
+
    return rc;
 }
 
@@ -0,0 +1,557 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_userlim.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/epoll.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/user.h>
+
+/*
+ * epoll
+ * ---------
+ *
+ * Unlike poll() and select(), which set up a waiter on all the kconds and
+ * re-scan all the fds at every call, an epoll object keeps its interest set
+ * between the calls. Each item has a kcond_watcher on the kconds of its handle:
+ * when one of them is signaled, the watcher pushes the item in the ready list
+ * of the epoll object and wakes up its waiters. Therefore, epoll_wait() checks
+ * only the items in the ready list: its cost is O(ready) instead of O(nfds).
+ *
+ * The level-triggered items still ready after being reported go back in the
+ * ready list, while the edge-triggered ones (EPOLLET) don't, until their kconds
+ * get signaled again. The EPOLLONESHOT items get disabled after the first
+ * report, until they're re-armed with EPOLL_CTL_MOD.
+ *
+ * Locking: the interest sets and the per-handle lists of items (`epitems` in
+ * fs_handle_base) are protected by `epoll_lock`. The ready lists are changed
+ * by the watchers as well, which run with preemption disabled: therefore,
+ * they're protected by disabling the preemption.
+ */
+
+#define EPOLL_PRIVATE_BITS                          (EPOLLONESHOT | EPOLLET)
+
+struct epoll;
+
+struct epoll_item {
+
+   struct bintree_node node;     /* in epoll->items, keyed by `h` */
+   struct list_node ready_node;  /* in epoll->ready_list, when `ready` */
+   struct epoll_item *next;      /* next item watching the same handle */
+   struct epoll *ep;
+   fs_handle h;
+   struct epoll_event ev;
+   bool ready;
+
+   struct kcond_watcher rwatch;
+   struct kcond_watcher wwatch;
+   struct kcond_watcher ewatch;
+};
+
+struct epoll {
+
+   KOBJ_BASE_FIELDS
+
+   struct epoll_item *items;     /* interest set (bintree root) */
+   struct list ready_list;
+   struct kcond ready_cond;      /* signaled when an item gets ready */
+};
+
+static struct kmutex epoll_lock = STATIC_KMUTEX_INIT(epoll_lock, 0);
+static const struct file_ops static_ops_epoll;
+
+static struct epoll *get_epoll_of_handle(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+
+   if (kh->fops != &static_ops_epoll)
+      return NULL;
+
+   return (void *)kh->kobj;
+}
+
+static ALWAYS_INLINE bool epoll_item_is_armed(struct epoll_item *it)
+{
+   return (it->ev.events & ~EPOLL_PRIVATE_BITS) != 0;
+}
+
+/* Called with preemption disabled, by the watchers or directly */
+static void epoll_item_signaled(struct epoll_item *it)
+{
+   struct epoll *ep = it->ep;
+   ASSERT(!is_preemption_enabled());
+
+   if (it->ready || !epoll_item_is_armed(it))
+      return;
+
+   it->ready = true;
+   list_add_tail(&ep->ready_list, &it->ready_node);
+   kcond_signal_all(&ep->ready_cond);
+}
+
+static void epoll_rwatch_cb(struct kcond_watcher *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, rwatch));
+}
+
+static void epoll_wwatch_cb(struct kcond_watcher *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, wwatch));
+}
+
+static void epoll_ewatch_cb(struct kcond_watcher *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, ewatch));
+}
+
+static void epoll_item_enqueue(struct epoll_item *it)
+{
+   disable_preemption();
+   {
+      epoll_item_signaled(it);
+   }
+   enable_preemption();
+}
+
+static void epoll_item_dequeue(struct epoll_item *it)
+{
+   disable_preemption();
+   {
+      if (it->ready) {
+         list_remove(&it->ready_node);
+         it->ready = false;
+      }
+   }
+   enable_preemption();
+}
+
+/* Pop the first item from the ready list of `ep`. Returns NULL if empty. */
+static struct epoll_item *epoll_pop_ready(struct epoll *ep)
+{
+   struct epoll_item *it = NULL;
+
+   disable_preemption();
+   {
+      if (!list_is_empty(&ep->ready_list)) {
+         it = list_first_obj(&ep->ready_list, struct epoll_item, ready_node);
+         list_remove(&it->ready_node);
+         it->ready = false;
+      }
+   }
+   enable_preemption();
+   return it;
+}
+
+static void epoll_item_watch(struct epoll_item *it)
+{
+   struct kcond *c;
+
+   if ((it->ev.events & EPOLLIN) && (c = vfs_get_rready_cond(it->h)))
+      kcond_add_watcher(c, &it->rwatch);
+
+   if ((it->ev.events & EPOLLOUT) && (c = vfs_get_wready_cond(it->h)))
+      kcond_add_watcher(c, &it->wwatch);
+
+   if ((c = vfs_get_except_cond(it->h)))
+      kcond_add_watcher(c, &it->ewatch);
+}
+
+static void epoll_item_unwatch(struct epoll_item *it)
+{
+   /* Note: removing a watcher not added to any kcond is harmless */
+   kcond_remove_watcher(&it->rwatch);
+   kcond_remove_watcher(&it->wwatch);
+   kcond_remove_watcher(&it->ewatch);
+}
+
+static void epoll_item_arm(struct epoll_item *it, struct epoll_event *ev)
+{
+   /* Like poll(), always listen for errors and treat IN/OUT events alike */
+   u32 events = ev->events | EPOLLERR | EPOLLHUP;
+
+   if (events & (EPOLLRDNORM | EPOLLRDBAND | EPOLLPRI))
+      events |= EPOLLIN;
+
+   if (events & (EPOLLWRNORM | EPOLLWRBAND))
+      events |= EPOLLOUT;
+
+   epoll_item_unwatch(it);
+
+   disable_preemption();
+   {
+      it->ev.events = events;
+      it->ev.data = ev->data;
+   }
+   enable_preemption();
+
+   epoll_item_watch(it);
+
+   /* Let the next epoll_wait() check the current state of the handle */
+   epoll_item_enqueue(it);
+}
+
+static int
+epoll_add_item(struct epoll *ep, fs_handle h, struct epoll_event *ev)
+{
+   struct fs_handle_base *hb = h;
+   struct epoll_item *it;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   if (!(it = kzalloc_obj(struct epoll_item)))
+      return -ENOMEM;
+
+   bintree_node_init(&it->node);
+   list_node_init(&it->ready_node);
+   list_node_init(&it->rwatch.node);
+   list_node_init(&it->wwatch.node);
+   list_node_init(&it->ewatch.node);
+   it->rwatch.cb = &epoll_rwatch_cb;
+   it->wwatch.cb = &epoll_wwatch_cb;
+   it->ewatch.cb = &epoll_ewatch_cb;
+   it->ep = ep;
+   it->h = h;
+
+   bintree_insert_ptr(&ep->items, it, struct epoll_item, node, h);
+   it->next = hb->epitems;
+   hb->epitems = it;
+
+   epoll_item_arm(it, ev);
+   return 0;
+}
+
+static void epoll_remove_item(struct epoll *ep, struct epoll_item *it)
+{
+   struct fs_handle_base *hb = it->h;
+   struct epoll_item **pos;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_lock));
+
+   epoll_item_unwatch(it);
+   epoll_item_dequeue(it);
+   bintree_remove_ptr(&ep->items, it->h, struct epoll_item, node, h);
+
+   for (pos = &hb->epitems; *pos != it; pos = &(*pos)->next)
+      ASSERT(*pos != NULL);
+
+   *pos = it->next;
+   kfree_obj(it, struct epoll_item);
+}
+
+void epoll_on_handle_close(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+
+   kmutex_lock(&epoll_lock);
+   {
+      while (hb->epitems)
+         epoll_remove_item(hb->epitems->ep, hb->epitems);
+   }
+   kmutex_unlock(&epoll_lock);
+}
+
+/* Returns the events of `it` which are ready now */
+static u32 epoll_item_get_events(struct epoll_item *it)
+{
+   const u32 events = it->ev.events;
+   u32 revents = 0;
+   int rc;
+
+   if ((events & EPOLLIN) && vfs_read_ready(it->h))
+      revents |= EPOLLIN;
+
+   if ((events & EPOLLOUT) && vfs_write_ready(it->h))
+      revents |= EPOLLOUT;
+
+   if ((rc = vfs_except_ready(it->h)))
+      revents |= rc > 0 ? (u32)rc : EPOLLERR;
+
+   return revents;
+}
+
+/*
+ * Check the items in the ready list of `ep` and store up to `max` events in
+ * `evs`. Returns the number of events stored.
+ */
+static int epoll_collect(struct epoll *ep, struct epoll_event *evs, int max)
+{
+   struct epoll_item *it, *temp;
+   struct list requeue;
+   u32 revents;
+   int n = 0;
+
+   list_init(&requeue);
+   kmutex_lock(&epoll_lock);
+
+   while (n < max && (it = epoll_pop_ready(ep))) {
+
+      if (!(revents = epoll_item_get_events(it)))
+         continue; /* Not ready anymore or just a spurious signal */
+
+      evs[n++] = (struct epoll_event) {
+         .events = revents,
+         .data = it->ev.data,
+      };
+
+      disable_preemption();
+      {
+         if (it->ev.events & EPOLLONESHOT) {
+
+            /* Disabled until EPOLL_CTL_MOD */
+            it->ev.events &= EPOLL_PRIVATE_BITS;
+
+         } else if (!(it->ev.events & EPOLLET) && !it->ready) {
+
+            /*
+             * Level-triggered: check it again on the next call. Meanwhile,
+             * keep it in a separate list to avoid reporting it twice here.
+             */
+            it->ready = true;
+            list_add_tail(&requeue, &it->ready_node);
+         }
+      }
+      enable_preemption();
+   }
+
+   disable_preemption();
+   {
+      list_for_each(it, temp, &requeue, ready_node) {
+         list_remove(&it->ready_node);
+         list_add_tail(&ep->ready_list, &it->ready_node);
+      }
+   }
+   enable_preemption();
+
+   kmutex_unlock(&epoll_lock);
+   return n;
+}
+
+static int
+epoll_wait_int(struct epoll *ep, struct epoll_event *evs, int max, int timeout)
+{
+   struct task *curr = get_curr_task();
+   u64 deadline = 0, now = 0;
+   int n;
+
+   /*
+    * Use a deadline instead of a plain timer because kcond_signal_*() cancel
+    * the wakeup timer of the task they wake up.
+    */
+   if (timeout > 0)
+      deadline = get_ticks() + MAX((u32)timeout / (1000 / TIMER_HZ), 1u);
+
+   while (!(n = epoll_collect(ep, evs, max)) && timeout) {
+
+      if (timeout > 0 && (now = get_ticks()) >= deadline)
+         break;
+
+      disable_preemption();
+
+      if (!list_is_empty(&ep->ready_list)) {
+         /* An item got ready after epoll_collect() */
+         enable_preemption();
+         continue;
+      }
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &ep->ready_cond,
+                         NO_EXTRA,
+                         &ep->ready_cond.wait_list);
+
+      if (timeout > 0)
+         task_set_wakeup_timer(curr, (u32)(deadline - now));
+
+      enter_sleep_wait_state();
+
+      /* ------------------- We've been woken up ------------------- */
+
+      wait_obj_reset(&curr->wobj);
+
+      if (timeout > 0)
+         task_cancel_wakeup_timer(curr);
+
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   return n;
+}
+
+static int epoll_read_ready(fs_handle h)
+{
+   struct epoll *ep = get_epoll_of_handle(h);
+   bool ret;
+
+   /* Note: the items in the ready list might turn out to be not ready */
+   disable_preemption();
+   {
+      ret = !list_is_empty(&ep->ready_list);
+   }
+   enable_preemption();
+   return ret;
+}
+
+static struct kcond *epoll_get_rready_cond(fs_handle h)
+{
+   struct epoll *ep = get_epoll_of_handle(h);
+   return &ep->ready_cond;
+}
+
+static const struct file_ops static_ops_epoll =
+{
+   .read_ready = epoll_read_ready,
+   .get_rready_cond = epoll_get_rready_cond,
+};
+
+static void destroy_epoll(struct epoll *ep)
+{
+   kmutex_lock(&epoll_lock);
+   {
+      while (ep->items)
+         epoll_remove_item(ep, ep->items);
+   }
+   kmutex_unlock(&epoll_lock);
+
+   kcond_destory(&ep->ready_cond);
+   kfree_obj(ep, struct epoll);
+}
+
+fs_handle create_epoll_handle(void)
+{
+   struct epoll *ep;
+   fs_handle h;
+
+   if (!(ep = (void *)kzalloc_obj(struct epoll)))
+      return NULL;
+
+   ep->destory_obj = (void *)&destroy_epoll;
+   list_init(&ep->ready_list);
+   kcond_init(&ep->ready_cond);
+
+   if (!(h = kfs_create_new_handle(&static_ops_epoll, (void *)ep, O_RDWR))) {
+      destroy_epoll(ep);
+      return NULL;
+   }
+
+   return h;
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct epoll_event *u_event)
+{
+   struct epoll_item *it;
+   struct epoll_event ev;
+   struct epoll *ep;
+   fs_handle eh, h;
+   int rc = 0;
+
+   if (!(eh = get_fs_handle(epfd)) || !(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!vfs_get_rready_cond(h) &&
+       !vfs_get_wready_cond(h) &&
+       !vfs_get_except_cond(h))
+   {
+      /* Like on Linux, regular files and directories cannot be watched */
+      return -EPERM;
+   }
+
+   if (!(ep = get_epoll_of_handle(eh)))
+      return -EINVAL;
+
+   if (get_epoll_of_handle(h))
+      return -EINVAL; /* Nested epoll objects are not supported */
+
+   if (op != EPOLL_CTL_DEL)
+      if (copy_from_user(&ev, u_event, sizeof(ev)))
+         return -EFAULT;
+
+   kmutex_lock(&epoll_lock);
+
+   it = bintree_find_ptr(ep->items, h, struct epoll_item, node, h);
+
+   switch (op) {
+
+      case EPOLL_CTL_ADD:
+         rc = !it ? epoll_add_item(ep, h, &ev) : -EEXIST;
+         break;
+
+      case EPOLL_CTL_MOD:
+         if (it)
+            epoll_item_arm(it, &ev);
+         else
+            rc = -ENOENT;
+         break;
+
+      case EPOLL_CTL_DEL:
+         if (it)
+            epoll_remove_item(ep, it);
+         else
+            rc = -ENOENT;
+         break;
+
+      default:
+         rc = -EINVAL;
+   }
+
+   kmutex_unlock(&epoll_lock);
+   return rc;
+}
+
+int sys_epoll_wait(int epfd,
+                   struct epoll_event *u_events,
+                   int maxevents,
+                   int timeout)
+{
+   struct task *curr = get_curr_task();
+   struct epoll_event *evs = curr->args_copybuf;
+   struct epoll *ep;
+   fs_handle eh;
+   int rc;
+
+   if (!(eh = get_fs_handle(epfd)))
+      return -EBADF;
+
+   if (!(ep = get_epoll_of_handle(eh)) || maxevents <= 0)
+      return -EINVAL;
+
+   /* Return at most as many events as they fit in `args_copybuf` */
+   maxevents = MIN(maxevents, (int)(ARGS_COPYBUF_SIZE / sizeof(*evs)));
+
+   if ((rc = epoll_wait_int(ep, evs, maxevents, timeout)) <= 0)
+      return rc;
+
+   if (copy_to_user(u_events, evs, sizeof(*evs) * (size_t)rc))
+      return -EFAULT;
+
+   return rc;
+}
+
+int sys_epoll_pwait(int epfd,
+                    struct epoll_event *u_events,
+                    int maxevents,
+                    int timeout,
+                    const sigset_t *u_sigmask,
+                    size_t sigsetsize)
+{
+   int rc;
+
+   if (!u_sigmask)
+      return sys_epoll_wait(epfd, u_events, maxevents, timeout);
+
+   if ((rc = set_temp_sigmask(u_sigmask, sigsetsize)))
+      return rc;
+
+   rc = sys_epoll_wait(epfd, u_events, maxevents, timeout);
+   restore_temp_sigmask(rc == -EINTR);
+   return rc;
+}
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/eventfd.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sys_types.h>
+
+/*
+ * eventfd
+ * ---------
+ *
+ * Just a 64-bit counter: write() adds to it, while read() returns its value
+ * and resets it, or decrements it by 1, in semaphore mode (EFD_SEMAPHORE).
+ * read() blocks while the counter is 0 and write() blocks when the counter
+ * would exceed EVENTFD_MAX. Both the conditions have a kcond, so eventfds can
+ * be used with poll(), select() and epoll.
+ */
+
+#define EVENTFD_MAX                              (0xfffffffffffffffeull)
+
+struct eventfd {
+
+   KOBJ_BASE_FIELDS
+
+   struct kmutex mutex;
+   struct kcond not_zero_cond;      /* signaled when `count` becomes > 0 */
+   struct kcond not_max_cond;       /* signaled when `count` gets decremented */
+   u64 count;
+   bool semaphore;
+};
+
+static ssize_t efd_read(fs_handle h, char *buf, size_t size)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   ssize_t rc = sizeof(u64);
+   u64 val;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   kmutex_lock(&e->mutex);
+
+   while (!e->count) {
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&e->not_zero_cond, &e->mutex, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   val = e->semaphore ? 1 : e->count;
+   e->count -= val;
+   memcpy(buf, &val, sizeof(val));
+   kcond_signal_all(&e->not_max_cond);
+
+out:
+   kmutex_unlock(&e->mutex);
+   return rc;
+}
+
+static ssize_t efd_write(fs_handle h, char *buf, size_t size)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   ssize_t rc = sizeof(u64);
+   u64 val;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   memcpy(&val, buf, sizeof(val));
+
+   if (val > EVENTFD_MAX)
+      return -EINVAL;
+
+   kmutex_lock(&e->mutex);
+
+   while (e->count > EVENTFD_MAX - val) {
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      kcond_wait(&e->not_max_cond, &e->mutex, KCOND_WAIT_FOREVER);
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   e->count += val;
+
+   if (e->count)
+      kcond_signal_all(&e->not_zero_cond);
+
+out:
+   kmutex_unlock(&e->mutex);
+   return rc;
+}
+
+static int efd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   bool ret;
+
+   kmutex_lock(&e->mutex);
+   {
+      ret = e->count > 0;
+   }
+   kmutex_unlock(&e->mutex);
+   return ret;
+}
+
+static int efd_write_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   bool ret;
+
+   kmutex_lock(&e->mutex);
+   {
+      ret = e->count < EVENTFD_MAX;
+   }
+   kmutex_unlock(&e->mutex);
+   return ret;
+}
+
+static struct kcond *efd_get_rready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   return &e->not_zero_cond;
+}
+
+static struct kcond *efd_get_wready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+   return &e->not_max_cond;
+}
+
+static const struct file_ops static_ops_eventfd =
+{
+   .read = efd_read,
+   .write = efd_write,
+   .read_ready = efd_read_ready,
+   .write_ready = efd_write_ready,
+   .get_rready_cond = efd_get_rready_cond,
+   .get_wready_cond = efd_get_wready_cond,
+};
+
+int eventfd_signal(fs_handle h, u64 n)
+{
+   struct kfs_handle *kh = h;
+   struct eventfd *e = (void *)kh->kobj;
+
+   if (kh->fops != &static_ops_eventfd)
+      return -EINVAL;
+
+   kmutex_lock(&e->mutex);
+   {
+      if (n && e->count <= EVENTFD_MAX - n) {
+         e->count += n;
+         kcond_signal_all(&e->not_zero_cond);
+      }
+   }
+   kmutex_unlock(&e->mutex);
+   return 0;
+}
+
+static void destroy_eventfd(struct eventfd *e)
+{
+   kcond_destory(&e->not_max_cond);
+   kcond_destory(&e->not_zero_cond);
+   kmutex_destroy(&e->mutex);
+   kfree_obj(e, struct eventfd);
+}
+
+fs_handle create_eventfd_handle(u32 initval, int flags)
+{
+   struct eventfd *e;
+   fs_handle h;
+
+   if (!(e = (void *)kzalloc_obj(struct eventfd)))
+      return NULL;
+
+   e->destory_obj = (void *)&destroy_eventfd;
+   e->count = initval;
+   e->semaphore = !!(flags & EFD_SEMAPHORE);
+   kmutex_init(&e->mutex, 0);
+   kcond_init(&e->not_zero_cond);
+   kcond_init(&e->not_max_cond);
+
+   h = kfs_create_new_handle(&static_ops_eventfd,
+                             (void *)e,
+                             O_RDWR | (flags & O_NONBLOCK));
+
+   if (!h) {
+      destroy_eventfd(e);
+      return NULL;
+   }
+
+   return h;
+}
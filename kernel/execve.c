@@ -11,6 +11,8 @@
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/interrupts.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/fs/flock.h>
 
 static const char *const default_env[] =
 {
@@ -342,6 +344,20 @@ do_execve_int(struct execve_ctx *ctx, const char *path, const char *const *argv)
       return rc;
    }
 
+   if (ctx->curr_user_task && process_is_multithreaded(get_curr_proc())) {
+
+      /* Point of no return for the other threads, as on Linux */
+      if ((rc = terminate_other_threads())) {
+
+         pdir_destroy(pinfo.pdir);
+
+         if (pinfo.lf)
+            release_subsys_flock(pinfo.lf);
+
+         return rc;
+      }
+   }
+
    disable_preemption();
    {
       rc = setup_process(&pinfo,
@@ -357,6 +373,7 @@ do_execve_int(struct execve_ctx *ctx, const char *path, const char *const *argv)
       return rc;                 /* setup_process() failed */
 
    /* From now on, we cannot fail */
+   ti->clear_child_tid = NULL;    /* it points into the old address space */
    close_cloexec_handles(ti->pi);
    disable_preemption();
    {
@@ -403,6 +420,14 @@ int sys_execve(const char *user_filename,
    struct task *curr = get_curr_task();
    ASSERT(curr != NULL);
 
+   /*
+    * On Linux, the thread calling execve() takes the PID of the process. That
+    * cannot work here because the struct process is allocated together with
+    * the main thread: only the main thread can call execve().
+    */
+   if (!is_main_thread(curr))
+      return -EINVAL;
+
    if ((rc = execve_get_path(user_filename, &path)))
       return rc;
 
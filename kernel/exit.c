@@ -13,9 +13,13 @@
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/futex.h>
+#include <tilck/kernel/user.h>
 
 #include <tilck/mods/tracing.h>
 
+#include <sys/wait.h>         // system header
+
 static void
 task_free_all_kernel_allocs(struct task *ti)
 {
@@ -173,6 +177,75 @@ call_on_task_exit_callbacks(void)
    }
 }
 
+/*
+ * CLONE_CHILD_CLEARTID and set_tid_address(): reset the TID at the address
+ * given by the user and wake up one waiter on it. That's how pthread_join()
+ * waits for a thread to exit.
+ */
+static void
+clear_child_tid(struct task *ti)
+{
+   int zero = 0;
+
+   ASSERT(is_preemption_enabled());
+
+   if (!ti->clear_child_tid)
+      return;
+
+   if (!copy_to_user(ti->clear_child_tid, &zero, sizeof(zero)))
+      futex_wake_addr((u32 *)ti->clear_child_tid, 1);
+
+   ti->clear_child_tid = NULL;
+}
+
+static struct task *
+get_other_thread(struct task *ti)
+{
+   struct task *pos;
+
+   list_for_each_ro(pos, &ti->pi->threads, threads_node) {
+      if (pos != ti)
+         return pos;
+   }
+
+   return NULL;
+}
+
+static void
+kill_other_threads(struct task *ti)
+{
+   struct task *pos;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(pos, &ti->pi->threads, threads_node) {
+      if (pos != ti)
+         send_signal2(ti->pi->pid, pos->tid, SIGKILL, false);
+   }
+}
+
+/*
+ * Called by the main thread: the struct process is allocated together with
+ * its struct task (see get_process_task()), therefore the main thread cannot
+ * go away before all the other threads did.
+ */
+static void
+wait_for_other_threads(struct task *ti)
+{
+   struct task *other;
+   ASSERT(!is_preemption_enabled());
+
+   while ((other = get_other_thread(ti))) {
+
+      prepare_to_wait_on(WOBJ_TASK,
+                         TO_PTR(other->tid),
+                         NO_EXTRA,
+                         &other->tasks_waiting_list);
+
+      enter_sleep_wait_state();
+      disable_preemption();
+   }
+}
+
 /*
  * Note: we HAVE TO make this function NO_INLINE otherwise clang in release
  * builds generates code that is incompatible with asm hacks changing both
@@ -193,6 +266,18 @@ switch_stack_free_mem_and_schedule(void)
    /* Free the heap allocations used, including the kernel stack */
    free_mem_for_zombie_task(get_curr_task());
 
+   if (!is_main_thread(get_curr_task())) {
+
+      /* Nobody waits for non-main threads: free the task right now */
+      remove_task(get_curr_task());
+
+      disable_interrupts_forced();
+      {
+         set_curr_task(kernel_process);
+      }
+      enable_interrupts_forced();
+   }
+
    /* Run the scheduler */
    schedule();
 
@@ -201,17 +286,35 @@ switch_stack_free_mem_and_schedule(void)
 }
 
 
+NORETURN static void
+exit_non_main_thread(struct task *ti, int exit_code, int term_sig)
+{
+   ASSERT(!is_preemption_enabled());
+
+   list_remove(&ti->threads_node);
+   ti->pi->exited_threads_ticks.total += ti->ticks.total;
+   ti->pi->exited_threads_ticks.total_kernel += ti->ticks.total_kernel;
+   task_change_state(ti, TASK_STATE_ZOMBIE);
+   ti->wstatus = EXITCODE(exit_code, term_sig);
+
+   call_on_task_exit_callbacks();
+   task_free_all_kernel_allocs(ti);
+
+   /* Wake-up the main thread, in case it's waiting for us to exit */
+   wake_up_tasks_waiting_on(ti, task_died);
+   switch_stack_free_mem_and_schedule();
+}
+
 /*
- * NOTE: this code ASSUMES that user processes have a _single_ thread:
- *
- *    process = task = thread
- *
- * TODO: re-design this function when thread support is introduced.
+ * Exit path of the current task. For non-main threads, that's just about
+ * freeing the task. The main thread, instead, first waits for all the other
+ * threads to exit and then terminates the whole process.
  *
  * NOTE: the kernel "process" has multiple threads (kthreads), but they cannot
  * be signalled nor killed.
  */
-void terminate_process(int exit_code, int term_sig)
+NORETURN static void
+do_exit(int exit_code, int term_sig)
 {
    struct task *const ti = get_curr_task();
    struct process *const pi = ti->pi;
@@ -225,6 +328,7 @@ void terminate_process(int exit_code, int term_sig)
    if (term_sig)
       trace_task_killed(term_sig);
 
+   clear_child_tid(ti);
    disable_preemption();
 
    if (ti->wobj.type != WOBJ_NONE) {
@@ -250,11 +354,23 @@ void terminate_process(int exit_code, int term_sig)
    drop_all_pending_signals(ti);
    ti->nested_sig_handlers = -1;
 
+   if (!is_main_thread(ti))
+      exit_non_main_thread(ti, exit_code, term_sig);
+
+   wait_for_other_threads(ti);
+
+   if (pi->group_exiting) {
+      exit_code = WEXITSTATUS(pi->group_wstatus);
+      term_sig = WTERMSIG(pi->group_wstatus);
+   }
+
    /*
-    * Close all the handles, keeping the preemption enabled while doing so.
+    * Disarm the alarm and close all the handles, keeping the preemption
+    * enabled while doing so.
     */
    enable_preemption();
    {
+      ktimer_set(&pi->alarm_timer, 0, 0);
       close_all_handles();
    }
    disable_preemption();
@@ -337,3 +453,59 @@ void terminate_process(int exit_code, int term_sig)
 
    switch_stack_free_mem_and_schedule();
 }
+
+/*
+ * exit_group() or a fatal signal: kill all the threads of the current process.
+ * The exit code of the whole process is the one of the first thread getting
+ * here, as on Linux.
+ */
+void terminate_process(int exit_code, int term_sig)
+{
+   struct task *const ti = get_curr_task();
+   struct process *const pi = ti->pi;
+
+   disable_preemption();
+   {
+      if (!pi->group_exiting) {
+         pi->group_exiting = true;
+         pi->group_wstatus = EXITCODE(exit_code, term_sig);
+         kill_other_threads(ti);
+      }
+   }
+   enable_preemption();
+   do_exit(exit_code, term_sig);
+}
+
+/* exit(): terminate only the current thread */
+void terminate_thread(int exit_code)
+{
+   do_exit(exit_code, 0);
+}
+
+/*
+ * execve() from a multi-threaded process: kill all the other threads and wait
+ * for them to exit. Setting `group_exiting` prevents the killed threads from
+ * killing the current one in terminate_process().
+ */
+int terminate_other_threads(void)
+{
+   struct task *const ti = get_curr_task();
+   struct process *const pi = ti->pi;
+   int rc = 0;
+
+   ASSERT(is_main_thread(ti));
+
+   disable_preemption();
+   {
+      if (!pi->group_exiting) {
+         pi->group_exiting = true;
+         kill_other_threads(ti);
+         wait_for_other_threads(ti);
+         pi->group_exiting = false;
+      } else {
+         rc = -EINTR;   /* we're getting killed by a group exit */
+      }
+   }
+   enable_preemption();
+   return rc;
+}
@@ -9,6 +9,31 @@
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/user.h>
+
+#include <linux/sched.h>      // system header
+
+/*
+ * Threads share the whole struct process with their creator: they must share
+ * everything that's stored there. Without CLONE_THREAD, only the fork() and
+ * the vfork() cases are supported.
+ */
+#define CLONE_THREAD_FLAGS                                                 \
+   (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD)
+
+#define CLONE_SUPPORTED_FLAGS                                              \
+   (CLONE_THREAD_FLAGS | CLONE_VFORK | CLONE_SETTLS | CLONE_SYSVSEM |      \
+    CLONE_PARENT_SETTID | CLONE_CHILD_SETTID | CLONE_CHILD_CLEARTID |      \
+    CLONE_DETACHED | CSIGNAL)
+
+struct clone_ctx {
+   ulong flags;
+   void *newsp;
+   int *parent_tid;
+   void *tls;
+   int *child_tid;
+};
 
 static int fork_dup_all_handles(struct process *pi)
 {
@@ -56,9 +81,10 @@ static int fork_dup_all_handles(struct process *pi)
 }
 
 // Returns child's pid
-int do_fork(bool vfork)
+static int do_fork_int(bool vfork, const struct clone_ctx *ctx)
 {
-   int pid;
+   int pid, saved_tid_val;
+   bool restore_tid_val = false;
    int rc = -EAGAIN;
    struct task *child = NULL;
    struct task *curr = get_curr_task();
@@ -78,6 +104,18 @@ int do_fork(bool vfork)
 
    } else {
 
+      if (ctx->flags & CLONE_CHILD_SETTID) {
+
+         /*
+          * The child must find its TID at `child_tid`, in its own copy of the
+          * address space. Write it before cloning the pdir and then restore
+          * the parent's value: after the CoW, the two copies will diverge.
+          */
+         if (!copy_from_user(&saved_tid_val, ctx->child_tid, sizeof(int)))
+            if (!copy_to_user(ctx->child_tid, &pid, sizeof(int)))
+               restore_tid_val = true;
+      }
+
       if (FORK_NO_COW)
          new_pdir = pdir_deep_clone(curr_pi->pdir);
       else
@@ -107,14 +145,26 @@ int do_fork(bool vfork)
    // Make the parent to get child's pid as return value.
    set_return_register(curr->state_regs, (ulong) child->tid);
 
+   if (ctx->newsp)
+      VERIFY(arch_specific_clone_setup(child, ctx->newsp, NULL) == 0);
+
+   if (ctx->flags & CLONE_CHILD_CLEARTID)
+      child->clear_child_tid = ctx->child_tid;
+
    if (fork_dup_all_handles(child->pi) < 0)
       goto oom_case;
 
+   if (ctx->flags & CLONE_PARENT_SETTID)
+      copy_to_user(ctx->parent_tid, &pid, sizeof(int));
+
+   if (vfork && (ctx->flags & CLONE_CHILD_SETTID))
+      copy_to_user(ctx->child_tid, &pid, sizeof(int));   /* shared memory */
+
    add_task(child);
 
    if (vfork) {
 
-      curr->stopped = true;
+      task_set_stopped(curr, true);
       curr->vfork_stopped = true;
 
    } else {
@@ -127,6 +177,10 @@ int do_fork(bool vfork)
        */
 
       set_curr_pdir(curr_pi->pdir);
+
+      /* Now that the TLB has been flushed, this write will trigger a CoW */
+      if (restore_tid_val)
+         copy_to_user(ctx->child_tid, &saved_tid_val, sizeof(int));
    }
 
    enable_preemption();
@@ -160,6 +214,9 @@ oom_case:
    if (new_pdir)
       pdir_destroy(new_pdir);
 
+   if (restore_tid_val)
+      copy_to_user(ctx->child_tid, &saved_tid_val, sizeof(int));
+
    if (child) {
       child->state = TASK_STATE_ZOMBIE;
       free_common_task_allocs(child);
@@ -170,3 +227,117 @@ out:
    enable_preemption();
    return rc;
 }
+
+int do_fork(bool vfork)
+{
+   const struct clone_ctx ctx = {0};
+   return do_fork_int(vfork, &ctx);
+}
+
+/* Returns the TID of the new thread */
+static int do_clone_thread(const struct clone_ctx *ctx)
+{
+   int tid, rc;
+   struct task *ti = NULL;
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   void *tls = (ctx->flags & CLONE_SETTLS) ? ctx->tls : NULL;
+
+   disable_preemption();
+   ASSERT_TASK_STATE(curr->state, TASK_STATE_RUNNING);
+
+   if (pi->group_exiting || pending_signals()) {
+      /* Don't race with exit_group() or with a fatal signal */
+      rc = -EINTR;
+      goto out;
+   }
+
+   if ((tid = create_new_pid()) < 0) {
+      rc = -EAGAIN;
+      goto out;
+   }
+
+   if (!(ti = allocate_new_thread(pi, tid, true))) {
+      rc = -ENOMEM;
+      goto out;
+   }
+
+   ti->state = TASK_STATE_RUNNABLE;
+   ti->running_in_kernel = false;
+   ti->nice = curr->nice;
+   memcpy(ti->sa_mask, curr->sa_mask, sizeof(ti->sa_mask));
+   task_info_reset_kernel_stack(ti);
+
+   ti->state_regs--; // make room for a regs_t struct in the thread's stack
+   *ti->state_regs = *curr->state_regs;
+   set_return_register(ti->state_regs, 0);
+
+   if ((rc = arch_specific_clone_setup(ti, ctx->newsp, tls)) < 0)
+      goto err;
+
+   if (ctx->flags & CLONE_CHILD_CLEARTID)
+      ti->clear_child_tid = ctx->child_tid;
+
+   if (ctx->flags & CLONE_PARENT_SETTID)
+      copy_to_user(ctx->parent_tid, &tid, sizeof(int));
+
+   if (ctx->flags & CLONE_CHILD_SETTID)
+      copy_to_user(ctx->child_tid, &tid, sizeof(int));
+
+   list_add_tail(&pi->threads, &ti->threads_node);
+   add_task(ti);
+   enable_preemption();
+   return tid;
+
+err:
+   ti->state = TASK_STATE_ZOMBIE;
+   free_common_task_allocs(ti);
+   free_task(ti);
+
+out:
+   enable_preemption();
+   return rc;
+}
+
+int do_clone(ulong flags,
+             void *newsp,
+             int *parent_tid,
+             void *tls,
+             int *child_tid)
+{
+   const struct clone_ctx ctx = {
+      .flags = flags,
+      .newsp = newsp,
+      .parent_tid = parent_tid,
+      .tls = tls,
+      .child_tid = child_tid,
+   };
+
+   /*
+    * The exit signal (CSIGNAL) is ignored: the parent always gets SIGCHLD.
+    * CLONE_SYSVSEM and CLONE_DETACHED are ignored as well, like on Linux.
+    */
+
+   if (flags & ~CLONE_SUPPORTED_FLAGS)
+      return -EINVAL;
+
+   if (flags & CLONE_THREAD) {
+
+      if ((flags & CLONE_THREAD_FLAGS) != CLONE_THREAD_FLAGS)
+         return -EINVAL;
+
+      if (flags & CLONE_VFORK)
+         return -EINVAL;
+
+      return do_clone_thread(&ctx);
+   }
+
+   if (flags & (CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_SETTLS))
+      return -EINVAL;
+
+   /* A new process can share the address space with us only after vfork() */
+   if (!!(flags & CLONE_VM) != !!(flags & CLONE_VFORK))
+      return -EINVAL;
+
+   return do_fork_int(!!(flags & CLONE_VFORK), &ctx);
+}
@@ -144,6 +144,7 @@ create_dev_file(const char *filename, u16 major, u16 minor, void **devfile)
    }
 
    list_add_tail(&d->root_dir.files_list, &f->dir_node);
+   vfs_dcache_invalidate(fs);
 
    if (devfile)
       *devfile = f;
@@ -2,6 +2,8 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/fatz.h>
 
 #include <tilck/kernel/fs/fat32.h>
 #include <tilck/kernel/fs/vfs.h>
@@ -9,41 +11,81 @@
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/datetime.h>
 #include <tilck/kernel/user.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
 
 #include <dirent.h> // system header
 
 int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags);
 int fat_munmap(struct user_mapping *um, void *vaddrp, size_t len);
+bool fat_handle_fault(struct user_mapping *um, void *vaddrp, bool p, bool rw);
 int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size);
 
+static ALWAYS_INLINE int
+fat_copy_out(char *buf, const char *src, size_t len, bool user)
+{
+   if (!user) {
+      memcpy(buf, src, len);
+      return 0;
+   }
+
+   return copy_to_user(buf, src, len) ? -EFAULT : 0;
+}
+
 /*
- * Special fat_walk() wrapper handling the special case where `e` is NOT a dir
- * entry but a pointer to the entries in the root directory.
+ * Copy `len` bytes from the offset `off` of the cluster `clu` to `buf`, which
+ * is in user space when `user` is true. Returns 0 or a negative errno value.
  */
-
-static inline int
-fat_fs_walk_generic(struct fat_fs_device_data *d,
-                    struct fat_walk_static_params *static_walk_params,
-                    struct fat_entry *e)
+static int
+fat_copy_from_cluster(struct fat_fs_device_data *d,
+                      u32 clu,
+                      size_t off,
+                      char *buf,
+                      size_t len,
+                      bool user)
 {
-   return fat_walk(static_walk_params,
-                   e == d->root_dir_entries
-                     ? d->root_cluster
-                     : fat_get_first_cluster(e));
+   char *data;
+   int rc;
+
+   if (!d->zcache) {
+      data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+      return fat_copy_out(buf, data + off, len, user);
+   }
+
+   /* Compressed ramdisk: the cluster must stay in the cache while copying */
+   disable_preemption();
+   {
+      if (!(rc = fat_zcache_get(d, clu, &data))) {
+         rc = fat_copy_out(buf, data + off, len, user);
+         fat_zcache_put(d, clu);
+      }
+   }
+   enable_preemption();
+   return rc;
 }
 
-STATIC ssize_t
-fat_read(fs_handle handle, char *buf, size_t bufsize)
+/*
+ * Read from the file offset `off`, which is inside the cluster `*clu`. On
+ * return, `*clu` is the cluster containing the final offset, unless that
+ * offset is the end of the file, aligned at cluster boundary. When `user` is
+ * true, `buf` is in user space and the data is copied there directly. In case
+ * of error (e.g. a fault), the function returns the number of bytes copied so
+ * far or the error.
+ */
+static offt
+fat_read_at(struct fatfs_handle *h,
+            u32 *clu,
+            offt off,
+            char *buf,
+            size_t sz,
+            bool user)
 {
-   struct fatfs_handle *h = (struct fatfs_handle *) handle;
    struct fat_fs_device_data *d = h->fs->device_data;
    offt fsize = (offt)h->e->DIR_FileSize;
    offt written_to_buf = 0;
+   int rc;
 
-   if (h->e->directory)
-      return -EISDIR;
-
-   if (h->pos >= fsize) {
+   if (off >= fsize) {
 
       /*
        * The cursor is at the end or past the end: nothing to read.
@@ -54,19 +96,25 @@ fat_read(fs_handle handle, char *buf, size_t bufsize)
 
    do {
 
-      char *data = fat_get_pointer_to_cluster_data(d->hdr, h->curr_cluster);
-
-      const offt file_rem       = fsize - h->pos;
-      const offt buf_rem        = (offt)bufsize - written_to_buf;
-      const offt cluster_off    = h->pos % (offt)d->cluster_size;
+      const offt file_rem       = fsize - off;
+      const offt buf_rem        = (offt)sz - written_to_buf;
+      const offt cluster_off    = off % (offt)d->cluster_size;
       const offt cluster_rem    = (offt)d->cluster_size - cluster_off;
       const offt to_read        = MIN3(cluster_rem, buf_rem, file_rem);
 
       ASSERT(to_read >= 0);
 
-      memcpy(buf + written_to_buf, data + cluster_off, (size_t)to_read);
+      rc = fat_copy_from_cluster(d,
+                                 *clu,
+                                 (size_t)cluster_off,
+                                 buf + written_to_buf,
+                                 (size_t)to_read,
+                                 user);
+      if (rc)
+         return written_to_buf ? written_to_buf : rc;
+
       written_to_buf += to_read;
-      h->pos += to_read;
+      off += to_read;
 
       if (to_read < cluster_rem) {
 
@@ -79,83 +127,88 @@ fat_read(fs_handle handle, char *buf, size_t bufsize)
       }
 
       // find the next cluster
-      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, h->curr_cluster);
+      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, *clu);
 
       if (fat_is_end_of_clusterchain(d->type, fatval)) {
-         ASSERT(h->pos == fsize);
+         ASSERT(off == fsize);
          break;
       }
 
       // we do not expect BAD CLUSTERS
       ASSERT(!fat_is_bad_cluster(d->type, fatval));
 
-      h->curr_cluster = fatval; // go reading the new cluster in the chain.
+      *clu = fatval; // go reading the new cluster in the chain.
 
    } while (true);
 
-   return (ssize_t)written_to_buf;
+   return written_to_buf;
 }
 
-
-STATIC int
-fat_rewind(fs_handle handle)
+STATIC ssize_t
+fat_read(fs_handle handle, char *buf, size_t bufsize)
 {
    struct fatfs_handle *h = (struct fatfs_handle *) handle;
-   h->pos = 0;
-   h->curr_cluster = fat_get_first_cluster(h->e);
-   return 0;
+   offt rc;
+
+   if (h->e->directory)
+      return -EISDIR;
+
+   rc = fat_read_at(h, &h->curr_cluster, h->pos, buf, bufsize, false);
+   h->pos += rc;
+   return (ssize_t)rc;
 }
 
-STATIC offt
-fat_seek_forward(fs_handle handle, offt dist)
+static ssize_t
+fat_readv(fs_handle handle, const struct iovec *iov, int iovcnt)
 {
    struct fatfs_handle *h = (struct fatfs_handle *) handle;
-   struct fat_fs_device_data *d = h->fs->device_data;
-   offt fsize = (offt)h->e->DIR_FileSize;
-   offt moved_distance = 0;
+   ssize_t ret = 0;
+   offt rc;
 
-   if (dist == 0)
-      return h->pos;
-
-   if (h->pos + dist > fsize) {
-      /* Allow, like Linux does, to seek past the end of a file. */
-      h->pos += dist;
-      h->curr_cluster = (u32) -1; /* invalid cluster */
-      return (offt) h->pos;
-   }
+   if (h->e->directory)
+      return -EISDIR;
 
-   do {
+   for (int i = 0; i < iovcnt; i++) {
 
-      const offt file_rem       = fsize - h->pos;
-      const offt dist_rem       = dist - moved_distance;
-      const offt cluster_off    = h->pos % (offt)d->cluster_size;
-      const offt cluster_rem    = (offt)d->cluster_size - cluster_off;
-      const offt to_move        = MIN3(cluster_rem, dist_rem, file_rem);
+      rc = fat_read_at(h,
+                       &h->curr_cluster,
+                       h->pos,
+                       iov[i].iov_base,
+                       iov[i].iov_len,
+                       true);
 
-      ASSERT(to_move >= 0);
+      if (rc < 0) {
+         ret = ret ? ret : (ssize_t)rc;
+         break;
+      }
 
-      moved_distance += to_move;
-      h->pos += to_move;
+      h->pos += rc;
+      ret += (ssize_t)rc;
 
-      if (to_move < cluster_rem)
-         break;
+      if (rc < (offt)iov[i].iov_len)
+         break; // Not enough data to fill all the user buffers.
+   }
 
-      // find the next cluster
-      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, h->curr_cluster);
+   return ret;
+}
 
-      if (fat_is_end_of_clusterchain(d->type, fatval)) {
-         ASSERT(h->pos == fsize);
-         break;
-      }
+STATIC ssize_t
+fat_pread(fs_handle handle, char *buf, size_t bufsize, offt off)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+   struct fat_fs_device_data *d = h->fs->device_data;
+   u32 clu;
 
-      // we do not expect BAD CLUSTERS
-      ASSERT(!fat_is_bad_cluster(d->type, fatval));
+   if (h->e->directory)
+      return -EISDIR;
 
-      h->curr_cluster = fatval; // go reading the new cluster in the chain.
+   if (off >= (offt)h->e->DIR_FileSize)
+      return 0;
 
-   } while (true);
+   clu = fat_get_file_cluster(d, h->e, (u32)(off / (offt)d->cluster_size));
+   ASSERT(clu != 0);
 
-   return (offt)h->pos;
+   return (ssize_t)fat_read_at(h, &clu, off, buf, bufsize, false);
 }
 
 struct fat_count_dirents_ctx {
@@ -186,6 +239,7 @@ STATIC offt fat_count_dirents(struct fat_fs_device_data *d, struct fat_entry *e)
       .ctx = NULL,      /* no need for long name ctx */
       .h = d->hdr,
       .ft = d->type,
+      .zh = d->zhdr,
       .cb = &fat_count_dirents_cb,
       .arg = &ctx,
    };
@@ -220,51 +274,47 @@ fat_seek(fs_handle handle, offt off, int whence)
       return fat_seek_dir(fh, off);
    }
 
-   offt curr_pos = fh->pos;
+   struct fat_fs_device_data *d = fh->fs->device_data;
+   const offt fsize = (offt)fh->e->DIR_FileSize;
 
    switch (whence) {
 
       case SEEK_SET:
+         break;
 
-         if (off < 0)
-            return -EINVAL; /* invalid negative offset */
-
-         fat_rewind(handle);
+      case SEEK_CUR:
+         off += fh->pos;
          break;
 
       case SEEK_END:
-
-         if (off >= 0)
-            break;
-
-         struct fatfs_handle *h = (struct fatfs_handle *) handle;
-         off = (offt) h->e->DIR_FileSize + off;
-
-         if (off < 0)
-            return -EINVAL;
-
-         fat_rewind(handle);
+         off += fsize;
          break;
 
-      case SEEK_CUR:
+      default:
+         return -EINVAL;
+   }
 
-         if (off < 0) {
+   if (off < 0)
+      return -EINVAL; /* invalid negative offset */
 
-            off = curr_pos + off;
+   if (off < fsize) {
 
-            if (off < 0)
-               return -EINVAL;
+      fh->curr_cluster =
+         fat_get_file_cluster(d, fh->e, (u32)(off / (offt)d->cluster_size));
 
-            fat_rewind(handle);
-         }
+      ASSERT(fh->curr_cluster != 0);
 
-         break;
+   } else {
 
-      default:
-         return -EINVAL;
+      /*
+       * Allow, like Linux does, to seek at or past the end of a file. Reading
+       * from there will return 0 anyway.
+       */
+      fh->curr_cluster = (u32) -1; /* invalid cluster */
    }
 
-   return fat_seek_forward(handle, off);
+   fh->pos = off;
+   return fh->pos;
 }
 
 struct datetime
@@ -388,6 +438,7 @@ static int fat_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
       .ctx = &walk_ctx,
       .h = d->hdr,
       .ft = d->type,
+      .zh = d->zhdr,
       .cb = &fat_getdents_cb,
       .arg = &ctx,
    };
@@ -450,11 +501,14 @@ STATIC int fat_ioctl(fs_handle h, ulong request, void *arg)
 static const struct file_ops static_ops_fat =
 {
    .read = fat_read,
+   .pread = fat_pread,
+   .readv = fat_readv,
    .seek = fat_seek,
    .write = fat_write,
    .ioctl = fat_ioctl,
    .mmap = fat_mmap,
    .munmap = fat_munmap,
+   .handle_fault = fat_handle_fault,
 };
 
 STATIC int
@@ -517,8 +571,9 @@ fat_get_entry(struct fs *fs,
    struct fat_fs_device_data *d = fs->device_data;
    struct fat_fs_path *fp = (struct fat_fs_path *)fs_path;
    struct fat_walk_static_params walk_params;
-   struct fat_entry *dir_entry;
+   struct fat_entry *dir_entry, *res;
    struct fat_search_ctx ctx;
+   enum vfs_entry_type type = VFS_NONE;
 
    if (!dir_inode && !name)              // both dir_inode and name are NULL:
       return fat_get_root_entry(d, fp);  // getting a path to the root dir
@@ -529,19 +584,22 @@ fat_get_entry(struct fs *fs,
       if (is_dot_or_dotdot(name, (int)name_len))
          return fat_get_root_entry(d, fp);
 
-   walk_params = (struct fat_walk_static_params) {
-      .ctx = &ctx.walk_ctx,
-      .h = d->hdr,
-      .ft = d->type,
-      .cb = &fat_search_entry_cb,
-      .arg = &ctx,
-   };
-
-   fat_init_search_ctx(&ctx, name, true);
-   fat_fs_walk_generic(d, &walk_params, dir_entry);
-
-   struct fat_entry *res = !ctx.not_dir ? ctx.result : NULL;
-   enum vfs_entry_type type = VFS_NONE;
+   if (fat_dcache_lookup(d, dir_entry, name, (size_t)name_len, &res)) {
+
+      /* No memory for the directory cache: just walk the directory */
+      walk_params = (struct fat_walk_static_params) {
+         .ctx = &ctx.walk_ctx,
+         .h = d->hdr,
+         .ft = d->type,
+         .zh = d->zhdr,
+         .cb = &fat_search_entry_cb,
+         .arg = &ctx,
+      };
+
+      fat_init_search_ctx(&ctx, name, true);
+      fat_fs_walk_generic(d, &walk_params, dir_entry);
+      res = !ctx.not_dir ? ctx.result : NULL;
+   }
 
    if (res) {
 
@@ -619,29 +677,65 @@ struct fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags)
    if (!d)
       return NULL;
 
+   if (fatz_is_image(vaddr)) {
+
+      if (!fatz_check_image(vaddr, rd_size)) {
+         printk("ERROR: fat ramdisk: corrupted compressed image\n");
+         kfree_obj(d, struct fat_fs_device_data);
+         return NULL;
+      }
+
+      d->zhdr = vaddr;
+      vaddr = fatz_get_fat_hdr(d->zhdr);
+   }
+
    d->hdr = (struct fat_hdr *) vaddr;
    d->type = fat_get_type(d->hdr);
    d->cluster_size = d->hdr->BPB_SecPerClus * d->hdr->BPB_BytsPerSec;
    d->root_dir_entries = fat_get_rootdir(d->hdr, d->type, &d->root_cluster);
 
+   if (d->zhdr) {
+
+      /* FAT32: the root dir is in a (raw) data block, not after the FATs */
+      if (d->root_cluster)
+         d->root_dir_entries = fatz_get_dir_cluster(d->zhdr, d->root_cluster);
+
+      if (fat_zcache_init(d)) {
+         kfree_obj(d, struct fat_fs_device_data);
+         return NULL;
+      }
+   }
+
    fs = create_fs_obj("fat",
                       &static_fsops_fat,
                       d,
                       flags | VFS_FS_RQ_DE_SKIP);
 
    if (!fs) {
+      fat_zcache_destroy(d);
       kfree_obj(d, struct fat_fs_device_data);
       return NULL;
    }
 
-   if (!fat_ramdisk_prepare_for_mmap(d, rd_size))
+   if (d->zhdr) {
+
+      /* The pages mapped in user space are the ones of the cluster cache */
+      d->mmap_support = d->cluster_size >= PAGE_SIZE &&
+                        IS_PAGE_ALIGNED(d->cluster_size);
+
+   } else if (!fat_ramdisk_prepare_for_mmap(d, rd_size)) {
+
       d->mmap_support = true;
+   }
 
    return fs;
 }
 
 void fat_umount_ramdisk(struct fs *fs)
 {
+   fat_zcache_destroy(fs->device_data);
+   fat_destroy_chain_indexes(fs->device_data);
+   fat_destroy_dir_caches(fs->device_data);
    kfree_obj(fs->device_data, struct fat_fs_device_data);
    destory_fs_obj(fs);
 }
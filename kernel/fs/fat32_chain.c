@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/bintree.h>
+
+/*
+ * Cluster-chain index
+ * ---------------------
+ *
+ * Getting the N-th cluster of a file requires, in FAT, following the chain
+ * from its first cluster, one FAT entry at a time. That makes each seek and
+ * each positional read O(file size). To avoid that, for each regular file we
+ * keep a lazily-built array of runs of contiguous clusters: the chain is
+ * walked only once and only as far as the farthest position requested so far,
+ * while the lookups are a binary search over the runs. On ramdisks created by
+ * our build system, files are almost always made by a single run.
+ *
+ * The index is never invalidated because the FAT ramdisk is read-only.
+ */
+
+struct fat_cluster_run {
+   u32 file_clu;              /* index of the first cluster in the file */
+   u32 clu;                   /* first cluster number of the run */
+   u32 len;                   /* number of contiguous clusters */
+};
+
+struct fat_chain_index {
+
+   struct bintree_node node;
+   struct fat_entry *e;       /* key */
+
+   u32 indexed;               /* number of clusters indexed so far */
+   u32 next_clu;              /* next cluster to index, 0 if complete */
+   u32 runs_count;
+   u32 runs_cap;
+   struct fat_cluster_run *runs;
+};
+
+#define FAT_CHAIN_INDEX_MIN_RUNS                         4u
+
+static u32
+fat_walk_chain(struct fat_fs_device_data *d, u32 clu, u32 n)
+{
+   for (; n > 0; n--) {
+
+      clu = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+
+      if (fat_is_end_of_clusterchain(d->type, clu))
+         return 0;
+
+      /* we do not expect BAD CLUSTERS */
+      ASSERT(!fat_is_bad_cluster(d->type, clu));
+   }
+
+   return clu;
+}
+
+static struct fat_chain_index *
+fat_get_chain_index(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_chain_index *ci;
+
+   ci = bintree_find_ptr(d->chain_indexes, e, struct fat_chain_index, node, e);
+
+   if (ci)
+      return ci;
+
+   if (!(ci = kzalloc_obj(struct fat_chain_index)))
+      return NULL;
+
+   bintree_node_init(&ci->node);
+   ci->e = e;
+   ci->next_clu = fat_get_first_cluster(e);
+
+   bintree_insert_ptr(&d->chain_indexes,
+                      ci,
+                      struct fat_chain_index,
+                      node,
+                      e);
+   return ci;
+}
+
+static bool
+fat_chain_index_append(struct fat_chain_index *ci, u32 clu)
+{
+   struct fat_cluster_run *r = ci->runs_count
+      ? &ci->runs[ci->runs_count - 1]
+      : NULL;
+
+   if (r && r->clu + r->len == clu) {
+      r->len++;
+      return true;
+   }
+
+   if (ci->runs_count == ci->runs_cap) {
+
+      const u32 new_cap = MAX(ci->runs_cap * 2, FAT_CHAIN_INDEX_MIN_RUNS);
+      struct fat_cluster_run *runs;
+
+      if (!(runs = kalloc_array_obj(struct fat_cluster_run, new_cap)))
+         return false;
+
+      if (ci->runs_count)
+         memcpy(runs, ci->runs, sizeof(runs[0]) * ci->runs_count);
+
+      if (ci->runs)
+         kfree_array_obj(ci->runs, struct fat_cluster_run, ci->runs_cap);
+
+      ci->runs = runs;
+      ci->runs_cap = new_cap;
+   }
+
+   ci->runs[ci->runs_count++] = (struct fat_cluster_run) {
+      .file_clu = ci->indexed,
+      .clu = clu,
+      .len = 1,
+   };
+
+   return true;
+}
+
+/* Index the chain up to the n-th cluster (included), if it exists */
+static bool
+fat_chain_index_extend(struct fat_fs_device_data *d,
+                       struct fat_chain_index *ci,
+                       u32 n)
+{
+   u32 clu;
+
+   while (ci->next_clu && ci->indexed <= n) {
+
+      if (!fat_chain_index_append(ci, ci->next_clu))
+         return false;
+
+      ci->indexed++;
+      clu = fat_read_fat_entry(d->hdr, d->type, 0, ci->next_clu);
+
+      if (fat_is_end_of_clusterchain(d->type, clu)) {
+         ci->next_clu = 0;
+         break;
+      }
+
+      ASSERT(!fat_is_bad_cluster(d->type, clu));
+      ci->next_clu = clu;
+   }
+
+   return true;
+}
+
+static u32
+fat_chain_index_lookup(struct fat_chain_index *ci, u32 n)
+{
+   u32 lo = 0, hi = ci->runs_count;
+
+   if (n >= ci->indexed)
+      return 0;
+
+   /* Find the last run starting at or before `n` */
+   while (hi - lo > 1) {
+
+      const u32 mid = lo + (hi - lo) / 2;
+
+      if (ci->runs[mid].file_clu <= n)
+         lo = mid;
+      else
+         hi = mid;
+   }
+
+   ASSERT(n - ci->runs[lo].file_clu < ci->runs[lo].len);
+   return ci->runs[lo].clu + (n - ci->runs[lo].file_clu);
+}
+
+/*
+ * Get the cluster number of the n-th cluster of the file `e`.
+ * Returns 0 (never a valid data cluster) when the file is shorter than that.
+ */
+u32
+fat_get_file_cluster(struct fat_fs_device_data *d, struct fat_entry *e, u32 n)
+{
+   struct fat_chain_index *ci;
+   const u32 first_clu = fat_get_first_cluster(e);
+   u32 clu = 0;
+   bool ok = false;
+
+   ASSERT(!e->directory);
+
+   if (!first_clu)
+      return 0; /* empty file */
+
+   if (!n)
+      return first_clu;
+
+   disable_preemption();
+   {
+      if ((ci = fat_get_chain_index(d, e))) {
+         if ((ok = fat_chain_index_extend(d, ci, n)))
+            clu = fat_chain_index_lookup(ci, n);
+      }
+   }
+   enable_preemption();
+
+   if (!ok) {
+      /* Out of memory: just walk the chain */
+      clu = fat_walk_chain(d, first_clu, n);
+   }
+
+   return clu;
+}
+
+void fat_destroy_chain_indexes(struct fat_fs_device_data *d)
+{
+   struct fat_chain_index *ci;
+
+   while ((ci = d->chain_indexes)) {
+
+      bintree_remove_ptr(&d->chain_indexes,
+                         ci,
+                         struct fat_chain_index,
+                         node,
+                         e);
+
+      if (ci->runs)
+         kfree_array_obj(ci->runs, struct fat_cluster_run, ci->runs_cap);
+
+      kfree_obj(ci, struct fat_chain_index);
+   }
+}
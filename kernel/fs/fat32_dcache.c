@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * Directory cache
+ * -----------------
+ *
+ * Looking up a name in a FAT directory requires walking all of its clusters,
+ * decoding the long names (and checking their checksums) of each entry until
+ * a match is found. To avoid doing that at every path resolution, the first
+ * lookup in a given directory builds a hash table containing all of its
+ * entries, which is then used for all the following lookups.
+ *
+ * The matching rules are exactly the ones of fat_search_entry_cb(): the long
+ * names are compared in a case-sensitive way, while the entries having only
+ * a short name are compared in a case-insensitive way. In case of multiple
+ * matches, the first entry in the directory wins.
+ *
+ * Because the FAT ramdisk is read-only, the cache is never invalidated. Write
+ * support will require dropping the cache of the modified directories and
+ * calling vfs_dcache_invalidate() for the VFS-level dentry cache as well.
+ */
+
+struct fat_dcache_entry {
+
+   struct fat_dcache_entry *next;   /* next entry in the same bucket */
+   struct fat_entry *e;
+   const char *name;
+   u16 name_len;
+   bool icase;                      /* short name: case insensitive */
+};
+
+struct fat_dir_cache {
+
+   struct bintree_node node;
+   struct fat_entry *dir;           /* key */
+
+   size_t alloc_size;
+   u32 buckets_count;               /* always a power of 2 */
+   u32 entries_count;
+   struct fat_dcache_entry **buckets;
+   struct fat_dcache_entry *entries;    /* in directory order */
+};
+
+struct fat_dcache_build_ctx {
+
+   struct fat_dir_cache *dc;        /* NULL while counting */
+   u32 count;
+   size_t names_size;
+   char *names;
+   char shortname[16];
+};
+
+#define FAT_DCACHE_MIN_BUCKETS                           8u
+
+static u32 fat_dcache_hash(const char *s, size_t len, bool icase)
+{
+   /* FNV-1a */
+   u32 h = 2166136261u;
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)(icase ? tolower(s[i]) : s[i]);
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+static bool
+fat_dcache_name_eq(struct fat_dcache_entry *de, const char *s, size_t len)
+{
+   if (de->name_len != len)
+      return false;
+
+   if (!de->icase)
+      return !memcmp(de->name, s, len);
+
+   for (size_t i = 0; i < len; i++)
+      if (tolower(de->name[i]) != tolower(s[i]))
+         return false;
+
+   return true;
+}
+
+static int
+fat_dcache_build_cb(struct fat_hdr *hdr,
+                    enum fat_type ft,
+                    struct fat_entry *entry,
+                    const char *long_name,
+                    void *arg)
+{
+   struct fat_dcache_build_ctx *ctx = arg;
+   struct fat_dir_cache *dc = ctx->dc;
+   struct fat_dcache_entry *de;
+   const char *name = long_name;
+   size_t len;
+   u32 b;
+
+   if (!name) {
+      fat_get_short_name(entry, ctx->shortname);
+      name = ctx->shortname;
+   }
+
+   len = strlen(name);
+
+   if (!dc) {
+      ctx->count++;
+      ctx->names_size += len + 1;
+      return 0;
+   }
+
+   if (ctx->count == dc->entries_count)
+      return -1; /* Should never happen */
+
+   memcpy(ctx->names, name, len + 1);
+
+   de = &dc->entries[ctx->count++];
+   de->e = entry;
+   de->name = ctx->names;
+   de->name_len = (u16)len;
+   de->icase = !long_name;
+
+   b = fat_dcache_hash(name, len, de->icase) & (dc->buckets_count - 1);
+   de->next = dc->buckets[b];
+   dc->buckets[b] = de;
+
+   ctx->names += len + 1;
+   return 0;
+}
+
+static struct fat_dir_cache *
+fat_dcache_build(struct fat_fs_device_data *d, struct fat_entry *dir)
+{
+   struct fat_dcache_build_ctx ctx = {0};
+   struct fat_walk_long_name_ctx walk_ctx;
+   struct fat_dir_cache *dc;
+   u32 buckets_count;
+   size_t sz;
+   char *p;
+
+   struct fat_walk_static_params walk_params = {
+      .ctx = &walk_ctx,
+      .h = d->hdr,
+      .ft = d->type,
+      .zh = d->zhdr,
+      .cb = &fat_dcache_build_cb,
+      .arg = &ctx,
+   };
+
+   /* First pass: count the entries and the space needed for their names */
+   if (fat_fs_walk_generic(d, &walk_params, dir))
+      return NULL;
+
+   buckets_count = (u32)MAX(FAT_DCACHE_MIN_BUCKETS,
+                            roundup_next_power_of_2(ctx.count));
+
+   sz = sizeof(struct fat_dir_cache);
+   sz += sizeof(struct fat_dcache_entry *) * buckets_count;
+   sz += sizeof(struct fat_dcache_entry) * ctx.count;
+   sz += ctx.names_size;
+
+   if (!(p = kzmalloc(sz)))
+      return NULL;
+
+   dc = (void *)p;
+   p += sizeof(struct fat_dir_cache);
+
+   bintree_node_init(&dc->node);
+   dc->dir = dir;
+   dc->alloc_size = sz;
+   dc->buckets_count = buckets_count;
+   dc->entries_count = ctx.count;
+   dc->buckets = (void *)p;
+   p += sizeof(struct fat_dcache_entry *) * buckets_count;
+   dc->entries = (void *)p;
+   p += sizeof(struct fat_dcache_entry) * ctx.count;
+
+   /* Second pass: fill the hash table */
+   ctx.dc = dc;
+   ctx.count = 0;
+   ctx.names = p;
+
+   if (fat_fs_walk_generic(d, &walk_params, dir) ||
+       ctx.count != dc->entries_count)
+   {
+      kfree2(dc, sz);
+      return NULL;
+   }
+
+   return dc;
+}
+
+static struct fat_dir_cache *
+fat_dcache_get(struct fat_fs_device_data *d, struct fat_entry *dir)
+{
+   struct fat_dir_cache *dc, *new_dc;
+
+   disable_preemption();
+   {
+      dc = bintree_find_ptr(d->dir_caches,
+                            dir,
+                            struct fat_dir_cache,
+                            node,
+                            dir);
+   }
+   enable_preemption();
+
+   if (dc)
+      return dc;
+
+   if (!(new_dc = fat_dcache_build(d, dir)))
+      return NULL;
+
+   disable_preemption();
+   {
+      /* Somebody else might have built the same cache in the meanwhile */
+      dc = bintree_find_ptr(d->dir_caches,
+                            dir,
+                            struct fat_dir_cache,
+                            node,
+                            dir);
+
+      if (!dc) {
+
+         bintree_insert_ptr(&d->dir_caches,
+                            new_dc,
+                            struct fat_dir_cache,
+                            node,
+                            dir);
+
+         dc = new_dc;
+         new_dc = NULL;
+      }
+   }
+   enable_preemption();
+
+   if (new_dc)
+      kfree2(new_dc, new_dc->alloc_size);
+
+   return dc;
+}
+
+/*
+ * Look for `name` in the directory `dir`, using its cache.
+ * Returns 0 on success, setting *res to the entry found or to NULL, and
+ * -ENOMEM when the cache could not be built.
+ */
+int
+fat_dcache_lookup(struct fat_fs_device_data *d,
+                  struct fat_entry *dir,
+                  const char *name,
+                  size_t name_len,
+                  struct fat_entry **res)
+{
+   struct fat_dcache_entry *pos, *best = NULL;
+   struct fat_dir_cache *dc;
+   u32 b;
+
+   if (!(dc = fat_dcache_get(d, dir)))
+      return -ENOMEM;
+
+   for (int icase = 0; icase < 2; icase++) {
+
+      b = fat_dcache_hash(name, name_len, icase) & (dc->buckets_count - 1);
+
+      for (pos = dc->buckets[b]; pos != NULL; pos = pos->next) {
+
+         if (pos->icase != (bool)icase)
+            continue;
+
+         if (!fat_dcache_name_eq(pos, name, name_len))
+            continue;
+
+         /* The entries array is in directory order: the first match wins */
+         if (!best || pos < best)
+            best = pos;
+      }
+   }
+
+   *res = best ? best->e : NULL;
+   return 0;
+}
+
+void fat_destroy_dir_caches(struct fat_fs_device_data *d)
+{
+   struct fat_dir_cache *dc;
+
+   while ((dc = d->dir_caches)) {
+
+      bintree_remove_ptr(&d->dir_caches,
+                         dc,
+                         struct fat_dir_cache,
+                         node,
+                         dir);
+
+      kfree2(dc, dc->alloc_size);
+   }
+}
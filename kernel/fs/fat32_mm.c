@@ -11,6 +11,8 @@
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/fs/fat32.h>
 
+#include <sys/mman.h>      // system header
+
 int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
 {
    struct fat_hdr *hdr = d->hdr;
@@ -93,93 +95,121 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
    return 0;
 }
 
-int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+/*
+ * Map the page of `um` at `vaddr` in `pdir`, taking it directly from the
+ * ramdisk or, when it's compressed, from the cluster cache: the cached cluster
+ * is never evicted while mapped. Returns -EFAULT when the page is past EOF.
+ */
+static int
+fat_mmap_page(struct user_mapping *um, pdir_t *pdir, ulong vaddr)
 {
    struct fatfs_handle *fh = um->h;
    struct fat_fs_device_data *d = fh->fs->device_data;
-   const size_t off_begin = um->off;
-   const size_t off_end = off_begin + um->len;
-   ulong vaddr = um->vaddr, off = 0;
-   size_t mapped_cnt, tot_mapped_cnt = 0;
+   const ulong off = um->off + (vaddr - um->vaddr);
+   u32 pg_flags = PAGING_FL_US;
+   char *data;
    u32 clu;
+   int rc;
 
-   if (!d->mmap_support)
-      return -ENODEV; /* We do NOT support mmap for this "superblock" */
-
-   if (fh->e->directory)
-      return -EACCES;
-
-   if (flags & VFS_MM_DONT_MMAP)
-      return 0;
-
-   clu = fat_get_first_cluster(fh->e);
+   if (off >= fh->e->DIR_FileSize)
+      return -EFAULT; /* The whole page is past EOF */
 
-   do {
+   /* Thanks to the chain index, that's not a walk from the first cluster */
+   clu = fat_get_file_cluster(d, fh->e, off / d->cluster_size);
 
-      char *data;
-      const ulong clu_end_off = off + d->cluster_size;
+   if (!clu)
+      return -EFAULT; /* The cluster chain is shorter than the file */
 
-      // Are we past the end of the mapped region?
-      if (off >= off_end)
-         break;
-
-      // Does this cluster belong to the mapped region?
-      if (clu_end_off > off_begin) {
-
-         // The cluster ends *after* the beginning of our region
-         data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+   /*
+    * The file-system is read-only, therefore only the private mappings can be
+    * writable: their pages are copied on write, see handle_potential_cow().
+    */
+   if (um->flags == MAP_PRIVATE)
+      pg_flags |= (um->prot & PROT_WRITE) ? PAGING_FL_COW : 0;
+   else
+      pg_flags |= PAGING_FL_SHARED;
+
+   if (!d->zcache) {
+      data = fat_get_pointer_to_cluster_data(d->hdr, clu);
+      data += off % d->cluster_size;
+      return map_page(pdir, (void *)vaddr, KERNEL_VA_TO_PA(data), pg_flags);
+   }
 
-         if (off < off_begin) {
+   disable_preemption();
+   {
+      if (!(rc = fat_zcache_get(d, clu, &data))) {
 
-            // Our region begins somewhere in the middle of this cluster.
-            // This can happen only with cluster_size > PAGE_SIZE.
-            off = off_begin;
-            data += off_begin - off;
-         }
+         data += off % d->cluster_size;
+         rc = map_page(pdir, (void *)vaddr, KERNEL_VA_TO_PA(data), pg_flags);
+         fat_zcache_put(d, clu);
+      }
+   }
+   enable_preemption();
+   return rc;
+}
 
-         /*
-          * Calculate the number of pages to mmap, considering that:
-          *    - we cannot mmap in this iteration further than clu_end_off
-          *    - we must not mmap further than off_end
-          */
-         size_t pg_count = (MIN(clu_end_off, off_end) - off) >> PAGE_SHIFT;
+int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct fatfs_handle *fh = um->h;
+   struct fat_fs_device_data *d = fh->fs->device_data;
+   const ulong vend = um->vaddr + um->len;
+   ulong vaddr;
+   int rc = 0;
 
-         mapped_cnt = map_pages(pdir,
-                                (void *)vaddr,
-                                KERNEL_VA_TO_PA(data),
-                                pg_count,
-                                PAGING_FL_US | PAGING_FL_SHARED);
+   if (!d->mmap_support)
+      return -ENODEV; /* We do NOT support mmap for this "superblock" */
 
-         if (mapped_cnt != pg_count) {
-            unmap_pages_permissive(pdir,
-                                   (void *)um->vaddr,
-                                   tot_mapped_cnt,
-                                   false);
-            return -ENOMEM;
-         }
+   if (fh->e->directory)
+      return -EACCES;
 
-         vaddr += pg_count << PAGE_SHIFT;
-         off += pg_count << PAGE_SHIFT;
-         tot_mapped_cnt += mapped_cnt;
+   /*
+    * By default, the pages are mapped on the first access to each one of them
+    * by fat_handle_fault(): creating a mapping costs O(1).
+    */
+   if ((flags & VFS_MM_DONT_MMAP) || !(flags & VFS_MM_POPULATE))
+      return 0;
 
-         // After each iteration, `off` must always be aligned at `cluster_size`
-         ASSERT((off % d->cluster_size) == 0);
+   for (vaddr = um->vaddr; vaddr < vend; vaddr += PAGE_SIZE) {
+      if ((rc = fat_mmap_page(um, pdir, vaddr)))
+         break;
+   }
 
-      } else {
+   /* The pages past EOF are never mapped: accessing them means SIGBUS */
+   if (!rc || rc == -EFAULT)
+      return 0;
 
-         // We skipped the whole cluster
-         off += d->cluster_size;
-      }
+   unmap_pages_permissive(pdir,
+                          (void *)um->vaddr,
+                          (vaddr - um->vaddr) >> PAGE_SHIFT,
+                          false);
+   return rc;
+}
 
-      // Get the next cluster# from the File Allocation Table
-      clu = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+bool fat_handle_fault(struct user_mapping *um, void *vaddrp, bool p, bool rw)
+{
+   struct process *pi = get_curr_proc();
+   const ulong vaddr = (ulong)vaddrp & PAGE_MASK;
+   int rc = 0;
+
+   if (p)
+      return false; /* Write on a read-only page: there's nothing we can do */
+
+   disable_preemption();
+   {
+      /* The page might have been mapped by another thread in the meanwhile */
+      if (!is_mapped(pi->pdir, vaddrp))
+         rc = fat_mmap_page(um, pi->pdir, vaddr);
+   }
+   enable_preemption();
 
-      // We do not expect BAD CLUSTERS
-      ASSERT(!fat_is_bad_cluster(d->type, clu));
+   if (rc == -EFAULT)
+      return false; /* Read/write past EOF */
 
-   } while (!fat_is_end_of_clusterchain(d->type, clu));
+   if (rc)
+      panic("Out-of-memory: unable to map a fat page. No OOM killer");
 
-   return 0;
+   invalidate_page(vaddr);
+   return true;
 }
 
 int fat_munmap(struct user_mapping *um, void *vaddrp, size_t len)
@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/fatz.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/list.h>
+
+/*
+ * Cluster cache for compressed (FATZ) ramdisks
+ * ----------------------------------------------
+ *
+ * On a FATZ ramdisk, the data clusters of the regular files are decompressed
+ * on demand, on the first read or page fault touching them, into this cache.
+ * The cache is bounded: once it's full, the least recently used cluster gets
+ * evicted to make room for the new one. Each cluster in use is pinned while
+ * its data is being accessed, while the clusters memory-mapped by some process
+ * are kept as long as they're mapped, because their pages are the ones in the
+ * mappings: evicting them would break the sharing of the pages between the
+ * processes. Those clusters are not counted against the bound, as their memory
+ * is accounted to the mappings.
+ *
+ * The directories are never cached, as their clusters are stored uncompressed
+ * in the image (see fatz.h).
+ */
+
+#define FAT_ZCACHE_SIZE                                  (256 * KB)
+#define FAT_ZCACHE_MIN_ENTRIES                                    4u
+
+struct fat_zcache_entry {
+
+   struct list_node lru_node;
+   u32 clu;
+   u32 pins;
+   char *data;
+};
+
+struct fat_zcache {
+
+   struct fat_zcache_entry **map;      /* indexed by cluster - 2 */
+   struct list lru;                    /* least recently used first */
+   u32 count;
+   u32 max_count;
+};
+
+static bool
+fat_zcache_is_mapped(struct fat_fs_device_data *d, struct fat_zcache_entry *ze)
+{
+   /* Our reference to the pages is not the only one: they're mapped */
+   return d->mmap_support &&
+          are_pageframes_shared(get_kernel_pdir(), ze->data, d->cluster_size);
+}
+
+static void
+fat_zcache_free_entry(struct fat_fs_device_data *d, struct fat_zcache_entry *ze)
+{
+   struct fat_zcache *zc = d->zcache;
+
+   ASSERT(!ze->pins);
+
+   list_remove(&ze->lru_node);
+   zc->map[ze->clu - 2] = NULL;
+   zc->count--;
+
+   if (d->mmap_support) {
+      release_pageframes_mapped_at(get_kernel_pdir(),
+                                   ze->data,
+                                   d->cluster_size);
+   }
+
+   aligned_kfree2(ze->data, d->cluster_size);
+   kfree_obj(ze, struct fat_zcache_entry);
+}
+
+/* Evict the least recently used cluster, unless all of them are in use */
+static void fat_zcache_evict(struct fat_fs_device_data *d)
+{
+   struct fat_zcache_entry *ze;
+
+   list_for_each_ro(ze, &d->zcache->lru, lru_node) {
+
+      if (!ze->pins && !fat_zcache_is_mapped(d, ze)) {
+         fat_zcache_free_entry(d, ze);
+         return;
+      }
+   }
+}
+
+static int
+fat_zcache_load(struct fat_fs_device_data *d,
+                u32 clu,
+                struct fat_zcache_entry **res)
+{
+   struct fat_zcache *zc = d->zcache;
+   struct fat_zcache_entry *ze;
+   const u32 cs = d->cluster_size;
+
+   if (zc->count >= zc->max_count)
+      fat_zcache_evict(d);
+
+   if (!(ze = kzalloc_obj(struct fat_zcache_entry)))
+      return -ENOMEM;
+
+   if (!(ze->data = aligned_kmalloc(cs, MIN(cs, PAGE_SIZE)))) {
+      kfree_obj(ze, struct fat_zcache_entry);
+      return -ENOMEM;
+   }
+
+   if (!fatz_read_cluster(d->zhdr, clu, ze->data)) {
+      aligned_kfree2(ze->data, cs);
+      kfree_obj(ze, struct fat_zcache_entry);
+      return -EIO;
+   }
+
+   /* Hold a reference to the pages, as they might get mapped in user space */
+   if (d->mmap_support)
+      retain_pageframes_mapped_at(get_kernel_pdir(), ze->data, cs);
+
+   ze->clu = clu;
+   list_node_init(&ze->lru_node);
+   list_add_tail(&zc->lru, &ze->lru_node);
+   zc->map[clu - 2] = ze;
+   zc->count++;
+
+   *res = ze;
+   return 0;
+}
+
+int fat_zcache_get(struct fat_fs_device_data *d, u32 clu, char **data)
+{
+   struct fat_zcache *zc = d->zcache;
+   struct fat_zcache_entry *ze;
+   int rc;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (clu < 2 || clu - 2 >= d->zhdr->clusters)
+      return -EIO; /* Corrupted cluster chain */
+
+   if ((ze = zc->map[clu - 2])) {
+
+      /* Move the cluster at the end of the LRU list */
+      list_remove(&ze->lru_node);
+      list_add_tail(&zc->lru, &ze->lru_node);
+
+   } else if ((rc = fat_zcache_load(d, clu, &ze))) {
+
+      return rc;
+   }
+
+   ze->pins++;
+   *data = ze->data;
+   return 0;
+}
+
+void fat_zcache_put(struct fat_fs_device_data *d, u32 clu)
+{
+   struct fat_zcache_entry *ze = d->zcache->map[clu - 2];
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(ze != NULL);
+   ASSERT(ze->pins > 0);
+
+   ze->pins--;
+}
+
+int fat_zcache_init(struct fat_fs_device_data *d)
+{
+   struct fat_zcache *zc;
+   const u32 clusters = MAX(d->zhdr->clusters, 1u);
+
+   if (!(zc = kzalloc_obj(struct fat_zcache)))
+      return -ENOMEM;
+
+   if (!(zc->map = kzalloc_array_obj(struct fat_zcache_entry *, clusters))) {
+      kfree_obj(zc, struct fat_zcache);
+      return -ENOMEM;
+   }
+
+   list_init(&zc->lru);
+   zc->max_count = MAX(FAT_ZCACHE_SIZE / d->cluster_size,
+                       FAT_ZCACHE_MIN_ENTRIES);
+
+   d->zcache = zc;
+   return 0;
+}
+
+void fat_zcache_destroy(struct fat_fs_device_data *d)
+{
+   struct fat_zcache *zc = d->zcache;
+   struct fat_zcache_entry *ze, *tmp;
+
+   if (!zc)
+      return;
+
+   list_for_each(ze, tmp, &zc->lru, lru_node)
+      fat_zcache_free_entry(d, ze);
+
+   kfree_array_obj(zc->map,
+                   struct fat_zcache_entry *,
+                   MAX(d->zhdr->clusters, 1u));
+   kfree_obj(zc, struct fat_zcache);
+   d->zcache = NULL;
+}
@@ -11,9 +11,17 @@
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/pipe.h>
+#include <tilck/kernel/epoll.h>
+#include <tilck/kernel/eventfd.h>
+#include <tilck/kernel/timerfd.h>
+#include <tilck/kernel/signalfd.h>
+#include <tilck/kernel/io_uring.h>
 
 #include <fcntl.h>      // system header
 
+/* Max bytes transferred by a single read() or write(): see sys_read() */
+#define MAX_RW_COUNT                               0x7ffff000u
+
 static inline bool is_fd_in_valid_range(int fd)
 {
    return IN_RANGE(fd, 0, MAX_HANDLES);
@@ -194,9 +202,21 @@ int sys_read(int fd, void *u_buf, size_t count)
     * return type of sys_read().
     */
 
+   count = MIN(count, MAX_RW_COUNT);
+
    if (h->spec_flags & VFS_SPFL_NO_USER_COPY)
       return (int) vfs_read(h, u_buf, count);
 
+   if (h->fops->readv) {
+
+      /*
+       * The file supports scatter/gather I/O, which always works directly on
+       * the user buffers: use it to avoid the bounce buffer.
+       */
+      const struct iovec iov = { .iov_base = u_buf, .iov_len = count };
+      return (int) vfs_readv(h, &iov, 1);
+   }
+
    count = MIN(count, IO_COPYBUF_SIZE);
    ret = (int) vfs_read(h, curr->io_copybuf, count);
 
@@ -218,9 +238,18 @@ int sys_write(int fd, const void *u_buf, size_t count)
    if (!(h = get_fs_handle(fd)))
       return -EBADF;
 
+   count = MIN(count, MAX_RW_COUNT);
+
    if (h->spec_flags & VFS_SPFL_NO_USER_COPY)
       return (int)vfs_write(h, (void *)u_buf, count);
 
+   if (h->fops->writev) {
+
+      /* See sys_read() */
+      const struct iovec iov = { .iov_base = (void *)u_buf, .iov_len = count };
+      return (int) vfs_writev(h, &iov, 1);
+   }
+
    count = MIN(count, IO_COPYBUF_SIZE);
 
    if (copy_from_user(curr->io_copybuf, u_buf, count))
@@ -304,6 +333,291 @@ int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
    return (int)vfs_readv(handle, iov, u_iovcnt);
 }
 
+int sys_pread64(int fd, void *u_buf, size_t count, s64 off)
+{
+   int ret;
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (off < 0)
+      return -EINVAL;
+
+   if (h->spec_flags & VFS_SPFL_NO_USER_COPY)
+      return -ESPIPE; /* special files don't support positional reads */
+
+   count = MIN(count, IO_COPYBUF_SIZE);
+   ret = (int) vfs_pread(h, curr->io_copybuf, count, (offt)off);
+
+   if (ret > 0) {
+      if (copy_to_user(u_buf, curr->io_copybuf, (size_t)ret) < 0)
+         ret = -EFAULT;
+   }
+
+   return ret;
+}
+
+int sys_preadv(int fd, const struct iovec *u_iov, int u_iovcnt, s64 off)
+{
+   struct task *curr = get_curr_task();
+   struct iovec *iov = (void *)curr->args_copybuf;
+   const u32 iovcnt = (u32) u_iovcnt;
+   fs_handle handle;
+
+   if (u_iovcnt <= 0 || off < 0)
+      return -EINVAL;
+
+   if (sizeof(struct iovec) * iovcnt > ARGS_COPYBUF_SIZE)
+      return -EINVAL;
+
+   if (copy_from_user(iov, u_iov, sizeof(struct iovec) * iovcnt))
+      return -EFAULT;
+
+   if (iov_len_overflow(iov, u_iovcnt))
+      return -EINVAL;
+
+   if (!(handle = get_fs_handle(fd)))
+      return -EBADF;
+
+   return (int)vfs_preadv(handle, iov, u_iovcnt, (offt)off);
+}
+
+/* All the SPLICE_F_* flags: MOVE, NONBLOCK, MORE and GIFT */
+#define SPLICE_F_ALL                                     0xfu
+
+static int get_user_off64(s64 *u_off, offt *off)
+{
+   s64 val;
+
+   if (copy_from_user(&val, u_off, sizeof(val)))
+      return -EFAULT;
+
+   if (val < 0)
+      return -EINVAL;
+
+   if (val > LONG_MAX)
+      return -EOVERFLOW; /* offt is just a long */
+
+   *off = (offt)val;
+   return 0;
+}
+
+static int put_user_off64(s64 *u_off, offt off)
+{
+   s64 val = off;
+   return copy_to_user(u_off, &val, sizeof(val)) ? -EFAULT : 0;
+}
+
+/*
+ * Common code for the syscalls based on vfs_transfer() having optional
+ * pointers to 64-bit offsets in user space.
+ */
+static int
+call_vfs_transfer(fs_handle in,
+                  s64 *u_off_in,
+                  fs_handle out,
+                  s64 *u_off_out,
+                  size_t len)
+{
+   offt in_off = 0, out_off = 0;
+   ssize_t rc;
+
+   if (u_off_in && (rc = get_user_off64(u_off_in, &in_off)))
+      return (int)rc;
+
+   if (u_off_out && (rc = get_user_off64(u_off_out, &out_off)))
+      return (int)rc;
+
+   rc = vfs_transfer(in,
+                     u_off_in ? &in_off : NULL,
+                     out,
+                     u_off_out ? &out_off : NULL,
+                     MIN(len, MAX_RW_COUNT));
+
+   if (rc > 0) {
+
+      if (u_off_in && put_user_off64(u_off_in, in_off))
+         return -EFAULT;
+
+      if (u_off_out && put_user_off64(u_off_out, out_off))
+         return -EFAULT;
+   }
+
+   return (int)rc;
+}
+
+int sys_sendfile(int out_fd, int in_fd, long *u_offset, size_t count)
+{
+   fs_handle in, out;
+   long off;
+   int rc;
+
+   if (!(in = get_fs_handle(in_fd)) || !(out = get_fs_handle(out_fd)))
+      return -EBADF;
+
+   count = MIN(count, MAX_RW_COUNT);
+
+   if (!u_offset)
+      return (int)vfs_transfer(in, NULL, out, NULL, count);
+
+   if (copy_from_user(&off, u_offset, sizeof(off)))
+      return -EFAULT;
+
+   rc = (int)vfs_transfer(in, &off, out, NULL, count);
+
+   if (rc > 0 && copy_to_user(u_offset, &off, sizeof(off)))
+      return -EFAULT;
+
+   return rc;
+}
+
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_offset, size_t count)
+{
+   fs_handle in, out;
+
+   if (!(in = get_fs_handle(in_fd)) || !(out = get_fs_handle(out_fd)))
+      return -EBADF;
+
+   return call_vfs_transfer(in, u_offset, out, NULL, count);
+}
+
+int sys_splice(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+               size_t len, u32 flags)
+{
+   struct pipe *pin, *pout;
+   fs_handle in, out;
+
+   /*
+    * The flags are just hints: in particular, the blocking behavior is
+    * determined only by the O_NONBLOCK flag of the pipe handles.
+    */
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   pin = get_pipe_of_handle(in);
+   pout = get_pipe_of_handle(out);
+
+   if (!pin && !pout)
+      return -EINVAL; /* at least one of the two files must be a pipe */
+
+   if ((pin && u_off_in) || (pout && u_off_out))
+      return -ESPIPE;
+
+   if (pin && pin == pout)
+      return -EINVAL;
+
+   return call_vfs_transfer(in, u_off_in, out, u_off_out, len);
+}
+
+int sys_tee(int fd_in, int fd_out, size_t len, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   struct pipe *pin, *pout;
+   fs_handle in, out;
+   int rc;
+
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   pin = get_pipe_of_handle(in);
+   pout = get_pipe_of_handle(out);
+
+   if (!pin || !pout || pin == pout)
+      return -EINVAL;
+
+   /* Copy the data without consuming it, then write it to the other pipe */
+   len = MIN(len, IO_COPYBUF_SIZE);
+
+   if ((rc = (int)pipe_peek(in, curr->io_copybuf, len)) <= 0)
+      return rc;
+
+   return (int)vfs_write(out, curr->io_copybuf, (size_t)rc);
+}
+
+int sys_vmsplice(int fd, const struct iovec *u_iov, ulong nr_segs, u32 flags)
+{
+   struct task *curr = get_curr_task();
+   struct iovec *iov = (void *)curr->args_copybuf;
+   struct fs_handle_base *h;
+
+   if (flags & ~SPLICE_F_ALL)
+      return -EINVAL;
+
+   if (sizeof(struct iovec) * nr_segs > ARGS_COPYBUF_SIZE)
+      return -EINVAL;
+
+   if (!(h = get_fs_handle(fd)) || !get_pipe_of_handle(h))
+      return -EBADF;
+
+   if (!nr_segs)
+      return 0;
+
+   if (copy_from_user(iov, u_iov, sizeof(struct iovec) * nr_segs))
+      return -EFAULT;
+
+   if (iov_len_overflow(iov, (int)nr_segs))
+      return -EINVAL;
+
+   /*
+    * Without page-stealing, vmsplice() is just a writev() to the pipe or a
+    * readv() from it, depending on the pipe's end. Both work directly on the
+    * user buffers, with no bounce buffer.
+    */
+   if (h->fl_flags & O_WRONLY)
+      return (int)vfs_writev(h, iov, (int)nr_segs);
+
+   return (int)vfs_readv(h, iov, (int)nr_segs);
+}
+
+static int check_copy_file_range_handle(fs_handle h)
+{
+   struct stat64 st;
+   int rc;
+
+   if ((rc = vfs_fstat64(h, &st)))
+      return rc;
+
+   if (S_ISDIR(st.st_mode))
+      return -EISDIR;
+
+   if (!S_ISREG(st.st_mode))
+      return -EINVAL;
+
+   return 0;
+}
+
+int sys_copy_file_range(int fd_in, s64 *u_off_in, int fd_out, s64 *u_off_out,
+                        size_t len, u32 flags)
+{
+   struct fs_handle_base *in, *out;
+   int rc;
+
+   if (flags)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   if (out->fl_flags & O_APPEND)
+      return -EBADF;
+
+   if ((rc = check_copy_file_range_handle(in)))
+      return rc;
+
+   if ((rc = check_copy_file_range_handle(out)))
+      return rc;
+
+   return call_vfs_transfer(in, u_off_in, out, u_off_out, len);
+}
+
 static int
 call_vfs_stat64(const char *u_path,
                 struct stat64 *u_statbuf,
@@ -954,3 +1268,158 @@ no_fds:
    ret = -EMFILE;
    goto err_end;
 }
+
+int sys_epoll_create(int size)
+{
+   if (size <= 0)
+      return -EINVAL;
+
+   return sys_epoll_create1(0);
+}
+
+int sys_epoll_create1(int flags)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   int fd;
+
+   if (flags & ~EPOLL_CLOEXEC)
+      return -EINVAL;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0) {
+      fd = -EMFILE;
+      goto end;
+   }
+
+   if (!(h = create_epoll_handle())) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & EPOLL_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   curr->pi->handles[fd] = h;
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+/*
+ * Install a just-created handle of a kernel object (eventfd, timerfd etc.) in
+ * the first free slot. When there are no free slots, the handle is closed.
+ * `h` is NULL when its creation failed because of out-of-memory.
+ */
+static int install_new_kobj_handle(struct fs_handle_base *h, bool cloexec)
+{
+   struct process *pi = get_curr_proc();
+   int fd;
+
+   if (!h)
+      return -ENOMEM;
+
+   kmutex_lock(&pi->fslock);
+   {
+      if ((fd = get_free_handle_num(pi)) >= 0) {
+
+         if (cloexec)
+            h->fd_flags |= FD_CLOEXEC;
+
+         pi->handles[fd] = h;
+      }
+   }
+   kmutex_unlock(&pi->fslock);
+
+   if (fd < 0) {
+      vfs_close(h);
+      return -EMFILE;
+   }
+
+   return fd;
+}
+
+int sys_eventfd(unsigned int initval)
+{
+   return sys_eventfd2(initval, 0);
+}
+
+int sys_eventfd2(unsigned int initval, int flags)
+{
+   if (flags & ~(EFD_SEMAPHORE | EFD_CLOEXEC | EFD_NONBLOCK))
+      return -EINVAL;
+
+   return install_new_kobj_handle(create_eventfd_handle(initval, flags),
+                                  !!(flags & EFD_CLOEXEC));
+}
+
+int sys_timerfd_create(int clockid, int flags)
+{
+   if (flags & ~(TFD_CLOEXEC | TFD_NONBLOCK))
+      return -EINVAL;
+
+   if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC)
+      return -EINVAL;
+
+   return install_new_kobj_handle(create_timerfd_handle(clockid, flags),
+                                  !!(flags & TFD_CLOEXEC));
+}
+
+int sys_signalfd(int fd, const sigset_t *u_mask, size_t sizemask)
+{
+   return sys_signalfd4(fd, u_mask, sizemask, 0);
+}
+
+int sys_signalfd4(int fd, const sigset_t *u_mask, size_t sizemask, int flags)
+{
+   ulong mask[K_SIGACTION_MASK_WORDS];
+   fs_handle h;
+   int rc;
+
+   if (flags & ~(SFD_CLOEXEC | SFD_NONBLOCK))
+      return -EINVAL;
+
+   if (sizemask != sizeof(mask))
+      return -EINVAL;
+
+   if (copy_from_user(mask, u_mask, sizeof(mask)))
+      return -EFAULT;
+
+   if (fd != -1) {
+
+      /* Change the mask of an existing signalfd */
+      if (!(h = get_fs_handle(fd)))
+         return -EBADF;
+
+      if ((rc = signalfd_set_mask(h, mask)))
+         return rc;
+
+      return fd;
+   }
+
+   return install_new_kobj_handle(create_signalfd_handle(mask, flags),
+                                  !!(flags & SFD_CLOEXEC));
+}
+
+int sys_io_uring_setup(u32 entries, struct io_uring_params *u_params)
+{
+   struct io_uring_params p;
+   fs_handle h;
+   int rc;
+
+   if (copy_from_user(&p, u_params, sizeof(p)))
+      return -EFAULT;
+
+   if ((rc = create_io_uring_handle(entries, &p, &h)))
+      return rc;
+
+   if (copy_to_user(u_params, &p, sizeof(p))) {
+      vfs_close(h);
+      return -EFAULT;
+   }
+
+   /* Like on Linux, the io_uring fds are always close-on-exec */
+   return install_new_kobj_handle(h, true);
+}
@@ -1,59 +1,338 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
-static struct ramfs_block *ramfs_new_block(offt page)
+/*
+ * Block map
+ * -----------
+ *
+ * The data pages of each file are kept in a radix tree indexed by the page
+ * number in the file. Each node is an array of RAMFS_BMAP_SLOTS pointers to
+ * the nodes of the next level or, in the last level, to the data pages. The
+ * height of the tree grows only as much as needed to contain the last page:
+ * files smaller than a page (the vast majority) have height 0 and their root
+ * points directly to their only page, while `RAMFS_BMAP_SLOTS^h` pages fit in
+ * a tree of height `h`. Holes are simply NULL slots.
+ *
+ * When writing, the pages are allocated in contiguous chunks of up to
+ * RAMFS_MAX_CHUNK_PAGES pages (when the write is big enough), in order to
+ * reduce the number of kmalloc() calls. The chunks are allocated already split
+ * in page-size sub-blocks (see internal_kmalloc_split_block()), so that each
+ * page can be freed individually with a regular kfree2() call: therefore, the
+ * chunks don't need to be tracked at all.
+ */
+
+#define RAMFS_BMAP_SHIFT                                 6u
+#define RAMFS_BMAP_SLOTS                (1u << RAMFS_BMAP_SHIFT)
+#define RAMFS_MAX_CHUNK_PAGES                           16u
+
+static ALWAYS_INLINE u32 ramfs_bmap_slot_idx(ulong pg, u32 level)
 {
-   struct ramfs_block *b;
+   return (pg >> (level * RAMFS_BMAP_SHIFT)) & (RAMFS_BMAP_SLOTS - 1);
+}
 
-   /* Allocate memory for the block object */
-   if (!(b = kalloc_obj(struct ramfs_block)))
-      return NULL;
+static ALWAYS_INLINE bool ramfs_bmap_fits(u32 height, ulong pg)
+{
+   return height * RAMFS_BMAP_SHIFT >= NBITS ||
+          !(pg >> (height * RAMFS_BMAP_SHIFT));
+}
 
-   /* Allocate block's data */
-   if (!(b->vaddr = kzmalloc(PAGE_SIZE))) {
-      kfree_obj(b, struct ramfs_block);
+static void *ramfs_bmap_lookup(struct ramfs_inode *i, ulong pg)
+{
+   void *p = i->bmap_root;
+
+   if (!ramfs_bmap_fits(i->bmap_height, pg))
       return NULL;
+
+   for (u32 level = i->bmap_height; p && level > 0; level--)
+      p = ((void **)p)[ramfs_bmap_slot_idx(pg, level - 1)];
+
+   return p;
+}
+
+static void **ramfs_bmap_new_node(void)
+{
+   return kzalloc_array_obj(void *, RAMFS_BMAP_SLOTS);
+}
+
+static void ramfs_bmap_free_node(void **node)
+{
+   kfree_array_obj(node, void *, RAMFS_BMAP_SLOTS);
+}
+
+/*
+ * Get the address of the slot for the page `pg`, allocating the tree nodes
+ * necessary to reach it. Returns NULL in case of OOM.
+ */
+static void **ramfs_bmap_get_slot(struct ramfs_inode *i, ulong pg)
+{
+   void **slot;
+   void **node;
+
+   if (!i->bmap_root) {
+
+      /* Empty tree: just set the right height */
+      while (!ramfs_bmap_fits(i->bmap_height, pg))
+         i->bmap_height++;
+
+   } else {
+
+      while (!ramfs_bmap_fits(i->bmap_height, pg)) {
+
+         if (!(node = ramfs_bmap_new_node()))
+            return NULL;
+
+         node[0] = i->bmap_root;
+         i->bmap_root = node;
+         i->bmap_height++;
+      }
    }
 
-   /* Retain the pageframe used by this block */
-   retain_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   slot = &i->bmap_root;
 
-   /* Init the block object */
-   bintree_node_init(&b->node);
-   b->offset = page;
-   return b;
+   for (u32 level = i->bmap_height; level > 0; level--) {
+
+      if (!*slot) {
+         if (!(*slot = ramfs_bmap_new_node()))
+            return NULL;
+      }
+
+      slot = &((void **)*slot)[ramfs_bmap_slot_idx(pg, level - 1)];
+   }
+
+   return slot;
+}
+
+static void *ramfs_alloc_chunk(u32 n)
+{
+   size_t sz = n * PAGE_SIZE;
+   void *chunk;
+
+   /* Split the chunk in page-size sub-blocks: see the comment above */
+   if ((chunk = general_kmalloc(&sz, PAGE_SIZE)))
+      ASSERT(sz == n * PAGE_SIZE);
+
+   return chunk;
 }
 
-static void ramfs_destroy_block(struct ramfs_block *b)
+static void ramfs_free_page(void *page)
 {
-   /* Release the pageframe used by this block */
-   release_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   if (ramfs_put_shared_page(page))
+      return; /* The page is still used by other files */
 
-   /* Free the memory pointed by this block */
-   kfree2(b->vaddr, PAGE_SIZE);
+   /* Release the pageframe used by this page */
+   release_pageframes_mapped_at(get_kernel_pdir(), page, PAGE_SIZE);
+   kfree2(page, PAGE_SIZE);
+}
+
+static bool ramfs_bmap_node_is_empty(void **node)
+{
+   for (u32 k = 0; k < RAMFS_BMAP_SLOTS; k++)
+      if (node[k])
+         return false;
 
-   /* Free the memory used by the block object itself */
-   kfree_obj(b, struct ramfs_block);
+   return true;
 }
 
+/*
+ * Free all the pages >= `first_pg` in the subtree rooted at `*slot`, covering
+ * the pages starting from `base`. Frees the empty nodes as well.
+ */
 static void
-ramfs_append_new_block(struct ramfs_inode *inode, struct ramfs_block *block)
+ramfs_bmap_truncate_rec(struct ramfs_inode *i,
+                        void **slot,
+                        u32 level,
+                        ulong base,
+                        ulong first_pg)
+{
+   void **node = *slot;
+   ulong span;
+
+   if (!node)
+      return;
+
+   if (!level) {
+
+      if (base >= first_pg) {
+         ramfs_free_page(node);
+         i->blocks_count--;
+         *slot = NULL;
+      }
+
+      return;
+   }
+
+   span = 1ul << ((level - 1) * RAMFS_BMAP_SHIFT);
+
+   for (u32 k = 0; k < RAMFS_BMAP_SLOTS; k++) {
+
+      if (base + (k + 1) * span <= first_pg)
+         continue; /* the whole child is below first_pg */
+
+      ramfs_bmap_truncate_rec(i, &node[k], level - 1, base + k * span, first_pg);
+   }
+
+   if (ramfs_bmap_node_is_empty(node)) {
+      ramfs_bmap_free_node(node);
+      *slot = NULL;
+   }
+}
+
+/* Free all the pages >= `first_pg` and shrink the tree accordingly */
+static void ramfs_bmap_truncate(struct ramfs_inode *i, ulong first_pg)
 {
-   DEBUG_ONLY_UNSAFE(bool success =)
-      bintree_insert_ptr(&inode->blocks_tree_root,
-                         block,
-                         struct ramfs_block,
-                         node,
-                         offset);
+   void **node;
+
+   ramfs_bmap_truncate_rec(i, &i->bmap_root, i->bmap_height, 0, first_pg);
+
+   if (!i->bmap_root) {
+      i->bmap_height = 0;
+      return;
+   }
+
+   /* Drop the root nodes having only their first child */
+   while (i->bmap_height > 0) {
 
-   ASSERT(success);
-   inode->blocks_count++;
+      node = i->bmap_root;
+
+      for (u32 k = 1; k < RAMFS_BMAP_SLOTS; k++)
+         if (node[k])
+            return;
+
+      i->bmap_root = node[0];
+      i->bmap_height--;
+      ramfs_bmap_free_node(node);
+   }
 }
 
-static int ramfs_inode_extend(struct ramfs_inode *i, offt new_len)
+/*
+ * Allocate the pages for writing the range [pos, end), starting from the one
+ * containing `pos`, as a single contiguous chunk when possible. The parts of
+ * the new pages outside of the range are zeroed. Returns the (first) page
+ * containing `pos` or NULL in case of OOM, setting `*count` to the number of
+ * contiguous pages allocated.
+ */
+static void *
+ramfs_alloc_pages(struct ramfs_inode *i, offt pos, offt end, u32 *count)
 {
-   ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
-   ASSERT(new_len > i->fsize);
+   const ulong pg = (ulong)(pos >> PAGE_SHIFT);
+   const ulong end_pg = (ulong)((end + PAGE_SIZE - 1) >> PAGE_SHIFT);
+   const size_t head = (size_t)(pos & (offt)OFFSET_IN_PAGE_MASK);
+   const size_t tail = (size_t)(end & (offt)OFFSET_IN_PAGE_MASK);
+   void **slots[RAMFS_MAX_CHUNK_PAGES];
+   char *chunk;
+   u32 n = RAMFS_MAX_CHUNK_PAGES;
+
+   ASSERT(end > pos);
+
+   /* Find the biggest aligned chunk of free slots fully inside the range */
+   while (n > 1 && ((pg & (n - 1)) || pg + n > end_pg))
+      n /= 2;
+
+   for (u32 k = 1; k < n; k++) {
+      if (ramfs_bmap_lookup(i, pg + k)) {
+         n = 1;
+         break;
+      }
+   }
+
+   /*
+    * Make the tree tall enough for the whole chunk before getting the slots
+    * below: growing a tree of height 0 changes the meaning of its root slot,
+    * which is the slot of the page 0.
+    */
+   if (n > 1 && !ramfs_bmap_get_slot(i, pg + n - 1))
+      n = 1;
+
+   while (!(chunk = ramfs_alloc_chunk(n))) {
+
+      if (n == 1)
+         return NULL;
+
+      n /= 2;
+   }
+
+   for (u32 k = 0; k < n; k++) {
+
+      if (!(slots[k] = ramfs_bmap_get_slot(i, pg + k))) {
+
+         /* OOM while allocating the tree nodes: free the unused pages */
+         for (u32 j = k; j < n; j++)
+            kfree2(chunk + j * PAGE_SIZE, PAGE_SIZE);
+
+         if (!k)
+            return NULL;
+
+         n = k;
+         break;
+      }
+   }
+
+   /* Retain the pageframes used by the pages */
+   retain_pageframes_mapped_at(get_kernel_pdir(), chunk, n * PAGE_SIZE);
+
+   for (u32 k = 0; k < n; k++) {
+      ASSERT(*slots[k] == NULL);
+      *slots[k] = chunk + k * PAGE_SIZE;
+   }
+
+   i->blocks_count += n;
+   *count = n;
+
+   if (head)
+      bzero(chunk, head);
+
+   if (pg + n == end_pg && tail)
+      bzero(chunk + (n - 1) * PAGE_SIZE + tail, PAGE_SIZE - tail);
+
+   return chunk;
+}
+
+/*
+ * Make sure that `page`, the page `pg` of `i`, is not shared with other files
+ * before writing to it, by replacing it with a private copy when necessary.
+ * Returns the page to write to, or NULL in case of OOM.
+ */
+static void *ramfs_get_private_page(struct ramfs_inode *i, ulong pg, void *page)
+{
+   void **slot;
+   void *copy;
+
+   ASSERT(ramfs_bmap_lookup(i, pg) == page);
+
+   if (!ramfs_is_page_shared(page))
+      return page;
+
+   if (!(copy = ramfs_alloc_chunk(1)))
+      return NULL;
+
+   /* The slot exists already: ramfs_bmap_get_slot() can't fail here */
+   slot = ramfs_bmap_get_slot(i, pg);
+   ASSERT(slot && *slot == page);
+
+   retain_pageframes_mapped_at(get_kernel_pdir(), copy, PAGE_SIZE);
+   memcpy(copy, page, PAGE_SIZE);
+   *slot = copy;
+
+   ramfs_free_page(page);
+   return copy;
+}
+
+static int ramfs_truncate_pages(struct ramfs_inode *i, offt len)
+{
+   const ulong first_pg = (ulong)((len + PAGE_SIZE - 1) >> PAGE_SHIFT);
+   const size_t off = (size_t)(len & (offt)OFFSET_IN_PAGE_MASK);
+   char *last = NULL;
+
+   /* The last page will be written: it must not be shared */
+   if (off && (last = ramfs_bmap_lookup(i, first_pg - 1))) {
+      if (!(last = ramfs_get_private_page(i, first_pg - 1, last)))
+         return -ENOMEM;
+   }
+
+   ramfs_bmap_truncate(i, first_pg);
+
+   /* Zero the part of the last page past the new EOF */
+   if (last)
+      bzero(last + off, PAGE_SIZE - off);
 
-   i->fsize = new_len;
    return 0;
 }
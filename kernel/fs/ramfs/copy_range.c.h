@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/* Max bytes copied by a single ramfs_copy_range() call, holding the locks */
+#define RAMFS_COPY_RANGE_MAX                              (1 * MB)
+
+/*
+ * Make the page `pg` of `i` be `page`, a page of another file, replacing its
+ * current page, if any. Returns false in case of OOM.
+ */
+static bool
+ramfs_install_shared_page(struct ramfs_inode *i, ulong pg, void *page)
+{
+   void **slot;
+   void *old;
+
+   if (!ramfs_share_page(page))
+      return false;
+
+   if (!(slot = ramfs_bmap_get_slot(i, pg))) {
+      ramfs_put_shared_page(page);
+      return false;
+   }
+
+   old = *slot;
+   *slot = page;
+
+   if (old)
+      ramfs_free_page(old);
+   else
+      i->blocks_count++;
+
+   return true;
+}
+
+/*
+ * Check if the page of `ri` containing `in_pos` can be shared with `ro`, at
+ * `out_pos`, in order to copy `n` bytes. Both the positions must be at the
+ * beginning of a page and the copy must cover the whole page, except when it
+ * ends at the EOF of both the files: the bytes past EOF are always zero.
+ */
+static bool
+ramfs_can_share_page(struct ramfs_inode *ri,
+                     offt in_pos,
+                     struct ramfs_inode *ro,
+                     offt out_pos,
+                     size_t n)
+{
+   if ((in_pos | out_pos) & (offt)OFFSET_IN_PAGE_MASK)
+      return false;
+
+   if (n == PAGE_SIZE)
+      return true;
+
+   return in_pos + (offt)n == ri->fsize && out_pos + (offt)n >= ro->fsize;
+}
+
+static ssize_t
+ramfs_copy_range_nolock(struct ramfs_handle *in,
+                        offt in_pos,
+                        struct ramfs_handle *out,
+                        offt out_pos,
+                        size_t len)
+{
+   struct ramfs_inode *ri = in->inode;
+   struct ramfs_inode *ro = out->inode;
+   const offt saved_pos = out->pos;
+   ssize_t tot = 0, rc = 0;
+   char *data;
+   size_t n;
+
+   /* See shared_pages.c.h. The inline data cannot be shared, of course */
+   const bool can_share = list_is_empty(&ri->mappings_list) &&
+                          list_is_empty(&ro->mappings_list) &&
+                          !ri->inline_data &&
+                          !ro->inline_data;
+
+   if (in_pos >= ri->fsize)
+      return 0;
+
+   if (out_pos >= RAMFS_MAX_POS)
+      return -EFBIG; /* See ramfs_write_nolock() */
+
+   len = MIN(len, RAMFS_COPY_RANGE_MAX);
+   len = MIN(len, (size_t)(ri->fsize - in_pos));
+   len = MIN(len, (size_t)(RAMFS_MAX_POS - out_pos));
+
+   for (; len > 0; len -= n) {
+
+      const ulong pg = (ulong)(in_pos >> PAGE_SHIFT);
+      const ulong out_pg = (ulong)(out_pos >> PAGE_SHIFT);
+      const size_t pg_off = (size_t)(in_pos & (offt)OFFSET_IN_PAGE_MASK);
+      bool whole_page;
+
+      n = MIN(len, PAGE_SIZE - pg_off);
+      data = ramfs_get_page_data(ri, pg);
+      whole_page = ramfs_can_share_page(ri, in_pos, ro, out_pos, n);
+
+      if (whole_page && !data && !ramfs_get_page_data(ro, out_pg)) {
+
+         /* A hole in both the files: there's nothing to copy */
+         if (out_pos + (offt)n > ro->fsize) {
+            if ((rc = ramfs_inode_extend(ro, out_pos + (offt)n)))
+               break;
+         }
+
+      } else if (whole_page && data && can_share &&
+                 ramfs_install_shared_page(ro, out_pg, data))
+      {
+         if (out_pos + (offt)n > ro->fsize)
+            ro->fsize = out_pos + (offt)n;
+
+      } else {
+
+         /* Just copy the data, reading holes from the zero page */
+         out->pos = out_pos;
+         data = data ? data + pg_off : zero_page;
+
+         if ((rc = ramfs_write_nolock(out, data, n, false)) <= 0)
+            break;
+
+         if ((size_t)rc < n) {
+            tot += rc;
+            break;
+         }
+      }
+
+      tot += (ssize_t)n;
+      in_pos += (offt)n;
+      out_pos += (offt)n;
+   }
+
+   out->pos = saved_pos;
+   return tot ? tot : rc;
+}
+
+static ssize_t
+ramfs_copy_range(fs_handle in, offt in_pos, fs_handle out, offt out_pos,
+                 size_t len)
+{
+   struct ramfs_handle *rin = in;
+   struct ramfs_handle *rout = out;
+   ssize_t rc;
+
+   if (rin->inode->type != VFS_FILE || rout->inode->type != VFS_FILE)
+      return -EXDEV;
+
+   if (rin->inode == rout->inode)
+      return -EXDEV; /* Copies within the same file: let the VFS handle them */
+
+   /* Always take the two locks in the same order to avoid deadlocks */
+   if (rin->inode < rout->inode) {
+      ramfs_file_shlock(rin);
+      ramfs_file_exlock(rout);
+   } else {
+      ramfs_file_exlock(rout);
+      ramfs_file_shlock(rin);
+   }
+
+   rc = ramfs_copy_range_nolock(rin, in_pos, rout, out_pos, len);
+
+   ramfs_file_exunlock(rout);
+   ramfs_file_shunlock(rin);
+   return rc;
+}
@@ -1,5 +1,10 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+static DEFINE_KMALLOC_CACHE(ramfs_entry_cache,
+                            "ramfs_entry",
+                            sizeof(struct ramfs_entry),
+                            NULL);
+
 static long ramfs_insert_remove_entry_cmp(const void *a, const void *b)
 {
    const struct ramfs_entry *e1 = a;
@@ -14,6 +19,20 @@ static long ramfs_find_entry_cmp(const void *obj, const void *valptr)
    return strcmp(e->name, searched_str);
 }
 
+static long ramfs_insert_remove_cookie_cmp(const void *a, const void *b)
+{
+   const struct ramfs_entry *e1 = a;
+   const struct ramfs_entry *e2 = b;
+   return (e1->cookie > e2->cookie) - (e1->cookie < e2->cookie);
+}
+
+static long ramfs_find_cookie_cmp(const void *obj, const void *valptr)
+{
+   const struct ramfs_entry *e = obj;
+   const offt *cookie = valptr;
+   return (e->cookie > *cookie) - (e->cookie < *cookie);
+}
+
 static int
 ramfs_dir_add_entry(struct ramfs_inode *idir,
                     const char *iname,
@@ -29,15 +48,17 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
    if (enl > sizeof(e->name))
       return -ENAMETOOLONG;
 
-   if (!(e = kalloc_obj(struct ramfs_entry)))
+   if (!(e = kmalloc_cache_alloc(&ramfs_entry_cache)))
       return -ENOSPC;
 
    ASSERT(ie->parent_dir != NULL);
 
    bintree_node_init(&e->node);
+   bintree_node_init(&e->cnode);
    list_node_init(&e->lnode);
 
    e->inode = ie;
+   e->cookie = idir->next_cookie++;
    memcpy(e->name, iname, enl);
 
    if (e->name[enl-2] == '/') {
@@ -53,6 +74,13 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
                   struct ramfs_entry,
                   node);
 
+   bintree_insert(&idir->cookies_tree_root,
+                  e,
+                  ramfs_insert_remove_cookie_cmp,
+                  struct ramfs_entry,
+                  cnode);
+
+   /* Cookies are monotonic: the list remains sorted by cookie */
    list_add_tail(&idir->entries_list, &e->lnode);
 
    ie->nlink++;
@@ -63,34 +91,32 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
 static void
 ramfs_dir_remove_entry(struct ramfs_inode *idir, struct ramfs_entry *e)
 {
-   struct ramfs_handle *pos;
    struct ramfs_inode *ie = e->inode;
    ASSERT(idir->type == VFS_DIR);
 
    /*
-    * Before removing this entry, we have to check if, among the handles opened
-    * for `idir`, there are any having dpos == e. For each one of them, we have
-    * to move `dpos` forward, before removing the entry `e`.
+    * NOTE: the handles of `idir` don't need any fix-up, as their position is
+    * just a cookie: see ramfs_getdents().
     */
 
-   list_for_each_ro(pos, &idir->handles_list, node) {
-
-      if (pos->dpos == e)
-         pos->dpos = list_next_obj(pos->dpos, lnode);
-   }
-
    bintree_remove(&idir->entries_tree_root,
                   e,
                   ramfs_insert_remove_entry_cmp,
                   struct ramfs_entry,
                   node);
 
+   bintree_remove(&idir->cookies_tree_root,
+                  e,
+                  ramfs_insert_remove_cookie_cmp,
+                  struct ramfs_entry,
+                  cnode);
+
    list_remove(&e->lnode);
 
    ASSERT(ie->nlink > 0);
    ie->nlink--;
    idir->num_entries--;
-   kfree_obj(e, struct ramfs_entry);
+   kmalloc_cache_free(&ramfs_entry_cache, e);
 }
 
 static struct ramfs_entry *
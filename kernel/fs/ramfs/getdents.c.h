@@ -1,9 +1,19 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+/*
+ * Each entry of a directory gets a cookie when it's created, from a per-dir
+ * monotonically increasing counter. The position of a directory handle is the
+ * cookie of the next entry to return (or the first one after it, if that entry
+ * has been removed in the meanwhile), which is also the value of d_off of the
+ * previous entry. Therefore, resuming a getdents() or a seekdir() costs just a
+ * lookup in the cookies tree, while the handles don't need any fix-up when the
+ * entries get removed, as it happened when they pointed to the entries.
+ */
 static int ramfs_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
 {
    struct ramfs_handle *rh = h;
    struct ramfs_inode *inode = rh->inode;
+   struct ramfs_entry *e;
    int rc = 0;
 
    if (inode->type != VFS_DIR)
@@ -12,13 +22,23 @@ static int ramfs_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
    if ((inode->mode & 0400) != 0400) /* read permission */
       return -EACCES;
 
-   list_for_each_ro_kp(rh->dpos, &inode->entries_list, lnode) {
+   e = bintree_find_ge(inode->cookies_tree_root,
+                       &rh->pos,
+                       ramfs_find_cookie_cmp,
+                       struct ramfs_entry,
+                       cnode);
+
+   if (!e)
+      return 0; /* end of the directory */
+
+   list_for_each_ro_kp(e, &inode->entries_list, lnode) {
 
       struct vfs_dent64 dent = {
-         .ino        = rh->dpos->inode->ino,
-         .type       = rh->dpos->inode->type,
-         .name_len   = rh->dpos->name_len,
-         .name       = rh->dpos->name,
+         .ino        = e->inode->ino,
+         .type       = e->inode->type,
+         .name_len   = e->name_len,
+         .name       = e->name,
+         .next_off   = e->cookie + 1,
       };
 
       if ((rc = cb(&dent, arg)))
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Inline data
+ * -------------
+ *
+ * Small files don't get any page: their data is kept in a buffer beside the
+ * inode, just big enough to contain it. Its size, `inline_cap`, is a power of
+ * 2 growing together with the file, up to RAMFS_INLINE_MAX_SIZE. The bytes of
+ * the buffer past EOF are always zero, exactly like the ones in the last page
+ * of a regular file.
+ *
+ * A file gets promoted to block storage (see blocks.c.h) as soon as it grows
+ * past RAMFS_INLINE_MAX_SIZE or when it's memory-mapped, since the mappings
+ * need whole pages. The files having pages or mappings never go back inline:
+ * only a truncate to 0 frees their storage and makes that possible again.
+ */
+
+#define RAMFS_INLINE_MIN_SIZE                             32u
+#define RAMFS_INLINE_MAX_SIZE                            512u
+
+/* Check if the range [0, end) of `i` can be stored inline */
+static bool ramfs_can_be_inline(struct ramfs_inode *i, offt end)
+{
+   return !i->bmap_root &&
+          list_is_empty(&i->mappings_list) &&
+          MAX(end, i->fsize) <= (offt)RAMFS_INLINE_MAX_SIZE;
+}
+
+/*
+ * Get the data of the page `pg` of `i`, either inline or from the block map.
+ * Returns NULL in case of a hole.
+ */
+static ALWAYS_INLINE char *ramfs_get_page_data(struct ramfs_inode *i, ulong pg)
+{
+   if (i->inline_data)
+      return pg ? NULL : i->inline_data;
+
+   return ramfs_bmap_lookup(i, pg);
+}
+
+/* Make the inline buffer of `i` at least `size` bytes big */
+static int ramfs_inline_reserve(struct ramfs_inode *i, size_t size)
+{
+   u32 cap = RAMFS_INLINE_MIN_SIZE;
+   char *buf;
+
+   ASSERT(size <= RAMFS_INLINE_MAX_SIZE);
+
+   if (size <= i->inline_cap)
+      return 0;
+
+   while (cap < size)
+      cap *= 2;
+
+   if (!(buf = kzmalloc(cap)))
+      return -ENOMEM;
+
+   if (i->inline_data) {
+      memcpy(buf, i->inline_data, i->inline_cap);
+      kfree2(i->inline_data, i->inline_cap);
+   }
+
+   i->inline_data = buf;
+   i->inline_cap = cap;
+   return 0;
+}
+
+static void ramfs_inline_free(struct ramfs_inode *i)
+{
+   kfree2(i->inline_data, i->inline_cap);
+   i->inline_data = NULL;
+   i->inline_cap = 0;
+}
+
+/* Move the inline data of `i`, if any, to a regular page */
+static int ramfs_inline_promote(struct ramfs_inode *i)
+{
+   char *page;
+   u32 n;
+
+   if (!i->inline_data)
+      return 0;
+
+   ASSERT(!i->bmap_root);
+
+   if (!(page = ramfs_alloc_pages(i, 0, PAGE_SIZE, &n)))
+      return -ENOMEM;
+
+   memcpy(page, i->inline_data, i->inline_cap);
+   bzero(page + i->inline_cap, PAGE_SIZE - i->inline_cap);
+   ramfs_inline_free(i);
+   return 0;
+}
+
+/*
+ * Write `len` bytes at `pos` in the inline buffer of `i`, which gets allocated
+ * or grown as necessary. The caller must have checked ramfs_can_be_inline().
+ * Returns `len` or a negative errno value: nothing is written in that case.
+ */
+static ssize_t
+ramfs_inline_write(struct ramfs_inode *i,
+                   offt pos,
+                   char *buf,
+                   size_t len,
+                   bool user)
+{
+   const offt end = pos + (offt)len;
+   int rc;
+
+   ASSERT(ramfs_can_be_inline(i, end));
+
+   if ((rc = ramfs_inline_reserve(i, (size_t)MAX(end, i->fsize))))
+      return rc;
+
+   if (!user) {
+
+      memcpy(i->inline_data + pos, buf, len);
+
+   } else if (copy_from_user(i->inline_data + pos, buf, len)) {
+
+      /* Keep zeroed the bytes past EOF */
+      if (end > i->fsize)
+         bzero(i->inline_data + i->fsize, (size_t)(end - i->fsize));
+
+      if (!i->fsize)
+         ramfs_inline_free(i);
+
+      return -EFAULT;
+   }
+
+   if (end > i->fsize)
+      i->fsize = end;
+
+   return (ssize_t)len;
+}
+
+static void ramfs_inline_truncate(struct ramfs_inode *i, offt len)
+{
+   ASSERT(len < i->fsize);
+   ASSERT(i->fsize <= (offt)i->inline_cap);
+
+   if (!len) {
+      ramfs_inline_free(i);
+      return;
+   }
+
+   bzero(i->inline_data + len, (size_t)(i->fsize - len));
+}
@@ -2,13 +2,19 @@
 
 #define DEBUG_RAMFS_CREATE_INODE_PRINTK      0
 
+static DEFINE_KMALLOC_CACHE(ramfs_inode_cache,
+                            "ramfs_inode",
+                            sizeof(struct ramfs_inode),
+                            NULL);
+
 static struct ramfs_inode *ramfs_new_inode(struct ramfs_data *d)
 {
-   struct ramfs_inode *i = kzalloc_obj(struct ramfs_inode);
+   struct ramfs_inode *i = kmalloc_cache_alloc(&ramfs_inode_cache);
 
    if (!i)
       return NULL;
 
+   bzero(i, sizeof(*i));
    rwlock_wp_init(&i->rwlock, true);
    list_init(&i->mappings_list);
 
@@ -35,7 +41,6 @@ ramfs_create_inode_dir(struct ramfs_data *d,
    i->type = VFS_DIR;
    i->mode = (mode & 0777) | S_IFDIR;
    list_init(&i->entries_list);
-   list_init(&i->handles_list);
 
    if (!parent) {
       /* root case */
@@ -45,7 +50,7 @@ ramfs_create_inode_dir(struct ramfs_data *d,
    i->parent_dir = parent;
 
    if (ramfs_dir_add_entry(i, ".", i) < 0) {
-      kfree_obj(i, struct ramfs_inode);
+      kmalloc_cache_free(&ramfs_inode_cache, i);
       return NULL;
    }
 
@@ -54,7 +59,7 @@ ramfs_create_inode_dir(struct ramfs_data *d,
       struct ramfs_entry *e = i->entries_tree_root;
       ramfs_dir_remove_entry(i, e);
 
-      kfree_obj(i, struct ramfs_inode);
+      kmalloc_cache_free(&ramfs_inode_cache, i);
       return NULL;
    }
 
@@ -99,11 +104,13 @@ static int ramfs_destroy_inode(struct ramfs_data *d, struct ramfs_inode *i)
          break;
 
       case VFS_FILE:
-         ASSERT(i->blocks_tree_root == NULL);
+         ASSERT(i->bmap_root == NULL);
+         ASSERT(i->inline_data == NULL);
          break;
 
       case VFS_DIR:
          ASSERT(i->entries_tree_root == NULL);
+         ASSERT(i->cookies_tree_root == NULL);
          break;
 
       case VFS_SYMLINK:
@@ -115,7 +122,7 @@ static int ramfs_destroy_inode(struct ramfs_data *d, struct ramfs_inode *i)
    }
 
    rwlock_wp_destroy(&i->rwlock);
-   kfree_obj(i, struct ramfs_inode);
+   kmalloc_cache_free(&ramfs_inode_cache, i);
    return 0;
 }
 
@@ -1,77 +1,142 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+/*
+ * Memory mappings
+ * -----------------
+ *
+ * The pages of a mapping are mapped on demand, by ramfs_handle_fault(), on the
+ * first access to each one of them: that makes creating a mapping cost O(1),
+ * no matter how big it is. Only with VFS_MM_POPULATE (MAP_POPULATE or ELF
+ * segments, which cannot fault) all the pages get mapped immediately.
+ *
+ * Shared mappings map the file's pages themselves: the holes in the file get
+ * filled with zeroed pages on the first access, as the writes to the mapping
+ * must go to the file. Private mappings, instead, map the file's pages (or the
+ * zero page, for the holes) read-only and let handle_potential_cow() copy them
+ * on the first write: the file is never affected.
+ */
+
 static int ramfs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
 {
    return generic_fs_munmap(um, vaddrp, len);
 }
 
+/*
+ * Map the page of `um` at `vaddr` in `pdir`. Returns -EFAULT when the page is
+ * past EOF and -ENOMEM in the out-of-memory case.
+ */
 static int
-ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+ramfs_mmap_page(struct user_mapping *um, pdir_t *pdir, ulong vaddr)
 {
    struct ramfs_handle *rh = um->h;
    struct ramfs_inode *i = rh->inode;
-   ulong vaddr = um->vaddr;
-   struct bintree_walk_ctx ctx;
-   struct ramfs_block *b;
-   u32 pg_flags;
-   int rc;
+   const ulong off = um->off + (vaddr - um->vaddr);
+   const ulong pg = off >> PAGE_SHIFT;
+   const bool wr = !!(um->prot & PROT_WRITE);
+   u32 pg_flags = PAGING_FL_US;
+   char *data;
+   u32 n;
 
-   const size_t off_begin = um->off;
-   const size_t off_end = off_begin + um->len;
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(!i->inline_data);
 
-   ASSERT(IS_PAGE_ALIGNED(um->len));
+   if (off >= (ulong)i->fsize)
+      return -EFAULT; /* The whole page is past EOF */
 
-   if (i->type != VFS_FILE)
-      return -EACCES;
+   data = ramfs_bmap_lookup(i, pg);
+
+   if (um->flags == MAP_PRIVATE) {
+
+      if (!data) {
+         pg_flags |= wr ? PAGING_FL_RW : 0;
+         return map_zero_page(pdir, (void *)vaddr, pg_flags);
+      }
+
+      pg_flags |= wr ? PAGING_FL_COW : 0;
+      return map_page(pdir, (void *)vaddr, KERNEL_VA_TO_PA(data), pg_flags);
+   }
 
-   if (flags & VFS_MM_DONT_MMAP)
-      goto register_mapping;
+   if (!data) {
 
-   bintree_in_order_visit_start(&ctx,
-                                i->blocks_tree_root,
-                                struct ramfs_block,
-                                node,
-                                false);
+      const offt pos = (offt)off;
 
-   pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+      if (!(data = ramfs_alloc_pages(i, pos, pos + PAGE_SIZE, &n)))
+         return -ENOMEM;
 
-   if ((rh->fl_flags & O_RDWR) == O_RDWR)
-      pg_flags |= PAGING_FL_RW;
+      bzero(data, PAGE_SIZE);
 
-   while ((b = bintree_in_order_visit_next(&ctx))) {
+   } else {
 
-      if ((size_t)b->offset < off_begin)
-         continue; /* skip this block */
+      /* The writes through the mapping must not affect other files */
+      if (!(data = ramfs_get_private_page(i, pg, data)))
+         return -ENOMEM;
+   }
+
+   pg_flags |= PAGING_FL_SHARED | (wr ? PAGING_FL_RW : 0);
+   return map_page(pdir, (void *)vaddr, KERNEL_VA_TO_PA(data), pg_flags);
+}
+
+static int
+ramfs_mmap_populate(struct user_mapping *um, pdir_t *pdir)
+{
+   const ulong vend = um->vaddr + um->len;
+   ulong va;
+   int rc = 0;
 
-      if ((size_t)b->offset >= off_end)
+   for (va = um->vaddr; va < vend; va += PAGE_SIZE) {
+      if ((rc = ramfs_mmap_page(um, pdir, va)))
          break;
+   }
 
-      rc = map_page(pdir,
-                    (void *)vaddr,
-                    KERNEL_VA_TO_PA(b->vaddr),
-                    pg_flags);
+   /* The pages past EOF are never mapped: accessing them means SIGBUS */
+   if (!rc || rc == -EFAULT)
+      return 0;
 
-      if (rc) {
+   /* Out of memory: unmap the pages already mapped */
+   for (ulong v = um->vaddr; v < va; v += PAGE_SIZE)
+      unmap_page_permissive(pdir, (void *)v, false);
 
-         /* mmap failed, we have to unmap the pages already mapped */
-         vaddr -= PAGE_SIZE;
+   return rc;
+}
 
-         for (; vaddr >= um->vaddr; vaddr -= PAGE_SIZE) {
-            unmap_page_permissive(pdir, (void *)vaddr, false);
-         }
+static int
+ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct ramfs_handle *rh = um->h;
+   struct ramfs_inode *i = rh->inode;
+   int rc = 0;
 
-         return rc;
-      }
+   ASSERT(IS_PAGE_ALIGNED(um->len));
 
-      vaddr += PAGE_SIZE;
-   }
+   if (i->type != VFS_FILE)
+      return -EACCES;
+
+   if (flags & VFS_MM_DONT_MMAP) {
+
+      /*
+       * Just register the mapping: that's used by munmap() when splitting
+       * an existing mapping, with preemption disabled.
+       */
+      if (!(flags & VFS_MM_DONT_REGISTER))
+         list_add_tail(&i->mappings_list, &um->inode_node);
 
-register_mapping:
-   if (!(flags & VFS_MM_DONT_REGISTER)) {
-      list_add_tail(&i->mappings_list, &um->inode_node);
+      return 0;
    }
 
-   return 0;
+   /* Prevent ramfs_copy_range() from sharing pages in the meanwhile */
+   ramfs_file_exlock(rh);
+   {
+      /* The mappings need whole pages: see inline_data.c.h */
+      rc = ramfs_inline_promote(i);
+
+      if (!rc && (flags & VFS_MM_POPULATE))
+         rc = ramfs_mmap_populate(um, pdir);
+
+      if (!rc && !(flags & VFS_MM_DONT_REGISTER))
+         list_add_tail(&i->mappings_list, &um->inode_node);
+   }
+   ramfs_file_exunlock(rh);
+   return rc;
 }
 
 static bool
@@ -81,10 +146,7 @@ ramfs_handle_fault_int(struct process *pi,
                        bool p,
                        bool rw)
 {
-   struct ramfs_handle *rh = um->h;
    ulong vaddr = (ulong) vaddrp;
-   ulong abs_off;
-   struct ramfs_block *block;
    int rc;
 
    ASSERT(um != NULL);
@@ -101,27 +163,16 @@ ramfs_handle_fault_int(struct process *pi,
       return false;
    }
 
-   /* The page is *not* present */
-   abs_off = um->off + (vaddr - um->vaddr);
+   if (is_mapped(pi->pdir, vaddrp))
+      return true; /* Another thread faulted on the same page before us */
 
-   if (abs_off >= (ulong)rh->inode->fsize)
-      return false; /* Read/write past EOF */
-
-   if (rw) {
-      /* Create and map on-the-fly a struct ramfs_block */
-      if (!(block = ramfs_new_block((offt)(abs_off & PAGE_MASK))))
-         panic("Out-of-memory: unable to alloc a ramfs_block. No OOM killer");
+   rc = ramfs_mmap_page(um, pi->pdir, vaddr & PAGE_MASK);
 
-      ramfs_append_new_block(rh->inode, block);
-   }
-
-   rc = map_page(pi->pdir,
-                 (void *)(vaddr & PAGE_MASK),
-                 KERNEL_VA_TO_PA(rw ? block->vaddr : &zero_page),
-                 PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+   if (rc == -EFAULT)
+      return false; /* Read/write past EOF */
 
    if (rc)
-      panic("Out-of-memory: unable to map a ramfs_block. No OOM killer");
+      panic("Out-of-memory: unable to map a ramfs page. No OOM killer");
 
    invalidate_page(vaddr);
    return true;
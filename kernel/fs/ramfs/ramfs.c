@@ -11,14 +11,17 @@
 #include <sys/mman.h>      // system header
 
 #include "ramfs_int.h"
-#include "getdents.c.h"
 #include "locking.c.h"
 #include "dir_entries.c.h"
+#include "getdents.c.h"
 #include "inodes.c.h"
 #include "stat.c.h"
+#include "shared_pages.c.h"
 #include "blocks.c.h"
+#include "inline_data.c.h"
 #include "mmap.c.h"
 #include "rw_ops.c.h"
+#include "copy_range.c.h"
 #include "open.c.h"
 #include "mkdir.c.h"
 
@@ -62,17 +65,6 @@ static int ramfs_unlink(struct vfs_path *p)
    return 0;
 }
 
-static void ramfs_on_close(fs_handle h)
-{
-   struct ramfs_handle *rh = h;
-   struct ramfs_inode *i = rh->inode;
-
-   if (i->type == VFS_DIR) {
-      /* Remove this handle from h->inode->handles_list */
-      list_remove(&rh->node);
-   }
-}
-
 static void ramfs_on_close_last_handle(fs_handle h)
 {
    struct ramfs_handle *rh = h;
@@ -314,7 +306,6 @@ static const struct fs_ops static_fsops_ramfs =
 {
    .get_inode = ramfs_getinode,
    .open = ramfs_open,
-   .on_close = ramfs_on_close,
    .on_close_last_handle = ramfs_on_close_last_handle,
    .getdents = ramfs_getdents,
    .unlink = ramfs_unlink,
@@ -20,33 +20,29 @@
 
 struct ramfs_inode;
 
-struct ramfs_block {
-
-   struct bintree_node node;
-   offt offset;                  /* MUST BE divisible by PAGE_SIZE */
-   void *vaddr;
-};
-
 /*
  * Ramfs entries do not *necessarily* need to have a fixed size, as they are
  * allocated dynamically on the heap. Said that, a fixed-size entry struct is
- * simpler to manage and faster to alloc/free, in particular with Tilck's
- * current kmalloc implementation.
+ * simpler to manage and faster to alloc/free, as they come from a kmalloc
+ * cache: see dir_entries.c.h.
  */
 #define RAMFS_ENTRY_SIZE 256
 #define RAMFS_ENTRY_MAX_LEN (                   \
    RAMFS_ENTRY_SIZE                             \
-   - sizeof(struct bintree_node)                \
+   - 2 * sizeof(struct bintree_node)            \
    - sizeof(struct list_node)                   \
    - sizeof(struct ramfs_inode *)               \
+   - sizeof(offt)                               \
    - sizeof(u8)                                 \
 )
 
 struct ramfs_entry {
 
-   struct bintree_node node;
+   struct bintree_node node;        /* node in the tree sorted by name */
+   struct bintree_node cnode;       /* node in the tree sorted by cookie */
    struct list_node lnode;
    struct ramfs_inode *inode;
+   offt cookie;                     /* see ramfs_getdents() */
    u8 name_len;                     /* NOTE: includes the final \0 */
    char name[RAMFS_ENTRY_MAX_LEN];
 };
@@ -66,7 +62,7 @@ struct ramfs_inode {
    struct rwlock_wp rwlock;
    nlink_t nlink;
    mode_t mode;
-   size_t blocks_count;                /* count of page-size blocks */
+   size_t blocks_count;                /* count of data pages */
    struct ramfs_inode *parent_dir;
    struct list mappings_list;          /* see ramfs_unmap_past_eof_mappings() */
 
@@ -75,15 +71,19 @@ struct ramfs_inode {
       /* valid when type == VFS_FILE */
       struct {
          offt fsize;
-         struct ramfs_block *blocks_tree_root;
+         void *bmap_root;              /* radix tree of pages: blocks.c.h */
+         u32 bmap_height;
+         u32 inline_cap;
+         char *inline_data;            /* small files: see inline_data.c.h */
       };
 
       /* valid when type == VFS_DIR */
       struct {
          offt num_entries;
+         offt next_cookie;
          struct ramfs_entry *entries_tree_root;
-         struct list entries_list;
-         struct list handles_list;
+         struct ramfs_entry *cookies_tree_root;
+         struct list entries_list;     /* sorted by cookie */
       };
 
       /* valid when type == VFS_SYMLINK */
@@ -105,12 +105,6 @@ struct ramfs_handle {
 
    /* ramfs-specific fields */
    struct ramfs_inode *inode;
-
-   /* valid only if inode->type == VFS_DIR */
-   struct {
-      struct list_node node;        /* node in inode->handles_list */
-      struct ramfs_entry *dpos;     /* current entry position */
-   };
 };
 
 STATIC_ASSERT(sizeof(struct ramfs_handle) <= MAX_FS_HANDLE_SIZE);
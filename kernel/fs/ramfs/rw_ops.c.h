@@ -7,21 +7,11 @@ static int ramfs_ioctl(fs_handle h, ulong cmd, void *argp)
 
 static offt ramfs_dir_seek(struct ramfs_handle *rh, offt target_off)
 {
-   struct ramfs_inode *i = rh->inode;
-   struct ramfs_entry *dpos;
-   offt off = 0;
-
-   list_for_each_ro(dpos, &i->entries_list, lnode) {
-
-      if (off == target_off) {
-         rh->pos = off;
-         rh->dpos = dpos;
-         break;
-      }
-
-      off++;
-   }
-
+   /*
+    * The position of a directory handle is just the cookie of the next entry
+    * to return: see ramfs_getdents(). Any value is acceptable here.
+    */
+   rh->pos = target_off;
    return rh->pos;
 }
 
@@ -166,8 +156,11 @@ static void ramfs_unmap_past_eof_mappings(struct ramfs_inode *i, size_t len)
       const ulong voff = rlen >= um->off ? rlen - um->off : 0;
       const ulong vend = um->vaddr + um->len;
 
+      /* The private copies of the pages (see mmap.c.h) have to be freed */
+      const bool do_free = um->flags == MAP_PRIVATE;
+
       for (va = um->vaddr + voff; va < vend; va += PAGE_SIZE) {
-         unmap_page_permissive(um->pi->pdir, (void *)va, false);
+         unmap_page_permissive(um->pi->pdir, (void *)va, do_free);
          invalidate_page(va);
       }
    }
@@ -175,6 +168,8 @@ static void ramfs_unmap_past_eof_mappings(struct ramfs_inode *i, size_t len)
 
 static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
 {
+   int rc;
+
    ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
 
    if (len < 0 || len >= i->fsize)
@@ -197,26 +192,44 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
    }
    enable_preemption();
 
-   while (true) {
-
-      struct ramfs_block *b =
-         bintree_get_last_obj(i->blocks_tree_root, struct ramfs_block, node);
+   if (i->inline_data) {
 
-      if (!b || b->offset < len)
-         break;
+      ramfs_inline_truncate(i, len);
 
-      /* Remove the block object from the tree */
-      bintree_remove_ptr(&i->blocks_tree_root,
-                         b,
-                         struct ramfs_block,
-                         node,
-                         offset);
+   } else if ((rc = ramfs_truncate_pages(i, len))) {
 
-      ramfs_destroy_block(b);
+      /*
+       * The only possible failure is OOM while copying a shared page (see
+       * shared_pages.c.h), in which case nothing changed. The mappings just
+       * unmapped will be simply mapped again by ramfs_handle_fault().
+       */
+      return rc;
    }
 
    i->fsize = len;
-   i->blocks_count = pow2_round_up_at((ulong) len, PAGE_SIZE);
+   return 0;
+}
+
+static int ramfs_inode_extend(struct ramfs_inode *i, offt new_len)
+{
+   int rc;
+
+   ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
+   ASSERT(new_len > i->fsize);
+
+   if (i->inline_data) {
+
+      /* The inline buffer must always contain the whole file */
+      if (new_len <= (offt)RAMFS_INLINE_MAX_SIZE)
+         rc = ramfs_inline_reserve(i, (size_t)new_len);
+      else
+         rc = ramfs_inline_promote(i);
+
+      if (rc)
+         return rc;
+   }
+
+   i->fsize = new_len;
    return 0;
 }
 
@@ -248,8 +261,13 @@ static int ramfs_truncate(struct fs *fs, vfs_inode_ptr_t i, offt len)
    return ramfs_inode_truncate_safe(i, len, false);
 }
 
+/*
+ * When `user` is true, `buf` is a user space buffer (readv and writev) and it's
+ * accessed directly, with no bounce buffer and no limit on `len`. In case of a
+ * fault, the functions return the number of bytes copied so far or -EFAULT.
+ */
 static ssize_t
-ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len)
+ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len, bool user)
 {
    struct ramfs_inode *inode = rh->inode;
    offt tot_read = 0;
@@ -262,8 +280,8 @@ ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len)
 
    while (buf_rem > 0) {
 
-      struct ramfs_block *block;
-      const offt page     = rh->pos & (offt)PAGE_MASK;
+      char *data;
+      const ulong page    = (ulong)(rh->pos >> PAGE_SHIFT);
       const offt page_off = rh->pos & (offt)OFFSET_IN_PAGE_MASK;
       const offt page_rem = (offt)PAGE_SIZE - page_off;
       const offt file_rem = inode->fsize - rh->pos;
@@ -277,18 +295,21 @@ ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len)
       if (!to_read)
          break;
 
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+      if ((data = ramfs_get_page_data(inode, page)))
+         data += page_off;    /* reading a regular page or inline data */
+      else
+         data = zero_page;    /* reading a hole */
 
-      if (block) {
-         /* reading a regular block */
-         memcpy(buf + tot_read, block->vaddr + page_off, (size_t)to_read);
-      } else {
-         /* reading a hole */
-         memset(buf + tot_read, 0, (size_t)to_read);
+      if (!user) {
+
+         memcpy(buf + tot_read, data, (size_t)to_read);
+
+      } else if (copy_to_user(buf + tot_read, data, (size_t)to_read)) {
+
+         if (!tot_read)
+            return -EFAULT;
+
+         break;
       }
 
       tot_read += to_read;
@@ -306,18 +327,23 @@ static ssize_t ramfs_read(fs_handle h, char *buf, size_t len)
 
    ramfs_file_shlock(h);
    {
-      ret = ramfs_read_nolock(rh, buf, len);
+      ret = ramfs_read_nolock(rh, buf, len, false);
    }
    ramfs_file_shunlock(h);
    return ret;
 }
 
+#define RAMFS_MAX_POS       ((offt)(LONG_MAX & ~OFFSET_IN_PAGE_MASK))
+
 static ssize_t
-ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len)
+ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len, bool user)
 {
    struct ramfs_inode *inode = rh->inode;
+   char *new_pages = NULL, *new_pages_end = NULL;
    offt tot_written = 0;
-   offt buf_rem = (offt)len;
+   offt buf_rem;
+   ssize_t rc;
+   u32 n;
 
    /* We can be sure it's a file because dirs cannot be open for writing */
    ASSERT(inode->type == VFS_FILE);
@@ -325,34 +351,82 @@ ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len)
    if (rh->fl_flags & O_APPEND)
       rh->pos = inode->fsize;
 
+   /*
+    * The file position must not overflow: the limit is page-aligned in order
+    * to make safe rounding up the end of the write to PAGE_SIZE as well.
+    */
+   if (len > 0 && rh->pos >= RAMFS_MAX_POS)
+      return -EFBIG;
+
+   len = MIN(len, (size_t)(RAMFS_MAX_POS - rh->pos));
+
+   if (!len)
+      return 0;
+
+   if (ramfs_can_be_inline(inode, rh->pos + (offt)len)) {
+
+      /* Small file: see inline_data.c.h */
+      if ((rc = ramfs_inline_write(inode, rh->pos, buf, len, user)) > 0)
+         rh->pos += rc;
+
+      return rc == -ENOMEM ? -ENOSPC : rc;
+   }
+
+   /* The file is growing too much: move its inline data to a page */
+   if (ramfs_inline_promote(inode))
+      return -ENOSPC;
+
+   buf_rem = (offt)len;
+
    while (buf_rem > 0) {
 
-      struct ramfs_block *block;
-      const offt page     = rh->pos & (offt)PAGE_MASK;
+      char *data;
+      const ulong page    = (ulong)(rh->pos >> PAGE_SHIFT);
       const offt page_off = rh->pos & (offt)OFFSET_IN_PAGE_MASK;
       const offt page_rem = (offt)PAGE_SIZE - page_off;
       const offt to_write = MIN(page_rem, buf_rem);
 
       ASSERT(to_write > 0);
 
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+      if ((data = ramfs_bmap_lookup(inode, page))) {
+
+         /* The page might be shared with other files: see shared_pages.c.h */
+         if (!(data = ramfs_get_private_page(inode, page, data)))
+            break;
 
-      /* Assert that if page_off > 0, the block is present */
-      ASSERT(!page_off || block);
+      } else {
 
-      if (!block) {
+         /* Allocate (possibly) all the pages needed by the rest of the write */
+         data = ramfs_alloc_pages(inode, rh->pos, rh->pos + buf_rem, &n);
 
-         if (!(block = ramfs_new_block(page)))
+         if (!data)
             break;
 
-         ramfs_append_new_block(inode, block);
+         new_pages = data;
+         new_pages_end = data + n * PAGE_SIZE;
+      }
+
+      if (!user) {
+
+         memcpy(data + page_off, buf + tot_written, (size_t)to_write);
+
+      } else if (copy_from_user(data + page_off,
+                                buf + tot_written,
+                                (size_t)to_write))
+      {
+         /*
+          * The pages we just allocated and haven't written yet must not keep
+          * their old content: they might be in a hole or past EOF.
+          */
+         if (data >= new_pages && data < new_pages_end)
+            bzero(data + page_off, (size_t)(new_pages_end - data - page_off));
+
+         if (!tot_written)
+            return -EFAULT;
+
+         break;
       }
 
-      memcpy(block->vaddr + page_off, buf + tot_written, (size_t)to_write);
       tot_written += to_write;
       buf_rem     -= to_write;
       rh->pos     += to_write;
@@ -361,7 +435,7 @@ ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len)
          inode->fsize = rh->pos;
    }
 
-   if (len > 0 && !tot_written)
+   if (!tot_written)
       return -ENOSPC;
 
    return (ssize_t)tot_written;
@@ -374,7 +448,7 @@ static ssize_t ramfs_write(fs_handle h, char *buf, size_t len)
 
    ramfs_file_exlock(h);
    {
-      ret = ramfs_write_nolock(rh, buf, len);
+      ret = ramfs_write_nolock(rh, buf, len, false);
    }
    ramfs_file_exunlock(h);
    return ret;
@@ -383,24 +457,18 @@ static ssize_t ramfs_write(fs_handle h, char *buf, size_t len)
 static ssize_t
 ramfs_readv_nolock(struct ramfs_handle *rh, const struct iovec *iov, int iovcnt)
 {
-   struct task *curr = get_curr_task();
    ssize_t ret = 0;
    ssize_t rc;
-   size_t len;
 
    for (int i = 0; i < iovcnt; i++) {
 
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
-      rc = ramfs_read_nolock(rh, curr->io_copybuf, len);
+      rc = ramfs_read_nolock(rh, iov[i].iov_base, iov[i].iov_len, true);
 
       if (rc < 0) {
-         ret = rc;
+         ret = ret ? ret : rc;
          break;
       }
 
-      if (copy_to_user(iov[i].iov_base, curr->io_copybuf, len))
-         return -EFAULT;
-
       ret += rc;
 
       if (rc < (ssize_t)iov[i].iov_len)
@@ -427,22 +495,15 @@ ramfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
 static ssize_t
 ramfs_writev_nolock(struct ramfs_handle *h, const struct iovec *iov, int iovcnt)
 {
-   struct task *curr = get_curr_task();
    ssize_t ret = 0;
    ssize_t rc;
-   size_t len;
 
    for (int i = 0; i < iovcnt; i++) {
 
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
-
-      if (copy_from_user(curr->io_copybuf, iov[i].iov_base, len))
-         return -EFAULT;
-
-      rc = ramfs_write_nolock(h, curr->io_copybuf, len);
+      rc = ramfs_write_nolock(h, iov[i].iov_base, iov[i].iov_len, true);
 
       if (rc < 0) {
-         ret = rc;
+         ret = ret ? ret : rc;
          break;
       }
 
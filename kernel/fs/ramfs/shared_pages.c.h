@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Shared pages
+ * --------------
+ *
+ * In order to make copy_file_range() and sendfile() between ramfs files cheap,
+ * ramfs_copy_range() makes the destination file use the same pages of the
+ * source file, instead of copying them, when possible. Such pages are then
+ * copied on write: before writing to a shared page, a file has to replace it
+ * with a private copy by calling ramfs_get_private_page().
+ *
+ * The share count of a page, i.e. the number of files using it, is kept in a
+ * global tree only for the pages used by 2+ files: all the other pages are
+ * implicitly used by a single file. That makes the common case (no shared
+ * pages at all) free in terms of memory and almost free in terms of time.
+ *
+ * Writes through the memory mappings do not go through ramfs, therefore the
+ * pages of a file having memory mappings are never shared: ramfs_mmap_page()
+ * replaces the shared pages with private copies before mapping them in shared
+ * mappings and ramfs_copy_range() does not share the pages of files having
+ * mappings at all.
+ */
+
+struct ramfs_shared_page {
+
+   struct bintree_node node;
+   void *page;                      /* key */
+   u32 users;                       /* always >= 2 */
+};
+
+static struct ramfs_shared_page *ramfs_shared_pages;
+
+static struct ramfs_shared_page *ramfs_find_shared_page(void *page)
+{
+   ASSERT(!is_preemption_enabled());
+
+   return bintree_find_ptr(ramfs_shared_pages,
+                           page,
+                           struct ramfs_shared_page,
+                           node,
+                           page);
+}
+
+static bool ramfs_is_page_shared(void *page)
+{
+   bool ret;
+
+   disable_preemption();
+   {
+      ret = ramfs_shared_pages && ramfs_find_shared_page(page);
+   }
+   enable_preemption();
+   return ret;
+}
+
+/* Add one more user to `page`. Returns false in case of OOM. */
+static bool ramfs_share_page(void *page)
+{
+   struct ramfs_shared_page *sp;
+   bool ok = true;
+
+   disable_preemption();
+   {
+      if ((sp = ramfs_find_shared_page(page))) {
+
+         sp->users++;
+
+      } else if ((sp = kzalloc_obj(struct ramfs_shared_page))) {
+
+         bintree_node_init(&sp->node);
+         sp->page = page;
+         sp->users = 2;
+
+         bintree_insert_ptr(&ramfs_shared_pages,
+                            sp,
+                            struct ramfs_shared_page,
+                            node,
+                            page);
+
+      } else {
+
+         ok = false;
+      }
+   }
+   enable_preemption();
+   return ok;
+}
+
+/*
+ * Drop one user of `page`. Returns true if the page is still used by other
+ * files, false if the caller was its only user and it has to be freed.
+ */
+static bool ramfs_put_shared_page(void *page)
+{
+   struct ramfs_shared_page *sp, *to_free = NULL;
+   bool still_used = false;
+
+   disable_preemption();
+   {
+      if (ramfs_shared_pages && (sp = ramfs_find_shared_page(page))) {
+
+         still_used = true;
+
+         if (--sp->users == 1) {
+
+            bintree_remove_ptr(&ramfs_shared_pages,
+                               sp,
+                               struct ramfs_shared_page,
+                               node,
+                               page);
+            to_free = sp;
+         }
+      }
+   }
+   enable_preemption();
+
+   if (to_free)
+      kfree_obj(to_free, struct ramfs_shared_page);
+
+   return still_used;
+}
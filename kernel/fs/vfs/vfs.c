@@ -10,15 +10,18 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/epoll.h>
 
 #include <dirent.h> // system header
 
 #include "../fs_int.h"
+#include "vfs_dcache.c.h"
 #include "vfs_mp.c.h"
 #include "vfs_locking.c.h"
 #include "vfs_resolve.c.h"
 #include "vfs_getdents.c.h"
 #include "vfs_op_ready.c.h"
+#include "vfs_transfer.c.h"
 
 static u32 next_device_id;
 
@@ -38,6 +41,9 @@ void vfs_close(fs_handle h)
    if (!pi->vforked)
       remove_all_mappings_of_handle(pi, h);
 
+   if (hb->epitems)
+      epoll_on_handle_close(h);
+
    if (fsops->on_close)
       fsops->on_close(h);
 
@@ -96,6 +102,9 @@ int vfs_dup(fs_handle h, fs_handle *dup_h)
    /* The new file descriptor does NOT share old file descriptor's fd_flags */
    new_handle->fd_flags = 0;
 
+   /* Nor its epoll items: the interest sets refer to single handles */
+   new_handle->epitems = NULL;
+
    /* Check that the locked_file object (if any) is still the same */
    ASSERT(new_handle->lf == hb->lf);
 
@@ -276,6 +285,9 @@ vfs_open_impl(struct fs *fs, struct vfs_path *p,
    if ((rc = fs->fsops->open(p, out, flags, mode)))
       return rc;
 
+   if (!p->fs_path.inode)
+      vfs_dcache_invalidate(fs); /* open() created a new file */
+
    {
       struct fs_handle_base *hb = *out;
 
@@ -340,6 +352,8 @@ int vfs_stat64(const char *path, struct stat64 *statbuf, bool res_last_sl)
 static ALWAYS_INLINE int
 vfs_mkdir_impl(struct fs *fs, struct vfs_path *p, mode_t mode, ulong x, ulong y)
 {
+   int rc;
+
    if (!fs->fsops->mkdir)
       return -EPERM;
 
@@ -349,7 +363,11 @@ vfs_mkdir_impl(struct fs *fs, struct vfs_path *p, mode_t mode, ulong x, ulong y)
    if (p->fs_path.inode)
       return -EEXIST;
 
-   return fs->fsops->mkdir(p, mode);
+   if ((rc = fs->fsops->mkdir(p, mode)))
+      return rc;
+
+   vfs_dcache_invalidate(fs);
+   return 0;
 }
 
 int vfs_mkdir(const char *path, mode_t mode)
@@ -368,6 +386,8 @@ int vfs_mkdir(const char *path, mode_t mode)
 static ALWAYS_INLINE int
 vfs_rmdir_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
 {
+   int rc;
+
    if (!fs->fsops->rmdir)
       return -EPERM;
 
@@ -377,7 +397,11 @@ vfs_rmdir_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
    if (!p->fs_path.inode)
       return -ENOENT;
 
-   return fs->fsops->rmdir(p);
+   if ((rc = fs->fsops->rmdir(p)))
+      return rc;
+
+   vfs_dcache_invalidate(fs);
+   return 0;
 }
 
 int vfs_rmdir(const char *path)
@@ -394,6 +418,8 @@ int vfs_rmdir(const char *path)
 static ALWAYS_INLINE int
 vfs_unlink_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
 {
+   int rc;
+
    if (!fs->fsops->unlink)
       return -EPERM;
 
@@ -403,7 +429,11 @@ vfs_unlink_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
    if (!p->fs_path.inode)
       return -ENOENT;
 
-   return fs->fsops->unlink(p);
+   if ((rc = fs->fsops->unlink(p)))
+      return rc;
+
+   vfs_dcache_invalidate(fs);
+   return 0;
 }
 
 int vfs_unlink(const char *path)
@@ -464,6 +494,8 @@ static ALWAYS_INLINE int
 vfs_symlink_impl(struct fs *fs,
                  struct vfs_path *p, const char *target, ulong u1, ulong u2)
 {
+   int rc;
+
    if (!fs->fsops->symlink)
       return -EPERM;
 
@@ -473,7 +505,11 @@ vfs_symlink_impl(struct fs *fs,
    if (p->fs_path.inode)
       return -EEXIST; /* the linkpath already exists! */
 
-   return fs->fsops->symlink(target, p);
+   if ((rc = fs->fsops->symlink(target, p)))
+      return rc;
+
+   vfs_dcache_invalidate(fs);
+   return 0;
 }
 
 int vfs_symlink(const char *target, const char *linkpath)
@@ -682,6 +718,9 @@ vfs_rename_or_link(const char *oldpath,
          : -EROFS /* read-only struct fs */
       : -EPERM; /* not supported */
 
+   if (!rc)
+      vfs_dcache_invalidate(fs);
+
    /* We're done, release fs's exlock and its retain count */
    vfs_smart_fs_unlock(fs, true);
    release_obj(fs);
@@ -769,6 +808,9 @@ ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
    ssize_t rc;
    size_t len;
 
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
    if (hb->fops->readv)
       return hb->fops->readv(h, iov, iovcnt);
 
@@ -815,6 +857,9 @@ ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
    ssize_t rc;
    size_t len;
 
+   if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* file not opened for writing */
+
    if (hb->fops->writev)
       return hb->fops->writev(h, iov, iovcnt);
 
@@ -856,6 +901,81 @@ ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
    return ret;
 }
 
+ssize_t vfs_pread(fs_handle h, void *buf, size_t buf_size, offt off)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ssize_t rc;
+   offt saved_pos;
+
+   if (!hb->fops->read)
+      return -EBADF;
+
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
+   if (off < 0)
+      return -EINVAL;
+
+   if (hb->fops->pread)
+      return hb->fops->pread(h, buf, buf_size, off);
+
+   if (!hb->fops->seek)
+      return -ESPIPE;
+
+   /*
+    * The file system does not support positional reads: emulate them by
+    * moving the cursor and then restoring it back.
+    */
+
+   if ((saved_pos = hb->fops->seek(h, 0, SEEK_CUR)) < 0)
+      return saved_pos;
+
+   if ((rc = hb->fops->seek(h, off, SEEK_SET)) >= 0)
+      rc = hb->fops->read(h, buf, buf_size);
+
+   hb->fops->seek(h, saved_pos, SEEK_SET);
+   return rc;
+}
+
+ssize_t vfs_preadv(fs_handle h, const struct iovec *iov, int iovcnt, offt off)
+{
+   struct task *curr = get_curr_task();
+   ssize_t ret = 0;
+   ssize_t rc;
+   size_t len;
+
+   /*
+    * Like vfs_readv(), preadv() is implemented in a generic and non-atomic way
+    * on the top of vfs_pread(). That's fine, because the file offset is not
+    * affected anyway.
+    */
+
+   for (int i = 0; i < iovcnt; i++) {
+
+      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
+
+      rc = vfs_pread(h, curr->io_copybuf, len, off + ret);
+
+      if (rc < 0) {
+         ret = ret ? ret : rc;
+         break;
+      }
+
+      if (copy_to_user(iov[i].iov_base, curr->io_copybuf, (size_t)rc))
+         return -EFAULT;
+
+      ret += rc;
+
+      if (rc < (ssize_t)iov[i].iov_len)
+         break; // Not enough data to fill all the user buffers.
+   }
+
+   return ret;
+}
+
 u32 vfs_get_new_device_id(void)
 {
    return next_device_id++;
@@ -878,6 +998,7 @@ create_fs_obj(const char *type,
    fs->device_data = device_data;
    fs->flags = flags;
    fs->device_id = vfs_get_new_device_id();
+   fs->dcache_gen = vfs_dcache_new_gen();
 
    return fs;
 }
@@ -944,14 +1065,19 @@ int vfs_exunlock(struct fs *fs, vfs_inode_ptr_t i)
    return rc;
 }
 
+static DEFINE_KMALLOC_CACHE(handle_cache,
+                            "fs_handle",
+                            MAX_FS_HANDLE_SIZE,
+                            NULL);
+
 fs_handle vfs_alloc_handle_raw(void)
 {
-   return kmalloc(MAX_FS_HANDLE_SIZE);
+   return kmalloc_cache_alloc(&handle_cache);
 }
 
 void vfs_free_handle(fs_handle h)
 {
-   kfree2(h, MAX_FS_HANDLE_SIZE);
+   kmalloc_cache_free(&handle_cache, h);
 }
 
 fs_handle vfs_alloc_handle(void)
@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Dentry cache
+ * --------------
+ *
+ * Path resolution calls the get_entry() func of the struct fs for each
+ * component of each path. Depending on the filesystem, that might require
+ * a tree lookup (ramfs), a linear scan (devfs) or a hash lookup (fat). This
+ * global cache remembers the results of those calls, keyed by the tuple
+ * (fs, parent inode, name), so that frequently resolved paths skip the lookup
+ * in the filesystem entirely. Negative results (inode == NULL) are cached as
+ * well, since looking up non-existent files is very common (think of PATH
+ * searches).
+ *
+ * The cache has a fixed number of entries, recycled in LRU order: that makes
+ * its memory usage bounded and known at compile time. Names longer than
+ * VFS_DCACHE_NAME_MAX are never cached.
+ *
+ * Invalidation is per-fs and O(1): each struct fs has a generation number and
+ * each cached entry is valid only as long as its generation matches the one
+ * of its fs. The VFS path functions that modify directories (mkdir, rmdir,
+ * unlink, symlink, rename, link, open with O_CREAT) and mp_add() bump the
+ * generation of the fs, as the filesystems do when they create entries on
+ * their own (devfs, sysfs). Because generation numbers come from a global
+ * counter, entries belonging to a destroyed fs can never match a new fs
+ * allocated at the same address. A struct fs having dcache_gen == 0 (i.e.
+ * not created by create_fs_obj()) does not use the cache at all.
+ *
+ * Entries are looked up and inserted while holding (at least) a shared lock
+ * on the fs, therefore no directory can change in the meanwhile, except for
+ * the filesystems creating entries on their own: for them, the generation is
+ * read *before* calling get_entry(), so that a result computed before the
+ * invalidation can never become valid.
+ */
+
+#if TINY_KERNEL
+   #define VFS_DCACHE_ENTRIES                            64
+#else
+   #define VFS_DCACHE_ENTRIES                           256
+#endif
+
+#define VFS_DCACHE_BUCKETS             (VFS_DCACHE_ENTRIES / 2)
+#define VFS_DCACHE_NAME_MAX                              32
+
+struct vfs_dentry {
+
+   struct list_node hnode;          /* node in the hash bucket */
+   struct list_node lru_node;       /* node in the LRU list */
+
+   struct fs *fs;                   /* NULL if the entry is unused */
+   vfs_inode_ptr_t dir_inode;
+   u32 gen;
+   u32 hash;
+
+   struct fs_path fs_path;          /* result of get_entry() */
+
+   u32 name_len;
+   char name[VFS_DCACHE_NAME_MAX];
+};
+
+static struct vfs_dentry dcache_entries[VFS_DCACHE_ENTRIES];
+static struct list dcache_buckets[VFS_DCACHE_BUCKETS];
+static struct list dcache_lru;      /* most recently used first */
+static struct vfs_dcache_stats dcache_stats;
+static u32 dcache_last_gen;
+static bool dcache_initialized;
+
+STATIC_ASSERT((VFS_DCACHE_BUCKETS & (VFS_DCACHE_BUCKETS - 1)) == 0);
+
+static void vfs_dcache_init(void)
+{
+   list_init(&dcache_lru);
+
+   for (u32 i = 0; i < VFS_DCACHE_BUCKETS; i++)
+      list_init(&dcache_buckets[i]);
+
+   for (u32 i = 0; i < VFS_DCACHE_ENTRIES; i++) {
+
+      struct vfs_dentry *de = &dcache_entries[i];
+
+      list_node_init(&de->hnode);
+      list_node_init(&de->lru_node);
+      de->fs = NULL;
+      list_add_tail(&dcache_lru, &de->lru_node);
+   }
+
+   dcache_initialized = true;
+}
+
+static u32 vfs_dcache_new_gen(void)
+{
+   u32 gen;
+
+   disable_preemption();
+   {
+      if (!++dcache_last_gen)
+         ++dcache_last_gen;    /* 0 means "do not cache" */
+
+      gen = dcache_last_gen;
+   }
+   enable_preemption();
+   return gen;
+}
+
+void vfs_dcache_invalidate(struct fs *fs)
+{
+   fs->dcache_gen = vfs_dcache_new_gen();
+}
+
+void vfs_dcache_get_stats(struct vfs_dcache_stats *stats)
+{
+   disable_preemption();
+   {
+      *stats = dcache_stats;
+   }
+   enable_preemption();
+}
+
+static u32
+vfs_dcache_hash(struct fs *fs,
+                vfs_inode_ptr_t idir,
+                const char *name,
+                size_t name_len)
+{
+   /* FNV-1a */
+   u32 h = 2166136261u;
+
+   for (size_t i = 0; i < name_len; i++) {
+      h ^= (u8)name[i];
+      h *= 16777619u;
+   }
+
+   h ^= (u32)((ulong)idir >> 2) * 2654435761u;
+   h ^= (u32)((ulong)fs >> 2) * 2246822519u;
+   return h;
+}
+
+static struct vfs_dentry *
+vfs_dcache_find(struct fs *fs,
+                vfs_inode_ptr_t idir,
+                const char *name,
+                size_t name_len,
+                u32 hash)
+{
+   struct list *bucket = &dcache_buckets[hash & (VFS_DCACHE_BUCKETS - 1)];
+   struct vfs_dentry *pos;
+
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(pos, bucket, hnode) {
+
+      if (pos->hash != hash || pos->fs != fs || pos->dir_inode != idir)
+         continue;
+
+      if (pos->name_len == name_len && !memcmp(pos->name, name, name_len))
+         return pos;
+   }
+
+   return NULL;
+}
+
+static void vfs_dcache_drop(struct vfs_dentry *de)
+{
+   ASSERT(!is_preemption_enabled());
+
+   if (de->fs) {
+      list_remove(&de->hnode);
+      de->fs = NULL;
+   }
+
+   /* Unused entries are the first to be recycled */
+   list_remove(&de->lru_node);
+   list_add_tail(&dcache_lru, &de->lru_node);
+}
+
+static void
+vfs_dcache_insert(struct fs *fs,
+                  vfs_inode_ptr_t idir,
+                  const char *name,
+                  size_t name_len,
+                  u32 hash,
+                  u32 gen,
+                  struct fs_path *fs_path)
+{
+   struct vfs_dentry *de;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!(de = vfs_dcache_find(fs, idir, name, name_len, hash))) {
+
+      de = list_last_obj(&dcache_lru, struct vfs_dentry, lru_node);
+
+      if (de->fs) {
+         dcache_stats.evictions++;
+         list_remove(&de->hnode);
+      }
+
+      de->fs = fs;
+      de->dir_inode = idir;
+      de->hash = hash;
+      de->name_len = (u32)name_len;
+      memcpy(de->name, name, name_len);
+
+      list_add_tail(&dcache_buckets[hash & (VFS_DCACHE_BUCKETS - 1)],
+                    &de->hnode);
+   }
+
+   de->gen = gen;
+   de->fs_path = *fs_path;
+
+   list_remove(&de->lru_node);
+   list_add_head(&dcache_lru, &de->lru_node);
+}
+
+/* Cached version of vfs_get_entry(), for the lookup of a name in a directory */
+static void
+vfs_dcache_get_entry(struct fs *fs,
+                     vfs_inode_ptr_t idir,
+                     const char *name,
+                     ssize_t name_len,
+                     struct fs_path *fs_path)
+{
+   const u32 gen = fs->dcache_gen;
+   struct vfs_dentry *de;
+   bool hit = false;
+   u32 hash;
+
+   if (!gen || !idir || name_len <= 0 || name_len > VFS_DCACHE_NAME_MAX) {
+      vfs_get_entry(fs, idir, name, name_len, fs_path);
+      return;
+   }
+
+   hash = vfs_dcache_hash(fs, idir, name, (size_t)name_len);
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!dcache_initialized))
+         vfs_dcache_init();
+
+      if ((de = vfs_dcache_find(fs, idir, name, (size_t)name_len, hash))) {
+
+         if (de->gen == gen) {
+
+            *fs_path = de->fs_path;
+            list_remove(&de->lru_node);
+            list_add_head(&dcache_lru, &de->lru_node);
+            hit = true;
+
+         } else {
+
+            /* Stale entry: recycle it */
+            vfs_dcache_drop(de);
+         }
+      }
+
+      if (hit)
+         dcache_stats.hits++;
+      else
+         dcache_stats.misses++;
+   }
+   enable_preemption();
+
+   if (hit)
+      return;
+
+   vfs_get_entry(fs, idir, name, name_len, fs_path);
+
+   disable_preemption();
+   {
+      vfs_dcache_insert(fs, idir, name, (size_t)name_len, hash, gen, fs_path);
+   }
+   enable_preemption();
+}
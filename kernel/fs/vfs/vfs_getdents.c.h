@@ -73,7 +73,8 @@ static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
    }
 
    ctx->ent.d_ino    = vde->ino;
-   ctx->ent.d_off    = (u64) ctx->off + 1; /* "offset" (=ID) of the next dent */
+   /* "offset" (=ID) of the next dent */
+   ctx->ent.d_off    = vde->next_off ? (u64)vde->next_off : (u64)ctx->off + 1;
    ctx->ent.d_reclen = entry_size;
    ctx->ent.d_type   = vfs_type_to_linux_dirent_type(vde->type);
 
@@ -88,7 +89,7 @@ static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
 
    ctx->offset += entry_size;
    ctx->off++;
-   ctx->h->pos++;
+   ctx->h->pos = vde->next_off ? vde->next_off : ctx->h->pos + 1;
    return 0;
 }
 
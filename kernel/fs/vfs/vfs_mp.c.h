@@ -133,6 +133,14 @@ int mp_add(struct fs *target_fs, const char *target_path)
       /* Now that we've succeeded, we must retain the target_fs as well */
       retain_obj(target_fs);
 
+      /*
+       * The mount point crossing is not part of the cached lookups, but drop
+       * the cached entries of both the filesystems anyway, to be on the safe
+       * side.
+       */
+      vfs_dcache_invalidate(p.fs);
+      vfs_dcache_invalidate(target_fs);
+
    } else {
 
       /* no free slot, sorry */
@@ -147,6 +155,10 @@ int mp_add(struct fs *target_fs, const char *target_path)
 
 int mp_remove(const char *target_path)
 {
+   /*
+    * NOTE: once implemented, this will have to call vfs_dcache_invalidate()
+    * for both the host and the target fs, as mp_add() does.
+    */
    NOT_IMPLEMENTED();
 }
 
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * In-kernel data transfer
+ * -------------------------
+ *
+ * vfs_transfer() is the primitive behind sendfile(), splice() and
+ * copy_file_range(): it moves data from a file to another one without ever
+ * copying it to user space. When both the files belong to the same fs and
+ * their file_ops have a copy_range() func, the whole transfer is delegated to
+ * the fs (ramfs can just share the pages between the two files). Otherwise,
+ * the data is read and written in chunks through the per-task io_copybuf.
+ *
+ * When `in_off` or `out_off` is not NULL, the corresponding file is accessed
+ * at that offset, which is updated at the end, while the file position is not
+ * affected. Otherwise, the file position is used and updated, as read() and
+ * write() would do.
+ */
+
+static ssize_t
+vfs_copy_range(struct fs_handle_base *hi,
+               offt *in_off,
+               struct fs_handle_base *ho,
+               offt *out_off,
+               size_t len)
+{
+   const func_copy_range copy_range = hi->fops->copy_range;
+   offt in_pos, out_pos;
+   ssize_t tot = 0, rc = 0;
+
+   if (!copy_range || copy_range != ho->fops->copy_range || hi->fs != ho->fs)
+      return -EXDEV;
+
+   if (ho->fl_flags & O_APPEND)
+      return -EXDEV;
+
+   in_pos = in_off ? *in_off : hi->fops->seek(hi, 0, SEEK_CUR);
+   out_pos = out_off ? *out_off : ho->fops->seek(ho, 0, SEEK_CUR);
+
+   if (in_pos < 0 || out_pos < 0)
+      return -EXDEV;
+
+   /* The fs is allowed to copy less than requested: see file_ops */
+   while ((size_t)tot < len) {
+
+      rc = copy_range(hi, in_pos + tot, ho, out_pos + tot, len - (size_t)tot);
+
+      if (rc <= 0)
+         break;
+
+      tot += rc;
+   }
+
+   if (!tot)
+      return rc;
+
+   if (in_off)
+      *in_off += tot;
+   else
+      hi->fops->seek(hi, in_pos + tot, SEEK_SET);
+
+   if (out_off)
+      *out_off += tot;
+   else
+      ho->fops->seek(ho, out_pos + tot, SEEK_SET);
+
+   return tot;
+}
+
+/* Positional write, emulated with seek + write like vfs_pread() does */
+static ssize_t
+vfs_transfer_write(struct fs_handle_base *h, offt *off, char *buf, size_t len)
+{
+   offt saved_pos = 0;
+   ssize_t rc;
+
+   if (off) {
+
+      if (!h->fops->seek)
+         return -ESPIPE;
+
+      if ((saved_pos = h->fops->seek(h, 0, SEEK_CUR)) < 0)
+         return saved_pos;
+
+      if ((rc = h->fops->seek(h, *off, SEEK_SET)) < 0)
+         return rc;
+   }
+
+   rc = h->fops->write(h, buf, len);
+
+   if (off) {
+
+      h->fops->seek(h, saved_pos, SEEK_SET);
+
+      if (rc > 0)
+         *off += rc;
+   }
+
+   return rc;
+}
+
+static ssize_t
+vfs_transfer_generic(struct fs_handle_base *hi,
+                     offt *in_off,
+                     struct fs_handle_base *ho,
+                     offt *out_off,
+                     size_t len)
+{
+   char *buf = get_curr_task()->io_copybuf;
+   ssize_t tot = 0, rc = 0, wrc;
+   size_t n, written;
+
+   while ((size_t)tot < len) {
+
+      if (tot && pending_signals())
+         break;
+
+      n = MIN(len - (size_t)tot, IO_COPYBUF_SIZE);
+
+      if (in_off)
+         rc = vfs_pread(hi, buf, n, *in_off);
+      else
+         rc = vfs_read(hi, buf, n);
+
+      if (rc <= 0)
+         break;
+
+      if (in_off)
+         *in_off += rc;
+
+      /* Write everything we've read, unless an error occurs */
+      for (written = 0; written < (size_t)rc; written += (size_t)wrc) {
+
+         wrc = vfs_transfer_write(ho,
+                                  out_off,
+                                  buf + written,
+                                  (size_t)rc - written);
+
+         if (wrc <= 0) {
+
+            /*
+             * Give the bytes we couldn't write back to the input, when it's
+             * seekable. Otherwise (pipes, ttys), they're lost: there's
+             * nothing more we can do.
+             */
+            if (in_off)
+               *in_off -= rc - (ssize_t)written;
+            else if (hi->fops->seek)
+               hi->fops->seek(hi, (offt)written - rc, SEEK_CUR);
+
+            tot += (ssize_t)written;
+            return tot ? tot : wrc;
+         }
+      }
+
+      tot += rc;
+
+      if ((size_t)rc < n)
+         break; /* Short read: don't block waiting for more data */
+   }
+
+   return tot ? tot : rc;
+}
+
+ssize_t
+vfs_transfer(fs_handle in,
+             offt *in_off,
+             fs_handle out,
+             offt *out_off,
+             size_t len)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(in != NULL && out != NULL);
+
+   struct fs_handle_base *hi = in;
+   struct fs_handle_base *ho = out;
+   ssize_t rc;
+
+   if (!hi->fops->read || ((hi->fl_flags & O_WRONLY) &&
+                           !(hi->fl_flags & O_RDWR)))
+      return -EBADF; /* input file not opened for reading */
+
+   if (!ho->fops->write || !(ho->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* output file not opened for writing */
+
+   if ((hi->spec_flags | ho->spec_flags) & VFS_SPFL_NO_USER_COPY)
+      return -EINVAL; /* special files work only with user buffers */
+
+   if ((in_off && *in_off < 0) || (out_off && *out_off < 0))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   if ((rc = vfs_copy_range(hi, in_off, ho, out_off, len)) != -EXDEV)
+      return rc;
+
+   return vfs_transfer_generic(hi, in_off, ho, out_off, len);
+}
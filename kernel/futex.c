@@ -0,0 +1,596 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/futex.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/user.h>
+
+#include <sys/mman.h>      // system header
+#include <linux/futex.h>   // system header
+
+/*
+ * Futexes
+ * ---------
+ *
+ * The waiters sleep on the wait lists of a small hash table of buckets, using
+ * the regular wait_obj machinery: the `ptr` of their wait_obj points to a
+ * struct futex_waiter on their kernel stack, containing the futex key.
+ *
+ * The key of a futex in a MAP_SHARED mapping is its physical address, so that
+ * all the processes mapping the same page share it. In all the other cases
+ * (private memory or FUTEX_PRIVATE_FLAG), the key is the pair (pdir, vaddr):
+ * a physical address is not stable there, because of the CoW after fork().
+ *
+ * Locking: each bucket has a mutex, serializing the wait and the wake paths.
+ * Because the wait lists are touched also by wake_up() (e.g. when a signal
+ * interrupts the wait), they're changed only with preemption disabled.
+ */
+
+#define FUTEX_HASH_BITS                                                   6
+#define FUTEX_HASH_SIZE                              (1 << FUTEX_HASH_BITS)
+
+struct futex_key {
+   ulong addr;          /* paddr for shared futexes, vaddr otherwise */
+   pdir_t *pdir;        /* NULL for shared futexes */
+};
+
+struct futex_bucket {
+   struct kmutex lock;
+   struct list wait_list;
+};
+
+struct futex_waiter {
+   struct futex_key key;
+   struct task *ti;
+   u32 bitset;
+   bool woken;          /* set by futex_wake_waiter() */
+};
+
+static struct futex_bucket futex_buckets[FUTEX_HASH_SIZE];
+
+static ALWAYS_INLINE bool
+futex_key_eq(const struct futex_key *a, const struct futex_key *b)
+{
+   return a->addr == b->addr && a->pdir == b->pdir;
+}
+
+static struct futex_bucket *futex_get_bucket(const struct futex_key *key)
+{
+   const u32 h = (u32)(key->addr >> 2) ^ (u32)((ulong)key->pdir >> PAGE_SHIFT);
+   return &futex_buckets[(h * 0x9e3779b1u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+static int futex_get_key(u32 *uaddr, bool priv, struct futex_key *key)
+{
+   struct process *pi = get_curr_proc();
+   struct user_mapping *um;
+   int rc = 0;
+   ulong pa;
+   u32 val;
+
+   if ((ulong)uaddr & (sizeof(u32) - 1))
+      return -EINVAL;
+
+   *key = (struct futex_key) {
+      .addr = (ulong)uaddr,
+      .pdir = pi->pdir,
+   };
+
+   if (priv)
+      return 0;
+
+   disable_preemption();
+   {
+      um = process_get_user_mapping(uaddr);
+
+      if (um && (um->flags & MAP_SHARED)) {
+
+         /* Read the futex first, to make sure its page is mapped */
+         if (copy_from_user(&val, uaddr, sizeof(val)) ||
+             get_mapping2(pi->pdir, uaddr, &pa) < 0)
+         {
+            rc = -EFAULT;
+
+         } else {
+
+            *key = (struct futex_key) { .addr = pa, .pdir = NULL };
+         }
+      }
+   }
+   enable_preemption();
+   return rc;
+}
+
+static void futex_lock_buckets(struct futex_bucket *b1, struct futex_bucket *b2)
+{
+   if (b1 > b2) {
+      struct futex_bucket *tmp = b1;
+      b1 = b2;
+      b2 = tmp;
+   }
+
+   kmutex_lock(&b1->lock);
+
+   if (b2 != b1)
+      kmutex_lock(&b2->lock);
+}
+
+static void
+futex_unlock_buckets(struct futex_bucket *b1, struct futex_bucket *b2)
+{
+   if (b2 != b1)
+      kmutex_unlock(&b2->lock);
+
+   kmutex_unlock(&b1->lock);
+}
+
+static void futex_wake_waiter(struct futex_waiter *w)
+{
+   ASSERT(!is_preemption_enabled());
+
+   w->woken = true;
+   task_cancel_wakeup_timer(w->ti);
+   wake_up(w->ti);
+}
+
+/* Wake up to `nr` waiters of `key` matching `bitset`. Bucket locked. */
+static int
+futex_wake_locked(struct futex_bucket *b,
+                  const struct futex_key *key,
+                  u32 nr,
+                  u32 bitset)
+{
+   struct wait_obj *wo, *temp;
+   struct futex_waiter *w;
+   u32 cnt = 0;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&b->lock));
+
+   disable_preemption();
+   {
+      list_for_each(wo, temp, &b->wait_list, wait_list_node) {
+
+         if (cnt >= nr)
+            break;
+
+         w = wait_obj_get_ptr(wo);
+
+         if (!futex_key_eq(&w->key, key) || !(w->bitset & bitset))
+            continue;
+
+         futex_wake_waiter(w);
+         cnt++;
+      }
+   }
+   enable_preemption();
+   return (int)cnt;
+}
+
+static int
+futex_wait(u32 *uaddr, bool priv, u32 val, const u64 *timeout, u32 bitset)
+{
+   struct task *curr = get_curr_task();
+   struct futex_bucket *b;
+   struct futex_waiter w;
+   u32 uval;
+   int rc;
+
+   if (!bitset)
+      return -EINVAL;
+
+   w = (struct futex_waiter) { .ti = curr, .bitset = bitset };
+
+   if ((rc = futex_get_key(uaddr, priv, &w.key)))
+      return rc;
+
+   b = futex_get_bucket(&w.key);
+   kmutex_lock(&b->lock);
+
+   if (copy_from_user(&uval, uaddr, sizeof(uval))) {
+      kmutex_unlock(&b->lock);
+      return -EFAULT;
+   }
+
+   if (uval != val) {
+      kmutex_unlock(&b->lock);
+      return -EAGAIN;
+   }
+
+   if (timeout && !*timeout) {
+      kmutex_unlock(&b->lock);
+      return -ETIMEDOUT;
+   }
+
+   disable_preemption();
+   prepare_to_wait_on(WOBJ_FUTEX, &w, NO_EXTRA, &b->wait_list);
+
+   if (timeout)
+      task_set_wakeup_timer(curr, (u32)MIN(*timeout, (u64)0xffffffff));
+
+   kmutex_unlock(&b->lock);
+   enter_sleep_wait_state();
+
+   /* ------------------- We've been woken up ------------------- */
+
+   if (timeout)
+      task_cancel_wakeup_timer(curr);
+
+   if (w.woken)
+      return 0;
+
+   /*
+    * Both futex_wake_waiter() and the signals reset our wait_obj: if it's
+    * still set, we woke up because of the timeout.
+    */
+   if (wait_obj_reset(&curr->wobj))
+      return -ETIMEDOUT;
+
+   return pending_signals() ? -EINTR : 0;
+}
+
+static int futex_wake(u32 *uaddr, bool priv, u32 nr, u32 bitset)
+{
+   struct futex_bucket *b;
+   struct futex_key key;
+   int rc;
+
+   if (!bitset)
+      return -EINVAL;
+
+   if ((rc = futex_get_key(uaddr, priv, &key)))
+      return rc;
+
+   b = futex_get_bucket(&key);
+   kmutex_lock(&b->lock);
+   {
+      rc = futex_wake_locked(b, &key, nr, bitset);
+   }
+   kmutex_unlock(&b->lock);
+   return rc;
+}
+
+/* For the kernel itself: used on thread exit, for CLONE_CHILD_CLEARTID */
+int futex_wake_addr(u32 *uaddr, u32 nr)
+{
+   return futex_wake(uaddr, false, nr, FUTEX_BITSET_MATCH_ANY);
+}
+
+/*
+ * Wake up to `nr_wake` waiters of `uaddr` and move up to `nr_requeue` of the
+ * remaining ones to `uaddr2`. With `cmpval` != NULL (FUTEX_CMP_REQUEUE), do
+ * that only if `*uaddr` is still equal to `*cmpval`.
+ */
+static int
+futex_requeue(u32 *uaddr,
+              u32 *uaddr2,
+              bool priv,
+              u32 nr_wake,
+              u32 nr_requeue,
+              const u32 *cmpval)
+{
+   struct futex_bucket *b1, *b2;
+   struct futex_key key1, key2;
+   struct wait_obj *wo, *temp;
+   struct futex_waiter *w;
+   u32 woken = 0, moved = 0;
+   u32 uval;
+   int rc;
+
+   if ((rc = futex_get_key(uaddr, priv, &key1)))
+      return rc;
+
+   if ((rc = futex_get_key(uaddr2, priv, &key2)))
+      return rc;
+
+   b1 = futex_get_bucket(&key1);
+   b2 = futex_get_bucket(&key2);
+   futex_lock_buckets(b1, b2);
+
+   if (cmpval) {
+
+      if (copy_from_user(&uval, uaddr, sizeof(uval))) {
+         rc = -EFAULT;
+         goto out;
+      }
+
+      if (uval != *cmpval) {
+         rc = -EAGAIN;
+         goto out;
+      }
+   }
+
+   disable_preemption();
+   {
+      list_for_each(wo, temp, &b1->wait_list, wait_list_node) {
+
+         w = wait_obj_get_ptr(wo);
+
+         if (!futex_key_eq(&w->key, &key1))
+            continue;
+
+         if (woken < nr_wake) {
+
+            futex_wake_waiter(w);
+            woken++;
+
+         } else if (moved < nr_requeue) {
+
+            list_remove(&wo->wait_list_node);
+            list_add_tail(&b2->wait_list, &wo->wait_list_node);
+            w->key = key2;
+            moved++;
+
+         } else {
+
+            break;
+         }
+      }
+   }
+   enable_preemption();
+   rc = (int)(woken + moved);
+
+out:
+   futex_unlock_buckets(b1, b2);
+   return rc;
+}
+
+static ALWAYS_INLINE int sign_extend12(u32 v)
+{
+   return (int)(v << 20) >> 20;
+}
+
+static bool futex_op_cmp(u32 encoded_op, int oldval)
+{
+   const int cmparg = sign_extend12(encoded_op);
+
+   switch ((encoded_op >> 24) & 0xf) {
+      case FUTEX_OP_CMP_EQ: return oldval == cmparg;
+      case FUTEX_OP_CMP_NE: return oldval != cmparg;
+      case FUTEX_OP_CMP_LT: return oldval < cmparg;
+      case FUTEX_OP_CMP_LE: return oldval <= cmparg;
+      case FUTEX_OP_CMP_GT: return oldval > cmparg;
+      case FUTEX_OP_CMP_GE: return oldval >= cmparg;
+   }
+
+   return false;
+}
+
+/* Apply the operation encoded in `encoded_op` to `*uaddr`, atomically */
+static int futex_atomic_op(u32 *uaddr, u32 encoded_op, int *oldval)
+{
+   u32 op = (encoded_op >> 28) & 0xf;
+   u32 oparg = (u32)sign_extend12(encoded_op >> 12);
+   u32 val, newval;
+   int rc = 0;
+
+   if (op & FUTEX_OP_OPARG_SHIFT) {
+
+      if (oparg > 31)
+         return -EINVAL;
+
+      oparg = 1u << oparg;
+      op &= ~FUTEX_OP_OPARG_SHIFT;
+   }
+
+   /* Tilck is UP: disabling the preemption is enough for atomicity */
+   disable_preemption();
+
+   if (copy_from_user(&val, uaddr, sizeof(val))) {
+      rc = -EFAULT;
+      goto out;
+   }
+
+   switch (op) {
+      case FUTEX_OP_SET:  newval = oparg;        break;
+      case FUTEX_OP_ADD:  newval = val + oparg;  break;
+      case FUTEX_OP_OR:   newval = val | oparg;  break;
+      case FUTEX_OP_ANDN: newval = val & ~oparg; break;
+      case FUTEX_OP_XOR:  newval = val ^ oparg;  break;
+      default:
+         rc = -ENOSYS;
+         goto out;
+   }
+
+   if (copy_to_user(uaddr, &newval, sizeof(newval))) {
+      rc = -EFAULT;
+      goto out;
+   }
+
+   *oldval = (int)val;
+
+out:
+   enable_preemption();
+   return rc;
+}
+
+static int
+futex_wake_op(u32 *uaddr,
+              u32 *uaddr2,
+              bool priv,
+              u32 nr_wake,
+              u32 nr_wake2,
+              u32 encoded_op)
+{
+   struct futex_bucket *b1, *b2;
+   struct futex_key key1, key2;
+   int rc, oldval;
+
+   if ((rc = futex_get_key(uaddr, priv, &key1)))
+      return rc;
+
+   if ((rc = futex_get_key(uaddr2, priv, &key2)))
+      return rc;
+
+   b1 = futex_get_bucket(&key1);
+   b2 = futex_get_bucket(&key2);
+   futex_lock_buckets(b1, b2);
+
+   if (!(rc = futex_atomic_op(uaddr2, encoded_op, &oldval))) {
+
+      rc = futex_wake_locked(b1, &key1, nr_wake, FUTEX_BITSET_MATCH_ANY);
+
+      if (futex_op_cmp(encoded_op, oldval))
+         rc += futex_wake_locked(b2, &key2, nr_wake2, FUTEX_BITSET_MATCH_ANY);
+   }
+
+   futex_unlock_buckets(b1, b2);
+   return rc;
+}
+
+/*
+ * Convert a futex timeout to ticks. FUTEX_WAIT uses relative timeouts, while
+ * FUTEX_WAIT_BITSET uses absolute ones, by default on CLOCK_MONOTONIC.
+ */
+static int
+futex_timeout_to_ticks(const struct k_timespec64 *ts,
+                       bool abs,
+                       bool realtime,
+                       u64 *ticks)
+{
+   struct k_timespec64 now;
+   u64 t, now_t;
+
+   if (ts->tv_sec < 0 || ts->tv_nsec < 0 || ts->tv_nsec >= BILLION)
+      return -EINVAL;
+
+   t = timespec_to_ticks(ts);
+
+   if (abs) {
+
+      if (realtime)
+         real_time_get_timespec(&now);
+      else
+         monotonic_time_get_timespec(&now);
+
+      now_t = timespec_to_ticks(&now);
+      t = t > now_t ? t - now_t : 0;
+   }
+
+   *ticks = t;
+   return 0;
+}
+
+static int
+do_futex(u32 *uaddr,
+         int futex_op,
+         u32 val,
+         const struct k_timespec64 *timeout,
+         ulong val2,
+         u32 *uaddr2,
+         u32 val3)
+{
+   const bool priv = !!(futex_op & FUTEX_PRIVATE_FLAG);
+   const bool realtime = !!(futex_op & FUTEX_CLOCK_REALTIME);
+   const int cmd = futex_op & FUTEX_CMD_MASK;
+   u64 ticks;
+   int rc;
+
+   if (realtime && cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET)
+      return -ENOSYS;
+
+   switch (cmd) {
+
+      case FUTEX_WAIT:
+      case FUTEX_WAIT_BITSET:
+
+         if (timeout) {
+
+            rc = futex_timeout_to_ticks(timeout,
+                                        cmd == FUTEX_WAIT_BITSET,
+                                        realtime,
+                                        &ticks);
+            if (rc)
+               return rc;
+         }
+
+         return futex_wait(uaddr,
+                           priv,
+                           val,
+                           timeout ? &ticks : NULL,
+                           cmd == FUTEX_WAIT ? FUTEX_BITSET_MATCH_ANY : val3);
+
+      case FUTEX_WAKE:
+         return futex_wake(uaddr, priv, val, FUTEX_BITSET_MATCH_ANY);
+
+      case FUTEX_WAKE_BITSET:
+         return futex_wake(uaddr, priv, val, val3);
+
+      case FUTEX_REQUEUE:
+         return futex_requeue(uaddr, uaddr2, priv, val, (u32)val2, NULL);
+
+      case FUTEX_CMP_REQUEUE:
+         return futex_requeue(uaddr, uaddr2, priv, val, (u32)val2, &val3);
+
+      case FUTEX_WAKE_OP:
+         return futex_wake_op(uaddr, uaddr2, priv, val, (u32)val2, val3);
+
+      default:
+         /* Tilck does not support the PI futexes */
+         return -ENOSYS;
+   }
+}
+
+static ALWAYS_INLINE bool futex_cmd_has_timeout(int futex_op)
+{
+   const int cmd = futex_op & FUTEX_CMD_MASK;
+   return cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_BITSET;
+}
+
+int sys_futex_time32(u32 *uaddr, int futex_op, u32 val,
+                     const struct k_timespec32 *u_timeout,
+                     u32 *uaddr2, u32 val3)
+{
+   struct k_timespec32 ts32;
+   struct k_timespec64 ts;
+
+   if (!futex_cmd_has_timeout(futex_op) || !u_timeout) {
+
+      /* For the other operations, `u_timeout` is an integer (val2) */
+      return do_futex(uaddr, futex_op, val, NULL,
+                      (ulong)u_timeout, uaddr2, val3);
+   }
+
+   if (copy_from_user(&ts32, u_timeout, sizeof(ts32)))
+      return -EFAULT;
+
+   ts = (struct k_timespec64) {
+      .tv_sec = ts32.tv_sec,
+      .tv_nsec = ts32.tv_nsec,
+   };
+
+   return do_futex(uaddr, futex_op, val, &ts, 0, uaddr2, val3);
+}
+
+int sys_futex(u32 *uaddr, int futex_op, u32 val,
+              const struct k_timespec64 *u_timeout,
+              u32 *uaddr2, u32 val3)
+{
+   struct k_timespec64 ts;
+
+   if (!futex_cmd_has_timeout(futex_op) || !u_timeout) {
+
+      /* For the other operations, `u_timeout` is an integer (val2) */
+      return do_futex(uaddr, futex_op, val, NULL,
+                      (ulong)u_timeout, uaddr2, val3);
+   }
+
+   if (copy_from_user(&ts, u_timeout, sizeof(ts)))
+      return -EFAULT;
+
+   return do_futex(uaddr, futex_op, val, &ts, 0, uaddr2, val3);
+}
+
+void init_futex(void)
+{
+   for (int i = 0; i < FUTEX_HASH_SIZE; i++) {
+      kmutex_init(&futex_buckets[i].lock, 0);
+      list_init(&futex_buckets[i].wait_list);
+   }
+}
@@ -0,0 +1,1320 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+#include <tilck_gen_headers/config_userlim.h>
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/io_uring.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/io_uring.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/eventfd.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/worker_thread.h>
+
+#include <fcntl.h>      // system header
+#include <sys/mman.h>   // system header
+
+/*
+ * io_uring
+ * ---------
+ *
+ * A ring is a pair of queues shared with the user: the application writes
+ * SQEs (requests) and advances the SQ tail, while the kernel posts CQEs
+ * (completions) and advances the CQ tail. io_uring_enter() submits a batch of
+ * SQEs and optionally waits for completions, all with a single syscall.
+ *
+ * Tilck has no asynchronous I/O underneath: the read/write/open/close requests
+ * are executed synchronously, in the context of the submitter, and complete
+ * before io_uring_enter() returns. Their benefit is just the batching. The
+ * requests which can wait for a long time (poll, timeout) instead become
+ * in-flight requests, driven by kcond watchers and ktimers: when one of them
+ * gets ready, it's pushed in the ready list of its ring and the ring is queued
+ * for the `io_uring` worker thread, which completes the request. The fsync
+ * requests are always completed by the worker.
+ *
+ * The CQ never overflows: each submitted request reserves a CQE and the
+ * submission stops (-EBUSY, if nothing was submitted) when all the free CQEs
+ * are reserved. Therefore, IORING_FEAT_NODROP is advertised.
+ *
+ * Locking: `sq_lock` serializes the consumers of the SQ, while `lock` protects
+ * the CQ, the reservations and the in-flight requests. The ready lists and the
+ * global list of rings to drain are changed by the watchers as well, which run
+ * with preemption disabled: therefore, they're protected by disabling the
+ * preemption. The ktimers' callbacks cannot take `lock`, because ktimer_set()
+ * is called while holding it.
+ */
+
+/* The part of the rings shared with the user, in a single region */
+struct io_rings {
+
+   ATOMIC(u32) sq_head;          /* advanced by the kernel */
+   ATOMIC(u32) sq_tail;          /* advanced by the user */
+   u32 sq_ring_mask;
+   u32 sq_ring_entries;
+   u32 sq_flags;
+   u32 sq_dropped;               /* invalid SQ array entries skipped */
+
+   ATOMIC(u32) cq_head;          /* advanced by the user */
+   ATOMIC(u32) cq_tail;          /* advanced by the kernel */
+   u32 cq_ring_mask;
+   u32 cq_ring_entries;
+   u32 cq_overflow;              /* always 0, see the CQE reservations */
+   u32 cq_flags;
+
+   struct io_uring_cqe cqes[];   /* followed by the SQ array (u32 indexes) */
+};
+
+struct io_ring;
+
+struct io_req {
+
+   struct list_node node;        /* in ctx->reqs */
+   struct list_node ready_node;  /* in ctx->ready_list, when `queued` */
+   struct io_ring *ctx;
+   fs_handle h;                  /* a dup of the target handle, if any */
+   u64 user_data;
+   u8 opcode;
+   bool queued;
+
+   union {
+
+      struct {
+         u32 events;
+         struct kcond_watcher rwatch;
+         struct kcond_watcher wwatch;
+         struct kcond_watcher ewatch;
+      } poll;
+
+      struct {
+         struct ktimer timer;
+         u64 target;             /* complete at this cq_seq, 0 for never */
+      } timeout;
+
+      bool datasync;             /* IORING_OP_FSYNC */
+   };
+};
+
+struct io_ring {
+
+   KOBJ_BASE_FIELDS
+
+   struct kmutex sq_lock;
+   struct kmutex lock;
+   struct kcond cond;            /* signaled on new CQEs and ready requests */
+
+   struct io_rings *rings;
+   struct io_uring_sqe *sqes;
+   u32 *sq_array;                /* inside `rings`, after the CQEs */
+   u32 rings_order;              /* pf_alloc() order of `rings` */
+   u32 sqes_order;               /* pf_alloc() order of `sqes` */
+   u32 sq_entries;
+   u32 cq_entries;
+
+   /* Private copies: the user could overwrite the ones in `rings` */
+   u32 sq_head;
+   u32 cq_tail;
+
+   u32 reserved;                 /* CQEs reserved by the submitted requests */
+   u64 cq_seq;                   /* non-timeout CQEs posted, for the timeouts */
+
+   struct list reqs;             /* the in-flight requests */
+   struct list ready_list;       /* the in-flight requests to check */
+   struct list_node drain_node;  /* in io_drain_list, when `drain_queued` */
+   bool drain_queued;
+
+   fs_handle evfd;               /* a dup of the registered eventfd, if any */
+};
+
+static struct worker_thread *io_wth;
+static struct list io_drain_list = STATIC_LIST_INIT(io_drain_list);
+static struct kcond io_drain_cond = STATIC_KCOND_INIT(io_drain_cond);
+static struct io_ring *io_draining;    /* the ring drained by the worker */
+static bool io_drain_job_queued;
+
+static const struct file_ops static_ops_io_ring;
+
+static struct io_ring *get_io_ring_of_handle(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+
+   if (kh->fops != &static_ops_io_ring)
+      return NULL;
+
+   return (void *)kh->kobj;
+}
+
+static ALWAYS_INLINE u32 io_cq_count(struct io_ring *ctx)
+{
+   const u32 head = atomic_load_explicit(&ctx->rings->cq_head, mo_acquire);
+
+   /* A bogus head written by the user cannot make us overwrite CQEs */
+   return MIN(ctx->cq_tail - head, ctx->cq_entries);
+}
+
+static void io_check_timeouts(struct io_ring *ctx);
+
+static void io_post_cqe(struct io_ring *ctx, u64 user_data, int res, bool tmo)
+{
+   struct io_rings *rings = ctx->rings;
+   struct io_uring_cqe *cqe;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&ctx->lock));
+   ASSERT(ctx->reserved > 0);
+
+   cqe = &rings->cqes[ctx->cq_tail & (ctx->cq_entries - 1)];
+   cqe->user_data = user_data;
+   cqe->res = res;
+   cqe->flags = 0;
+
+   ctx->cq_tail++;
+   ctx->reserved--;
+   atomic_store_explicit(&rings->cq_tail, ctx->cq_tail, mo_release);
+
+   if (ctx->evfd)
+      eventfd_signal(ctx->evfd, 1);
+
+   kcond_signal_all(&ctx->cond);
+
+   if (!tmo) {
+      ctx->cq_seq++;
+      io_check_timeouts(ctx);
+   }
+}
+
+static void io_drain_job(void *unused);
+
+/*
+ * Put `req` in the ready list of its ring and make sure the worker will check
+ * it. Called with preemption disabled, by the watchers and the timers too.
+ */
+static void io_req_push(struct io_req *req)
+{
+   struct io_ring *ctx = req->ctx;
+   ASSERT(!is_preemption_enabled());
+
+   if (req->queued)
+      return;
+
+   req->queued = true;
+   list_add_tail(&ctx->ready_list, &req->ready_node);
+
+   if (!ctx->drain_queued) {
+      ctx->drain_queued = true;
+      list_add_tail(&io_drain_list, &ctx->drain_node);
+   }
+
+   if (!io_drain_job_queued) {
+
+      /*
+       * If the queue of the worker is full, the request will be completed by
+       * the next io_uring_enter() waiting for completions on this ring, which
+       * drains the ring by itself.
+       */
+      if (wth_enqueue_on(io_wth, &io_drain_job, NULL))
+         io_drain_job_queued = true;
+   }
+
+   kcond_signal_all(&ctx->cond);
+}
+
+static void io_poll_rwatch_cb(struct kcond_watcher *w)
+{
+   io_req_push(CONTAINER_OF(w, struct io_req, poll.rwatch));
+}
+
+static void io_poll_wwatch_cb(struct kcond_watcher *w)
+{
+   io_req_push(CONTAINER_OF(w, struct io_req, poll.wwatch));
+}
+
+static void io_poll_ewatch_cb(struct kcond_watcher *w)
+{
+   io_req_push(CONTAINER_OF(w, struct io_req, poll.ewatch));
+}
+
+static void io_timeout_cb(struct ktimer *t)
+{
+   disable_preemption();
+   {
+      io_req_push(CONTAINER_OF(t, struct io_req, timeout.timer));
+   }
+   enable_preemption();
+}
+
+static struct io_req *
+io_req_alloc(struct io_ring *ctx, const struct io_uring_sqe *sqe, fs_handle h)
+{
+   struct io_req *req;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&ctx->lock));
+
+   if (!(req = kzalloc_obj(struct io_req)))
+      return NULL;
+
+   list_node_init(&req->node);
+   list_node_init(&req->ready_node);
+   req->ctx = ctx;
+   req->h = h;
+   req->user_data = sqe->user_data;
+   req->opcode = sqe->opcode;
+
+   list_add_tail(&ctx->reqs, &req->node);
+   return req;
+}
+
+/* Stop the watchers and the timers of `req`, drop it and its dup handle */
+static void io_req_free(struct io_req *req)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&req->ctx->lock));
+
+   if (req->opcode == IORING_OP_POLL_ADD) {
+
+      /* Note: removing a watcher not added to any kcond is harmless */
+      kcond_remove_watcher(&req->poll.rwatch);
+      kcond_remove_watcher(&req->poll.wwatch);
+      kcond_remove_watcher(&req->poll.ewatch);
+
+   } else if (req->opcode == IORING_OP_TIMEOUT) {
+
+      ktimer_set(&req->timeout.timer, 0, 0);
+   }
+
+   disable_preemption();
+   {
+      if (req->queued)
+         list_remove(&req->ready_node);
+   }
+   enable_preemption();
+
+   list_remove(&req->node);
+
+   if (req->h)
+      vfs_close(req->h);
+
+   kfree_obj(req, struct io_req);
+}
+
+/*
+ * Complete the in-flight requests of type IORING_OP_TIMEOUT waiting for a
+ * number of completions which has been reached.
+ */
+static void io_check_timeouts(struct io_ring *ctx)
+{
+   struct io_req *req, *temp;
+
+   list_for_each(req, temp, &ctx->reqs, node) {
+
+      if (req->opcode != IORING_OP_TIMEOUT || !req->timeout.target)
+         continue;
+
+      if (req->timeout.target <= ctx->cq_seq) {
+         req->timeout.target = 0;
+         io_post_cqe(ctx, req->user_data, 0, true);
+         io_req_free(req);
+      }
+   }
+}
+
+/* Like poll(), always report errors and treat all IN/OUT events alike */
+static u32 io_poll_fix_events(u32 events)
+{
+   events |= POLLERR | POLLHUP;
+
+   if (events & (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI))
+      events |= POLLIN;
+
+   if (events & (POLLOUT | POLLWRNORM | POLLWRBAND))
+      events |= POLLOUT;
+
+   return events;
+}
+
+/* Returns the events of `h` which are ready now, among `events` */
+static u32 io_poll_get_events(fs_handle h, u32 events)
+{
+   u32 revents = 0;
+   int rc;
+
+   if ((events & POLLIN) && vfs_read_ready(h))
+      revents |= POLLIN;
+
+   if ((events & POLLOUT) && vfs_write_ready(h))
+      revents |= POLLOUT;
+
+   if ((rc = vfs_except_ready(h)))
+      revents |= rc > 0 ? (u32)rc : POLLERR;
+
+   return revents;
+}
+
+/* Called with ctx->lock held, for each request popped from the ready list */
+static void io_req_run(struct io_req *req)
+{
+   struct io_ring *ctx = req->ctx;
+   u32 revents;
+   int rc;
+
+   switch (req->opcode) {
+
+      case IORING_OP_POLL_ADD:
+
+         if (!(revents = io_poll_get_events(req->h, req->poll.events)))
+            return; /* Not ready anymore or just a spurious signal */
+
+         io_post_cqe(ctx, req->user_data, (int)revents, false);
+         break;
+
+      case IORING_OP_TIMEOUT:
+         io_post_cqe(ctx, req->user_data, -ETIME, true);
+         break;
+
+      case IORING_OP_FSYNC:
+         rc = req->datasync ? vfs_fdatasync(req->h) : vfs_fsync(req->h);
+         io_post_cqe(ctx, req->user_data, rc, false);
+         break;
+
+      default:
+         NOT_REACHED();
+   }
+
+   io_req_free(req);
+}
+
+/* Pop the first request from the ready list of `ctx`. NULL if empty. */
+static struct io_req *io_pop_ready(struct io_ring *ctx)
+{
+   struct io_req *req = NULL;
+
+   disable_preemption();
+   {
+      if (!list_is_empty(&ctx->ready_list)) {
+         req = list_first_obj(&ctx->ready_list, struct io_req, ready_node);
+         list_remove(&req->ready_node);
+         req->queued = false;
+      }
+   }
+   enable_preemption();
+   return req;
+}
+
+static void io_drain(struct io_ring *ctx)
+{
+   struct io_req *req;
+
+   kmutex_lock(&ctx->lock);
+   {
+      while ((req = io_pop_ready(ctx)))
+         io_req_run(req);
+   }
+   kmutex_unlock(&ctx->lock);
+}
+
+/* Pop the first ring from io_drain_list, marking it as being drained */
+static struct io_ring *io_pop_drain_list(void)
+{
+   struct io_ring *ctx = NULL;
+
+   disable_preemption();
+   {
+      if (!list_is_empty(&io_drain_list)) {
+         ctx = list_first_obj(&io_drain_list, struct io_ring, drain_node);
+         list_remove(&ctx->drain_node);
+         ctx->drain_queued = false;
+      } else {
+         io_drain_job_queued = false;
+      }
+
+      io_draining = ctx;
+   }
+   enable_preemption();
+   return ctx;
+}
+
+static void io_drain_job(void *unused)
+{
+   struct io_ring *ctx;
+
+   while ((ctx = io_pop_drain_list())) {
+
+      io_drain(ctx);
+
+      disable_preemption();
+      {
+         io_draining = NULL;
+         kcond_signal_all(&io_drain_cond);
+      }
+      enable_preemption();
+   }
+}
+
+/*
+ * Reserve a CQE for a new request. Fails if all the free CQEs are already
+ * reserved by the requests submitted before.
+ */
+static bool io_cq_reserve(struct io_ring *ctx)
+{
+   bool ok;
+
+   kmutex_lock(&ctx->lock);
+   {
+      if ((ok = io_cq_count(ctx) + ctx->reserved < ctx->cq_entries))
+         ctx->reserved++;
+   }
+   kmutex_unlock(&ctx->lock);
+   return ok;
+}
+
+static void io_post_sync_cqe(struct io_ring *ctx, u64 user_data, int res)
+{
+   kmutex_lock(&ctx->lock);
+   {
+      io_post_cqe(ctx, user_data, res, false);
+   }
+   kmutex_unlock(&ctx->lock);
+}
+
+/*
+ * Tilck has no pwrite() yet: like vfs_pread() does for the file systems
+ * without positional reads, move the cursor and restore it afterwards.
+ */
+static int io_pwrite(const struct io_uring_sqe *sqe, fs_handle h)
+{
+   offt saved, rc;
+
+   if ((saved = vfs_seek(h, 0, SEEK_CUR)) < 0)
+      return (int)saved;
+
+   if ((rc = vfs_seek(h, (s64)sqe->off, SEEK_SET)) >= 0) {
+
+      if (sqe->opcode == IORING_OP_WRITEV)
+         rc = sys_writev(sqe->fd, TO_PTR(sqe->addr), (int)sqe->len);
+      else
+         rc = sys_write(sqe->fd, TO_PTR(sqe->addr), sqe->len);
+   }
+
+   vfs_seek(h, saved, SEEK_SET);
+   return (int)rc;
+}
+
+static int io_rw(const struct io_uring_sqe *sqe)
+{
+   const bool vec = sqe->opcode == IORING_OP_READV ||
+                    sqe->opcode == IORING_OP_WRITEV;
+   const bool wr = sqe->opcode == IORING_OP_WRITE ||
+                   sqe->opcode == IORING_OP_WRITEV;
+   struct fs_handle_base *h;
+   void *u_buf = TO_PTR(sqe->addr);
+
+   if (!(h = get_fs_handle(sqe->fd)))
+      return -EBADF;
+
+   if (get_io_ring_of_handle(h))
+      return -EINVAL;
+
+   if (sqe->rw_flags)
+      return -EINVAL; /* RWF_* flags are not supported */
+
+   /* Like on Linux, the offset is ignored for pipes and other streams */
+   if (sqe->off == (u64)-1 || !h->fops->seek) {
+
+      if (wr)
+         return vec
+            ? sys_writev(sqe->fd, u_buf, (int)sqe->len)
+            : sys_write(sqe->fd, u_buf, sqe->len);
+
+      return vec
+         ? sys_readv(sqe->fd, u_buf, (int)sqe->len)
+         : sys_read(sqe->fd, u_buf, sqe->len);
+   }
+
+   if ((s64)sqe->off < 0)
+      return -EINVAL;
+
+   if (wr)
+      return io_pwrite(sqe, h);
+
+   return vec
+      ? sys_preadv(sqe->fd, u_buf, (int)sqe->len, (s64)sqe->off)
+      : sys_pread64(sqe->fd, u_buf, sqe->len, (s64)sqe->off);
+}
+
+static int io_openat(const struct io_uring_sqe *sqe)
+{
+   const char *u_path = TO_PTR(sqe->addr);
+   char c;
+
+   if (sqe->fd != AT_FDCWD) {
+
+      /* There's no openat() in Tilck: a dirfd is fine only for abs. paths */
+      if (copy_from_user(&c, u_path, 1))
+         return -EFAULT;
+
+      if (c != '/')
+         return -ENOSYS;
+   }
+
+   return sys_open(u_path, (int)sqe->open_flags, (mode_t)sqe->len);
+}
+
+static int io_close(const struct io_uring_sqe *sqe)
+{
+   fs_handle h;
+
+   if (!(h = get_fs_handle(sqe->fd)))
+      return -EBADF;
+
+   /* Like on Linux, the rings cannot be closed this way */
+   if (get_io_ring_of_handle(h))
+      return -EBADF;
+
+   return sys_close(sqe->fd);
+}
+
+/* Get a dup of the handle of `fd`, for an in-flight request */
+static int io_get_dup_handle(int fd, fs_handle *out)
+{
+   fs_handle h;
+   int rc;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (get_io_ring_of_handle(h))
+      return -EINVAL; /* The rings cannot be polled or synced by rings */
+
+   if ((rc = vfs_dup(h, out)))
+      return rc;
+
+   return 0;
+}
+
+/*
+ * Prepare an in-flight request of type IORING_OP_POLL_ADD. Returns 1 if the
+ * handle is ready already, with the events in *revents, without allocating
+ * anything.
+ */
+static int io_poll_add(struct io_ring *ctx, const struct io_uring_sqe *sqe,
+                       u32 *revents)
+{
+   const u32 events = io_poll_fix_events(sqe->poll32_events);
+   struct io_req *req;
+   struct kcond *c;
+   fs_handle h;
+   int rc;
+
+   if (!(h = get_fs_handle(sqe->fd)))
+      return -EBADF;
+
+   if ((*revents = io_poll_get_events(h, events)))
+      return 1;
+
+   if ((rc = io_get_dup_handle(sqe->fd, &h)))
+      return rc;
+
+   kmutex_lock(&ctx->lock);
+
+   if (!(req = io_req_alloc(ctx, sqe, h))) {
+      kmutex_unlock(&ctx->lock);
+      vfs_close(h);
+      return -ENOMEM;
+   }
+
+   list_node_init(&req->poll.rwatch.node);
+   list_node_init(&req->poll.wwatch.node);
+   list_node_init(&req->poll.ewatch.node);
+   req->poll.rwatch.cb = &io_poll_rwatch_cb;
+   req->poll.wwatch.cb = &io_poll_wwatch_cb;
+   req->poll.ewatch.cb = &io_poll_ewatch_cb;
+   req->poll.events = events;
+
+   if ((events & POLLIN) && (c = vfs_get_rready_cond(h)))
+      kcond_add_watcher(c, &req->poll.rwatch);
+
+   if ((events & POLLOUT) && (c = vfs_get_wready_cond(h)))
+      kcond_add_watcher(c, &req->poll.wwatch);
+
+   if ((c = vfs_get_except_cond(h)))
+      kcond_add_watcher(c, &req->poll.ewatch);
+
+   /* The handle might have become ready before adding the watchers */
+   if ((*revents = io_poll_get_events(h, events))) {
+      io_post_cqe(ctx, req->user_data, (int)*revents, false);
+      io_req_free(req);
+   }
+
+   kmutex_unlock(&ctx->lock);
+   return 0;
+}
+
+static int io_timeout_add(struct io_ring *ctx, const struct io_uring_sqe *sqe)
+{
+   struct k_kernel_timespec kts;
+   struct k_timespec64 ts, now;
+   struct io_req *req;
+   u64 ticks, now_ticks;
+
+   if (sqe->len != 1 || (sqe->timeout_flags & ~IORING_TIMEOUT_ABS))
+      return -EINVAL;
+
+   if (copy_from_user(&kts, TO_PTR(sqe->addr), sizeof(kts)))
+      return -EFAULT;
+
+   if (kts.tv_sec < 0 || kts.tv_nsec < 0 || kts.tv_nsec >= BILLION)
+      return -EINVAL;
+
+   ts = (struct k_timespec64) { .tv_sec = kts.tv_sec, .tv_nsec = kts.tv_nsec };
+   ticks = timespec_to_ticks(&ts);
+
+   if (sqe->timeout_flags & IORING_TIMEOUT_ABS) {
+
+      /* Absolute timeouts are relative to CLOCK_MONOTONIC, like on Linux */
+      monotonic_time_get_timespec(&now);
+      now_ticks = timespec_to_ticks(&now);
+      ticks = ticks > now_ticks ? ticks - now_ticks : 0;
+   }
+
+   kmutex_lock(&ctx->lock);
+   {
+      if (!(req = io_req_alloc(ctx, sqe, NULL))) {
+         kmutex_unlock(&ctx->lock);
+         return -ENOMEM;
+      }
+
+      /* With off > 0, complete the timeout after `off` other completions */
+      req->timeout.target = sqe->off ? ctx->cq_seq + sqe->off : 0;
+      ktimer_init(&req->timeout.timer, &io_timeout_cb);
+      ktimer_set(&req->timeout.timer, ticks ? ticks : 1, 0);
+   }
+   kmutex_unlock(&ctx->lock);
+   return 0;
+}
+
+static int io_fsync(struct io_ring *ctx, const struct io_uring_sqe *sqe)
+{
+   struct io_req *req;
+   fs_handle h;
+   int rc;
+
+   if (sqe->fsync_flags & ~IORING_FSYNC_DATASYNC)
+      return -EINVAL;
+
+   if ((rc = io_get_dup_handle(sqe->fd, &h)))
+      return rc;
+
+   kmutex_lock(&ctx->lock);
+
+   if (!(req = io_req_alloc(ctx, sqe, h))) {
+      kmutex_unlock(&ctx->lock);
+      vfs_close(h);
+      return -ENOMEM;
+   }
+
+   req->datasync = !!(sqe->fsync_flags & IORING_FSYNC_DATASYNC);
+
+   /* Syncing might take a while: let the worker do that */
+   disable_preemption();
+   {
+      io_req_push(req);
+   }
+   enable_preemption();
+
+   kmutex_unlock(&ctx->lock);
+   return 0;
+}
+
+/*
+ * Execute the request in `sqe`, which has a CQE reserved. Returns true if it
+ * completed, with its result in *res, or false if it became an in-flight
+ * request, which will post its CQE later (or it already did).
+ */
+static bool io_issue(struct io_ring *ctx, const struct io_uring_sqe *sqe,
+                     int *res)
+{
+   u32 revents;
+   int rc = 0;
+
+   if (sqe->flags) {
+      *res = -EINVAL; /* No IOSQE_* flag is supported */
+      return true;
+   }
+
+   switch (sqe->opcode) {
+
+      case IORING_OP_NOP:
+         break;
+
+      case IORING_OP_READ:
+      case IORING_OP_WRITE:
+      case IORING_OP_READV:
+      case IORING_OP_WRITEV:
+         rc = io_rw(sqe);
+         break;
+
+      case IORING_OP_OPENAT:
+         rc = io_openat(sqe);
+         break;
+
+      case IORING_OP_CLOSE:
+         rc = io_close(sqe);
+         break;
+
+      case IORING_OP_POLL_ADD:
+
+         if ((rc = io_poll_add(ctx, sqe, &revents)) == 1)
+            rc = (int)revents;
+         else if (!rc)
+            return false;
+
+         break;
+
+      case IORING_OP_TIMEOUT:
+
+         if (!(rc = io_timeout_add(ctx, sqe)))
+            return false;
+
+         break;
+
+      case IORING_OP_FSYNC:
+
+         if (!(rc = io_fsync(ctx, sqe)))
+            return false;
+
+         break;
+
+      default:
+         rc = -EINVAL;
+   }
+
+   *res = rc;
+   return true;
+}
+
+/*
+ * Submit up to `to_submit` SQEs. Returns the number of SQEs consumed or -EBUSY
+ * if none could be submitted because the CQ has no room.
+ */
+static int io_submit_sqes(struct io_ring *ctx, u32 to_submit)
+{
+   struct io_rings *rings = ctx->rings;
+   struct io_uring_sqe sqe;
+   u32 tail, idx, n;
+   int res;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&ctx->sq_lock));
+
+   tail = atomic_load_explicit(&rings->sq_tail, mo_acquire);
+   to_submit = MIN(to_submit, tail - ctx->sq_head);
+   to_submit = MIN(to_submit, ctx->sq_entries);
+
+   for (n = 0; n < to_submit; n++) {
+
+      if (!io_cq_reserve(ctx))
+         break;
+
+      idx = ctx->sq_array[ctx->sq_head & (ctx->sq_entries - 1)];
+      ctx->sq_head++;
+
+      if (idx >= ctx->sq_entries) {
+
+         /* Like Linux, skip the invalid entries counting them as dropped */
+         rings->sq_dropped++;
+
+         kmutex_lock(&ctx->lock);
+         {
+            ctx->reserved--;
+         }
+         kmutex_unlock(&ctx->lock);
+         continue;
+      }
+
+      /* Copy the SQE: the user might change it while we're using it */
+      memcpy(&sqe, &ctx->sqes[idx], sizeof(sqe));
+
+      if (io_issue(ctx, &sqe, &res))
+         io_post_sync_cqe(ctx, sqe.user_data, res);
+   }
+
+   atomic_store_explicit(&rings->sq_head, ctx->sq_head, mo_release);
+
+   if (!n && to_submit)
+      return -EBUSY;
+
+   return (int)n;
+}
+
+/* Wait until there are at least `min` CQEs in the CQ */
+static int io_wait_cqes(struct io_ring *ctx, u32 min)
+{
+   struct task *curr = get_curr_task();
+   min = MIN(min, ctx->cq_entries);
+
+   while (true) {
+
+      /* Complete the ready requests now, without waiting for the worker */
+      io_drain(ctx);
+
+      disable_preemption();
+
+      if (io_cq_count(ctx) >= min) {
+         enable_preemption();
+         return 0;
+      }
+
+      if (!list_is_empty(&ctx->ready_list)) {
+         /* A request got ready after io_drain() */
+         enable_preemption();
+         continue;
+      }
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &ctx->cond,
+                         NO_EXTRA,
+                         &ctx->cond.wait_list);
+
+      enter_sleep_wait_state();
+
+      /* ------------------- We've been woken up ------------------- */
+
+      wait_obj_reset(&curr->wobj);
+
+      if (pending_signals())
+         return -EINTR;
+   }
+}
+
+static int io_ring_read_ready(fs_handle h)
+{
+   struct io_ring *ctx = get_io_ring_of_handle(h);
+   return io_cq_count(ctx) > 0;
+}
+
+static struct kcond *io_ring_get_rready_cond(fs_handle h)
+{
+   struct io_ring *ctx = get_io_ring_of_handle(h);
+   return &ctx->cond;
+}
+
+static int io_ring_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
+{
+   struct io_ring *ctx = get_io_ring_of_handle(um->h);
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+   const size_t pg_count = um->len >> PAGE_SHIFT;
+   size_t off = um->off, size, mapped;
+   void *data;
+
+   ASSERT(IS_PAGE_ALIGNED(um->len));
+
+   if (um->flags != MAP_SHARED)
+      return -EINVAL; /* The rings make sense only as shared mappings */
+
+   if (off >= IORING_OFF_SQES) {
+      data = ctx->sqes;
+      size = PAGE_SIZE << ctx->sqes_order;
+      off -= IORING_OFF_SQES;
+   } else {
+      /* IORING_FEAT_SINGLE_MMAP: the SQ and the CQ rings are one region */
+      data = ctx->rings;
+      size = PAGE_SIZE << ctx->rings_order;
+      off -= off >= IORING_OFF_CQ_RING ? IORING_OFF_CQ_RING : 0;
+   }
+
+   if (off > size || um->len > size - off)
+      return -EINVAL;
+
+   /* The regions are small: always map them directly, no faults required */
+   if (flags & VFS_MM_DONT_MMAP)
+      return 0;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   mapped = map_pages(pdir,
+                      um->vaddrp,
+                      KERNEL_VA_TO_PA(data) + off,
+                      pg_count,
+                      pg_flags);
+
+   if (mapped != pg_count) {
+      unmap_pages_permissive(pdir, um->vaddrp, mapped, false);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
+
+static int io_ring_munmap(struct user_mapping *um, void *vaddrp, size_t len)
+{
+   return generic_fs_munmap(um, vaddrp, len);
+}
+
+static const struct file_ops static_ops_io_ring =
+{
+   .read_ready = io_ring_read_ready,
+   .get_rready_cond = io_ring_get_rready_cond,
+   .mmap = io_ring_mmap,
+   .munmap = io_ring_munmap,
+};
+
+static void destroy_io_ring(struct io_ring *ctx)
+{
+   struct task *curr = get_curr_task();
+   struct io_req *req, *temp;
+
+   /* Cancel the in-flight requests: no CQE is posted for them */
+   kmutex_lock(&ctx->lock);
+   {
+      list_for_each(req, temp, &ctx->reqs, node)
+         io_req_free(req);
+
+      if (ctx->evfd)
+         vfs_close(ctx->evfd);
+   }
+   kmutex_unlock(&ctx->lock);
+
+   /* Nothing can push requests now: make sure the worker is done with us */
+   disable_preemption();
+
+   if (ctx->drain_queued)
+      list_remove(&ctx->drain_node);
+
+   while (io_draining == ctx) {
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &io_drain_cond,
+                         NO_EXTRA,
+                         &io_drain_cond.wait_list);
+
+      enter_sleep_wait_state();
+      wait_obj_reset(&curr->wobj);
+      disable_preemption();
+   }
+
+   enable_preemption();
+
+   if (ctx->sqes)
+      pf_free(ctx->sqes, ctx->sqes_order);
+
+   if (ctx->rings)
+      pf_free(ctx->rings, ctx->rings_order);
+
+   kcond_destory(&ctx->cond);
+   kmutex_destroy(&ctx->lock);
+   kmutex_destroy(&ctx->sq_lock);
+   kfree_obj(ctx, struct io_ring);
+}
+
+static u32 io_pages_order(size_t size)
+{
+   return (u32)log2_for_power_of_2(
+      roundup_next_power_of_2(div_round_up(size, PAGE_SIZE))
+   );
+}
+
+static int io_ring_alloc_regions(struct io_ring *ctx)
+{
+   const size_t sq_array_off =
+      offsetof(struct io_rings, cqes) +
+      ctx->cq_entries * sizeof(struct io_uring_cqe);
+
+   const size_t rings_size = sq_array_off + ctx->sq_entries * sizeof(u32);
+   const size_t sqes_size = ctx->sq_entries * sizeof(struct io_uring_sqe);
+
+   ctx->rings_order = io_pages_order(rings_size);
+   ctx->sqes_order = io_pages_order(sqes_size);
+
+   if (!(ctx->rings = pf_alloc(ctx->rings_order)))
+      return -ENOMEM;
+
+   if (!(ctx->sqes = pf_alloc(ctx->sqes_order)))
+      return -ENOMEM;
+
+   /* Those pages get mapped in userspace: no stale data must leak there */
+   bzero(ctx->rings, PAGE_SIZE << ctx->rings_order);
+   bzero(ctx->sqes, PAGE_SIZE << ctx->sqes_order);
+
+   ctx->sq_array = (void *)((char *)ctx->rings + sq_array_off);
+   ctx->rings->sq_ring_mask = ctx->sq_entries - 1;
+   ctx->rings->sq_ring_entries = ctx->sq_entries;
+   ctx->rings->cq_ring_mask = ctx->cq_entries - 1;
+   ctx->rings->cq_ring_entries = ctx->cq_entries;
+   return 0;
+}
+
+static void io_fill_params(struct io_ring *ctx, struct io_uring_params *p)
+{
+   p->sq_entries = ctx->sq_entries;
+   p->cq_entries = ctx->cq_entries;
+   p->features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+
+   p->sq_off = (struct io_sqring_offsets) {
+      .head = offsetof(struct io_rings, sq_head),
+      .tail = offsetof(struct io_rings, sq_tail),
+      .ring_mask = offsetof(struct io_rings, sq_ring_mask),
+      .ring_entries = offsetof(struct io_rings, sq_ring_entries),
+      .flags = offsetof(struct io_rings, sq_flags),
+      .dropped = offsetof(struct io_rings, sq_dropped),
+      .array = (u32)((char *)ctx->sq_array - (char *)ctx->rings),
+   };
+
+   p->cq_off = (struct io_cqring_offsets) {
+      .head = offsetof(struct io_rings, cq_head),
+      .tail = offsetof(struct io_rings, cq_tail),
+      .ring_mask = offsetof(struct io_rings, cq_ring_mask),
+      .ring_entries = offsetof(struct io_rings, cq_ring_entries),
+      .overflow = offsetof(struct io_rings, cq_overflow),
+      .cqes = offsetof(struct io_rings, cqes),
+      .flags = offsetof(struct io_rings, cq_flags),
+   };
+}
+
+/* Check the params of io_uring_setup() and compute the sizes of the queues */
+static int
+io_check_params(u32 entries, struct io_uring_params *p, u32 *sq, u32 *cq)
+{
+   const u32 flags = p->flags;
+   u32 cq_entries = p->cq_entries;
+
+   if (flags & ~(IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP))
+      return -EINVAL;
+
+   for (int i = 0; i < ARRAY_SIZE(p->resv); i++)
+      if (p->resv[i])
+         return -EINVAL;
+
+   if (!entries)
+      return -EINVAL;
+
+   if (entries > IO_URING_MAX_ENTRIES) {
+
+      if (!(flags & IORING_SETUP_CLAMP))
+         return -EINVAL;
+
+      entries = IO_URING_MAX_ENTRIES;
+   }
+
+   *sq = (u32)roundup_next_power_of_2(entries);
+   *cq = 2 * *sq;
+
+   if (flags & IORING_SETUP_CQSIZE) {
+
+      if (!cq_entries)
+         return -EINVAL;
+
+      if (cq_entries > 2 * IO_URING_MAX_ENTRIES) {
+
+         if (!(flags & IORING_SETUP_CLAMP))
+            return -EINVAL;
+
+         cq_entries = 2 * IO_URING_MAX_ENTRIES;
+      }
+
+      *cq = (u32)roundup_next_power_of_2(cq_entries);
+
+      if (*cq < *sq)
+         return -EINVAL;
+   }
+
+   return 0;
+}
+
+static bool io_create_worker(void)
+{
+   bool ok;
+
+   disable_preemption();
+   {
+      if (!io_wth) {
+         io_wth = wth_create_thread("io_uring",
+                                    WTH_PRIO_LOWEST,
+                                    WTH_IO_URING_QUEUE_SIZE);
+      }
+
+      ok = io_wth != NULL;
+   }
+   enable_preemption();
+   return ok;
+}
+
+int create_io_uring_handle(u32 entries, struct io_uring_params *p, fs_handle *out)
+{
+   struct kfs_handle *h;
+   struct io_ring *ctx;
+   u32 sq, cq;
+   int rc;
+
+   if ((rc = io_check_params(entries, p, &sq, &cq)))
+      return rc;
+
+   if (!io_create_worker())
+      return -ENOMEM;
+
+   if (!(ctx = (void *)kzalloc_obj(struct io_ring)))
+      return -ENOMEM;
+
+   ctx->destory_obj = (void *)&destroy_io_ring;
+   ctx->sq_entries = sq;
+   ctx->cq_entries = cq;
+   kmutex_init(&ctx->sq_lock, 0);
+   kmutex_init(&ctx->lock, 0);
+   kcond_init(&ctx->cond);
+   list_init(&ctx->reqs);
+   list_init(&ctx->ready_list);
+   list_node_init(&ctx->drain_node);
+
+   if ((rc = io_ring_alloc_regions(ctx))) {
+      destroy_io_ring(ctx);
+      return rc;
+   }
+
+   if (!(h = kfs_create_new_handle(&static_ops_io_ring, (void *)ctx, O_RDWR))) {
+      destroy_io_ring(ctx);
+      return -ENOMEM;
+   }
+
+   h->spec_flags |= VFS_SPFL_MMAP_SUPPORTED;
+   io_fill_params(ctx, p);
+   *out = h;
+   return 0;
+}
+
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags,
+                       const void *u_sig, size_t sigsz)
+{
+   struct io_ring *ctx;
+   int submitted = 0;
+   fs_handle h;
+   int rc;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!(ctx = get_io_ring_of_handle(h)))
+      return -EOPNOTSUPP;
+
+   if (flags & ~IORING_ENTER_GETEVENTS)
+      return -EINVAL;
+
+   if (u_sig)
+      return -EINVAL; /* Not supported: use sigprocmask() instead */
+
+   if (to_submit) {
+
+      kmutex_lock(&ctx->sq_lock);
+      {
+         submitted = io_submit_sqes(ctx, to_submit);
+      }
+      kmutex_unlock(&ctx->sq_lock);
+
+      if (submitted < 0)
+         return submitted;
+   }
+
+   if ((flags & IORING_ENTER_GETEVENTS) && min_complete) {
+
+      if ((rc = io_wait_cqes(ctx, min_complete)) && !submitted)
+         return rc;
+   }
+
+   return submitted;
+}
+
+static int io_register_eventfd(struct io_ring *ctx, int efd)
+{
+   fs_handle h, dup_h;
+   int rc;
+
+   if (!(h = get_fs_handle(efd)))
+      return -EBADF;
+
+   /* Signaling by 0 is a no-op, but it fails if `h` is not an eventfd */
+   if ((rc = eventfd_signal(h, 0)))
+      return rc;
+
+   if ((rc = vfs_dup(h, &dup_h)))
+      return rc;
+
+   kmutex_lock(&ctx->lock);
+   {
+      if (!ctx->evfd) {
+         ctx->evfd = dup_h;
+         dup_h = NULL;
+      }
+   }
+   kmutex_unlock(&ctx->lock);
+
+   if (dup_h) {
+      vfs_close(dup_h);
+      return -EBUSY;
+   }
+
+   return 0;
+}
+
+static int io_unregister_eventfd(struct io_ring *ctx)
+{
+   fs_handle h;
+
+   kmutex_lock(&ctx->lock);
+   {
+      h = ctx->evfd;
+      ctx->evfd = NULL;
+   }
+   kmutex_unlock(&ctx->lock);
+
+   if (!h)
+      return -ENXIO;
+
+   vfs_close(h);
+   return 0;
+}
+
+int sys_io_uring_register(int fd, u32 opcode, void *u_arg, u32 nr_args)
+{
+   struct io_ring *ctx;
+   fs_handle h;
+   int efd;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!(ctx = get_io_ring_of_handle(h)))
+      return -EOPNOTSUPP;
+
+   switch (opcode) {
+
+      case IORING_REGISTER_EVENTFD:
+
+         if (nr_args != 1)
+            return -EINVAL;
+
+         if (copy_from_user(&efd, u_arg, sizeof(efd)))
+            return -EFAULT;
+
+         return io_register_eventfd(ctx, efd);
+
+      case IORING_UNREGISTER_EVENTFD:
+
+         if (u_arg || nr_args)
+            return -EINVAL;
+
+         return io_unregister_eventfd(ctx);
+
+      default:
+         return -EINVAL;
+   }
+}
@@ -9,6 +9,7 @@ void kcond_init(struct kcond *c)
 {
    DEBUG_ONLY(check_not_in_irq_handler());
    list_init(&c->wait_list);
+   list_init(&c->watchers);
 }
 
 bool kcond_is_anyone_waiting(struct kcond *c)
@@ -95,11 +96,41 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
    wake_up(ti);
 }
 
+void kcond_add_watcher(struct kcond *c, struct kcond_watcher *w)
+{
+   disable_preemption();
+   {
+      list_add_tail(&c->watchers, &w->node);
+   }
+   enable_preemption();
+}
+
+void kcond_remove_watcher(struct kcond_watcher *w)
+{
+   disable_preemption();
+   {
+      list_remove(&w->node);
+      list_node_init(&w->node);
+   }
+   enable_preemption();
+}
+
+static void kcond_notify_watchers(struct kcond *c)
+{
+   struct kcond_watcher *pos, *temp;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each(pos, temp, &c->watchers, node) {
+      pos->cb(pos);
+   }
+}
+
 void kcond_signal_one(struct kcond *c)
 {
    disable_preemption();
    {
       DEBUG_ONLY(check_not_in_irq_handler());
+      kcond_notify_watchers(c);
 
       if (!list_is_empty(&c->wait_list)) {
 
@@ -118,6 +149,7 @@ void kcond_signal_all(struct kcond *c)
    disable_preemption();
    {
       DEBUG_ONLY(check_not_in_irq_handler());
+      kcond_notify_watchers(c);
 
       list_for_each(wo_pos, temp, &c->wait_list, wait_list_node) {
          kcond_signal_int(c, wo_pos);
@@ -128,5 +160,6 @@ void kcond_signal_all(struct kcond *c)
 
 void kcond_destory(struct kcond *c)
 {
+   ASSERT(list_is_empty(&c->watchers));
    bzero(c, sizeof(struct kcond));
 }
@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/sched.h>
+
+#include <tilck_gen_headers/config_kmalloc.h>
+
+#define SLAB_NO_OBJ                               0xffffu
+#define SLAB_MIN_SIZE                           PAGE_SIZE
+#define SLAB_MIN_OBJS                                   8
+#define SLAB_OBJ_ALIGN                                  8
+
+/*
+ * Slab header, placed at the beginning of each slab. Slabs are allocated with
+ * alignment equal to their size: that allows to get the slab containing any
+ * given object with a simple bitmask. The free objects are linked through
+ * the `next_free` array of indexes, in order to not touch the objects
+ * themselves and keep them in their constructed state.
+ */
+struct kmalloc_slab {
+
+   struct list_node node;
+   struct kmalloc_cache *cache;
+   u16 free_head;             /* index of the first free obj or SLAB_NO_OBJ */
+   u16 used;                  /* number of objects in use */
+   u16 next_free[];           /* for each free object, the next free one */
+};
+
+STATIC struct list kmalloc_caches_list = STATIC_LIST_INIT(kmalloc_caches_list);
+
+static void kmalloc_cache_init(struct kmalloc_cache *c)
+{
+   const u32 obj_size = (u32)pow2_round_up_at(c->obj_size, SLAB_OBJ_ALIGN);
+   u32 slab_size, n, off;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(c->obj_size > 0);
+
+   slab_size = MAX(
+      SLAB_MIN_SIZE,
+      roundup_next_power_of_2(
+         sizeof(struct kmalloc_slab) + SLAB_MIN_OBJS * (obj_size + 2)
+      )
+   );
+
+   slab_size = MIN(slab_size, KMALLOC_MAX_ALIGN);
+   n = (slab_size - sizeof(struct kmalloc_slab)) / (obj_size + 2);
+   n = MIN(n, SLAB_NO_OBJ - 1);
+
+   while (n > 0) {
+
+      off = (u32)pow2_round_up_at(sizeof(struct kmalloc_slab) + n * 2,
+                                  SLAB_OBJ_ALIGN);
+
+      if (off + n * obj_size <= slab_size)
+         break;
+
+      n--;
+   }
+
+   VERIFY(n > 0);
+
+   c->obj_size = obj_size;
+   c->slab_size = slab_size;
+   c->objs_per_slab = n;
+   c->first_obj_off = off;
+   c->initialized = true;
+
+   list_add_tail(&kmalloc_caches_list, &c->node);
+}
+
+static ALWAYS_INLINE void *
+slab_obj(struct kmalloc_cache *c, struct kmalloc_slab *s, u32 idx)
+{
+   return (char *)s + c->first_obj_off + idx * c->obj_size;
+}
+
+static ALWAYS_INLINE struct kmalloc_slab *
+obj_to_slab(struct kmalloc_cache *c, void *obj)
+{
+   return (void *)((ulong)obj & ~((ulong)c->slab_size - 1));
+}
+
+static struct kmalloc_slab *
+kmalloc_cache_new_slab(struct kmalloc_cache *c)
+{
+   struct kmalloc_slab *s;
+
+   if (!(s = aligned_kmalloc(c->slab_size, c->slab_size)))
+      return NULL;
+
+   list_node_init(&s->node);
+   s->cache = c;
+   s->free_head = 0;
+   s->used = 0;
+
+   for (u32 i = 0; i < c->objs_per_slab; i++) {
+
+      s->next_free[i] = (u16)(i + 1 < c->objs_per_slab ? i + 1 : SLAB_NO_OBJ);
+
+      if (c->ctor)
+         c->ctor(slab_obj(c, s, i));
+   }
+
+   c->slabs_count++;
+   return s;
+}
+
+static void
+kmalloc_cache_free_slab(struct kmalloc_cache *c, struct kmalloc_slab *s)
+{
+   ASSERT(s->used == 0);
+   list_remove(&s->node);
+   aligned_kfree2(s, c->slab_size);
+   c->slabs_count--;
+}
+
+void *
+kmalloc_cache_alloc(struct kmalloc_cache *c)
+{
+   struct kmalloc_slab *s = NULL;
+   void *obj = NULL;
+   u32 idx;
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!c->initialized))
+         kmalloc_cache_init(c);
+
+      if (!list_is_empty(&c->partial_slabs)) {
+
+         s = list_first_obj(&c->partial_slabs, struct kmalloc_slab, node);
+
+      } else if (!list_is_empty(&c->empty_slabs)) {
+
+         s = list_first_obj(&c->empty_slabs, struct kmalloc_slab, node);
+         list_remove(&s->node);
+         list_add_tail(&c->partial_slabs, &s->node);
+
+      } else if ((s = kmalloc_cache_new_slab(c))) {
+
+         list_add_tail(&c->partial_slabs, &s->node);
+      }
+
+      if (s) {
+
+         idx = s->free_head;
+         ASSERT(idx != SLAB_NO_OBJ);
+
+         s->free_head = s->next_free[idx];
+         s->used++;
+
+         if (s->free_head == SLAB_NO_OBJ) {
+            list_remove(&s->node);
+            list_add_tail(&c->full_slabs, &s->node);
+         }
+
+         obj = slab_obj(c, s, idx);
+         c->objs_in_use++;
+         c->allocs_count++;
+         c->peak_objs_in_use = MAX(c->peak_objs_in_use, c->objs_in_use);
+      }
+   }
+   enable_preemption();
+   return obj;
+}
+
+void
+kmalloc_cache_free(struct kmalloc_cache *c, void *obj)
+{
+   struct kmalloc_slab *s;
+   u32 idx;
+
+   if (!obj)
+      return;
+
+   disable_preemption();
+   {
+      s = obj_to_slab(c, obj);
+      idx = (u32)((char *)obj - (char *)slab_obj(c, s, 0)) / c->obj_size;
+
+      ASSERT(s->cache == c);
+      ASSERT(obj == slab_obj(c, s, idx));
+      ASSERT(s->used > 0);
+
+      if (s->free_head == SLAB_NO_OBJ) {
+         /* The slab was full: now it will have one free object */
+         list_remove(&s->node);
+         list_add_tail(&c->partial_slabs, &s->node);
+      }
+
+      s->next_free[idx] = s->free_head;
+      s->free_head = (u16)idx;
+      s->used--;
+      c->objs_in_use--;
+
+      if (!s->used) {
+
+         /* Keep at most one empty slab around, release the others */
+         if (list_is_empty(&c->empty_slabs)) {
+            list_remove(&s->node);
+            list_add_tail(&c->empty_slabs, &s->node);
+         } else {
+            kmalloc_cache_free_slab(c, s);
+         }
+      }
+   }
+   enable_preemption();
+}
+
+struct kmalloc_cache *
+kmalloc_create_cache(const char *name, u32 obj_size, kmalloc_cache_ctor ctor)
+{
+   struct kmalloc_cache *c;
+
+   if (!(c = kzalloc_obj(struct kmalloc_cache)))
+      return NULL;
+
+   c->name = name;
+   c->obj_size = obj_size;
+   c->ctor = ctor;
+   c->dynamic = true;
+
+   list_init(&c->partial_slabs);
+   list_init(&c->full_slabs);
+   list_init(&c->empty_slabs);
+   list_node_init(&c->node);
+   return c;
+}
+
+void
+kmalloc_destroy_cache(struct kmalloc_cache *c)
+{
+   struct kmalloc_slab *pos, *temp;
+
+   disable_preemption();
+   {
+      VERIFY(c->objs_in_use == 0);
+      ASSERT(list_is_empty(&c->partial_slabs));
+      ASSERT(list_is_empty(&c->full_slabs));
+
+      list_for_each(pos, temp, &c->empty_slabs, node)
+         kmalloc_cache_free_slab(c, pos);
+
+      if (c->initialized)
+         list_remove(&c->node);
+
+      c->initialized = false;
+   }
+   enable_preemption();
+
+   if (c->dynamic)
+      kfree_obj(c, struct kmalloc_cache);
+}
+
+bool
+debug_kmalloc_get_cache_info(int n, struct debug_kmalloc_cache_info *i)
+{
+   struct kmalloc_cache *pos;
+   bool found = false;
+   int idx = 0;
+
+   disable_preemption();
+   {
+      list_for_each_ro(pos, &kmalloc_caches_list, node) {
+
+         if (idx++ != n)
+            continue;
+
+         *i = (struct debug_kmalloc_cache_info) {
+            .name = pos->name,
+            .obj_size = pos->obj_size,
+            .slab_size = pos->slab_size,
+            .objs_per_slab = pos->objs_per_slab,
+            .slabs_count = pos->slabs_count,
+            .objs_in_use = pos->objs_in_use,
+            .peak_objs_in_use = pos->peak_objs_in_use,
+            .allocs_count = pos->allocs_count,
+         };
+
+         found = true;
+         break;
+      }
+   }
+   enable_preemption();
+   return found;
+}
+
+#ifdef UNIT_TEST_ENVIRONMENT
+
+/*
+ * The unit tests re-initialize kmalloc from scratch, throwing away all the
+ * heaps: forget about the slabs of the statically allocated caches as well.
+ */
+void kmalloc_reset_caches_for_tests(void)
+{
+   struct kmalloc_cache *pos, *temp;
+
+   list_for_each(pos, temp, &kmalloc_caches_list, node) {
+
+      pos->initialized = false;
+      pos->slabs_count = 0;
+      pos->objs_in_use = 0;
+      pos->peak_objs_in_use = 0;
+      pos->allocs_count = 0;
+
+      list_init(&pos->partial_slabs);
+      list_init(&pos->full_slabs);
+      list_init(&pos->empty_slabs);
+      list_node_init(&pos->node);
+   }
+
+   list_init(&kmalloc_caches_list);
+}
+
+#endif
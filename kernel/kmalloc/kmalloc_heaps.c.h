@@ -21,6 +21,17 @@ STATIC struct kmalloc_heap *heaps[KMALLOC_HEAPS_COUNT];
 STATIC int used_heaps;
 STATIC size_t max_tot_heap_mem_free;
 
+/*
+ * Page-aligned ranges of usable memory left out of the heaps because too
+ * small (or because we ran out of heap slots). They're not wasted: the page
+ * frame allocator takes them over.
+ */
+static struct {
+   ulong va;
+   ulong end;
+} unused_ranges[KMALLOC_HEAPS_COUNT];
+static int unused_ranges_count;
+
 #ifndef UNIT_TEST_ENVIRONMENT
 
 void *kmalloc_get_first_heap(size_t *size)
@@ -304,17 +315,38 @@ static long greater_than_heap_cmp(const void *a, const void *b)
    return -1;
 }
 
+static void add_unused_range(ulong va, ulong end, bool dma)
+{
+   va = pow2_round_up_at(va, PAGE_SIZE);
+   end &= PAGE_MASK;
+
+   if (dma || va >= end)
+      return;
+
+   if (unused_ranges_count == ARRAY_SIZE(unused_ranges))
+      return;
+
+   unused_ranges[unused_ranges_count].va = va;
+   unused_ranges[unused_ranges_count].end = end;
+   unused_ranges_count++;
+}
+
 static void
 init_kmalloc_fill_region(int region, ulong vaddr, ulong limit, bool dma)
 {
+   const ulong region_begin = vaddr;
    int heap_index;
    vaddr = pow2_round_up_at(
       vaddr,
       MIN(KMALLOC_MIN_HEAP_SIZE, KMALLOC_MAX_ALIGN)
    );
 
-   if (vaddr >= limit)
+   if (vaddr >= limit) {
+      add_unused_range(region_begin, limit, dma);
       return;
+   }
+
+   add_unused_range(region_begin, vaddr, dma);
 
    while (true) {
 
@@ -335,6 +367,8 @@ init_kmalloc_fill_region(int region, ulong vaddr, ulong limit, bool dma)
       heaps[heap_index]->dma = dma;
       vaddr = heaps[heap_index]->vaddr + heaps[heap_index]->size;
    }
+
+   add_unused_range(vaddr, limit, dma);
 }
 
 void early_init_kmalloc(void)
@@ -346,6 +380,7 @@ void early_init_kmalloc(void)
    list_init(&avail_small_heaps_list);
 
    used_heaps = 0;
+   unused_ranges_count = 0;
    bzero(heaps, sizeof(heaps));
 
    {
@@ -415,6 +450,16 @@ size_t kmalloc_get_max_tot_heap_free(void)
    return max_tot_heap_mem_free;
 }
 
+bool kmalloc_get_unused_range(int n, ulong *va, ulong *end)
+{
+   if (n >= unused_ranges_count)
+      return false;
+
+   *va = unused_ranges[n].va;
+   *end = unused_ranges[n].end;
+   return true;
+}
+
 void
 debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
                                    struct debug_kmalloc_heap_info *i)
@@ -16,6 +16,7 @@
 #include <tilck/kernel/hal.h>
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
 #include <tilck/kernel/debug_utils.h>
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/elf_loader.h>
@@ -32,6 +33,7 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/fs/kernelfs.h>
 #include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/futex.h>
 
 #include <tilck/mods/console.h>
 #include <tilck/mods/fb_console.h>
@@ -357,6 +359,7 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_segmentation();
    init_fpu_memcpy();
    init_kmalloc();
+   init_pf_alloc();
    init_paging();
 
    acpi_mod_init_tables();
@@ -370,6 +373,7 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_timer();
    init_system_time();
    init_kernelfs();
+   init_futex();
 
    async_init();
    schedule();
@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/system_mmap.h>
+
+#include <tilck_gen_headers/config_kmalloc.h>
+
+/*
+ * Per-pageframe state byte:
+ *
+ *    bits [0, 3]: (order + 1) when the frame is the head of a free block,
+ *                 0 otherwise (allocated frame or not the head of its block).
+ *
+ *    bits [4, 6]: (order + 1) of the block borrowed from kmalloc containing
+ *                 the frame, or 0 when the frame comes from the memory map.
+ *
+ *    bit 7:       the frame is owned by the page-frame allocator.
+ */
+#define PF_FREE_ORDER_MASK                 0x0f
+#define PF_BORROW_ORDER_SHIFT                 4
+#define PF_BORROW_ORDER_MASK               0x70
+#define PF_MANAGED                         0x80
+
+/*
+ * Number of free pages below which we don't give back to kmalloc the blocks
+ * borrowed from it, once they become completely free. That avoids
+ * alloc/free ping-pong with kmalloc in the fork/exit paths.
+ */
+#define PF_KMALLOC_KEEP_PAGES               128
+
+STATIC_ASSERT(PF_MAX_ORDER + 1 <= PF_FREE_ORDER_MASK);
+STATIC_ASSERT((PAGE_SIZE << PF_KMALLOC_ORDER) <= KMALLOC_MAX_ALIGN);
+
+struct pf_free_block {
+   struct list_node node;
+};
+
+static u8 *pf_state;
+static ulong pf_count;
+static struct list pf_free_lists[PF_ORDERS];
+static struct pf_alloc_stats pf_stats;
+
+static ALWAYS_INLINE ulong va_to_pfn(void *va)
+{
+   return KERNEL_VA_TO_PA(va) >> PAGE_SHIFT;
+}
+
+static ALWAYS_INLINE void *pfn_to_va(ulong pfn)
+{
+   return KERNEL_PA_TO_VA(pfn << PAGE_SHIFT);
+}
+
+static ALWAYS_INLINE u32 pf_max_merge_order(u8 state)
+{
+   const u32 borrow = (state & PF_BORROW_ORDER_MASK) >> PF_BORROW_ORDER_SHIFT;
+   return borrow ? borrow - 1 : PF_MAX_ORDER;
+}
+
+static void pf_list_add(ulong pfn, u32 order)
+{
+   struct pf_free_block *b = pfn_to_va(pfn);
+
+   ASSERT(!(pf_state[pfn] & PF_FREE_ORDER_MASK));
+   pf_state[pfn] |= (u8)(order + 1);
+
+   list_node_init(&b->node);
+   list_add_head(&pf_free_lists[order], &b->node);
+   pf_stats.free_blocks[order]++;
+   pf_stats.free_pages += 1u << order;
+}
+
+static void pf_list_remove(ulong pfn, u32 order)
+{
+   struct pf_free_block *b = pfn_to_va(pfn);
+
+   ASSERT((pf_state[pfn] & PF_FREE_ORDER_MASK) == order + 1);
+   pf_state[pfn] &= (u8)~PF_FREE_ORDER_MASK;
+
+   list_remove(&b->node);
+   pf_stats.free_blocks[order]--;
+   pf_stats.free_pages -= 1u << order;
+}
+
+static void pf_set_range_state(ulong pfn, u32 order, u8 state)
+{
+   memset(&pf_state[pfn], state, 1u << order);
+}
+
+static bool pf_borrow_from_kmalloc(u32 order)
+{
+   void *va;
+   ulong pfn;
+   u8 state;
+
+   ASSERT(order <= PF_KMALLOC_ORDER);
+
+   /*
+    * Try to get a whole PF_KMALLOC_ORDER block, in order to make a single
+    * kmalloc call serve many page allocations. Fall back to smaller blocks
+    * when kmalloc is running out of memory.
+    */
+   for (u32 o = PF_KMALLOC_ORDER + 1; o-- > order; ) {
+
+      if (!(va = aligned_kmalloc(PAGE_SIZE << o, PAGE_SIZE << o)))
+         continue;
+
+      pfn = va_to_pfn(va);
+
+      if (UNLIKELY(pfn + (1u << o) > pf_count)) {
+         /* Should never happen: the frame is not covered by pf_state */
+         aligned_kfree2(va, PAGE_SIZE << o);
+         return false;
+      }
+
+      state = (u8)(PF_MANAGED | ((o + 1) << PF_BORROW_ORDER_SHIFT));
+      pf_set_range_state(pfn, o, state);
+      pf_list_add(pfn, o);
+
+      pf_stats.managed_pages += 1u << o;
+      pf_stats.kmalloc_pages += 1u << o;
+      return true;
+   }
+
+   return false;
+}
+
+static void *__pf_alloc(u32 order)
+{
+   struct pf_free_block *b;
+   ulong pfn;
+   u32 o;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (o = order; o < PF_ORDERS; o++)
+      if (!list_is_empty(&pf_free_lists[o]))
+         break;
+
+   if (o == PF_ORDERS) {
+
+      if (order > PF_KMALLOC_ORDER || !pf_borrow_from_kmalloc(order))
+         return NULL;
+
+      for (o = order; list_is_empty(&pf_free_lists[o]); o++) { }
+   }
+
+   b = list_first_obj(&pf_free_lists[o], struct pf_free_block, node);
+   pfn = va_to_pfn(b);
+   pf_list_remove(pfn, o);
+
+   /* Split the block, keeping the lower half each time */
+   while (o > order) {
+      o--;
+      pf_list_add(pfn + (1u << o), o);
+   }
+
+   return pfn_to_va(pfn);
+}
+
+static void __pf_free(ulong pfn, u32 order)
+{
+   const u8 state = pf_state[pfn] & (u8)~PF_FREE_ORDER_MASK;
+   const u32 max_order = pf_max_merge_order(state);
+   ulong buddy;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(pf_state[pfn] & PF_MANAGED);
+   ASSERT(!(pf_state[pfn] & PF_FREE_ORDER_MASK));
+   ASSERT(order <= max_order);
+   ASSERT(!(pfn & ((1u << order) - 1)));
+
+   /* Merge with the buddies, as long as they're free */
+   while (order < max_order) {
+
+      buddy = pfn ^ (1u << order);
+
+      if (buddy >= pf_count || pf_state[buddy] != (state | (order + 1)))
+         break;
+
+      pf_list_remove(buddy, order);
+      pfn &= ~(ulong)(1u << order);
+      order++;
+   }
+
+   if (state & PF_BORROW_ORDER_MASK) {
+
+      if (order == max_order && pf_stats.free_pages >= PF_KMALLOC_KEEP_PAGES) {
+
+         /* The whole block borrowed from kmalloc is free: give it back */
+         pf_set_range_state(pfn, order, 0);
+         aligned_kfree2(pfn_to_va(pfn), PAGE_SIZE << order);
+
+         pf_stats.managed_pages -= 1u << order;
+         pf_stats.kmalloc_pages -= 1u << order;
+         return;
+      }
+   }
+
+   pf_list_add(pfn, order);
+}
+
+void *pf_alloc(u32 order)
+{
+   void *va;
+   ASSERT(pf_state != NULL);
+
+   disable_preemption();
+   {
+      va = __pf_alloc(order);
+   }
+   enable_preemption();
+   return va;
+}
+
+void pf_free(void *va, u32 order)
+{
+   ASSERT(IS_PAGE_ALIGNED(va));
+
+   disable_preemption();
+   {
+      __pf_free(va_to_pfn(va), order);
+   }
+   enable_preemption();
+}
+
+size_t pf_alloc_batch(void **vec, size_t count)
+{
+   size_t i;
+
+   disable_preemption();
+   {
+      for (i = 0; i < count; i++)
+         if (!(vec[i] = __pf_alloc(0)))
+            break;
+   }
+   enable_preemption();
+   return i;
+}
+
+void pf_get_stats(struct pf_alloc_stats *stats)
+{
+   disable_preemption();
+   {
+      *stats = pf_stats;
+   }
+   enable_preemption();
+}
+
+static void pf_add_free_range(ulong pfn, ulong end)
+{
+   u32 order;
+
+   while (pfn < end) {
+
+      order = PF_MAX_ORDER;
+
+      while ((pfn & ((1u << order) - 1)) || pfn + (1u << order) > end)
+         order--;
+
+      pf_set_range_state(pfn, order, PF_MANAGED);
+      pf_list_add(pfn, order);
+      pf_stats.managed_pages += 1u << order;
+      pfn += 1u << order;
+   }
+}
+
+static ulong pf_get_linear_mapped_frames_count(void)
+{
+   struct mem_region r;
+   ulong end, max_end = 0;
+
+   for (int i = 0; i < get_mem_regions_count(); i++) {
+
+      get_mem_region(i, &r);
+
+      if (r.addr >= LINEAR_MAPPING_SIZE)
+         continue;
+
+      end = (ulong)MIN(r.addr + r.len, (u64)LINEAR_MAPPING_SIZE);
+      max_end = MAX(max_end, end);
+   }
+
+   return pow2_round_up_at(max_end, PAGE_SIZE) >> PAGE_SHIFT;
+}
+
+void init_pf_alloc(void)
+{
+   ulong va, end;
+
+   bzero(&pf_stats, sizeof(pf_stats));
+
+   for (int i = 0; i < PF_ORDERS; i++)
+      list_init(&pf_free_lists[i]);
+
+   pf_count = pf_get_linear_mapped_frames_count();
+
+   if (!(pf_state = kzmalloc(pf_count)))
+      panic("Unable to allocate the page-frame allocator's state");
+
+   for (int i = 0; kmalloc_get_unused_range(i, &va, &end); i++)
+      pf_add_free_range(va_to_pfn(TO_PTR(va)), va_to_pfn(TO_PTR(end)));
+}
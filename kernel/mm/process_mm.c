@@ -8,6 +8,7 @@
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/paging_hw.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/fs/devfs.h>
@@ -19,16 +20,14 @@ char page_size_buf[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 static inline void sys_brk_internal(struct process *pi, void *new_brk)
 {
+   const ulong brk = (ulong)pi->brk;
    ASSERT(!is_preemption_enabled());
+   ASSERT(pi->pdir == get_curr_pdir());
 
    if (new_brk < pi->brk) {
 
       /* we have to free pages */
-
-      for (void *vaddr = new_brk; vaddr < pi->brk; vaddr += PAGE_SIZE) {
-         unmap_page(pi->pdir, vaddr, true);
-      }
-
+      user_unmap_anon_mem((ulong)new_brk, (brk - (ulong)new_brk) >> PAGE_SHIFT);
       pi->brk = new_brk;
       return;
    }
@@ -43,29 +42,13 @@ static inline void sys_brk_internal(struct process *pi, void *new_brk)
       vaddr += PAGE_SIZE;
    }
 
-   /* OK, everything looks good here */
-
-   vaddr = pi->brk;
-
-   while (vaddr < new_brk) {
-
-      void *kernel_vaddr = kmalloc(PAGE_SIZE);
-
-      if (!kernel_vaddr)
-         break; /* we've allocated as much as possible */
-
-      const ulong paddr = KERNEL_VA_TO_PA(kernel_vaddr);
-
-      if (map_page(pi->pdir, vaddr, paddr, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
-         break;
-      }
-
-      vaddr += PAGE_SIZE;
-   }
+   /*
+    * OK, everything looks good here. Map the new pages to the zero page: they
+    * will be actually allocated on the first write.
+    */
 
-   /* We're done. */
-   pi->brk = vaddr;
+   if (user_map_anon_mem(brk, ((ulong)new_brk - brk) >> PAGE_SHIFT))
+      pi->brk = new_brk;
 }
 
 void *sys_brk(void *new_brk)
@@ -103,98 +86,42 @@ void *sys_brk(void *new_brk)
    return pi->brk;
 }
 
-static int create_process_mmap_heap(struct process *pi)
-{
-   struct kmalloc_heap *mmap_heap;
-   ASSERT(!pi->mi);
-
-   if (!(pi->mi = kalloc_obj(struct mappings_info)))
-      return -ENOMEM;
-
-   if (!(mmap_heap = kzmalloc(kmalloc_get_heap_struct_size()))) {
-      kfree_obj(pi->mi, struct mappings_info);
-      return -ENOMEM;
-   }
-
-   list_init(&pi->mi->mappings);
-   pi->mi->mmap_heap = mmap_heap;
-   pi->mi->mmap_heap_size = USER_MMAP_MIN_SZ;
-
-   bool success =
-      kmalloc_create_heap(mmap_heap,
-                          USER_MMAP_BEGIN,
-                          pi->mi->mmap_heap_size,
-                          PAGE_SIZE,
-                          KMALLOC_MAX_ALIGN,    /* alloc block size */
-                          false,                /* linear mapping */
-                          NULL,                 /* metadata_nodes */
-#if MMAP_NO_COW
-                          user_valloc_and_map,
-                          user_vfree_and_unmap);
-#else
-                          user_map_zero_page,
-                          user_unmap_zero_page);
-#endif
-
-   if (!success)
-      return -ENOMEM;
-
-   return 0;
-}
-
-static inline void
-mmap_err_case_free(struct process *pi, void *ptr, size_t actual_len)
-{
-   per_heap_kfree(pi->mi->mmap_heap,
-                  ptr,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
-}
-
 static struct user_mapping *
-mmap_on_user_heap(struct process *pi,
-                  size_t *actual_len_ref,
-                  fs_handle handle,
-                  u32 per_heap_kmalloc_flags,
-                  size_t off,
-                  int prot)
+mmap_in_user_vspace(struct process *pi,
+                    size_t len,
+                    fs_handle handle,
+                    size_t off,
+                    int prot,
+                    int flags)
 {
-   void *res;
    struct user_mapping *um;
+   ulong vaddr;
 
-   while (true) {
-
-      struct kmalloc_heap *new_heap;
-      struct kmalloc_heap *h = pi->mi->mmap_heap;
-      size_t heap_sz = pi->mi->mmap_heap_size;
-
-      res = per_heap_kmalloc(h,
-                             actual_len_ref,
-                             per_heap_kmalloc_flags);
-
-      if (LIKELY(res != NULL))
-         break;        /* great! */
-
-      if (heap_sz == USER_MMAP_MAX_SZ)
-         return NULL; /* cannot expand the heap more than that */
+   ASSERT(!is_preemption_enabled());
 
-      new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
+   vaddr = 0;
 
-      if (!new_heap)
-         return NULL; /* no enough memory */
+   /*
+    * Align the large mappings at 4 MB, in order to allow them to use big pages
+    * (framebuffer, anonymous memory). That's just best-effort.
+    */
+   if (len >= BIG_PAGE_SIZE)
+      vaddr = user_vaddr_alloc_aligned(pi->mi, len, BIG_PAGE_SIZE);
 
-      pi->mi->mmap_heap_size = heap_sz * 2;
-      pi->mi->mmap_heap = new_heap;
-      kmalloc_destroy_heap(h);
-   }
+   if (!vaddr && !(vaddr = user_vaddr_alloc(pi->mi, len)))
+      return NULL;
 
    /* NOTE: here `handle` might be NULL (zero-map case) and that's OK */
-   um = process_add_user_mapping(handle, res, *actual_len_ref, off, prot);
+   um = process_add_user_mapping(handle, TO_PTR(vaddr), len, off, prot, flags);
 
    if (!um) {
-      mmap_err_case_free(pi, res, *actual_len_ref);
+      user_vaddr_free(pi->mi, vaddr, len);
+      return NULL;
+   }
+
+   if (!handle && !user_map_anon_mem(vaddr, len >> PAGE_SHIFT)) {
+      process_remove_user_mapping(um);
+      user_vaddr_free(pi->mi, vaddr, len);
       return NULL;
    }
 
@@ -205,15 +132,16 @@ long
 sys_mmap_pgoff(void *addr, size_t len, int prot,
                int flags, int fd, size_t pgoffset)
 {
-   u32 per_heap_kmalloc_flags = KMALLOC_FL_MULTI_STEP | PAGE_SIZE;
    struct task *curr = get_curr_task();
    struct process *pi = curr->pi;
    struct fs_handle_base *handle = NULL;
    struct user_mapping *um = NULL;
+   const int type = flags & (MAP_SHARED | MAP_PRIVATE);
+   int um_flags = type;
    size_t actual_len;
-   int rc, fl;
+   int rc, fl, vfs_fl;
 
-   if ((flags & MAP_PRIVATE) && (flags & MAP_SHARED))
+   if (type != MAP_SHARED && type != MAP_PRIVATE)
       return -EINVAL; /* non-sense parameters */
 
    if (!len)
@@ -232,22 +160,25 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if (!(flags & MAP_ANONYMOUS))
          return -EINVAL;
 
-      if (flags & MAP_SHARED)
+      if (type == MAP_SHARED)
          return -EINVAL; /* MAP_SHARED not supported for anonymous mappings */
 
-      if (!(flags & MAP_PRIVATE))
-         return -EINVAL;
-
       if ((prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
          return -EINVAL;
 
       if (pgoffset != 0)
          return -EINVAL; /* pgoffset != 0 does not make sense here */
 
+      /*
+       * MAP_HUGETLB is just a hint here: the 4 MB pages get allocated on the
+       * first write to them, if possible. See pdir_promote_zero_page_table().
+       */
+      um_flags |= flags & MAP_HUGETLB;
+
    } else {
 
-      if (!(flags & MAP_SHARED))
-         return -EINVAL;
+      if (flags & MAP_HUGETLB)
+         return -EINVAL; /* No hugetlbfs, like on Linux without it */
 
       handle = get_fs_handle(fd);
 
@@ -262,37 +193,44 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if ((prot & (PROT_READ | PROT_WRITE)) == PROT_WRITE)
          return -EINVAL; /* disallow write-only mappings */
 
-      if (prot & PROT_WRITE) {
+      /*
+       * Writing to a private mapping never affects the file (the pages get
+       * copied on write, see handle_potential_cow()), therefore that doesn't
+       * require the file to be open for writing.
+       */
+      if ((prot & PROT_WRITE) && type == MAP_SHARED) {
          if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
             return -EACCES;
       }
-
-      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
    }
 
    if (!pi->mi)
-      if ((rc = create_process_mmap_heap(pi)))
-         return rc;
+      if (!(pi->mi = alloc_mappings_info()))
+         return -ENOMEM;
 
    disable_preemption();
    {
-      um = mmap_on_user_heap(pi,
-                             &actual_len,
-                             handle,
-                             per_heap_kmalloc_flags,
-                             pgoffset << PAGE_SHIFT,
-                             prot);
+      um = mmap_in_user_vspace(pi,
+                               actual_len,
+                               handle,
+                               pgoffset << PAGE_SHIFT,
+                               prot,
+                               um_flags);
    }
    enable_preemption();
 
    if (!um)
       return -ENOMEM;
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
-
    if (handle) {
 
-      if ((rc = vfs_mmap(um, pi->pdir, 0))) {
+      /*
+       * The pages of file mappings are mapped on the first access, unless
+       * the user asked for MAP_POPULATE: see vfs_handle_fault().
+       */
+      vfs_fl = (flags & MAP_POPULATE) ? VFS_MM_POPULATE : 0;
+
+      if ((rc = vfs_mmap(um, pi->pdir, vfs_fl))) {
 
          /*
           * Everything was apparently OK and the allocation in the user virtual
@@ -302,18 +240,12 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
          disable_preemption();
          {
-            mmap_err_case_free(pi, um->vaddrp, actual_len);
             process_remove_user_mapping(um);
+            user_vaddr_free(pi->mi, (ulong)um->vaddr, actual_len);
          }
          enable_preemption();
          return rc;
       }
-
-
-   } else {
-
-      if (MMAP_NO_COW)
-         bzero(um->vaddrp, actual_len);
    }
 
    return (long)um->vaddr;
@@ -321,7 +253,6 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
 static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 {
-   u32 kfree_flags = KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP;
    struct user_mapping *um = NULL, *um2 = NULL;
    ulong vaddr = (ulong) vaddrp;
    size_t actual_len;
@@ -346,57 +277,58 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 
    const ulong um_vend = um->vaddr + um->len;
 
-   if (actual_len == um->len) {
+   /* Un-mapping past the end of the mapping affects just the mapping itself */
+   actual_len = MIN(actual_len, um_vend - vaddr);
 
-      process_remove_user_mapping(um);
-
-   } else {
+   if (actual_len == um->len) {
+      full_remove_user_mapping(pi, um);
+      return 0;
+   }
 
-      /* partial un-map */
+   /* partial un-map */
 
-      if (vaddr == um->vaddr) {
+   if (vaddr == um->vaddr) {
 
-         /* unmap the beginning of the chunk */
-         um->vaddr += actual_len;
-         um->off += actual_len;
-         um->len -= actual_len;
+      /* unmap the beginning of the chunk */
+      um->vaddr += actual_len;
+      um->off += actual_len;
+      um->len -= actual_len;
 
-      } else if (vaddr + actual_len == um_vend) {
+   } else if (vaddr + actual_len == um_vend) {
 
-         /* unmap the end of the chunk */
-         um->len -= actual_len;
+      /* unmap the end of the chunk */
+      um->len -= actual_len;
 
-      } else {
+   } else {
 
-         /* Unmap something at the middle of the chunk */
+      /* Unmap something at the middle of the chunk */
 
-         /* Shrink the current struct user_mapping */
-         um->len = vaddr - um->vaddr;
+      /* Shrink the current struct user_mapping */
+      um->len = vaddr - um->vaddr;
 
-         /* Create a new struct user_mapping for its 2nd part */
-         um2 = process_add_user_mapping(
-            um->h,
-            (void *)(vaddr + actual_len),
-            (um_vend - (vaddr + actual_len)),
-            um->off + um->len + actual_len,
-            um->prot
-         );
+      /* Create a new struct user_mapping for its 2nd part */
+      um2 = process_add_user_mapping(
+         um->h,
+         (void *)(vaddr + actual_len),
+         (um_vend - (vaddr + actual_len)),
+         um->off + um->len + actual_len,
+         um->prot,
+         um->flags
+      );
 
-         if (!um2) {
+      if (!um2) {
 
-            /*
-             * Oops, we're out-of-memory! No problem, revert um->page_count
-             * and return -ENOMEM. Linux is allowed to do that.
-             */
-            um->len = um_vend - um->vaddr;
-            return -ENOMEM;
-         }
+         /*
+          * Oops, we're out-of-memory! No problem, revert um->page_count
+          * and return -ENOMEM. Linux is allowed to do that.
+          */
+         um->len = um_vend - um->vaddr;
+         return -ENOMEM;
       }
    }
 
    if (um->h) {
 
-      kfree_flags |= KFREE_FL_NO_ACTUAL_FREE;
       rc = vfs_munmap(um, vaddrp, actual_len);
 
       /*
@@ -410,14 +342,13 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 
       if (um2)
          vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
-   }
 
-   per_heap_kfree(pi->mi->mmap_heap,
-                  vaddrp,
-                  &actual_len,
-                  kfree_flags);
+   } else {
+
+      user_unmap_anon_mem(vaddr, actual_len >> PAGE_SHIFT);
+   }
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   user_vaddr_free(pi->mi, vaddr, actual_len);
    return 0;
 }
 
@@ -428,15 +359,14 @@ int sys_munmap(void *vaddrp, size_t len)
    ulong vaddr = (ulong) vaddrp;
    int rc;
 
-   if (!len || !pi->mi->mmap_heap)
+   if (!len || !pi->mi)
       return -EINVAL;
 
-   if (!IN_RANGE(vaddr,
-                 USER_MMAP_BEGIN,
-                 USER_MMAP_BEGIN + pi->mi->mmap_heap_size))
-   {
+   if (vaddr & OFFSET_IN_PAGE_MASK)
+      return -EINVAL;
+
+   if (!IN_RANGE(vaddr, USER_MMAP_BEGIN, USER_MMAP_END))
       return -EINVAL;
-   }
 
    disable_preemption();
    {
@@ -1,15 +1,328 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+#include <tilck/common/utils.h>
+
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/paging_hw.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/errno.h>
+
+#include <sys/mman.h>      // system header
+
+static DEFINE_KMALLOC_CACHE(um_cache,
+                            "user_mapping",
+                            sizeof(struct user_mapping),
+                            NULL);
+
+static DEFINE_KMALLOC_CACHE(gap_cache,
+                            "user_vaddr_gap",
+                            sizeof(struct user_vaddr_gap),
+                            NULL);
+
+static ALWAYS_INLINE long ulong_cmp(ulong a, ulong b)
+{
+   return a < b ? -1 : (a > b);
+}
+
+static long um_insert_cmp(const void *a, const void *b)
+{
+   const struct user_mapping *um1 = a;
+   const struct user_mapping *um2 = b;
+   return ulong_cmp(um1->vaddr, um2->vaddr);
+}
+
+static long um_find_cmp(const void *obj, const void *val)
+{
+   const struct user_mapping *um = obj;
+   const ulong vaddr = *(const ulong *)val;
+
+   if (vaddr < um->vaddr)
+      return 1;
+
+   if (vaddr >= um->vaddr + um->len)
+      return -1;
+
+   return 0;
+}
+
+static long gap_addr_cmp(const void *a, const void *b)
+{
+   const struct user_vaddr_gap *g1 = a;
+   const struct user_vaddr_gap *g2 = b;
+   return ulong_cmp(g1->vaddr, g2->vaddr);
+}
+
+static long gap_addr_find_cmp(const void *obj, const void *val)
+{
+   const struct user_vaddr_gap *g = obj;
+   const ulong vaddr = *(const ulong *)val;
+
+   if (vaddr < g->vaddr)
+      return 1;
+
+   if (vaddr >= g->vaddr + g->len)
+      return -1;
+
+   return 0;
+}
+
+static long gap_size_cmp(const void *a, const void *b)
+{
+   const struct user_vaddr_gap *g1 = a;
+   const struct user_vaddr_gap *g2 = b;
+
+   if (g1->len != g2->len)
+      return ulong_cmp(g1->len, g2->len);
+
+   return ulong_cmp(g1->vaddr, g2->vaddr);
+}
+
+static void gap_size_tree_insert(struct mappings_info *mi,
+                                 struct user_vaddr_gap *g)
+{
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert(&mi->gaps_by_size,
+                     g,
+                     gap_size_cmp,
+                     struct user_vaddr_gap,
+                     size_node);
+
+   ASSERT(success);
+}
+
+static void gap_size_tree_remove(struct mappings_info *mi,
+                                 struct user_vaddr_gap *g)
+{
+   DEBUG_ONLY_UNSAFE(void *res =)
+      bintree_remove(&mi->gaps_by_size,
+                     g,
+                     gap_size_cmp,
+                     struct user_vaddr_gap,
+                     size_node);
+
+   ASSERT(res == g);
+   bintree_node_init(&g->size_node);
+}
+
+static struct user_vaddr_gap *
+gap_new(struct mappings_info *mi, ulong vaddr, size_t len)
+{
+   struct user_vaddr_gap *g;
+
+   if (!(g = kmalloc_cache_alloc(&gap_cache)))
+      return NULL;
+
+   bintree_node_init(&g->addr_node);
+   bintree_node_init(&g->size_node);
+   g->vaddr = vaddr;
+   g->len = len;
+
+   bintree_insert(&mi->gaps_by_addr,
+                  g,
+                  gap_addr_cmp,
+                  struct user_vaddr_gap,
+                  addr_node);
+
+   gap_size_tree_insert(mi, g);
+   return g;
+}
+
+static void gap_delete(struct mappings_info *mi, struct user_vaddr_gap *g)
+{
+   bintree_remove(&mi->gaps_by_addr,
+                  g,
+                  gap_addr_cmp,
+                  struct user_vaddr_gap,
+                  addr_node);
+
+   gap_size_tree_remove(mi, g);
+   kmalloc_cache_free(&gap_cache, g);
+}
+
+static struct user_vaddr_gap *
+gap_find(struct mappings_info *mi, ulong vaddr)
+{
+   return bintree_find(mi->gaps_by_addr,
+                       &vaddr,
+                       gap_addr_find_cmp,
+                       struct user_vaddr_gap,
+                       addr_node);
+}
+
+/*
+ * Reserve `len` bytes of user virtual address space in the mmap area, using
+ * the smallest gap big enough (and the lowest one, among those). Returns 0
+ * in case there's no such gap.
+ */
+ulong user_vaddr_alloc(struct mappings_info *mi, size_t len)
+{
+   struct user_vaddr_gap key = { .vaddr = 0, .len = len };
+   struct user_vaddr_gap *g;
+   ulong vaddr;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   g = bintree_find_ge(mi->gaps_by_size,
+                       &key,
+                       gap_size_cmp,
+                       struct user_vaddr_gap,
+                       size_node);
+
+   if (!g)
+      return 0;
+
+   vaddr = g->vaddr;
+
+   if (g->len == len) {
+      gap_delete(mi, g);
+      return vaddr;
+   }
+
+   /*
+    * Shrink the gap from its beginning: that doesn't change its position in
+    * the tree ordered by address, but it does in the one ordered by size.
+    */
+   gap_size_tree_remove(mi, g);
+   g->vaddr += len;
+   g->len -= len;
+   gap_size_tree_insert(mi, g);
+   return vaddr;
+}
+
+/*
+ * Like user_vaddr_alloc(), but the returned vaddr is aligned at `align`, which
+ * must be a power of 2. The extra space reserved at both the ends of the range
+ * is given back immediately.
+ */
+ulong
+user_vaddr_alloc_aligned(struct mappings_info *mi, size_t len, size_t align)
+{
+   const size_t ext_len = len + align - PAGE_SIZE;
+   ulong vaddr, aligned;
+
+   ASSERT(align >= PAGE_SIZE && !(align & (align - 1)));
+
+   if (!(vaddr = user_vaddr_alloc(mi, ext_len)))
+      return 0;
+
+   aligned = pow2_round_up_at(vaddr, align);
+
+   if (aligned > vaddr)
+      user_vaddr_free(mi, vaddr, aligned - vaddr);
+
+   if (aligned + len < vaddr + ext_len)
+      user_vaddr_free(mi, aligned + len, vaddr + ext_len - aligned - len);
+
+   return aligned;
+}
+
+/*
+ * Give back to the mmap area the given range, merging it with the adjacent
+ * gaps, if any.
+ */
+void user_vaddr_free(struct mappings_info *mi, ulong vaddr, size_t len)
+{
+   const ulong end = vaddr + len;
+   struct user_vaddr_gap *prev = NULL, *next = NULL;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(IS_PAGE_ALIGNED(vaddr) && IS_PAGE_ALIGNED(len));
+   ASSERT(vaddr >= USER_MMAP_BEGIN && end <= USER_MMAP_END);
+   ASSERT(!gap_find(mi, vaddr));
+
+   if (vaddr > USER_MMAP_BEGIN)
+      prev = gap_find(mi, vaddr - 1);
+
+   if (end < USER_MMAP_END)
+      next = gap_find(mi, end);
+
+   if (prev && next) {
+
+      gap_size_tree_remove(mi, prev);
+      prev->len += len + next->len;
+      gap_delete(mi, next);
+      gap_size_tree_insert(mi, prev);
+
+   } else if (prev) {
+
+      gap_size_tree_remove(mi, prev);
+      prev->len += len;
+      gap_size_tree_insert(mi, prev);
+
+   } else if (next) {
+
+      /* Extending `next` backwards keeps its order in the by-address tree */
+      gap_size_tree_remove(mi, next);
+      next->vaddr = vaddr;
+      next->len += len;
+      gap_size_tree_insert(mi, next);
+
+   } else {
+
+      /*
+       * In the unlikely case we're out of memory here, the range just won't
+       * be available for new mappings until the process exits. It's better
+       * than making munmap() fail after the pages have been already unmapped.
+       */
+      gap_new(mi, vaddr, len);
+   }
+}
+
+struct mappings_info *alloc_mappings_info(void)
+{
+   struct mappings_info *mi;
+
+   if (!(mi = kzalloc_obj(struct mappings_info)))
+      return NULL;
+
+   list_init(&mi->mappings);
+
+   disable_preemption();
+   {
+      if (!gap_new(mi, USER_MMAP_BEGIN, USER_MMAP_END - USER_MMAP_BEGIN)) {
+         kfree_obj(mi, struct mappings_info);
+         mi = NULL;
+      }
+   }
+   enable_preemption();
+   return mi;
+}
+
+void free_mappings_info(struct mappings_info *mi)
+{
+   struct user_mapping *um, *temp;
+   struct user_vaddr_gap *g;
+
+   disable_preemption();
+   {
+      /*
+       * Normally, all the mappings have been removed at this point, but that
+       * is not the case when we're undoing a failed fork().
+       */
+      list_for_each(um, temp, &mi->mappings, pi_node) {
+         list_remove(&um->pi_node);
+         list_remove(&um->inode_node);
+         kmalloc_cache_free(&um_cache, um);
+      }
+
+      while ((g = mi->gaps_by_addr))
+         gap_delete(mi, g);
+   }
+   enable_preemption();
+   kfree_obj(mi, struct mappings_info);
+}
 
 struct user_mapping *
 process_add_user_mapping(fs_handle h,
                          void *vaddr,
                          size_t len,
                          size_t off,
-                         int prot)
+                         int prot,
+                         int flags)
 {
    struct process *pi = get_curr_proc();
    struct user_mapping *um;
@@ -19,11 +332,14 @@ process_add_user_mapping(fs_handle h,
    ASSERT(!process_get_user_mapping(vaddr));
    ASSERT(pi->mi);
 
-   if (!(um = kzalloc_obj(struct user_mapping)))
+   if (!(um = kmalloc_cache_alloc(&um_cache)))
       return NULL;
 
+   bzero(um, sizeof(struct user_mapping));
+
    list_node_init(&um->pi_node);
    list_node_init(&um->inode_node);
+   bintree_node_init(&um->tree_node);
 
    um->pi = pi;
    um->h = h;
@@ -31,55 +347,58 @@ process_add_user_mapping(fs_handle h,
    um->vaddrp = vaddr;
    um->off = off;
    um->prot = prot;
+   um->flags = flags;
 
    list_add_tail(&pi->mi->mappings, &um->pi_node);
+   bintree_insert(&pi->mi->mappings_tree,
+                  um,
+                  um_insert_cmp,
+                  struct user_mapping,
+                  tree_node);
    return um;
 }
 
 void process_remove_user_mapping(struct user_mapping *um)
 {
+   struct mappings_info *mi = um->pi->mi;
    ASSERT(!is_preemption_enabled());
 
    list_remove(&um->pi_node);
    list_remove(&um->inode_node);
-   kfree_obj(um, struct user_mapping);
+
+   bintree_remove(&mi->mappings_tree,
+                  um,
+                  um_insert_cmp,
+                  struct user_mapping,
+                  tree_node);
+
+   kmalloc_cache_free(&um_cache, um);
 }
 
 struct user_mapping *process_get_user_mapping(void *vaddrp)
 {
    const ulong vaddr = (ulong)vaddrp;
    struct process *pi = get_curr_proc();
-   struct user_mapping *pos;
 
    ASSERT(!is_preemption_enabled());
 
-   if (pi->mi) {
-
-      /*
-       * Given that pi->mi->mappings contains at the moment only the memory
-       * mappings done with mmap(), some small processes that don't use dynamic
-       * memory allocation will not even have this field (pi->mi == NULL).
-       *
-       * For the rest, the list is supposed to be *short*, so a linear scan
-       * is acceptable for the moment. If in the future we start to put
-       * there also the mappings for program's text and data and expect to have
-       * more than a few elements, it will be necessary to use a BST to perform
-       * the lookup here below.
-       */
-
-      list_for_each_ro(pos, &pi->mi->mappings, pi_node) {
-
-         if (IN_RANGE(vaddr, pos->vaddr, pos->vaddr + pos->len))
-            return pos;
-      }
-   }
+   /*
+    * Small processes that never called mmap() don't even have the mappings
+    * info (pi->mi == NULL).
+    */
+   if (!pi->mi)
+      return NULL;
 
-   return NULL;
+   return bintree_find(pi->mi->mappings_tree,
+                       &vaddr,
+                       um_find_cmp,
+                       struct user_mapping,
+                       tree_node);
 }
 
 void remove_all_user_zero_mem_mappings(struct process *pi)
 {
-   struct user_mapping *um;
+   struct user_mapping *um, *temp;
    struct list *mappings_list_p;
 
    ASSERT(!is_preemption_enabled());
@@ -89,10 +408,18 @@ void remove_all_user_zero_mem_mappings(struct process *pi)
 
    mappings_list_p = &pi->mi->mappings;
 
-   list_for_each_ro(um, mappings_list_p, pi_node) {
+   list_for_each(um, temp, mappings_list_p, pi_node) {
+
+      if (um->h)
+         continue;
 
-      if (!um->h)
-         full_remove_user_mapping(pi, um);
+      /*
+       * The callers are going to destroy the whole pdir, which releases all
+       * the pages anyway: unmapping them here one by one would just force
+       * the page tables still shared with the parent to be copied.
+       */
+      user_vaddr_free(pi->mi, um->vaddr, um->len);
+      process_remove_user_mapping(um);
    }
 
    ASSERT(list_is_empty(mappings_list_p));
@@ -121,20 +448,17 @@ void full_remove_user_mapping(struct process *pi, struct user_mapping *um)
    struct mappings_info *mi = pi->mi;
    size_t actual_len = um->len;
 
+   const ulong vaddr = um->vaddr;
+
    ASSERT(mi);
-   ASSERT(mi->mmap_heap);
 
    if (um->h)
       vfs_munmap(um, um->vaddrp, actual_len);
-
-   per_heap_kfree(mi->mmap_heap,
-                  um->vaddrp,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
+   else
+      user_unmap_anon_mem(vaddr, actual_len >> PAGE_SHIFT);
 
    process_remove_user_mapping(um);
+   user_vaddr_free(mi, vaddr, actual_len);
 }
 
 void remove_all_file_mappings(struct process *pi)
@@ -150,25 +474,37 @@ void remove_all_file_mappings(struct process *pi)
    }
 }
 
+static int dup_gap_cb(void *obj, void *arg)
+{
+   struct user_vaddr_gap *g = obj;
+   return gap_new(arg, g->vaddr, g->len) ? 0 : -ENOMEM;
+}
+
 struct mappings_info *
 duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
 {
    struct mappings_info *new_mi = NULL;
    struct user_mapping *um, *um2;
+   int rc;
 
-   if (!(new_mi = kalloc_obj(struct mappings_info)))
-      goto oom_case;
+   ASSERT(!is_preemption_enabled());
+
+   if (!(new_mi = kzalloc_obj(struct mappings_info)))
+      return NULL;
 
    list_init(&new_mi->mappings);
 
-   if (!(new_mi->mmap_heap = kmalloc_heap_dup(mi->mmap_heap)))
+   rc = bintree_in_order_visit(mi->gaps_by_addr,
+                               dup_gap_cb,
+                               new_mi,
+                               struct user_vaddr_gap,
+                               addr_node);
+   if (rc)
       goto oom_case;
 
-   new_mi->mmap_heap_size = mi->mmap_heap_size;
-
    list_for_each_ro(um, &mi->mappings, pi_node) {
 
-      if (!(um2 = kalloc_obj(struct user_mapping)))
+      if (!(um2 = kmalloc_cache_alloc(&um_cache)))
          goto oom_case;
 
       /* First just copy the mapping info */
@@ -180,9 +516,15 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
       /* Re-init the new nodes */
       list_node_init(&um2->pi_node);
       list_node_init(&um2->inode_node);
+      bintree_node_init(&um2->tree_node);
 
-      /* Add the pi_node to new process's mappings list */
+      /* Add the new mapping to new process's mappings list and tree */
       list_add_tail(&new_mi->mappings, &um2->pi_node);
+      bintree_insert(&new_mi->mappings_tree,
+                     um2,
+                     um_insert_cmp,
+                     struct user_mapping,
+                     tree_node);
 
       /*
        * If the inode_node belongs to a list (mappings per inode)
@@ -195,22 +537,7 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
    return new_mi;
 
 oom_case:
-
-   if (new_mi) {
-
-      if (new_mi->mmap_heap) {
-         kmalloc_destroy_heap(new_mi->mmap_heap);
-         kfree2(new_mi->mmap_heap, kmalloc_get_heap_struct_size());
-      }
-
-      list_for_each(um, um2, &new_mi->mappings, pi_node) {
-         list_remove(&um->pi_node);
-         kfree_obj(um, struct user_mapping);
-      }
-
-      kfree_obj(new_mi, struct mappings_info);
-   }
-
+   free_mappings_info(new_mi);
    return NULL;
 }
 
@@ -228,65 +555,53 @@ void user_vfree_and_unmap(ulong user_vaddr, size_t page_count)
    }
 }
 
-bool user_valloc_and_map_slow(ulong user_vaddr, size_t page_count)
+bool user_valloc_and_map(ulong user_vaddr, size_t page_count)
 {
    pdir_t *pdir = get_curr_pdir();
-   ulong pa, va = user_vaddr;
+   ulong va = user_vaddr;
+   size_t n, count, done = 0;
    void *kernel_vaddr;
+   u32 order;
 
-   for (size_t i = 0; i < page_count; i++, va += PAGE_SIZE) {
-
-      if (is_mapped(pdir, (void *)va)) {
-         user_vfree_and_unmap(user_vaddr, i);
-         return false;
-      }
-
-      if (!(kernel_vaddr = kmalloc(PAGE_SIZE))) {
-         user_vfree_and_unmap(user_vaddr, i);
-         return false;
-      }
-
-      pa = KERNEL_VA_TO_PA(kernel_vaddr);
-
-      if (map_page(pdir, (void *)va, pa, PAGING_FL_RWUS) != 0) {
-         kfree2(kernel_vaddr, PAGE_SIZE);
-         user_vfree_and_unmap(user_vaddr, i);
-         return false;
-      }
-   }
-
-   return true;
-}
+   while (done < page_count) {
 
-bool user_valloc_and_map(ulong user_vaddr, size_t page_count)
-{
-   pdir_t *pdir = get_curr_pdir();
-   size_t size = (size_t)page_count << PAGE_SHIFT;
-   size_t count;
+      /*
+       * Get the pageframes in blocks as big as possible (up to 64 KB), in order
+       * to map many pages at once. Fall back to smaller blocks when the page
+       * frame allocator has none of that size.
+       */
+      for (order = 0; order < PF_KMALLOC_ORDER; order++)
+         if ((2ul << order) > page_count - done)
+            break;
 
-   void *kernel_vaddr =
-      general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE);
+      while (!(kernel_vaddr = pf_alloc(order)) && order > 0)
+         order--;
 
-   if (!kernel_vaddr)
-      return user_valloc_and_map_slow(user_vaddr, page_count);
+      if (!kernel_vaddr)
+         goto oom_case;
 
-   ASSERT(size == (size_t)page_count << PAGE_SHIFT);
+      n = 1ul << order;
+      count = map_pages(pdir,
+                        (void *)va,
+                        KERNEL_VA_TO_PA(kernel_vaddr),
+                        n,
+                        PAGING_FL_US | PAGING_FL_RW);
 
-   count = map_pages(pdir,
-                     (void *)user_vaddr,
-                     KERNEL_VA_TO_PA(kernel_vaddr),
-                     page_count,
-                     PAGING_FL_US | PAGING_FL_RW);
+      if (count != n) {
+         unmap_pages(pdir, (void *)va, count, false);
+         pf_free(kernel_vaddr, order);
+         goto oom_case;
+      }
 
-   if (count != page_count) {
-      unmap_pages(pdir, (void *)user_vaddr, count, false);
-      general_kfree(kernel_vaddr,
-                    &size,
-                    KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
-      return false;
+      va += n << PAGE_SHIFT;
+      done += n;
    }
 
    return true;
+
+oom_case:
+   user_vfree_and_unmap(user_vaddr, done);
+   return false;
 }
 
 void user_unmap_zero_page(ulong user_vaddr, size_t page_count)
@@ -304,21 +619,70 @@ bool user_map_zero_page(ulong user_vaddr, size_t page_count)
 
    if (count != page_count) {
       user_unmap_zero_page(user_vaddr, count);
+      return false;
    }
 
    return true;
 }
 
+/*
+ * Map anonymous memory in the current process. Unless MMAP_NO_COW is set, no
+ * memory is actually allocated here: all the pages are mapped to the zero page
+ * as copy-on-write and they get allocated on the first write (demand paging).
+ */
+bool user_map_anon_mem(ulong user_vaddr, size_t page_count)
+{
+   if (MMAP_NO_COW) {
+
+      if (!user_valloc_and_map(user_vaddr, page_count))
+         return false;
+
+      bzero(TO_PTR(user_vaddr), page_count << PAGE_SHIFT);
+      process_inc_resident_pages(get_curr_proc(), page_count);
+      return true;
+   }
+
+   return user_map_zero_page(user_vaddr, page_count);
+}
+
+void user_unmap_anon_mem(ulong user_vaddr, size_t page_count)
+{
+   const ulong zero_page_paddr = KERNEL_VA_TO_PA(zero_page);
+   pdir_t *pdir = get_curr_pdir();
+   ulong va = user_vaddr;
+   size_t resident = 0;
+
+   for (size_t i = 0; i < page_count; i++, va += PAGE_SIZE) {
+
+      if (!is_mapped(pdir, (void *)va))
+         continue;
+
+      if (get_mapping(pdir, (void *)va) != zero_page_paddr)
+         resident++;
+   }
+
+   /* The whole 4 MB pages in the range, if any, get unmapped at once */
+   unmap_pages_permissive(pdir, TO_PTR(user_vaddr), page_count, true);
+   process_dec_resident_pages(get_curr_proc(), resident);
+}
+
 int generic_fs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
 {
    struct fs_handle_base *hb = um->h;
    struct process *pi = hb->pi;
    ulong vaddr = (ulong)vaddrp;
    ulong vend = vaddr + len;
+
+   /*
+    * The pages of a private mapping might be private copies (see the CoW
+    * logic) and they have to be freed. The file's pages are never freed here
+    * instead, as the fs holds a reference to them.
+    */
+   const bool do_free = um->flags == MAP_PRIVATE;
    ASSERT(IS_PAGE_ALIGNED(len));
 
    for (; vaddr < vend; vaddr += PAGE_SIZE) {
-      unmap_page_permissive(pi->pdir, (void *)vaddr, false);
+      unmap_page_permissive(pi->pdir, (void *)vaddr, do_free);
    }
 
    return 0;
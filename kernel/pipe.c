@@ -2,6 +2,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/string_util.h>
 
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/fs/vfs.h>
@@ -11,6 +12,7 @@
 #include <tilck/kernel/ringbuf.h>
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/sched.h>
+#include <tilck/kernel/user.h>
 
 struct pipe {
 
@@ -27,24 +29,116 @@ struct pipe {
    ATOMIC(int) write_handles;
 };
 
-static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
+static size_t iov_total_len(const struct iovec *iov, int iovcnt)
+{
+   size_t tot = 0;
+
+   for (int i = 0; i < iovcnt; i++)
+      tot += iov[i].iov_len;
+
+   return tot;
+}
+
+/*
+ * Move data from the pipe's buffer to the buffers in `iov`. When `user` is
+ * true, the buffers are in user space and the data is copied there directly,
+ * with no bounce buffer. Returns the number of bytes moved or -EFAULT.
+ */
+static ssize_t
+pipe_copy_out(struct pipe *p, const struct iovec *iov, int iovcnt, bool user)
+{
+   ssize_t tot = 0;
+   size_t off, n;
+   u8 *ptr;
+
+   for (int i = 0; i < iovcnt; i++) {
+
+      char *dest = iov[i].iov_base;
+
+      for (off = 0; off < iov[i].iov_len; off += n) {
+
+         if (!(n = ringbuf_get_read_chunk(&p->rb, &ptr)))
+            return tot;
+
+         n = MIN(n, iov[i].iov_len - off);
+
+         if (!user)
+            memcpy(dest + off, ptr, n);
+         else if (copy_to_user(dest + off, ptr, n))
+            return tot ? tot : -EFAULT;
+
+         ringbuf_consume_bytes(&p->rb, n);
+         tot += (ssize_t)n;
+      }
+   }
+
+   return tot;
+}
+
+/* Move data from the buffers in `iov` to the pipe's buffer */
+static ssize_t
+pipe_copy_in(struct pipe *p, const struct iovec *iov, int iovcnt, bool user)
+{
+   ssize_t tot = 0;
+   size_t off, n;
+   u8 *ptr;
+
+   for (int i = 0; i < iovcnt; i++) {
+
+      const char *src = iov[i].iov_base;
+
+      for (off = 0; off < iov[i].iov_len; off += n) {
+
+         if (!(n = ringbuf_get_write_chunk(&p->rb, &ptr)))
+            return tot;
+
+         n = MIN(n, iov[i].iov_len - off);
+
+         if (!user)
+            memcpy(ptr, src + off, n);
+         else if (copy_from_user(ptr, src + off, n))
+            return tot ? tot : -EFAULT;
+
+         ringbuf_commit_bytes(&p->rb, n);
+         tot += (ssize_t)n;
+      }
+   }
+
+   return tot;
+}
+
+/*
+ * When `peek` is true, the data is copied but not consumed: it remains in the
+ * pipe for the next readers (see tee()).
+ */
+static ssize_t
+pipe_read_int(fs_handle h,
+              const struct iovec *iov,
+              int iovcnt,
+              bool user,
+              bool peek)
 {
    struct kfs_handle *kh = h;
    struct pipe *p = (void *)kh->kobj;
    bool sig_pending = false;
+   struct ringbuf saved_rb;
    ssize_t rc = 0;
 
-   if (!size)
+   if (!iov_total_len(iov, iovcnt))
       return 0;
 
    kmutex_lock(&p->mutex);
 
    while (true) {
 
-      rc = (ssize_t)ringbuf_read_bytes(&p->rb, (u8 *)buf, size);
+      saved_rb = p->rb;
+      rc = pipe_copy_out(p, iov, iovcnt, user);
+
+      if (peek)
+         p->rb = saved_rb;
 
       if (rc)
-         break; /* Everything is alright, we read something */
+         break; /* We read something or got a fault */
 
       if (atomic_load_explicit(&p->write_handles, mo_relaxed) == 0) {
          /* No more writers, always return 0, no matter what. */
@@ -78,7 +172,8 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
     * The situation is perfectly symmetric for the readers as well, that's why
     * here below we wake up another reader if the buffer is not empty.
     */
-   kcond_signal_one(&p->not_full_cond);
+   if (!peek)
+      kcond_signal_one(&p->not_full_cond);
 
    if (!ringbuf_is_empty(&p->rb)) {
       /* The buffer is not empty: wake up one more reader, if any */
@@ -90,14 +185,26 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
    return !sig_pending ? rc : -EINTR;
 }
 
-static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
+static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
+{
+   const struct iovec iov = { .iov_base = buf, .iov_len = size };
+   return pipe_read_int(h, &iov, 1, false, false);
+}
+
+static ssize_t pipe_readv(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   return pipe_read_int(h, iov, iovcnt, true, false);
+}
+
+static ssize_t
+pipe_write_int(fs_handle h, const struct iovec *iov, int iovcnt, bool user)
 {
    struct kfs_handle *kh = h;
    struct pipe *p = (void *)kh->kobj;
    bool sig_pending = false;
    ssize_t rc = 0;
 
-   if (!size)
+   if (!iov_total_len(iov, iovcnt))
       return 0;
 
    kmutex_lock(&p->mutex);
@@ -107,15 +214,15 @@ static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
       if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
 
          /* Broken pipe */
-         send_signal(get_curr_pid(), SIGPIPE, true);
+         send_signal2(get_curr_pid(), get_curr_tid(), SIGPIPE, false);
          rc = -EPIPE;
          break;
       }
 
-      rc = (ssize_t)ringbuf_write_bytes(&p->rb, (u8 *)buf, size);
+      rc = pipe_copy_in(p, iov, iovcnt, user);
 
       if (rc)
-         break; /* Everything is alright, we wrote something */
+         break; /* We wrote something or got a fault */
 
       if (kh->fl_flags & O_NONBLOCK) {
          rc = -EAGAIN;
@@ -148,6 +255,17 @@ static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
    return !sig_pending ? rc : -EINTR;
 }
 
+static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
+{
+   const struct iovec iov = { .iov_base = buf, .iov_len = size };
+   return pipe_write_int(h, &iov, 1, false);
+}
+
+static ssize_t pipe_writev(fs_handle h, const struct iovec *iov, int iovcnt)
+{
+   return pipe_write_int(h, iov, iovcnt, true);
+}
+
 static int pipe_read_ready(fs_handle h)
 {
    struct kfs_handle *kh = h;
@@ -220,6 +338,7 @@ static struct kcond *pipe_get_except_cond(fs_handle h)
 static const struct file_ops static_ops_pipe_read_end =
 {
    .read = pipe_read,
+   .readv = pipe_readv,
    .read_ready = pipe_read_ready,
    .except_ready = pipe_except_ready,
    .get_rready_cond = pipe_get_rready_cond,
@@ -229,12 +348,37 @@ static const struct file_ops static_ops_pipe_read_end =
 static const struct file_ops static_ops_pipe_write_end =
 {
    .write = pipe_write,
+   .writev = pipe_writev,
    .except_ready = pipe_except_ready,
    .write_ready = pipe_write_ready,
    .get_wready_cond = pipe_get_wready_cond,
    .get_except_cond = pipe_get_except_cond,
 };
 
+struct pipe *get_pipe_of_handle(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+
+   if (kh->fops != &static_ops_pipe_read_end &&
+       kh->fops != &static_ops_pipe_write_end)
+   {
+      return NULL;
+   }
+
+   return (void *)kh->kobj;
+}
+
+ssize_t pipe_peek(fs_handle h, char *buf, size_t size)
+{
+   struct kfs_handle *kh = h;
+   const struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+   if (kh->fops != &static_ops_pipe_read_end)
+      return -EBADF;
+
+   return pipe_read_int(h, &iov, 1, false, true);
+}
+
 void destroy_pipe(struct pipe *p)
 {
    kcond_destory(&p->err_cond);
@@ -24,6 +24,15 @@ STATIC_ASSERT(IS_PAGE_ALIGNED(ARGS_COPYBUF_SIZE));
 
 #define ISOLATED_STACK_HI_VMEM_SPACE   (KERNEL_STACK_SIZE + (2 * PAGE_SIZE))
 
+/* struct task immediately followed by struct process (main threads) */
+static DEFINE_KMALLOC_CACHE(proc_cache,
+                            "process",
+                            TOT_PROC_AND_TASK_SIZE,
+                            NULL);
+
+/* struct task for the non-main threads */
+static DEFINE_KMALLOC_CACHE(task_cache, "task", sizeof(struct task), NULL);
+
 static void *alloc_kernel_isolated_stack(struct process *pi)
 {
    void *vaddr_in_block;
@@ -135,18 +144,16 @@ void process_free_mappings_info(struct process *pi)
    struct mappings_info *mi = pi->mi;
 
    if (mi && !pi->vforked) {
-      ASSERT(mi->mmap_heap);
-      kmalloc_destroy_heap(mi->mmap_heap);
-      kfree2(mi->mmap_heap, kmalloc_get_heap_struct_size());
-      kfree_obj(mi, struct mappings_info);
+      free_mappings_info(mi);
       pi->mi = NULL;
    }
 }
 
 void free_common_task_allocs(struct task *ti)
 {
-   struct process *pi = ti->pi;
-   process_free_mappings_info(pi);
+   /* The other threads share the mappings with the main one */
+   if (is_main_thread(ti))
+      process_free_mappings_info(ti->pi);
 
    free_kernel_stack(ti);
    kfree2(ti->io_copybuf, IO_COPYBUF_SIZE + ARGS_COPYBUF_SIZE);
@@ -170,7 +177,7 @@ void free_mem_for_zombie_task(struct task *ti)
 
    free_common_task_allocs(ti);
 
-   if (ti->pi->automatic_reaping) {
+   if (is_main_thread(ti) && ti->pi->automatic_reaping) {
       /* The SIGCHLD signal has been EXPLICITLY ignored by the parent */
       remove_task(ti);
    }
@@ -184,16 +191,28 @@ void init_task_lists(struct task *ti)
    list_node_init(&ti->zombie_node);
    list_node_init(&ti->wakeup_timer_node);
    list_node_init(&ti->siblings_node);
+   list_node_init(&ti->threads_node);
+   ti->rq = NULL;
 
    list_init(&ti->tasks_waiting_list);
    list_init(&ti->on_exit);
    bzero(&ti->wobj, sizeof(struct wait_obj));
 }
 
+static void process_alarm_cb(struct ktimer *t)
+{
+   struct process *pi = CONTAINER_OF(t, struct process, alarm_timer);
+   send_signal(pi->pid, SIGALRM, true);
+}
+
 void init_process_lists(struct process *pi)
 {
    list_init(&pi->children);
+   list_init(&pi->threads);
    kmutex_init(&pi->fslock, KMUTEX_FL_RECURSIVE);
+
+   /* From alarm(2): alarms created by alarm() are not inherited by fork() */
+   ktimer_init(&pi->alarm_timer, &process_alarm_cb);
 }
 
 struct task *
@@ -204,7 +223,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    bool common_allocs = false;
    bool arch_fields = false;
 
-   if (UNLIKELY(!(ti = kmalloc(TOT_PROC_AND_TASK_SIZE))))
+   if (UNLIKELY(!(ti = kmalloc_cache_alloc(&proc_cache))))
       goto oom_case;
 
    pi = (struct process *)(ti + 1);
@@ -235,6 +254,10 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    pi->automatic_reaping = false;
    pi->cwd.fs = NULL;
    pi->vforked = false;
+   pi->group_exiting = false;
+   pi->minor_faults = 0;
+   pi->peak_resident_pages = pi->resident_pages;
+   bzero(&pi->exited_threads_ticks, sizeof(pi->exited_threads_ticks));
 
    if (new_pdir != parent_pi->pdir) {
 
@@ -255,6 +278,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    ti->tid = pid;
    ti->is_main_thread = true;
    ti->timer_ready = false;
+   ti->clear_child_tid = NULL;
 
    /*
     * From fork(2):
@@ -282,6 +306,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    init_task_lists(ti);
    init_process_lists(pi);
    list_add_tail(&parent_pi->children, &ti->siblings_node);
+   list_add_tail(&pi->threads, &ti->threads_node);
 
    pi->proc_tty = parent_pi->proc_tty;
    return ti;
@@ -306,7 +331,7 @@ oom_case:
       if (MOD_debugpanel && pi->debug_cmdline)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
 
-      kfree2(ti, TOT_PROC_AND_TASK_SIZE);
+      kmalloc_cache_free(&proc_cache, ti);
    }
 
    return NULL;
@@ -316,14 +341,17 @@ struct task *allocate_new_thread(struct process *pi, int tid, bool alloc_bufs)
 {
    ASSERT(pi != NULL);
    struct task *process_task = get_process_task(pi);
-   struct task *ti = kzalloc_obj(struct task);
+   struct task *ti = kmalloc_cache_alloc(&task_cache);
+
+   if (ti)
+      bzero(ti, sizeof(struct task));
 
    if (!ti || !(ti->pi = pi) || !do_common_task_allocs(ti, alloc_bufs)) {
 
       if (ti) /* do_common_task_allocs() failed */
          free_common_task_allocs(ti);
 
-      kfree_obj(ti, struct task);
+      kmalloc_cache_free(&task_cache, ti);
       return NULL;
    }
 
@@ -331,7 +359,14 @@ struct task *allocate_new_thread(struct process *pi, int tid, bool alloc_bufs)
    ti->is_main_thread = false;
 
    init_task_lists(ti);
-   arch_specific_new_task_setup(ti, process_task);
+
+   if (!arch_specific_new_task_setup(ti, process_task)) {
+      ti->state = TASK_STATE_ZOMBIE;
+      free_common_task_allocs(ti);
+      kmalloc_cache_free(&task_cache, ti);
+      return NULL;
+   }
+
    return ti;
 }
 
@@ -355,7 +390,7 @@ static void free_process_int(struct process *pi)
    if (release_obj(pi) == 0) {
 
       arch_specific_free_proc(pi);
-      kfree2(get_process_task(pi), TOT_PROC_AND_TASK_SIZE);
+      kmalloc_cache_free(&proc_cache, get_process_task(pi));
 
       if (MOD_debugpanel)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
@@ -376,7 +411,7 @@ void free_task(struct task *ti)
    if (is_main_thread(ti))
       free_process_int(ti->pi);
    else
-      kfree_obj(ti, struct task);
+      kmalloc_cache_free(&task_cache, ti);
 }
 
 void *task_temp_kernel_alloc(size_t size)
@@ -541,7 +576,7 @@ handle_vforked_child_move_on(struct process *pi)
    ASSERT(parent->stopped);
    ASSERT(parent->vfork_stopped);
 
-   parent->stopped = false;
+   task_set_stopped(parent, false);
    parent->vfork_stopped = false;
 
    pi->vforked = false;
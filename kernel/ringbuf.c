@@ -180,6 +180,66 @@ size_t ringbuf_read_bytes(struct ringbuf *rb, u8 *buf, size_t len)
    return actual_len + actual_len2;
 }
 
+/*
+ * Chunk-based interface
+ * -----------------------
+ *
+ * ringbuf_get_read_chunk() returns the number of bytes that can be read
+ * contiguously starting from `*ptr`, without consuming them: that's done later
+ * by ringbuf_consume_bytes(). Symmetrically, ringbuf_get_write_chunk() returns
+ * the contiguous free space at `*ptr` and ringbuf_commit_bytes() makes the
+ * bytes written there part of the buffer. Data can be read or written in at
+ * most two chunks. This interface allows the callers to copy data directly
+ * from or to places where the copy might fail (e.g. user space), without
+ * losing any bytes in that case.
+ */
+
+size_t ringbuf_get_read_chunk(struct ringbuf *rb, u8 **ptr)
+{
+   ASSERT(rb->elem_size == 1);
+   *ptr = rb->buf + rb->read_pos;
+
+   if (ringbuf_is_empty(rb))
+      return 0;
+
+   if (rb->read_pos < rb->write_pos)
+      return rb->write_pos - rb->read_pos;
+
+   return rb->max_elems - rb->read_pos;
+}
+
+size_t ringbuf_get_write_chunk(struct ringbuf *rb, u8 **ptr)
+{
+   ASSERT(rb->elem_size == 1);
+   *ptr = rb->buf + rb->write_pos;
+
+   if (ringbuf_is_full(rb))
+      return 0;
+
+   if (rb->write_pos < rb->read_pos)
+      return rb->read_pos - rb->write_pos;
+
+   return rb->max_elems - rb->write_pos;
+}
+
+void ringbuf_consume_bytes(struct ringbuf *rb, size_t len)
+{
+   ASSERT(rb->elem_size == 1);
+   ASSERT(len <= rb->elems);
+
+   rb->read_pos = (u32)((rb->read_pos + len) % rb->max_elems);
+   rb->elems -= (u32)len;
+}
+
+void ringbuf_commit_bytes(struct ringbuf *rb, size_t len)
+{
+   ASSERT(rb->elem_size == 1);
+   ASSERT(len <= rb->max_elems - rb->elems);
+
+   rb->write_pos = (u32)((rb->write_pos + len) % rb->max_elems);
+   rb->elems += (u32)len;
+}
+
 bool ringbuf_read_elem(struct ringbuf *rb, void *elem_ptr /* out */)
 {
    if (ringbuf_is_empty(rb))
@@ -10,6 +10,22 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/errno.h>
+#include <tilck/kernel/syscalls.h>
+
+#include <sys/resource.h>     // system header
+
+#define RQ_BITMAP_WORDS \
+   ((SCHED_PRIO_LEVELS + NBITS - 1) / NBITS)
+
+/*
+ * O(1) run-queue. Each priority level has its FIFO list of runnable tasks and
+ * a bit in `bitmap`, set when the list is not empty: picking the next task is
+ * a matter of finding the first set bit and taking the head of its list.
+ */
+struct runqueue {
+   ulong bitmap[RQ_BITMAP_WORDS];
+   struct list queues[SCHED_PRIO_LEVELS];
+};
 
 /* Shared global variables */
 struct task *__current;
@@ -19,7 +35,6 @@ ATOMIC(bool) __need_resched;              /* see docs/atomics.md */
 struct task *kernel_process;
 struct process *kernel_process_pi;
 
-struct list runnable_tasks_list;
 struct list sleeping_tasks_list;
 struct list zombie_tasks_list;
 
@@ -31,6 +46,18 @@ static int current_max_pid = -1;
 static int current_max_kernel_tid = -1;
 static struct task *idle_task;
 
+/*
+ * The runnable tasks are split between two run-queues: the `active` one, which
+ * contains the tasks that still have some time left in their time-slice and
+ * the `expired` one, containing the tasks that consumed it entirely. The next
+ * task to run is always picked from the active run-queue and, when that becomes
+ * empty, the two run-queues are swapped. That guarantees that even tasks having
+ * the lowest priority won't starve.
+ */
+static struct runqueue runqueues[2];
+static struct runqueue *rq_active = &runqueues[0];
+static struct runqueue *rq_expired = &runqueues[1];
+
 const char *const task_state_str[5] = {
    [TASK_STATE_INVALID]  = "invalid",
    [TASK_STATE_RUNNABLE] = "runnable",
@@ -116,7 +143,7 @@ int sched_count_proc_in_group(int pgid)
 
       while ((ti = bintree_in_order_visit_next(&ctx))) {
 
-         if (ti->pi->pgid == pgid)
+         if (is_main_thread(ti) && ti->pi->pgid == pgid)
             count++;
       }
    }
@@ -230,8 +257,8 @@ static int create_new_pid_visit_cb(void *obj, void *arg)
 
    } else {
 
-      if (!is_main_thread(ti))
-         return 0; /* skip threads */
+      if (is_kernel_thread(ti))
+         return 0; /* skip kernel threads: user threads share the pid space */
 
       ASSERT(tid >= 0);
 
@@ -378,6 +405,17 @@ static void idle(void)
       ASSERT(is_preemption_enabled());
 
       idle_ticks++;
+
+      if (KRN_TICKLESS_IDLE) {
+
+         disable_interrupts_forced();
+         {
+            if (!need_reschedule() && !runnable_tasks_count)
+               timer_idle_enter();
+         }
+         enable_interrupts_forced();
+      }
+
       halt();
 
       if (need_reschedule() || runnable_tasks_count > 0)
@@ -395,7 +433,10 @@ static void create_kernel_process(void)
    struct task *s_kernel_ti = (struct task *)kernel_proc_buf;
    struct process *s_kernel_pi = (struct process *)(s_kernel_ti + 1);
 
-   list_init(&runnable_tasks_list);
+   for (int i = 0; i < 2; i++)
+      for (int j = 0; j < SCHED_PRIO_LEVELS; j++)
+         list_init(&runqueues[i].queues[j]);
+
    list_init(&sleeping_tasks_list);
    list_init(&zombie_tasks_list);
 
@@ -439,8 +480,96 @@ void process_set_tty(struct process *pi, void *t)
    pi->proc_tty = t;
 }
 
+static void rq_enqueue(struct runqueue *rq, struct task *ti)
+{
+   const int prio = ti->nice - MIN_NICE;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(ti->rq == NULL);
+
+   /* Tasks woken up by their timer run first, among the ones in their level */
+   if (ti->timer_ready)
+      list_add_head(&rq->queues[prio], &ti->runnable_node);
+   else
+      list_add_tail(&rq->queues[prio], &ti->runnable_node);
+
+   rq->bitmap[prio / NBITS] |= (1ul << (prio % NBITS));
+   ti->rq = rq;
+   runnable_tasks_count++;
+}
+
+static void rq_dequeue(struct task *ti)
+{
+   struct runqueue *rq = ti->rq;
+   const int prio = ti->nice - MIN_NICE;
+
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(rq != NULL);
+
+   list_remove(&ti->runnable_node);
+
+   if (list_is_empty(&rq->queues[prio]))
+      rq->bitmap[prio / NBITS] &= ~(1ul << (prio % NBITS));
+
+   ti->rq = NULL;
+   runnable_tasks_count--;
+   ASSERT(runnable_tasks_count >= 0);
+}
+
+static struct task *rq_first_task(struct runqueue *rq)
+{
+   for (int i = 0; i < RQ_BITMAP_WORDS; i++) {
+
+      if (rq->bitmap[i]) {
+
+         const int prio = i * NBITS + __builtin_ctzl(rq->bitmap[i]);
+         ASSERT(!list_is_empty(&rq->queues[prio]));
+
+         return list_first_obj(&rq->queues[prio], struct task, runnable_node);
+      }
+   }
+
+   return NULL;
+}
+
+/*
+ * Returns the highest-priority task in the active run-queue, without removing
+ * it from there. That will happen when its state will change to RUNNING.
+ */
+static struct task *rq_pick_next_task(void)
+{
+   struct task *ti;
+   ulong var;
+
+   disable_interrupts(&var);
+   {
+      if (!(ti = rq_first_task(rq_active))) {
+
+         struct runqueue *tmp = rq_active;
+         rq_active = rq_expired;
+         rq_expired = tmp;
+
+         ti = rq_first_task(rq_active);
+      }
+   }
+   enable_interrupts(&var);
+   return ti;
+}
+
+u32 sched_get_timeslice(struct task *ti)
+{
+   /*
+    * Scale the time-slice linearly with the priority: nice 0 gets exactly
+    * TIME_SLICE_TICKS, nice -20 twice as much and nice 19 just 1/20 of it.
+    */
+   const u32 levels_below = (u32)(MAX_NICE - ti->nice + 1);
+   return MAX(1u, (u32)TIME_SLICE_TICKS * levels_below / 20);
+}
+
 void init_sched(void)
 {
+   struct task *ti;
+   ulong var;
    int tid;
 
    ASSERT(kernel_process_pi->pid == 0);
@@ -452,7 +581,15 @@ void init_sched(void)
    if (tid < 0)
       panic("Unable to create the idle_task!");
 
-   idle_task = get_task(tid);
+   ti = get_task(tid);
+
+   disable_interrupts(&var);
+   {
+      /* The idle task never lives in the run-queue: it's the fallback */
+      rq_dequeue(ti);
+      idle_task = ti;
+   }
+   enable_interrupts(&var);
 }
 
 void set_current_task_in_kernel(void)
@@ -461,7 +598,7 @@ void set_current_task_in_kernel(void)
    get_curr_task()->running_in_kernel = true;
 }
 
-static void task_add_to_state_list(struct task *ti)
+static void task_add_to_state_list(struct task *ti, bool expired)
 {
    if (is_worker_thread(ti))
       return;
@@ -469,8 +606,8 @@ static void task_add_to_state_list(struct task *ti)
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_add_tail(&runnable_tasks_list, &ti->runnable_node);
-         runnable_tasks_count++;
+         if (!ti->stopped && ti != idle_task)
+            rq_enqueue(expired ? rq_expired : rq_active, ti);
          break;
 
       case TASK_STATE_SLEEPING:
@@ -498,9 +635,8 @@ static void task_remove_from_state_list(struct task *ti)
    switch (atomic_load_explicit(&ti->state, mo_relaxed)) {
 
       case TASK_STATE_RUNNABLE:
-         list_remove(&ti->runnable_node);
-         runnable_tasks_count--;
-         ASSERT(runnable_tasks_count >= 0);
+         if (ti->rq)
+            rq_dequeue(ti);
          break;
 
       case TASK_STATE_SLEEPING:
@@ -521,15 +657,23 @@ static void task_remove_from_state_list(struct task *ti)
 
 void task_change_state(struct task *ti, enum task_state new_state)
 {
+   bool expired;
    ulong var;
    ASSERT(ti->state != new_state);
    ASSERT(ti->state != TASK_STATE_ZOMBIE);
 
    disable_interrupts(&var);
    {
+      /*
+       * A task preempted after consuming its whole time-slice goes in the
+       * expired run-queue. Tasks woken up or preempted early, remain active.
+       */
+      expired = ti->state == TASK_STATE_RUNNING &&
+                ti->ticks.timeslice >= sched_get_timeslice(ti);
+
       task_remove_from_state_list(ti);
       atomic_store_explicit(&ti->state, new_state, mo_relaxed);
-      task_add_to_state_list(ti);
+      task_add_to_state_list(ti, expired);
    }
    enable_interrupts(&var);
 }
@@ -546,11 +690,36 @@ void task_change_state_idempotent(struct task *ti, enum task_state new_state)
    enable_interrupts(&var);
 }
 
+void task_set_stopped(struct task *ti, bool stopped)
+{
+   ulong var;
+   disable_interrupts(&var);
+   {
+      /*
+       * Stopped tasks are kept out of the run-queue, even if their state
+       * is RUNNABLE, in order to never waste time skipping them.
+       */
+      if (stopped && ti->rq)
+         rq_dequeue(ti);
+
+      ti->stopped = stopped;
+
+      if (!stopped && !ti->rq && ti->state == TASK_STATE_RUNNABLE)
+         task_add_to_state_list(ti, false);
+   }
+   enable_interrupts(&var);
+}
+
 void add_task(struct task *ti)
 {
+   ulong var;
    disable_preemption();
    {
-      task_add_to_state_list(ti);
+      disable_interrupts(&var);
+      {
+         task_add_to_state_list(ti, false);
+      }
+      enable_interrupts(&var);
 
       bintree_insert_ptr(&tree_by_tid_root,
                          ti,
@@ -563,11 +732,16 @@ void add_task(struct task *ti)
 
 void remove_task(struct task *ti)
 {
+   ulong var;
    disable_preemption();
    {
       ASSERT_TASK_STATE(ti->state, TASK_STATE_ZOMBIE);
 
-      task_remove_from_state_list(ti);
+      disable_interrupts(&var);
+      {
+         task_remove_from_state_list(ti);
+      }
+      enable_interrupts(&var);
 
       bintree_remove_ptr(&tree_by_tid_root,
                          ti,
@@ -598,7 +772,7 @@ void sched_account_ticks(void)
 
    if (curr->stopped                                 ||
        state != TASK_STATE_RUNNING                   ||
-         (!runner && t->timeslice >= TIME_SLICE_TICKS)
+         (!runner && t->timeslice >= sched_get_timeslice(curr))
        )
    {
       sched_set_need_resched();
@@ -638,7 +812,6 @@ void schedule(void)
 {
    enum task_state curr_state = get_curr_task_state();
    struct task *selected = NULL;
-   struct task *pos;
 
    ASSERT(!is_preemption_enabled());
 
@@ -663,42 +836,25 @@ void schedule(void)
    if (selected)
       switch_to_task(selected);
 
-   list_for_each_ro(pos, &runnable_tasks_list, runnable_node) {
+   selected = rq_pick_next_task();
 
-      ASSERT_TASK_STATE(pos->state, TASK_STATE_RUNNABLE);
+   if (!selected && get_curr_task_state() == TASK_STATE_RUNNABLE)
+      selected = get_curr_task();
 
-      if (pos->stopped || pos == idle_task)
-         continue;
+   if (selected == get_curr_task()) {
 
-      if (pos->timer_ready) {
-         selected = pos;
-         break;
-      }
+      selected->ticks.timeslice = 0;
 
-      if (pos == get_curr_task())
-         continue;
+      if (LIKELY(!pending_signals())) {
+         task_change_state(selected, TASK_STATE_RUNNING);
+         return;
+      }
 
-      if (!selected || pos->ticks.total < selected->ticks.total)
-         selected = pos;
+      switch_to_task(selected);
    }
 
-   if (!selected) {
-
-      if (get_curr_task_state() == TASK_STATE_RUNNABLE) {
-
-         selected = get_curr_task();
-         selected->ticks.timeslice = 0;
-
-         if (LIKELY(!pending_signals())) {
-            task_change_state(selected, TASK_STATE_RUNNING);
-            return;
-         }
-
-         switch_to_task(selected);
-      }
-
+   if (!selected)
       selected = idle_task;
-   }
 
    ASSERT(!selected->stopped);
    switch_to_task(selected);
@@ -726,7 +882,7 @@ struct process *get_process(int pid)
 
    ti = get_task(pid);
 
-   if (ti && !is_kernel_thread(ti))
+   if (ti && is_main_thread(ti) && !is_kernel_thread(ti))
       return ti->pi;
 
    return NULL;
@@ -757,6 +913,9 @@ int send_signal_to_group(int pgid, int sig)
 
       struct process *pi = ti->pi;
 
+      if (!is_main_thread(ti))
+         continue;
+
       if (pi->pgid == pgid && pi != curr_pi && pi->pid != 1) {
 
          if (pi->pid != pgid)
@@ -803,6 +962,9 @@ int send_signal_to_session(int sid, int sig)
 
       struct process *pi = ti->pi;
 
+      if (!is_main_thread(ti))
+         continue;
+
       if (pi->pgid == sid && pi != curr_pi && pi->pid != 1) {
 
          if (pi->pid != sid)
@@ -827,3 +989,129 @@ int send_signal_to_session(int sid, int sig)
 
    return count > 0 ? 0 : -ESRCH;
 }
+
+static void task_set_nice(struct task *ti, int nice)
+{
+   struct runqueue *rq;
+   ulong var;
+
+   nice = CLAMP(nice, MIN_NICE, MAX_NICE);
+
+   disable_interrupts(&var);
+   {
+      if ((rq = ti->rq)) {
+
+         /* Move the task to its new priority level in the same run-queue */
+         rq_dequeue(ti);
+         ti->nice = nice;
+         rq_enqueue(rq, ti);
+
+      } else {
+
+         ti->nice = nice;
+      }
+   }
+   enable_interrupts(&var);
+}
+
+static bool task_prio_match(struct task *ti, int which, int who)
+{
+   if (is_kernel_thread(ti))
+      return false;
+
+   switch (which) {
+
+      case PRIO_PROCESS:
+         return ti->tid == who;
+
+      case PRIO_PGRP:
+         return ti->pi->pgid == who;
+
+      case PRIO_USER:
+         return who == 0; /* Tilck has just the root user */
+
+      default:
+         NOT_REACHED();
+   }
+}
+
+/*
+ * Visits all the user tasks matching `which` and `who` and, when `set` is
+ * true, changes their nice value to `*nice`. Otherwise, it stores in `*nice`
+ * the lowest nice value (= highest priority) among the matching tasks.
+ */
+static int
+sched_prio_visit(int which, int who, int *nice, bool set)
+{
+   struct bintree_walk_ctx ctx;
+   struct task *ti;
+   int count = 0;
+   int res = MAX_NICE;
+
+   if (which != PRIO_PROCESS && which != PRIO_PGRP && which != PRIO_USER)
+      return -EINVAL;
+
+   if (!who) {
+
+      if (which == PRIO_PROCESS)
+         who = get_curr_tid();
+      else if (which == PRIO_PGRP)
+         who = get_curr_proc()->pgid;
+   }
+
+   disable_preemption();
+
+   bintree_in_order_visit_start(&ctx,
+                                tree_by_tid_root,
+                                struct task,
+                                tree_by_tid_node,
+                                false);
+
+   while ((ti = bintree_in_order_visit_next(&ctx))) {
+
+      if (!task_prio_match(ti, which, who))
+         continue;
+
+      if (set)
+         task_set_nice(ti, *nice);
+      else
+         res = MIN(res, ti->nice);
+
+      count++;
+   }
+
+   enable_preemption();
+
+   if (!count)
+      return -ESRCH;
+
+   if (!set)
+      *nice = res;
+
+   return 0;
+}
+
+int sys_nice(int inc)
+{
+   struct task *curr = get_curr_task();
+
+   inc = CLAMP(inc, -SCHED_PRIO_LEVELS, SCHED_PRIO_LEVELS);
+   task_set_nice(curr, curr->nice + inc);
+   return 0;
+}
+
+int sys_getpriority(int which, int who)
+{
+   int nice, rc;
+
+   if ((rc = sched_prio_visit(which, who, &nice, false)))
+      return rc;
+
+   /* Like Linux, return 20 - nice, in order to avoid negative values */
+   return 20 - nice;
+}
+
+int sys_setpriority(int which, int who, int prio)
+{
+   return sched_prio_visit(which, who, &prio, true);
+}
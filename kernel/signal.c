@@ -11,11 +11,14 @@
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/sys_types.h>
 #include <tilck/kernel/hal.h>
+#include <tilck/kernel/signalfd.h>
 
 #include <tilck/mods/tracing.h>
 
 typedef void (*action_type)(struct task *, int signum);
 
+static bool is_sig_ignored(struct task *ti, int signum);
+
 static void __add_sig(ulong *set, int signum)
 {
    ASSERT(signum > 0);
@@ -33,6 +36,7 @@ static void __add_sig(ulong *set, int signum)
 static void add_pending_sig(struct task *ti, int signum)
 {
    __add_sig(ti->sa_pending, signum);
+   signalfd_notify();
 }
 
 static void __del_sig(ulong *set, int signum)
@@ -96,6 +100,43 @@ static int get_first_pending_sig(struct task *ti)
    return -1;
 }
 
+static int get_first_pending_sig_in(struct task *ti, const ulong *mask)
+{
+   for (u32 i = 0; i < K_SIGACTION_MASK_WORDS; i++) {
+
+      ulong val = ti->sa_pending[i] & mask[i];
+
+      if (val != 0)
+         return (int)(i * NBITS + get_first_set_bit_index_l(val) + 1);
+   }
+
+   return -1;
+}
+
+int dequeue_pending_sig_in(const ulong *mask, bool peek)
+{
+   struct task *ti = get_curr_task();
+   struct task *main_ti = get_process_task(ti->pi);
+   int sig;
+
+   disable_preemption();
+   {
+      /*
+       * The signals sent to the whole process and blocked by all of its
+       * threads remain pending in the main thread: check it as well.
+       */
+      if ((sig = get_first_pending_sig_in(ti, mask)) < 0 && main_ti != ti) {
+         ti = main_ti;
+         sig = get_first_pending_sig_in(ti, mask);
+      }
+
+      if (sig > 0 && !peek)
+         del_pending_sig(ti, sig);
+   }
+   enable_preemption();
+   return sig;
+}
+
 void drop_all_pending_signals(void *__curr)
 {
    ASSERT(!is_preemption_enabled());
@@ -164,7 +205,11 @@ bool process_signals(void *__ti, enum sig_state sig_state, void *regs)
       return false;
    }
 
-   sig = get_first_pending_sig(ti);
+   while ((sig = get_first_pending_sig(ti)) > 0 && is_sig_ignored(ti, sig)) {
+
+      /* Ignored signal, which was pending because it was blocked */
+      del_pending_sig(ti, sig);
+   }
 
    if (sig < 0)
       return false;
@@ -212,7 +257,7 @@ static void signal_wakeup_task(struct task *ti)
       }
 
 
-      ti->stopped = false;
+      task_set_stopped(ti, false);
 
    } else {
 
@@ -249,6 +294,17 @@ static void action_terminate(struct task *ti, int signum)
 
 static void action_ignore(struct task *ti, int signum)
 {
+   if (is_sig_masked(ti, signum)) {
+
+      /*
+       * Like on Linux, blocked signals are never discarded, even if ignored:
+       * they might be read through a signalfd or the handler might change
+       * before they get unblocked. See process_signals().
+       */
+      add_pending_sig(ti, signum);
+      return;
+   }
+
    if (ti->tid == 1 && signum != SIGCHLD) {
       printk(
          "WARNING: ignoring signal %s[%d] sent to init (pid 1)\n",
@@ -262,7 +318,7 @@ static void action_stop(struct task *ti, int signum)
    ASSERT(!is_kernel_thread(ti));
 
    trace_signal_delivered(ti->tid, signum);
-   ti->stopped = true;
+   task_set_stopped(ti, true);
    ti->wstatus = STOPCODE(signum);
    wake_up_tasks_waiting_on(ti, task_stopped);
 
@@ -279,7 +335,7 @@ static void action_continue(struct task *ti, int signum)
       return;
 
    trace_signal_delivered(ti->tid, signum);
-   ti->stopped = false;
+   task_set_stopped(ti, false);
    ti->wstatus = CONTINUED;
    wake_up_tasks_waiting_on(ti, task_continued);
 }
@@ -321,6 +377,17 @@ static const action_type signal_default_actions[_NSIG] =
    [SIGWINCH] = action_terminate,
 };
 
+static bool is_sig_ignored(struct task *ti, int signum)
+{
+   __sighandler_t h = ti->pi->sa_handlers[signum - 1];
+
+   if (h == SIG_DFL)
+      return ti->tid == 1 /* see do_send_signal() */ ||
+             signal_default_actions[signum] == action_ignore;
+
+   return h == SIG_IGN;
+}
+
 static void do_send_signal(struct task *ti, int signum)
 {
    ASSERT(IN_RANGE(signum, 0, _NSIG));
@@ -381,6 +448,27 @@ static void do_send_signal(struct task *ti, int signum)
    }
 }
 
+/*
+ * A signal sent to a whole process goes to its main thread, unless the main
+ * thread is blocking it or it's exiting (waiting for the other threads): in
+ * that case, pick the first thread not blocking the signal, if any.
+ */
+static struct task *
+get_signal_target_thread(struct task *main_ti, int signum)
+{
+   struct task *pos;
+
+   if (main_ti->nested_sig_handlers >= 0 && !is_sig_masked(main_ti, signum))
+      return main_ti;
+
+   list_for_each_ro(pos, &main_ti->pi->threads, threads_node) {
+      if (pos->nested_sig_handlers >= 0 && !is_sig_masked(pos, signum))
+         return pos;
+   }
+
+   return main_ti;
+}
+
 int send_signal2(int pid, int tid, int signum, bool whole_process)
 {
    struct task *ti;
@@ -407,7 +495,9 @@ int send_signal2(int pid, int tid, int signum, bool whole_process)
    if (ti->state == TASK_STATE_ZOMBIE)
       goto end; /* do nothing */
 
-   /* TODO: update this code when thread support is added */
+   if (whole_process)
+      ti = get_signal_target_thread(ti, signum);
+
    do_send_signal(ti, signum);
 
 end:
@@ -456,19 +546,27 @@ bool pending_signals(void)
 /* NOTE: deprecated syscall */
 int sys_tkill(int tid, int sig)
 {
+   struct task *ti;
+   int pid = 0;
+
    if (!IN_RANGE(sig, 0, _NSIG) || tid <= 0)
       return -EINVAL;
 
-   return send_signal(tid, sig, false);
+   disable_preemption();
+   {
+      if ((ti = get_task(tid)))
+         pid = ti->pi->pid;
+   }
+   enable_preemption();
+
+   if (!pid)
+      return -ESRCH;
+
+   return send_signal2(pid, tid, sig, false);
 }
 
 int sys_tgkill(int pid /* linux: tgid */, int tid, int sig)
 {
-   if (pid != tid) {
-      printk("sys_tgkill: pid != tid NOT SUPPORTED yet.\n");
-      return -EINVAL;
-   }
-
    if (!IN_RANGE(sig, 0, _NSIG) || pid <= 0 || tid <= 0)
       return -EINVAL;
 
@@ -480,9 +578,11 @@ static int kill_each_task(void *obj, void *arg)
    struct task *ti = obj;
    int sig = *(int *)arg;
 
-   if (ti != get_curr_task() && !is_kernel_thread(ti)) {
-      send_signal(ti->tid, sig, false);
-   }
+   if (!is_main_thread(ti) || is_kernel_thread(ti))
+      return 0; /* the signal is for the whole process */
+
+   if (ti->pi != get_curr_proc())
+      send_signal(ti->tid, sig, true);
 
    return 0;
 }
@@ -805,6 +905,48 @@ int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
    return sys_pause();
 }
 
+int set_temp_sigmask(const sigset_t *u_mask, size_t sigsetsize)
+{
+   struct task *curr = get_curr_task();
+   ulong mask[K_SIGACTION_MASK_WORDS];
+
+   if (curr->nested_sig_handlers > 0)
+      return -EPERM; /* See sys_rt_sigsuspend() */
+
+   ASSERT(!curr->in_sigsuspend);
+
+   if (sigsetsize < sizeof(mask))
+      return -EINVAL;
+
+   if (copy_from_user(mask, u_mask, sizeof(mask)))
+      return -EFAULT;
+
+   __del_sig(mask, SIGKILL);
+   __del_sig(mask, SIGSTOP);
+
+   disable_preemption();
+   {
+      memcpy(curr->sa_old_mask, curr->sa_mask, sizeof(curr->sa_old_mask));
+      memcpy(curr->sa_mask, mask, sizeof(curr->sa_mask));
+   }
+   enable_preemption();
+   return 0;
+}
+
+void restore_temp_sigmask(bool interrupted)
+{
+   struct task *curr = get_curr_task();
+
+   disable_preemption();
+   {
+      if (interrupted)
+         curr->in_sigsuspend = true;
+      else
+         memcpy(curr->sa_mask, curr->sa_old_mask, sizeof(curr->sa_mask));
+   }
+   enable_preemption();
+}
+
 int sys_pause(void)
 {
    ASSERT(!is_preemption_enabled()); /* Thanks to SYSFL_NO_PREEMPT */
@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/atomics.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/signalfd.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sys_types.h>
+
+/*
+ * signalfd
+ * ----------
+ *
+ * A signalfd has no state other than its mask: reading from it dequeues the
+ * pending signals in the mask of the *reading* task, like on Linux. Typically,
+ * those signals are blocked, otherwise they'd be delivered to their handlers.
+ *
+ * All the signalfds share a single kcond, signaled by signal.c every time a
+ * signal becomes pending, while there's at least one signalfd around. Signals
+ * are rare events compared to I/O: the spurious wake-ups of the readers and
+ * watchers of other processes' signalfds are cheaper than tracking them.
+ */
+
+struct signalfd {
+
+   KOBJ_BASE_FIELDS
+
+   ulong mask[K_SIGACTION_MASK_WORDS];
+};
+
+static struct kcond signalfd_cond = STATIC_KCOND_INIT(signalfd_cond);
+static ATOMIC(int) signalfd_count;
+static const struct file_ops static_ops_signalfd;
+
+void signalfd_notify(void)
+{
+   if (atomic_load_explicit(&signalfd_count, mo_relaxed) > 0)
+      kcond_signal_all(&signalfd_cond);
+}
+
+/*
+ * Wait for a signal in the mask to become pending. Unlike kcond_wait(), check
+ * for it with preemption disabled, right before going to sleep: signal.c
+ * signals the kcond without holding any mutex we could use here.
+ */
+static void signalfd_wait(struct signalfd *sfd)
+{
+   disable_preemption();
+
+   if (dequeue_pending_sig_in(sfd->mask, true) > 0) {
+      enable_preemption();
+      return;
+   }
+
+   prepare_to_wait_on(WOBJ_KCOND,
+                      &signalfd_cond,
+                      NO_EXTRA,
+                      &signalfd_cond.wait_list);
+
+   enter_sleep_wait_state();
+   wait_obj_reset(&get_curr_task()->wobj);
+}
+
+static ssize_t signalfd_read(fs_handle h, char *buf, size_t size)
+{
+   struct kfs_handle *kh = h;
+   struct signalfd *sfd = (void *)kh->kobj;
+   struct signalfd_siginfo *si = (void *)buf;
+   ssize_t rc = 0;
+   int sig;
+
+   if (size < sizeof(*si))
+      return -EINVAL;
+
+   while ((size_t)rc + sizeof(*si) <= size) {
+
+      if ((sig = dequeue_pending_sig_in(sfd->mask, false)) < 0) {
+
+         if (rc)
+            break; /* We already got at least one signal */
+
+         if (kh->fl_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+         signalfd_wait(sfd);
+
+         if (pending_signals())
+            return -EINTR;
+
+         continue;
+      }
+
+      /* Tilck doesn't keep track of the sender: just SI_USER, pid 0, uid 0 */
+      bzero(si, sizeof(*si));
+      si->ssi_signo = (u32)sig;
+      si->ssi_code = SI_USER;
+
+      rc += (ssize_t)sizeof(*si);
+      si++;
+   }
+
+   return rc;
+}
+
+static int signalfd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct signalfd *sfd = (void *)kh->kobj;
+   return dequeue_pending_sig_in(sfd->mask, true) > 0;
+}
+
+static struct kcond *signalfd_get_rready_cond(fs_handle h)
+{
+   return &signalfd_cond;
+}
+
+static const struct file_ops static_ops_signalfd =
+{
+   .read = signalfd_read,
+   .read_ready = signalfd_read_ready,
+   .get_rready_cond = signalfd_get_rready_cond,
+};
+
+static void signalfd_set_mask_int(struct signalfd *sfd, const ulong *mask)
+{
+   disable_preemption();
+   {
+      memcpy(sfd->mask, mask, sizeof(sfd->mask));
+
+      /* Like sigprocmask(), silently ignore SIGKILL and SIGSTOP */
+      sfd->mask[(SIGKILL - 1) / NBITS] &= ~(1ul << ((SIGKILL - 1) % NBITS));
+      sfd->mask[(SIGSTOP - 1) / NBITS] &= ~(1ul << ((SIGSTOP - 1) % NBITS));
+   }
+   enable_preemption();
+}
+
+int signalfd_set_mask(fs_handle h, const ulong *mask)
+{
+   struct kfs_handle *kh = h;
+
+   if (kh->fops != &static_ops_signalfd)
+      return -EINVAL;
+
+   signalfd_set_mask_int((void *)kh->kobj, mask);
+
+   /* The readers and the watchers have to re-check with the new mask */
+   kcond_signal_all(&signalfd_cond);
+   return 0;
+}
+
+static void destroy_signalfd(struct signalfd *sfd)
+{
+   atomic_fetch_sub_explicit(&signalfd_count, 1, mo_relaxed);
+   kfree_obj(sfd, struct signalfd);
+}
+
+fs_handle create_signalfd_handle(const ulong *mask, int flags)
+{
+   struct signalfd *sfd;
+   fs_handle h;
+
+   if (!(sfd = (void *)kzalloc_obj(struct signalfd)))
+      return NULL;
+
+   sfd->destory_obj = (void *)&destroy_signalfd;
+   signalfd_set_mask_int(sfd, mask);
+   atomic_fetch_add_explicit(&signalfd_count, 1, mo_relaxed);
+
+   h = kfs_create_new_handle(&static_ops_signalfd,
+                             (void *)sfd,
+                             O_RDONLY | (flags & O_NONBLOCK));
+
+   if (!h) {
+      destroy_signalfd(sfd);
+      return NULL;
+   }
+
+   return h;
+}
@@ -11,8 +11,15 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/signal.h>
 #include <tilck/kernel/timer.h>
+#include <tilck/kernel/datetime.h>
 #include <tilck/kernel/fs/vfs.h>
 
+#include <sys/resource.h>     // system header
+
+#ifndef RUSAGE_THREAD
+   #define RUSAGE_THREAD 1         /* Linux-specific, not always exposed */
+#endif
+
 #define LINUX_REBOOT_MAGIC1         0xfee1dead
 #define LINUX_REBOOT_MAGIC2          672274793
 #define LINUX_REBOOT_MAGIC2A          85072278
@@ -112,7 +119,7 @@ int sys_newuname(struct utsname *user_buf)
 
 NORETURN int sys_exit(int exit_status)
 {
-   terminate_process(exit_status, 0 /* term_sig */);
+   terminate_thread(exit_status);
 
    /* Necessary to guarantee to the compiler that we won't return. */
    NOT_REACHED();
@@ -120,37 +127,87 @@ NORETURN int sys_exit(int exit_status)
 
 NORETURN int sys_exit_group(int status)
 {
-   // TODO: update when user threads are supported
-   sys_exit(status);
+   terminate_process(status, 0 /* term_sig */);
+   NOT_REACHED();
+}
+
+/* Sum the ticks of all the threads of `pi`, including the exited ones */
+static struct sched_ticks get_process_ticks(struct process *pi)
+{
+   struct sched_ticks ticks = pi->exited_threads_ticks;
+   struct task *pos;
+
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(pos, &pi->threads, threads_node) {
+      ticks.total += pos->ticks.total;
+      ticks.total_kernel += pos->ticks.total_kernel;
+   }
+
+   return ticks;
 }
 
 ulong sys_times(struct tms *user_buf)
 {
    struct task *curr = get_curr_task();
+   struct sched_ticks ticks;
    struct tms buf;
 
-   // TODO (threads): when threads are supported, update sys_times()
    // TODO: consider supporting tms_cutime and tms_cstime in sys_times()
 
    disable_preemption();
    {
-
-      buf = (struct tms) {
-         .tms_utime = (clock_t) curr->ticks.total,
-         .tms_stime = (clock_t) curr->ticks.total_kernel,
-         .tms_cutime = 0,
-         .tms_cstime = 0,
-      };
-
+      ticks = get_process_ticks(curr->pi);
    }
    enable_preemption();
 
+   buf = (struct tms) {
+      .tms_utime = (clock_t) ticks.total,
+      .tms_stime = (clock_t) ticks.total_kernel,
+      .tms_cutime = 0,
+      .tms_cstime = 0,
+   };
+
    if (copy_to_user(user_buf, &buf, sizeof(buf)) != 0)
       return (ulong) -EBADF;
 
    return (ulong) get_ticks();
 }
 
+int sys_getrusage(int who, struct k_rusage *user_buf)
+{
+   struct task *curr = get_curr_task();
+   struct process *pi = curr->pi;
+   struct k_rusage ru = {0};
+   struct sched_ticks ticks;
+
+   // TODO: consider supporting RUSAGE_CHILDREN in sys_getrusage()
+
+   if (who != RUSAGE_SELF && who != RUSAGE_THREAD && who != RUSAGE_CHILDREN)
+      return -EINVAL;
+
+   if (who != RUSAGE_CHILDREN) {
+
+      disable_preemption();
+      {
+         /* The memory counters are per-process even with RUSAGE_THREAD */
+         ticks = who == RUSAGE_SELF ? get_process_ticks(pi) : curr->ticks;
+
+         ticks_to_timeval(ticks.total - ticks.total_kernel, &ru.ru_utime);
+         ticks_to_timeval(ticks.total_kernel, &ru.ru_stime);
+
+         ru.ru_maxrss = (long)(pi->peak_resident_pages << (PAGE_SHIFT - 10));
+         ru.ru_minflt = (long)pi->minor_faults;
+      }
+      enable_preemption();
+   }
+
+   if (copy_to_user(user_buf, &ru, sizeof(ru)) != 0)
+      return -EFAULT;
+
+   return 0;
+}
+
 int sys_fork(void)
 {
    return do_fork(false);
@@ -161,6 +218,52 @@ int sys_vfork(void)
    return do_fork(true);
 }
 
+/* NOTE: this is the i386 argument order (CONFIG_CLONE_BACKWARDS on Linux) */
+int sys_clone(ulong flags,
+              void *newsp,
+              int *parent_tidptr,
+              void *tls,
+              int *child_tidptr)
+{
+   return do_clone(flags, newsp, parent_tidptr, tls, child_tidptr);
+}
+
+int sys_clone3(struct k_clone_args *u_args, size_t size)
+{
+   struct k_clone_args args = {0};
+   void *stack;
+
+   if (size < K_CLONE_ARGS_SIZE_VER0)
+      return -EINVAL;
+
+   if (size > sizeof(args))
+      return -E2BIG;
+
+   if (copy_from_user(&args, u_args, size))
+      return -EFAULT;
+
+   /* Not supported: the TIDs selection and cgroups */
+   if (args.set_tid_size || args.cgroup)
+      return -EINVAL;
+
+   if (args.exit_signal >= _NSIG || (args.flags >> 32))
+      return -EINVAL;
+
+   if (!args.stack != !args.stack_size)
+      return -EINVAL;
+
+   /* clone3() takes the lowest address of the stack, not its top */
+   stack = args.stack
+      ? TO_PTR(args.stack + args.stack_size)
+      : NULL;
+
+   return do_clone((ulong)args.flags,
+                   stack,
+                   TO_PTR(args.parent_tid),
+                   TO_PTR(args.tls),
+                   TO_PTR(args.child_tid));
+}
+
 static int
 stop_all_user_tasks(void *task, void *unused)
 {
@@ -168,7 +271,7 @@ stop_all_user_tasks(void *task, void *unused)
 
    if (!is_kernel_thread(ti)) {
       printk("Stopping TID %d\n", ti->tid);
-      ti->stopped = true;
+      task_set_stopped(ti, true);
    }
 
    return 0;
@@ -232,6 +335,18 @@ int sys_reboot(u32 magic, u32 magic2, u32 cmd, void *arg)
 
 int sys_sched_yield(void)
 {
+   struct task *curr = get_curr_task();
+
+   /*
+    * Consider the time-slice as consumed, in order to move the current task
+    * to the expired run-queue and let all the other runnable tasks run first.
+    */
+   disable_preemption();
+   {
+      curr->ticks.timeslice = sched_get_timeslice(curr);
+   }
+   enable_preemption();
+
    kernel_yield();
    return 0;
 }
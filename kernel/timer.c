@@ -5,6 +5,7 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/atomics.h>
+#include <tilck/common/utils.h>
 
 #include <tilck/kernel/sched.h>
 #include <tilck/kernel/hal.h>
@@ -13,6 +14,11 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/syscalls.h>
 
 FASTCALL void asm_nop_loop(u32 iters);
 
@@ -32,7 +38,6 @@ u32 slow_timer_irq_handler_count;
 volatile ATOMIC(u32) __bogo_loops;
 
 /* Static variables */
-static struct list timer_wakeup_list = STATIC_LIST_INIT(timer_wakeup_list);
 static u32 loops_per_tick;         /* Tilck bogoMips as loops/tick    */
 static u32 loops_per_ms = 5000000; /* loops/millisecond (initial val)  */
 static u32 loops_per_us = 5000;    /* loops/microsecond (initial val) */
@@ -50,6 +55,111 @@ u64 get_ticks(void)
    return curr_ticks;
 }
 
+/*
+ * Hierarchical timing wheel for the tasks' wakeup timers
+ * --------------------------------------------------------
+ *
+ * Each armed wakeup timer has an absolute expiry tick (`wakeup_timer_tick`)
+ * and lives in exactly one slot of the wheel. The first level (`tw_root`) has
+ * one slot per tick, for the next TW_ROOT_SIZE ticks. Each one of the other
+ * levels covers a TW_LVL_SIZE times bigger time-horizon with the same number of
+ * slots, which become proportionally coarser. All together, the levels cover
+ * the whole 32-bit range of ticks.
+ *
+ * On every tick, ONLY the current slot of the first level gets visited. When
+ * the first level wraps around, the timers in the current slot of the second
+ * level are re-inserted (cascade) and, therefore, spread in the first level;
+ * when the second level wraps around, the same happens for the third level and
+ * so on. That makes inserting and cancelling a timer O(1) and the per-tick
+ * work in the IRQ context proportional only to the number of expiring timers
+ * (plus an amortized cascading cost), no matter how many tasks are sleeping.
+ */
+
+#define TW_ROOT_BITS          8
+#define TW_LVL_BITS           6
+#define TW_ROOT_SIZE          (1u << TW_ROOT_BITS)
+#define TW_LVL_SIZE           (1u << TW_LVL_BITS)
+#define TW_ROOT_MASK          (TW_ROOT_SIZE - 1)
+#define TW_LVL_MASK           (TW_LVL_SIZE - 1)
+#define TW_LEVELS             4 /* levels, other than the root one */
+
+STATIC_ASSERT(TW_ROOT_BITS + TW_LEVELS * TW_LVL_BITS == 32);
+
+#define TW_LVL_SHIFT(n)       (TW_ROOT_BITS + (n) * TW_LVL_BITS)
+#define TW_LVL_INDEX(t, n)    (((t) >> TW_LVL_SHIFT(n)) & TW_LVL_MASK)
+
+static struct list tw_root[TW_ROOT_SIZE];
+static struct list tw_levels[TW_LEVELS][TW_LVL_SIZE];
+
+/* The tick whose slot in tw_root will be processed next */
+static u32 tw_curr_tick;
+
+static void tw_add_timer(struct task *ti)
+{
+   const u32 exp = ti->wakeup_timer_tick;
+   const u32 delta = exp - tw_curr_tick;
+   struct list *slot;
+   int n;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (delta < TW_ROOT_SIZE) {
+
+      slot = &tw_root[exp & TW_ROOT_MASK];
+
+   } else {
+
+      for (n = 0; n < TW_LEVELS - 1; n++)
+         if (delta < (1u << TW_LVL_SHIFT(n + 1)))
+            break;
+
+      slot = &tw_levels[n][TW_LVL_INDEX(exp, n)];
+   }
+
+   list_add_tail(slot, &ti->wakeup_timer_node);
+}
+
+static ALWAYS_INLINE bool tw_is_timer_active(struct task *ti)
+{
+   return !list_node_is_empty(&ti->wakeup_timer_node);
+}
+
+static ALWAYS_INLINE void tw_del_timer(struct task *ti)
+{
+   list_remove(&ti->wakeup_timer_node);
+   list_node_init(&ti->wakeup_timer_node);
+}
+
+/*
+ * Re-inserts all the timers in the current slot of the given level. Returns
+ * the index of that slot: when it's 0, the level wrapped around as well and
+ * the next level has to be cascaded too.
+ */
+static u32 tw_cascade(int n)
+{
+   const u32 idx = TW_LVL_INDEX(tw_curr_tick, n);
+   struct list *slot = &tw_levels[n][idx];
+   struct task *pos, *temp;
+
+   list_for_each(pos, temp, slot, wakeup_timer_node) {
+      list_remove(&pos->wakeup_timer_node);
+      tw_add_timer(pos);
+   }
+
+   list_init(slot);
+   return idx;
+}
+
+static void init_timer_wheel(void)
+{
+   for (u32 i = 0; i < TW_ROOT_SIZE; i++)
+      list_init(&tw_root[i]);
+
+   for (int n = 0; n < TW_LEVELS; n++)
+      for (u32 i = 0; i < TW_LVL_SIZE; i++)
+         list_init(&tw_levels[n][i]);
+}
+
 void task_set_wakeup_timer(struct task *ti, u32 ticks)
 {
    ulong var;
@@ -57,14 +167,12 @@ void task_set_wakeup_timer(struct task *ti, u32 ticks)
 
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up == 0) {
-         ASSERT(!list_is_node_in_list(&ti->wakeup_timer_node));
-         list_add_tail(&timer_wakeup_list, &ti->wakeup_timer_node);
-      } else {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-      }
+      if (tw_is_timer_active(ti))
+         list_remove(&ti->wakeup_timer_node);
 
-      ti->ticks_before_wake_up = ticks;
+      /* The timer expires while processing the `ticks`-th tick from now */
+      ti->wakeup_timer_tick = tw_curr_tick + ticks - 1;
+      tw_add_timer(ti);
    }
    enable_interrupts(&var);
 }
@@ -76,9 +184,10 @@ void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks)
 
    disable_interrupts(&var);
    {
-      if (ti->ticks_before_wake_up > 0) {
-         ASSERT(list_is_node_in_list(&ti->wakeup_timer_node));
-         ti->ticks_before_wake_up = new_ticks;
+      if (tw_is_timer_active(ti)) {
+         list_remove(&ti->wakeup_timer_node);
+         ti->wakeup_timer_tick = tw_curr_tick + new_ticks - 1;
+         tw_add_timer(ti);
       }
    }
    enable_interrupts(&var);
@@ -87,15 +196,13 @@ void task_update_wakeup_timer_if_any(struct task *ti, u32 new_ticks)
 u32 task_cancel_wakeup_timer(struct task *ti)
 {
    ulong var;
-   u32 old;
+   u32 old = 0;
    disable_interrupts(&var);
    {
-      old = ti->ticks_before_wake_up;
-
-      if (old > 0) {
+      if (tw_is_timer_active(ti)) {
+         old = ti->wakeup_timer_tick - tw_curr_tick + 1;
          ti->timer_ready = false;
-         ti->ticks_before_wake_up = 0;
-         list_remove(&ti->wakeup_timer_node);
+         tw_del_timer(ti);
       }
    }
    enable_interrupts(&var);
@@ -106,68 +213,38 @@ static void tick_all_timers(void)
 {
    struct task *pos, *temp;
    bool any_woken_up_task = false;
+   struct list *slot;
    ulong var;
+   u32 idx;
 
-   /*
-    * This is *NOT* the best we can do. In particular, it's terrible to keep
-    * the interrupts disabled while iterating the _whole_ timer_wakeup_list.
-    *
-    * Possible better solutions
-    * -----------------------------
-    * 1. Keep the tasks to wake-up in a sort of ordered list and then use
-    * relative timers. This way, at each tick we'll have to decrement just one
-    * single counter. We'll start decrement the next counter only when the first
-    * counter reaches 0 and its list node is removed. Of course, if we cannot
-    * use kmalloc() in case of sleep, it gets much harder to create such an
-    * ordered list and make it live inside a member of struct task. Maybe a BST
-    * will do the job, but that would require paying O(logN) per tick for
-    * finding the earliest timer. Not sure how better would be now for N < 50
-    * (typical), given the huge added constant for the BST functions. Also, the
-    * cancellation of a timer would require some extra effort in order to
-    * re-calculate the relative timer values, while we want the cancellation to
-    * be light-fast because it's run by IRQ handlers.
-    *
-    * 2. Use a fixed number of wakeup lists like: short-term, mid-term and
-    * long-term. Current task's wakeup list node will be placed in one those
-    * lists, depending on far in the future the task is supposted to be woke up.
-    * On every tick, here in tick_all_timers(), ONLY the short-term list will be
-    * iterated. That's a considerable improvement. In a system, there might be
-    * even 1,000 active timers, but how many of them will expire in the next
-    * second? Only a small percentage of them. To further improve the
-    * scalability, it's possible to have even more than 3 lists, or to further
-    * reduce the time-horizon of the short-term list. Periodically, but NOT on
-    * every tick, the `ticks_before_wake_up` field belonging to tasks in the
-    * other wakeup lists will adjusted with bigger decrements and tasks will be
-    * moved from one list to another. That will also happen in case the wakeup
-    * timer is changed for task with an already active timer. This solution
-    * looks much better than solution 1.
-    *
-    * Conclusion
-    * ---------------------
-    * For the moment, given the very limited scale of Tilck (tens of tasks at
-    * most running on the whole system), the current solution is safe and
-    * good-enough but, at some point, a smarter ad-hoc solution should be
-    * devised. Probably solution 2 is the right candidate.
-    */
    disable_interrupts(&var);
 
-   list_for_each(pos, temp, &timer_wakeup_list, wakeup_timer_node) {
+   idx = tw_curr_tick & TW_ROOT_MASK;
 
-      /* If task is part of this list, it's counter must be > 0 */
-      ASSERT(pos->ticks_before_wake_up > 0);
+   if (!idx) {
 
-      if (UNLIKELY(--pos->ticks_before_wake_up == 0)) {
+      /* The root level wrapped around: cascade the next levels, if needed */
+      for (int n = 0; n < TW_LEVELS; n++)
+         if (tw_cascade(n))
+            break;
+   }
 
-         pos->timer_ready = true;
-         list_remove(&pos->wakeup_timer_node);
+   slot = &tw_root[idx];
 
-         if (pos->state == TASK_STATE_SLEEPING) {
-            task_change_state(pos, TASK_STATE_RUNNABLE);
-            any_woken_up_task = true;
-         }
+   list_for_each(pos, temp, slot, wakeup_timer_node) {
+
+      ASSERT(pos->wakeup_timer_tick == tw_curr_tick);
+
+      pos->timer_ready = true;
+      tw_del_timer(pos);
+
+      if (pos->state == TASK_STATE_SLEEPING) {
+         task_change_state(pos, TASK_STATE_RUNNABLE);
+         any_woken_up_task = true;
       }
    }
 
+   tw_curr_tick++;
    enable_interrupts(&var);
 
    if (any_woken_up_task)
@@ -258,6 +335,222 @@ void kernel_sleep_ms(u64 ms)
    kernel_sleep(MAX(1u, ms_to_ticks(ms)));
 }
 
+/*
+ * Kernel timers with a callback
+ * -------------------------------
+ *
+ * The armed timers are kept in a list sorted by expiry tick. The `ktimers`
+ * kthread runs the callbacks of the expired timers and then sleeps on a kcond,
+ * with a timeout set to the expiry of the first timer in the list: arming a
+ * timer before it signals the kcond, so that the timeout gets re-computed.
+ * Running the callbacks in a kthread and not in the timer IRQ handler allows
+ * them to signal kconds, send signals and so on.
+ *
+ * There are just a few of those timers (timerfds, alarms and io_uring
+ * timeouts), so keeping a sorted list is cheaper than any kind of timing
+ * wheel, like the one used for the tasks' wakeup timers.
+ */
+
+static struct list ktimers_list = STATIC_LIST_INIT(ktimers_list);
+static struct kmutex ktimers_lock = STATIC_KMUTEX_INIT(ktimers_lock, 0);
+static struct kcond ktimers_cond = STATIC_KCOND_INIT(ktimers_cond);
+
+static ALWAYS_INLINE bool ktimer_is_armed(struct ktimer *t)
+{
+   return !list_node_is_empty(&t->node);
+}
+
+static void ktimer_add(struct ktimer *t)
+{
+   struct ktimer *pos;
+   ASSERT(kmutex_is_curr_task_holding_lock(&ktimers_lock));
+
+   list_for_each_ro(pos, &ktimers_list, node) {
+      if (pos->expire > t->expire)
+         break;
+   }
+
+   list_add_before(&pos->node, &t->node);
+}
+
+static void ktimer_del(struct ktimer *t)
+{
+   list_remove(&t->node);
+   list_node_init(&t->node);
+}
+
+void ktimer_init(struct ktimer *t, void (*cb)(struct ktimer *))
+{
+   list_node_init(&t->node);
+   t->expire = 0;
+   t->interval = 0;
+   t->cb = cb;
+}
+
+u64 ktimer_set(struct ktimer *t, u64 ticks, u64 interval)
+{
+   const u64 now = get_ticks();
+   u64 old = 0;
+
+   kmutex_lock(&ktimers_lock);
+   {
+      if (ktimer_is_armed(t)) {
+         old = t->expire > now ? t->expire - now : 1;
+         ktimer_del(t);
+      }
+
+      if (ticks) {
+
+         t->expire = now + ticks;
+         t->interval = interval;
+         ktimer_add(t);
+
+         /* The first timer changed: the kthread has to re-compute its timeout */
+         if (list_first_obj(&ktimers_list, struct ktimer, node) == t)
+            kcond_signal_one(&ktimers_cond);
+      }
+   }
+   kmutex_unlock(&ktimers_lock);
+   return old;
+}
+
+u64 ktimer_get(struct ktimer *t, u64 *interval)
+{
+   const u64 now = get_ticks();
+   u64 rem = 0;
+
+   kmutex_lock(&ktimers_lock);
+   {
+      if (ktimer_is_armed(t))
+         rem = t->expire > now ? t->expire - now : 1;
+
+      if (interval)
+         *interval = rem ? t->interval : 0;
+   }
+   kmutex_unlock(&ktimers_lock);
+   return rem;
+}
+
+static void ktimers_thread(void *unused)
+{
+   struct ktimer *t;
+   u64 now, delta;
+
+   kmutex_lock(&ktimers_lock);
+
+   while (true) {
+
+      now = get_ticks();
+
+      while (!list_is_empty(&ktimers_list)) {
+
+         t = list_first_obj(&ktimers_list, struct ktimer, node);
+
+         if (t->expire > now)
+            break;
+
+         ktimer_del(t);
+
+         if (t->interval) {
+
+            /* Skip the periods we missed, if any: the callback has to count */
+            t->expire += ((now - t->expire) / t->interval + 1) * t->interval;
+            ktimer_add(t);
+         }
+
+         t->cb(t);
+      }
+
+      if (list_is_empty(&ktimers_list)) {
+         kcond_wait(&ktimers_cond, &ktimers_lock, KCOND_WAIT_FOREVER);
+         continue;
+      }
+
+      t = list_first_obj(&ktimers_list, struct ktimer, node);
+      delta = t->expire - now;
+      kcond_wait(&ktimers_cond, &ktimers_lock, (u32)MIN(delta, 0xffffffffull));
+   }
+}
+
+static void init_ktimers(void)
+{
+   if (kthread_create(&ktimers_thread, 0, NULL) < 0)
+      panic("Timer: unable to create the ktimers kthread");
+}
+
+/*
+ * alarm() and the ITIMER_REAL interval timer share the same per-process ktimer,
+ * like on Linux. Its callback sends SIGALRM to the process (see process.c).
+ */
+
+static bool is_timeval_valid(const struct timeval *tv)
+{
+   return tv->tv_sec >= 0 && tv->tv_usec >= 0 && tv->tv_usec < 1000000;
+}
+
+int sys_alarm(unsigned int seconds)
+{
+   struct process *pi = get_curr_proc();
+   u64 rem;
+
+   rem = ktimer_set(&pi->alarm_timer, (u64)seconds * TIMER_HZ, 0);
+
+   /* The seconds remaining for the previous alarm, if any */
+   return (int)div_round_up64(rem, TIMER_HZ);
+}
+
+int sys_getitimer(int which, struct itimerval *u_val)
+{
+   struct process *pi = get_curr_proc();
+   struct itimerval val;
+   u64 rem, interval;
+
+   if (which != ITIMER_REAL)
+      return -EINVAL; /* ITIMER_VIRTUAL and ITIMER_PROF are not supported */
+
+   rem = ktimer_get(&pi->alarm_timer, &interval);
+   ticks_to_timeval(rem, &val.it_value);
+   ticks_to_timeval(interval, &val.it_interval);
+
+   if (copy_to_user(u_val, &val, sizeof(val)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_setitimer(int which,
+                  const struct itimerval *u_new,
+                  struct itimerval *u_old)
+{
+   struct process *pi = get_curr_proc();
+   struct itimerval val = {0};
+   int rc;
+
+   if (which != ITIMER_REAL)
+      return -EINVAL; /* ITIMER_VIRTUAL and ITIMER_PROF are not supported */
+
+   if (u_new) {
+
+      if (copy_from_user(&val, u_new, sizeof(val)))
+         return -EFAULT;
+
+      if (!is_timeval_valid(&val.it_value) ||
+          !is_timeval_valid(&val.it_interval))
+      {
+         return -EINVAL;
+      }
+   }
+
+   if (u_old)
+      if ((rc = sys_getitimer(which, u_old)))
+         return rc;
+
+   ktimer_set(&pi->alarm_timer,
+              timeval_to_ticks(&val.it_value),
+              timeval_to_ticks(&val.it_interval));
+   return 0;
+}
+
 static ALWAYS_INLINE bool timer_nested_irq(void)
 {
    bool res = false;
@@ -278,14 +571,10 @@ static ALWAYS_INLINE bool timer_nested_irq(void)
    return res;
 }
 
-static enum irq_action timer_irq_handler(void *ctx)
+static void account_tick(void)
 {
    u32 ns_delta;
-   ASSERT(are_interrupts_enabled());
-
-   if (KRN_TRACK_NESTED_INTERR)
-      if (timer_nested_irq())
-         return IRQ_HANDLED;
+   ulong var;
 
    /*
     * Compute `ns_delta` by reading `__tick_duration` and `__tick_adj_val` here
@@ -295,7 +584,9 @@ static enum irq_action timer_irq_handler(void *ctx)
     *    1. `__tick_duration` is immutable
     *    2. `__tick_adj_val` is changed only by datetime.c while keeping
     *       interrupts disabled and it's read only here. Nested timer IRQs
-    *       will be ignored (see above). No other IRQ handler should read it.
+    *       will be ignored (see above). No other IRQ handler should read it,
+    *       except for timer_oneshot_catch_up(), which runs with interrupts
+    *       disabled.
     */
 
    if (__tick_adj_ticks_rem) {
@@ -305,7 +596,7 @@ static enum irq_action timer_irq_handler(void *ctx)
       ns_delta = __tick_duration;
    }
 
-   disable_interrupts_forced();
+   disable_interrupts(&var);
    {
       /*
        * Alter __ticks and __time_ns here, while keeping the interrupts disabled
@@ -316,13 +607,108 @@ static enum irq_action timer_irq_handler(void *ctx)
       __ticks++;
       __time_ns += ns_delta;
    }
-   enable_interrupts_forced();
+   enable_interrupts(&var);
+}
+
+static enum irq_action timer_irq_handler(void *ctx)
+{
+   ASSERT(are_interrupts_enabled());
+
+   if (KRN_TRACK_NESTED_INTERR)
+      if (timer_nested_irq())
+         return IRQ_HANDLED;
 
+   account_tick();
    sched_account_ticks();
    tick_all_timers();
    return IRQ_HANDLED;
 }
 
+/*
+ * Tickless idle
+ * ----------------
+ *
+ * When the idle task is the only one that can run, there's no point in
+ * receiving a timer IRQ on every tick: timer_idle_enter() programs the timer
+ * in one-shot mode, to fire on the first tick having some work to do in the
+ * timer wheel (or as far as the hardware allows). All the ticks before that one
+ * are "skipped", meaning that they get accounted later, all together, by
+ * timer_oneshot_catch_up() without visiting the wheel, as we know their slots
+ * are empty. That happens at the beginning of the first IRQ received, no matter
+ * which one, before running any IRQ handler: that way, the handlers and the
+ * tasks they wake up will always see an up-to-date time.
+ *
+ * If the IRQ came before the one-shot timer fired, the timer gets shortened to
+ * fire at the end of the current tick: from there, the periodic mode resumes.
+ */
+
+u32 __oneshot_ticks;       /* ticks covered by the one-shot timer, 0 if off */
+u64 __skipped_ticks;       /* ticks accounted by the catch-up, in total */
+
+void timer_oneshot_catch_up(void)
+{
+   u32 skip, elapsed;
+   ASSERT(!are_interrupts_enabled());
+   ASSERT(__oneshot_ticks > 0);
+
+   elapsed = hw_timer_oneshot_cut();
+
+   if (elapsed >= __oneshot_ticks) {
+
+      /*
+       * The one-shot timer fired. The last tick it covered is NOT skipped: it
+       * will be handled as usual by timer_irq_handler(), right now or as soon
+       * as the pending timer IRQ will be delivered.
+       */
+      hw_timer_periodic();
+      skip = __oneshot_ticks - 1;
+      __oneshot_ticks = 0;
+
+   } else {
+
+      skip = elapsed;
+      __oneshot_ticks = 1;
+   }
+
+   __skipped_ticks += skip;
+
+   for (u32 i = 0; i < skip; i++) {
+
+      ASSERT((tw_curr_tick & TW_ROOT_MASK) != 0);
+      ASSERT(list_is_empty(&tw_root[tw_curr_tick & TW_ROOT_MASK]));
+
+      account_tick();
+      sched_account_ticks();
+      tw_curr_tick++;
+   }
+}
+
+void timer_idle_enter(void)
+{
+   const u32 max_ticks = hw_timer_oneshot_max_ticks();
+   u32 t, n;
+
+   ASSERT(!are_interrupts_enabled());
+
+   if (__oneshot_ticks)
+      return; /* The one-shot timer is still finishing the current tick */
+
+   /*
+    * Count the ticks we can skip: the ones with an empty slot in the first
+    * level of the wheel. Stop at the first one needing a cascade as well.
+    */
+   for (n = 0; n < max_ticks - 1; n++) {
+
+      t = tw_curr_tick + n;
+
+      if (!(t & TW_ROOT_MASK) || !list_is_empty(&tw_root[t & TW_ROOT_MASK]))
+         break;
+   }
+
+   if (n > 0)
+      __oneshot_ticks = hw_timer_oneshot(n + 1);
+}
+
 static enum irq_action measure_bogomips_irq_handler(void *ctx);
 
 DEFINE_IRQ_HANDLER_NODE(timer, timer_irq_handler, NULL);
@@ -409,6 +795,9 @@ void init_timer(void)
    static struct bogo_measure_ctx ctx;
    measure_bogomips.context = &ctx;
 
+   init_timer_wheel();
+   init_ktimers();
+
    __tick_duration = hw_timer_setup(TS_SCALE / TIMER_HZ);
 
    printk("*** Init the kernel timer\n");
@@ -0,0 +1,419 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/timerfd.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/syscalls.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/user.h>
+
+/*
+ * timerfd
+ * ---------
+ *
+ * The number of expirations is never stored: it's computed from the absolute
+ * expiry tick and the interval, when needed. A read() consumes them by moving
+ * the expiry tick forward (or by disarming the timer, for one-shot timers).
+ * Therefore, the ktimer's callback has just to wake up the readers and the
+ * watchers of `cond` (poll, select, epoll): it doesn't touch the timerfd state.
+ */
+
+struct timerfd {
+
+   KOBJ_BASE_FIELDS
+
+   struct kmutex mutex;
+   struct kcond cond;               /* signaled when the timer expires */
+   struct ktimer timer;
+   int clockid;
+
+   u64 expire;                      /* absolute expiry tick, 0 if disarmed */
+   u64 interval;                    /* in ticks, 0 for one-shot timers */
+};
+
+static const struct file_ops static_ops_timerfd;
+
+/* Returns a negative errno value in case `fd` is not a timerfd */
+static int get_timerfd(int fd, struct timerfd **t)
+{
+   struct kfs_handle *kh = get_fs_handle(fd);
+
+   if (!kh)
+      return -EBADF;
+
+   if (kh->fops != &static_ops_timerfd)
+      return -EINVAL;
+
+   *t = (void *)kh->kobj;
+   return 0;
+}
+
+static u64 timerfd_expirations(struct timerfd *t, u64 now)
+{
+   if (!t->expire || now < t->expire)
+      return 0;
+
+   return t->interval ? (now - t->expire) / t->interval + 1 : 1;
+}
+
+/* Ticks remaining before the next expiry, 0 if disarmed */
+static u64 timerfd_remaining(struct timerfd *t, u64 now)
+{
+   const u64 n = timerfd_expirations(t, now);
+
+   if (!t->expire)
+      return 0;
+
+   if (!n)
+      return t->expire - now;
+
+   /* Already expired, but not consumed yet */
+   return t->interval ? t->expire + n * t->interval - now : 0;
+}
+
+static void timerfd_ktimer_cb(struct ktimer *kt)
+{
+   struct timerfd *t = CONTAINER_OF(kt, struct timerfd, timer);
+   kcond_signal_all(&t->cond);
+}
+
+static ssize_t timerfd_read(fs_handle h, char *buf, size_t size)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *t = (void *)kh->kobj;
+   ssize_t rc = sizeof(u64);
+   u64 now, n, timeout;
+
+   if (size < sizeof(u64))
+      return -EINVAL;
+
+   kmutex_lock(&t->mutex);
+
+   while (true) {
+
+      now = get_ticks();
+
+      if ((n = timerfd_expirations(t, now)))
+         break;
+
+      if (kh->fl_flags & O_NONBLOCK) {
+         rc = -EAGAIN;
+         goto out;
+      }
+
+      /*
+       * Wait with a timeout as well, instead of relying only on the ktimer's
+       * callback, which might signal the kcond just before we start waiting.
+       */
+      timeout = t->expire ? t->expire - now : KCOND_WAIT_FOREVER;
+      kcond_wait(&t->cond, &t->mutex, (u32)MIN(timeout, 0xffffffffull));
+
+      if (pending_signals()) {
+         rc = -EINTR;
+         goto out;
+      }
+   }
+
+   if (t->interval)
+      t->expire += n * t->interval;
+   else
+      t->expire = 0;
+
+   memcpy(buf, &n, sizeof(n));
+
+out:
+   kmutex_unlock(&t->mutex);
+   return rc;
+}
+
+static int timerfd_read_ready(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *t = (void *)kh->kobj;
+   bool ret;
+
+   kmutex_lock(&t->mutex);
+   {
+      ret = timerfd_expirations(t, get_ticks()) > 0;
+   }
+   kmutex_unlock(&t->mutex);
+   return ret;
+}
+
+static struct kcond *timerfd_get_rready_cond(fs_handle h)
+{
+   struct kfs_handle *kh = h;
+   struct timerfd *t = (void *)kh->kobj;
+   return &t->cond;
+}
+
+static const struct file_ops static_ops_timerfd =
+{
+   .read = timerfd_read,
+   .read_ready = timerfd_read_ready,
+   .get_rready_cond = timerfd_get_rready_cond,
+};
+
+static void destroy_timerfd(struct timerfd *t)
+{
+   /* After this call, the callback is guaranteed to not be running */
+   ktimer_set(&t->timer, 0, 0);
+
+   kcond_destory(&t->cond);
+   kmutex_destroy(&t->mutex);
+   kfree_obj(t, struct timerfd);
+}
+
+fs_handle create_timerfd_handle(int clockid, int flags)
+{
+   struct timerfd *t;
+   fs_handle h;
+
+   if (!(t = (void *)kzalloc_obj(struct timerfd)))
+      return NULL;
+
+   t->destory_obj = (void *)&destroy_timerfd;
+   t->clockid = clockid;
+   kmutex_init(&t->mutex, 0);
+   kcond_init(&t->cond);
+   ktimer_init(&t->timer, &timerfd_ktimer_cb);
+
+   h = kfs_create_new_handle(&static_ops_timerfd,
+                             (void *)t,
+                             O_RDONLY | (flags & O_NONBLOCK));
+
+   if (!h) {
+      destroy_timerfd(t);
+      return NULL;
+   }
+
+   return h;
+}
+
+static int
+timerfd_timespec_to_ticks(const struct k_timespec64 *ts, u64 *ticks)
+{
+   if (ts->tv_sec < 0 || ts->tv_nsec < 0 || ts->tv_nsec >= BILLION)
+      return -EINVAL;
+
+   *ticks = timespec_to_ticks(ts);
+   return 0;
+}
+
+static void
+timerfd_get_value(struct timerfd *t,
+                  struct k_timespec64 *value,
+                  struct k_timespec64 *interval)
+{
+   ticks_to_timespec(timerfd_remaining(t, get_ticks()), value);
+   ticks_to_timespec(t->interval, interval);
+}
+
+static int
+do_timerfd_settime(int fd,
+                   int flags,
+                   struct k_timespec64 *value,     /* in/out */
+                   struct k_timespec64 *interval)  /* in/out */
+{
+   struct k_timespec64 old_value, old_interval, now_ts;
+   struct timerfd *t;
+   u64 ticks, int_ticks, now, now_ticks;
+   int rc;
+
+   if (flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET))
+      return -EINVAL;
+
+   if ((rc = get_timerfd(fd, &t)))
+      return rc;
+
+   if ((rc = timerfd_timespec_to_ticks(value, &ticks)))
+      return rc;
+
+   if ((rc = timerfd_timespec_to_ticks(interval, &int_ticks)))
+      return rc;
+
+   kmutex_lock(&t->mutex);
+
+   now = get_ticks();
+   timerfd_get_value(t, &old_value, &old_interval);
+
+   if (ticks && (flags & TFD_TIMER_ABSTIME)) {
+
+      /* Absolute time on the timer's clock: convert it to a relative one */
+      if (t->clockid == CLOCK_REALTIME)
+         real_time_get_timespec(&now_ts);
+      else
+         monotonic_time_get_timespec(&now_ts);
+
+      now_ticks = timespec_to_ticks(&now_ts);
+
+      /* A time in the past makes the timer expire immediately */
+      ticks = ticks > now_ticks ? ticks - now_ticks : 1;
+   }
+
+   t->expire = ticks ? now + ticks : 0;
+   t->interval = ticks ? int_ticks : 0;
+
+   /*
+    * Note: the ktimer's callback doesn't take our mutex, so there's no lock
+    * ordering problem in calling ktimer_set() while holding it.
+    */
+   ktimer_set(&t->timer, ticks, t->interval);
+
+   /* The blocked readers have to re-compute their timeouts */
+   kcond_signal_all(&t->cond);
+   kmutex_unlock(&t->mutex);
+
+   *value = old_value;
+   *interval = old_interval;
+   return 0;
+}
+
+static int
+do_timerfd_gettime(int fd,
+                   struct k_timespec64 *value,
+                   struct k_timespec64 *interval)
+{
+   struct timerfd *t;
+   int rc;
+
+   if ((rc = get_timerfd(fd, &t)))
+      return rc;
+
+   kmutex_lock(&t->mutex);
+   {
+      timerfd_get_value(t, value, interval);
+   }
+   kmutex_unlock(&t->mutex);
+   return 0;
+}
+
+/*
+ * -------------------------------------
+ * SYSCALLS
+ * -------------------------------------
+ */
+
+int sys_timerfd_settime32(int fd, int flags,
+                          const struct k_itimerspec32 *u_new,
+                          struct k_itimerspec32 *u_old)
+{
+   struct k_timespec64 value, interval;
+   struct k_itimerspec32 its;
+   int rc;
+
+   if (copy_from_user(&its, u_new, sizeof(its)))
+      return -EFAULT;
+
+   value = (struct k_timespec64) {
+      .tv_sec = its.it_value.tv_sec,
+      .tv_nsec = its.it_value.tv_nsec,
+   };
+
+   interval = (struct k_timespec64) {
+      .tv_sec = its.it_interval.tv_sec,
+      .tv_nsec = its.it_interval.tv_nsec,
+   };
+
+   if ((rc = do_timerfd_settime(fd, flags, &value, &interval)))
+      return rc;
+
+   if (u_old) {
+
+      its = (struct k_itimerspec32) {
+         .it_interval = { (s32)interval.tv_sec, interval.tv_nsec },
+         .it_value = { (s32)value.tv_sec, value.tv_nsec },
+      };
+
+      if (copy_to_user(u_old, &its, sizeof(its)))
+         return -EFAULT;
+   }
+
+   return 0;
+}
+
+int sys_timerfd_gettime32(int fd, struct k_itimerspec32 *u_curr)
+{
+   struct k_timespec64 value, interval;
+   struct k_itimerspec32 its;
+   int rc;
+
+   if ((rc = do_timerfd_gettime(fd, &value, &interval)))
+      return rc;
+
+   its = (struct k_itimerspec32) {
+      .it_interval = { (s32)interval.tv_sec, interval.tv_nsec },
+      .it_value = { (s32)value.tv_sec, value.tv_nsec },
+   };
+
+   if (copy_to_user(u_curr, &its, sizeof(its)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_timerfd_settime(int fd, int flags,
+                        const struct k_itimerspec64 *u_new,
+                        struct k_itimerspec64 *u_old)
+{
+   struct k_timespec64 value, interval;
+   struct k_itimerspec64 its;
+   int rc;
+
+   if (copy_from_user(&its, u_new, sizeof(its)))
+      return -EFAULT;
+
+   value = (struct k_timespec64) {
+      .tv_sec = its.it_value.tv_sec,
+      .tv_nsec = (long)its.it_value.tv_nsec,
+   };
+
+   interval = (struct k_timespec64) {
+      .tv_sec = its.it_interval.tv_sec,
+      .tv_nsec = (long)its.it_interval.tv_nsec,
+   };
+
+   if ((rc = do_timerfd_settime(fd, flags, &value, &interval)))
+      return rc;
+
+   if (u_old) {
+
+      its = (struct k_itimerspec64) {
+         .it_interval = { interval.tv_sec, interval.tv_nsec },
+         .it_value = { value.tv_sec, value.tv_nsec },
+      };
+
+      if (copy_to_user(u_old, &its, sizeof(its)))
+         return -EFAULT;
+   }
+
+   return 0;
+}
+
+int sys_timerfd_gettime(int fd, struct k_itimerspec64 *u_curr)
+{
+   struct k_timespec64 value, interval;
+   struct k_itimerspec64 its;
+   int rc;
+
+   if ((rc = do_timerfd_gettime(fd, &value, &interval)))
+      return rc;
+
+   its = (struct k_itimerspec64) {
+      .it_interval = { interval.tv_sec, interval.tv_nsec },
+      .it_value = { value.tv_sec, value.tv_nsec },
+   };
+
+   if (copy_to_user(u_curr, &its, sizeof(its)))
+      return -EFAULT;
+
+   return 0;
+}
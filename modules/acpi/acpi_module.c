@@ -29,6 +29,10 @@ static u8 acpi_fadt_revision;
 static u16 acpi_iapc_boot_arch;
 static u32 acpi_fadt_flags;
 
+/* CPUs and interrupt controllers, read from MADT */
+static struct acpi_madt_info acpi_madt_info;
+static bool acpi_has_madt_info;
+
 /* Callback lists */
 static struct list on_subsystem_enabled_cb_list
    = STATIC_LIST_INIT(on_subsystem_enabled_cb_list);
@@ -150,6 +154,96 @@ acpi_read_acpi_hw_flags(void)
    AcpiPutTable((struct acpi_table_header *)fadt);
 }
 
+static void
+acpi_madt_handle_subtable(struct acpi_madt_info *mi, ACPI_SUBTABLE_HEADER *h)
+{
+   switch (h->Type) {
+
+      case ACPI_MADT_TYPE_LOCAL_APIC: {
+
+         ACPI_MADT_LOCAL_APIC *lapic = (void *)h;
+
+         if (!(lapic->LapicFlags & ACPI_MADT_ENABLED))
+            break;
+
+         if (mi->cpu_count == ARRAY_SIZE(mi->lapic_ids)) {
+            printk("ACPI: MADT: ignoring CPU with LAPIC ID %u\n", lapic->Id);
+            break;
+         }
+
+         mi->lapic_ids[mi->cpu_count++] = lapic->Id;
+         break;
+      }
+
+      case ACPI_MADT_TYPE_IO_APIC: {
+
+         ACPI_MADT_IO_APIC *ioapic = (void *)h;
+
+         if (!mi->ioapic_count++)
+            mi->ioapic_paddr = ioapic->Address;
+
+         break;
+      }
+
+      case ACPI_MADT_TYPE_LOCAL_APIC_OVERRIDE: {
+
+         ACPI_MADT_LOCAL_APIC_OVERRIDE *ovr = (void *)h;
+
+         if (ovr->Address <= 0xffffffff)
+            mi->lapic_paddr = (ulong)ovr->Address;
+
+         break;
+      }
+
+      default:
+         break;
+   }
+}
+
+static void
+acpi_read_madt(void)
+{
+   struct acpi_madt_info *mi = &acpi_madt_info;
+   struct acpi_table_madt *madt;
+   ACPI_SUBTABLE_HEADER *h;
+   ACPI_STATUS rc;
+   ulong end;
+
+   rc = AcpiGetTable(ACPI_SIG_MADT, 1, (struct acpi_table_header **)&madt);
+
+   if (rc == AE_NOT_FOUND)
+      return;
+
+   if (ACPI_FAILURE(rc)) {
+      print_acpi_failure("AcpiGetTable", "MADT", rc);
+      return;
+   }
+
+   mi->lapic_paddr = madt->Address;
+   mi->has_8259 = !!(madt->Flags & ACPI_MADT_PCAT_COMPAT);
+
+   h = (void *)(madt + 1);
+   end = (ulong)madt + madt->Header.Length;
+
+   while ((ulong)h + sizeof(*h) <= end && h->Length > 0) {
+      acpi_madt_handle_subtable(mi, h);
+      h = (void *)((ulong)h + h->Length);
+   }
+
+   AcpiPutTable((struct acpi_table_header *)madt);
+   acpi_has_madt_info = true;
+
+   printk("ACPI: MADT: CPUs: %u, LAPIC: %p, I/O APICs: %u (first: %p)\n",
+          mi->cpu_count, TO_PTR(mi->lapic_paddr),
+          mi->ioapic_count, TO_PTR(mi->ioapic_paddr));
+}
+
+const struct acpi_madt_info *
+acpi_get_madt_info(void)
+{
+   return acpi_has_madt_info ? &acpi_madt_info : NULL;
+}
+
 void
 acpi_reboot(void)
 {
@@ -254,6 +348,7 @@ acpi_mod_init_tables(void)
 
    acpi_init_status = ais_tables_initialized;
    acpi_read_acpi_hw_flags();
+   acpi_read_madt();
 }
 
 void
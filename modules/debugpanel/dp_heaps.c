@@ -5,13 +5,16 @@
 
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/kmalloc_debug.h>
+#include <tilck/kernel/page_alloc.h>
 
 #include "termutil.h"
 #include "dp_int.h"
 
 static size_t heaps_alloc[KMALLOC_HEAPS_COUNT];
 static struct debug_kmalloc_heap_info hi;
+static struct debug_kmalloc_cache_info ci;
 static struct debug_kmalloc_stats stats;
+static struct pf_alloc_stats pf_stats;
 static size_t tot_usable_mem_kb;
 static size_t tot_used_mem_kb;
 static long tot_diff;
@@ -40,6 +43,7 @@ static void dp_heaps_on_enter(void)
    ASSERT(tot_usable_mem_kb > 0);
 
    debug_kmalloc_get_stats(&stats);
+   pf_get_stats(&pf_stats);
 }
 
 static void dp_show_kmalloc_heaps(void)
@@ -121,6 +125,49 @@ static void dp_show_kmalloc_heaps(void)
    }
 
    dp_writeln("");
+
+   dp_writeln(
+      "     name     "
+      TERM_VLINE " objsz "
+      TERM_VLINE " slab  "
+      TERM_VLINE " slabs "
+      TERM_VLINE "  used  "
+      TERM_VLINE "  peak  "
+      TERM_VLINE "  allocs  "
+   );
+
+   dp_writeln(
+      GFX_ON
+      "qqqqqqqqqqqqqqnqqqqqqqnqqqqqqqnqqqqqqqnqqqqqqqqnqqqqqqqqnqqqqqqqqqq"
+      GFX_OFF
+   );
+
+   for (int i = 0; debug_kmalloc_get_cache_info(i, &ci); i++) {
+
+      dp_writeln(
+         " %-12s "
+         TERM_VLINE " %5u "
+         TERM_VLINE " %2u KB "
+         TERM_VLINE " %5u "
+         TERM_VLINE " %6u "
+         TERM_VLINE " %6u "
+         TERM_VLINE " %8u ",
+         ci.name,
+         ci.obj_size,
+         ci.slab_size / KB,
+         ci.slabs_count,
+         ci.objs_in_use,
+         ci.peak_objs_in_use,
+         ci.allocs_count
+      );
+   }
+
+   dp_writeln("");
+   dp_writeln("Page frames: %u KB managed, %u KB from kmalloc, %u KB free",
+              pf_stats.managed_pages * PAGE_SIZE / KB,
+              pf_stats.kmalloc_pages * PAGE_SIZE / KB,
+              pf_stats.free_pages * PAGE_SIZE / KB);
+   dp_writeln("");
 }
 
 static void dp_heaps_on_exit(void)
@@ -92,6 +92,7 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(KERNEL_UBSAN);
    DUMP_BOOL_OPT(TERM_BIG_SCROLL_BUF);
    DUMP_BOOL_OPT(KRN_RESCHED_ENABLE_PREEMPT);
+   DUMP_BOOL_OPT(KRN_TICKLESS_IDLE);
    DUMP_BOOL_OPT(KERNEL_BIG_IO_BUF);
    DUMP_BOOL_OPT(PS2_DO_SELFTEST);
    DUMP_BOOL_OPT(PS2_VERBOSE_DEBUG_LOG);
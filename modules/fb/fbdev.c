@@ -123,6 +123,9 @@ fbdev_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (um->off != 0)
       return -EINVAL; /* not supported, at least for the moment */
 
+   if (um->flags == MAP_PRIVATE)
+      return -EINVAL; /* the framebuffer cannot be copied on write */
+
    if (flags & VFS_MM_DONT_MMAP)
       goto register_mapping;
 
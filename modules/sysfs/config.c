@@ -42,6 +42,7 @@ DEF_STATIC_CONF_RO(BOOL,  stack_isolation,         KERNEL_STACK_ISOLATION);
 DEF_STATIC_CONF_RO(BOOL,  symbols,                 KERNEL_SYMBOLS);
 DEF_STATIC_CONF_RO(BOOL,  printk_on_curr_tty,      KRN_PRINTK_ON_CURR_TTY);
 DEF_STATIC_CONF_RO(BOOL,  resched_enable_preempt,  KRN_RESCHED_ENABLE_PREEMPT);
+DEF_STATIC_CONF_RO(BOOL,  tickless_idle,           KRN_TICKLESS_IDLE);
 DEF_STATIC_CONF_RO(BOOL,  big_io_buf,              KERNEL_BIG_IO_BUF);
 DEF_STATIC_CONF_RO(BOOL,  gcov,                    KERNEL_GCOV);
 DEF_STATIC_CONF_RO(BOOL,  fork_no_cow,             FORK_NO_COW);
@@ -103,6 +104,7 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(symbols),
       SYSOBJ_CONF_PROP_PAIR(printk_on_curr_tty),
       SYSOBJ_CONF_PROP_PAIR(resched_enable_preempt),
+      SYSOBJ_CONF_PROP_PAIR(tickless_idle),
       SYSOBJ_CONF_PROP_PAIR(big_io_buf),
       SYSOBJ_CONF_PROP_PAIR(gcov),
       SYSOBJ_CONF_PROP_PAIR(fork_no_cow),
@@ -16,6 +16,8 @@
 #include <tilck/kernel/modules.h>
 #include <tilck/kernel/sort.h>
 
+#include <sys/mman.h>      // system header
+
 #include "sysfs_int.h"
 #include "dents.c.h"
 #include "inodes.c.h"
@@ -492,7 +494,11 @@ sysfs_register_obj(struct fs *fs,
    iobj->dir.obj = obj;
    obj->inode = iobj;
    obj->parent = parent;
-   return sysfs_create_files_for_obj(fs, obj);
+   rc = sysfs_create_files_for_obj(fs, obj);
+
+   /* Even in case of failure, some entries might have been created */
+   vfs_dcache_invalidate(fs);
+   return rc;
 }
 
 struct symlink_tmp {
@@ -620,6 +626,8 @@ sysfs_symlink_obj(struct fs *fs,
 
    if (rc < 0)
       sysfs_destroy_inode(sd, link);
+   else
+      vfs_dcache_invalidate(fs);
 
 out:
    /* Free our temporary object, since `link` now has a copy of tmp->path */
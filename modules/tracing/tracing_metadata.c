@@ -33,6 +33,10 @@ static const struct syscall_info __tracing_metadata[] =
    SYSCALL_TYPE_1(SYS_getpgid, "pid"),
    SYSCALL_TYPE_1(SYS_getsid, "pid"),
 
+#if defined(__i386__)
+   SYSCALL_TYPE_1(SYS_nice, "inc"),
+#endif
+
    SYSCALL_TYPE_2(SYS_creat, "path", "mode"),
    SYSCALL_TYPE_2(SYS_chmod, "path", "mode"),
    SYSCALL_TYPE_2(SYS_mkdir, "path", "mode"),
@@ -48,6 +52,7 @@ static const struct syscall_info __tracing_metadata[] =
 
    SYSCALL_TYPE_5(SYS_setpgid, "pid", "pgid"),
    SYSCALL_TYPE_5(SYS_dup2, "oldfd", "newfd"),
+   SYSCALL_TYPE_5(SYS_getpriority, "which", "who"),
 
 #if defined(__i386__)
    SYSCALL_TYPE_6(SYS_chown16, "path", "owner", "group"),
@@ -60,6 +65,7 @@ static const struct syscall_info __tracing_metadata[] =
    SYSCALL_TYPE_6(SYS_lchown, "path", "owner", "group"),
 
    SYSCALL_TYPE_7(SYS_fchown, "fd", "owner", "group"),
+   SYSCALL_TYPE_7(SYS_setpriority, "which", "who", "prio"),
 
    SYSCALL_RW(SYS_read, "fd", "buf", &ptype_big_buf, sys_param_out, "count"),
    SYSCALL_RW(SYS_write, "fd", "buf", &ptype_big_buf, sys_param_in, "count"),
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Build a compressed FAT image (FATZ, see fatz.h) from a FAT partition file.
+ * The kernel decompresses its clusters on demand, when it's used as ramdisk.
+ */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/fat32_base.h>
+#include <tilck/common/fatz.h>
+#include <tilck/common/lz4.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+static void show_help_and_exit(int argc, char **argv)
+{
+   printf("Syntax:\n");
+   printf("    %s <fat part file> <output file>\n", argv[0]);
+   exit(1);
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+   ssize_t rc;
+
+   while (len > 0) {
+
+      rc = write(fd, buf, len);
+
+      if (rc < 0) {
+
+         if (errno == EINTR)
+            continue;
+
+         perror("write() failed");
+         return -1;
+      }
+
+      buf += rc;
+      len -= (size_t)rc;
+   }
+
+   return 0;
+}
+
+static int
+do_compress(struct fat_hdr *hdr, size_t fat_file_sz, const char *out_file)
+{
+   const u32 used_bytes = fat_calculate_used_bytes(hdr);
+   u32 buf_size, zsize;
+   void *buf, *wrkmem;
+   int fd, rc = 1;
+
+   if (used_bytes > fat_file_sz) {
+      fprintf(stderr,
+              "FATAL ERROR: used bytes (%u) > st_size (%zu)\n",
+              used_bytes, fat_file_sz);
+      return 1;
+   }
+
+   buf_size = used_bytes + fatz_get_max_overhead(hdr);
+   buf = malloc(buf_size);
+   wrkmem = malloc(LZ4_WRKMEM_SIZE);
+
+   if (!buf || !wrkmem) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      goto out;
+   }
+
+   if (!(zsize = fatz_build(hdr, buf, buf_size, wrkmem))) {
+      fprintf(stderr, "FATAL ERROR: fatz_build() failed\n");
+      goto out;
+   }
+
+   if (!fatz_check_image(buf, zsize)) {
+      fprintf(stderr, "FATAL ERROR: the FATZ image is corrupted\n");
+      goto out;
+   }
+
+   fd = open(out_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+   if (fd < 0) {
+      perror("open() failed");
+      goto out;
+   }
+
+   if (!write_all(fd, buf, zsize))
+      rc = 0;
+
+   close(fd);
+
+   if (!rc) {
+      printf("INFO: FAT image compressed: %u -> %u bytes (%u%%)\n",
+             used_bytes, zsize, (u32)(100ull * zsize / used_bytes));
+   }
+
+out:
+   free(wrkmem);
+   free(buf);
+   return rc;
+}
+
+int main(int argc, char **argv)
+{
+   struct stat statbuf;
+   void *vaddr;
+   int fd, rc;
+
+   if (argc < 3)
+      show_help_and_exit(argc, argv);
+
+   if (stat(argv[1], &statbuf) < 0) {
+      perror("stat() failed");
+      return 1;
+   }
+
+   if (!S_ISREG(statbuf.st_mode) ||
+       statbuf.st_size < (off_t)sizeof(struct fat_hdr))
+   {
+      fprintf(stderr, "Invalid file type\n");
+      return 1;
+   }
+
+   fd = open(argv[1], O_RDONLY);
+
+   if (fd < 0) {
+      perror("open() failed");
+      return 1;
+   }
+
+   vaddr = mmap(NULL,                                 /* addr */
+                statbuf.st_size,                      /* length */
+                PROT_READ,                            /* prot */
+                MAP_PRIVATE,                          /* flags */
+                fd,                                   /* fd */
+                0);                                   /* offset */
+
+   if (vaddr == (void *)-1) {
+      perror("mmap() failed");
+      close(fd);
+      return 1;
+   }
+
+   rc = do_compress(vaddr, (size_t)statbuf.st_size, argv[2]);
+
+   munmap(vaddr, statbuf.st_size);
+   close(fd);
+   return rc;
+}
@@ -86,6 +86,43 @@ void selftest_sleep_short()
 
 DECLARE_AND_REGISTER_SELF_TEST(sleep, se_short, &selftest_sleep_short)
 
+static void sleeping_kthread(void *arg)
+{
+   const u64 wait_ticks = (ulong)arg;
+   u64 before = get_ticks();
+
+   kernel_sleep(wait_ticks);
+
+   u64 after = get_ticks();
+   u64 elapsed = after - before;
+
+   VERIFY(elapsed >= wait_ticks);
+   VERIFY((elapsed - wait_ticks) <= TIMER_HZ/10);
+}
+
+/*
+ * Many tasks sleeping at the same time, with timers expiring both in the first
+ * level of the timer wheel and in the coarser ones (more than 256 ticks).
+ */
+void selftest_sleep2_short()
+{
+   int tids[32];
+
+   for (int i = 0; i < (int)ARRAY_SIZE(tids); i++) {
+
+      ulong wait_ticks = 1 + (ulong)i * 37 % (2 * TIMER_HZ);
+      tids[i] = kthread_create(sleeping_kthread, 0, (void *)wait_ticks);
+
+      if (tids[i] < 0)
+         panic("Unable to create sleeping_kthread");
+   }
+
+   kthread_join_all(tids, ARRAY_SIZE(tids), true);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(sleep2, se_short, &selftest_sleep2_short)
+
 void selftest_join_med()
 {
    int tid;
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/hal.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/page_alloc.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/self_tests.h>
+
+#define PF_TEST_PAGES                                  1000
+
+static size_t pf_used_pages(void)
+{
+   struct pf_alloc_stats s;
+   pf_get_stats(&s);
+   return s.managed_pages - s.free_pages;
+}
+
+static void pf_alloc_check_orders(void)
+{
+   void *blocks[PF_KMALLOC_ORDER + 1];
+
+   for (u32 o = 0; o <= PF_KMALLOC_ORDER; o++) {
+
+      if (!(blocks[o] = pf_alloc(o)))
+         panic("pf_alloc(%u) failed", o);
+
+      if ((ulong)blocks[o] & ((PAGE_SIZE << o) - 1))
+         panic("pf_alloc(%u) returned a non-aligned block: %p", o, blocks[o]);
+
+      memset(blocks[o], (int)o, PAGE_SIZE << o);
+   }
+
+   for (u32 o = 0; o <= PF_KMALLOC_ORDER; o++) {
+
+      const u8 *p = blocks[o];
+
+      for (size_t i = 0; i < (PAGE_SIZE << o); i++)
+         if (p[i] != o)
+            panic("Overlapping blocks returned by pf_alloc()");
+
+      pf_free(blocks[o], o);
+   }
+}
+
+void selftest_page_alloc_short(void)
+{
+   void **pages;
+   size_t used, n;
+   u64 start, duration;
+
+   if (!(pages = kalloc_array_obj(void *, PF_TEST_PAGES)))
+      panic("No enough memory for the 'pages' buffer");
+
+   used = pf_used_pages();
+   pf_alloc_check_orders();
+
+   start = RDTSC();
+
+   for (int i = 0; i < PF_TEST_PAGES; i++)
+      if (!(pages[i] = pf_alloc_page()))
+         panic("pf_alloc_page() failed");
+
+   for (int i = 0; i < PF_TEST_PAGES; i++)
+      pf_free_page(pages[i]);
+
+   duration = (RDTSC() - start) / PF_TEST_PAGES;
+   printk("Cycles per pf_alloc_page() + pf_free_page(): %" PRIu64 "\n",
+          duration);
+
+   start = RDTSC();
+
+   for (int i = 0; i < PF_TEST_PAGES; i++)
+      if (!(pages[i] = kmalloc(PAGE_SIZE)))
+         panic("kmalloc(PAGE_SIZE) failed");
+
+   for (int i = 0; i < PF_TEST_PAGES; i++)
+      kfree2(pages[i], PAGE_SIZE);
+
+   duration = (RDTSC() - start) / PF_TEST_PAGES;
+   printk("Cycles per kmalloc(PAGE_SIZE) + kfree: %" PRIu64 "\n", duration);
+
+   n = pf_alloc_batch(pages, PF_TEST_PAGES);
+
+   if (n != PF_TEST_PAGES)
+      panic("pf_alloc_batch() allocated only %zu pages", n);
+
+   /* Free the pages in a different order, to exercise the buddy merging */
+   for (int i = 0; i < PF_TEST_PAGES; i += 2)
+      pf_free_page(pages[i]);
+
+   for (int i = 1; i < PF_TEST_PAGES; i += 2)
+      pf_free_page(pages[i]);
+
+   if (pf_used_pages() != used)
+      panic("Used pages: %zu, expected: %zu", pf_used_pages(), used);
+
+   kfree_array_obj(pages, void *, PF_TEST_PAGES);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(page_alloc,
+                               se_short,
+                               &selftest_page_alloc_short)
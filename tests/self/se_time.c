@@ -149,3 +149,62 @@ void selftest_delay_manual(void)
 }
 
 DECLARE_AND_REGISTER_SELF_TEST(delay, se_manual, &selftest_delay_manual)
+
+/*
+ * Sleep across many one-shot periods of the tickless idle and check that the
+ * skipped ticks got caught up: both the ticks and the system time must have
+ * advanced as if the timer IRQ had fired on every tick.
+ */
+void selftest_tickless_short(void)
+{
+   const u64 wait_ticks = TIMER_HZ / 2;
+   u64 t0, t1, ts0, ts1, sk0, sk1, elapsed, elapsed_ns, exp_ns;
+   ulong var;
+
+   if (!KRN_TICKLESS_IDLE) {
+      printk("KRN_TICKLESS_IDLE is disabled: skipping the test\n");
+      se_regular_end();
+      return;
+   }
+
+   disable_interrupts(&var);
+   {
+      t0 = get_ticks();
+      ts0 = get_sys_time();
+      sk0 = __skipped_ticks;
+   }
+   enable_interrupts(&var);
+
+   kernel_sleep(wait_ticks);
+
+   disable_interrupts(&var);
+   {
+      t1 = get_ticks();
+      ts1 = get_sys_time();
+      sk1 = __skipped_ticks;
+   }
+   enable_interrupts(&var);
+
+   elapsed = t1 - t0;
+   elapsed_ns = ts1 - ts0;
+   exp_ns = elapsed * (TS_SCALE / TIMER_HZ);
+
+   printk("elapsed ticks: %" PRIu64 " (expected: %" PRIu64 ")\n",
+          elapsed, wait_ticks);
+   printk("elapsed time:  %" PRIu64 " ns (expected: %" PRIu64 " ns)\n",
+          elapsed_ns, exp_ns);
+   printk("skipped ticks: %" PRIu64 "\n", sk1 - sk0);
+
+   /* The sleep covered several one-shots: some ticks must have been skipped */
+   VERIFY(sk1 - sk0 > hw_timer_oneshot_max_ticks());
+
+   VERIFY(elapsed >= wait_ticks);
+   VERIFY(elapsed - wait_ticks <= TIMER_HZ / 10);
+
+   /* The drift compensation can alter the duration of a tick by a bit */
+   VERIFY(elapsed_ns >= exp_ns - exp_ns / 10);
+   VERIFY(elapsed_ns <= exp_ns + exp_ns / 10);
+   se_regular_end();
+}
+
+DECLARE_AND_REGISTER_SELF_TEST(tickless, se_short, &selftest_tickless_short)
@@ -11,6 +11,7 @@ DECL_CMD(runall);
 DECL_CMD(loop);
 DECL_CMD(fork0);
 DECL_CMD(fork1);
+DECL_CMD(fork_cow);
 DECL_CMD(sysenter);
 DECL_CMD(fork_se);
 DECL_CMD(bad_read);
@@ -23,6 +24,10 @@ DECL_CMD(fpu_loop);
 DECL_CMD(brk);
 DECL_CMD(mmap);
 DECL_CMD(mmap2);
+DECL_CMD(brk2);
+DECL_CMD(mmap3);
+DECL_CMD(hugetlb1);
+DECL_CMD(fbmmap1);
 DECL_CMD(kcow);
 DECL_CMD(wpid1);
 DECL_CMD(wpid2);
@@ -45,6 +50,7 @@ DECL_CMD(poll2);
 DECL_CMD(poll3);
 DECL_CMD(bigargv);
 DECL_CMD(cloexec);
+DECL_CMD(nice1);
 DECL_CMD(fs1);
 DECL_CMD(fs2);
 DECL_CMD(fs3);
@@ -59,15 +65,33 @@ DECL_CMD(fmmap4);
 DECL_CMD(fmmap5);
 DECL_CMD(fmmap6);
 DECL_CMD(fmmap7);
+DECL_CMD(fmmap8);
 DECL_CMD(fs_perf1);
 DECL_CMD(fs_perf2);
+DECL_CMD(fs_perf3);
+DECL_CMD(fs_perf4);
 DECL_CMD(pipe1);
 DECL_CMD(pipe2);
 DECL_CMD(pipe3);
 DECL_CMD(pipe4);
 DECL_CMD(pipe5);
+DECL_CMD(pipe6);
 DECL_CMD(pollerr);
 DECL_CMD(pollhup);
+DECL_CMD(epoll1);
+DECL_CMD(epoll2);
+DECL_CMD(futex1);
+DECL_CMD(futex2);
+DECL_CMD(clone1);
+DECL_CMD(clone2);
+DECL_CMD(clone3);
+DECL_CMD(eventfd1);
+DECL_CMD(eventfd2);
+DECL_CMD(timerfd1);
+DECL_CMD(alarm1);
+DECL_CMD(signalfd1);
+DECL_CMD(io_uring1);
+DECL_CMD(io_uring2);
 DECL_CMD(execve0);
 DECL_CMD(vfork0);
 DECL_CMD(extra);
@@ -96,6 +120,7 @@ static struct test_cmd_entry _cmds_table[] =
 
    CMD_ENTRY(fork0,        TT_MED,    true),
    CMD_ENTRY(fork1,        TT_SHORT,  true),
+   CMD_ENTRY(fork_cow,     TT_SHORT,  true),
    CMD_ENTRY(sysenter,     TT_SHORT,  true),
    CMD_ENTRY(fork_se,      TT_MED,    true),
    CMD_ENTRY(bad_read,     TT_SHORT,  true),
@@ -108,6 +133,10 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(brk,          TT_SHORT,  true),
    CMD_ENTRY(mmap,         TT_MED,    true),
    CMD_ENTRY(mmap2,        TT_SHORT,  true),
+   CMD_ENTRY(brk2,         TT_SHORT,  true),
+   CMD_ENTRY(mmap3,        TT_SHORT,  true),
+   CMD_ENTRY(hugetlb1,     TT_SHORT,  true),
+   CMD_ENTRY(fbmmap1,      TT_SHORT,  true),
    CMD_ENTRY(kcow,         TT_SHORT,  true),
    CMD_ENTRY(wpid1,        TT_SHORT,  true),
    CMD_ENTRY(wpid2,        TT_SHORT,  true),
@@ -123,6 +152,7 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(sig_ignore,   TT_SHORT,  true),
    CMD_ENTRY(bigargv,      TT_SHORT,  true),
    CMD_ENTRY(cloexec,      TT_SHORT,  true),
+   CMD_ENTRY(nice1,        TT_SHORT,  true),
    CMD_ENTRY(fs1,          TT_SHORT,  true),
    CMD_ENTRY(fs2,          TT_SHORT,  true),
    CMD_ENTRY(fs3,          TT_SHORT,  true),
@@ -132,6 +162,8 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fs7,          TT_SHORT,  true),
    CMD_ENTRY(fs_perf1,     TT_SHORT,  true),
    CMD_ENTRY(fs_perf2,     TT_SHORT,  true),
+   CMD_ENTRY(fs_perf3,     TT_SHORT,  true),
+   CMD_ENTRY(fs_perf4,     TT_SHORT,  true),
    CMD_ENTRY(fmmap1,       TT_SHORT,  true),
    CMD_ENTRY(fmmap2,       TT_SHORT,  true),
    CMD_ENTRY(fmmap3,       TT_SHORT,  true),
@@ -139,11 +171,13 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fmmap5,       TT_SHORT,  true),
    CMD_ENTRY(fmmap6,       TT_SHORT,  true),
    CMD_ENTRY(fmmap7,       TT_SHORT,  true),
+   CMD_ENTRY(fmmap8,       TT_SHORT,  true),
    CMD_ENTRY(pipe1,        TT_SHORT,  true),
    CMD_ENTRY(pipe2,        TT_SHORT,  true),
    CMD_ENTRY(pipe3,        TT_SHORT,  true),
    CMD_ENTRY(pipe4,        TT_SHORT,  true),
    CMD_ENTRY(pipe5,        TT_SHORT,  true),
+   CMD_ENTRY(pipe6,        TT_SHORT,  true),
    CMD_ENTRY(pollerr,      TT_SHORT,  true),
    CMD_ENTRY(pollhup,      TT_SHORT,  true),
    CMD_ENTRY(poll1,        TT_SHORT,  true),
@@ -153,6 +187,20 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(select2,      TT_SHORT,  true),
    CMD_ENTRY(select3,      TT_SHORT,  true),
    CMD_ENTRY(select4,      TT_SHORT,  true),
+   CMD_ENTRY(epoll1,       TT_SHORT,  true),
+   CMD_ENTRY(epoll2,       TT_SHORT,  true),
+   CMD_ENTRY(futex1,       TT_SHORT,  true),
+   CMD_ENTRY(futex2,       TT_SHORT,  true),
+   CMD_ENTRY(clone1,       TT_SHORT,  true),
+   CMD_ENTRY(clone2,       TT_SHORT,  true),
+   CMD_ENTRY(clone3,       TT_SHORT,  true),
+   CMD_ENTRY(eventfd1,     TT_SHORT,  true),
+   CMD_ENTRY(eventfd2,     TT_SHORT,  true),
+   CMD_ENTRY(timerfd1,     TT_SHORT,  true),
+   CMD_ENTRY(alarm1,       TT_SHORT,  true),
+   CMD_ENTRY(signalfd1,    TT_SHORT,  true),
+   CMD_ENTRY(io_uring1,    TT_SHORT,  true),
+   CMD_ENTRY(io_uring2,    TT_SHORT,  true),
    CMD_ENTRY(execve0,      TT_SHORT,  true),
    CMD_ENTRY(vfork0,       TT_SHORT,  true),
    CMD_ENTRY(extra,        TT_MED,    true),
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#include "devshell.h"
+
+#define THREADS_COUNT                4
+#define THREAD_ITERS               500
+
+static pthread_mutex_t counter_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int counter;
+static __thread int tls_var;
+
+static int gettid_raw(void)
+{
+   return (int)syscall(SYS_gettid);
+}
+
+static void *counter_thread(void *arg)
+{
+   const int n = (int)(long)arg;
+
+   if (gettid_raw() == getpid())
+      return (void *)1;
+
+   tls_var = n;
+
+   for (int i = 0; i < THREAD_ITERS; i++) {
+
+      pthread_mutex_lock(&counter_lock);
+      counter++;
+      pthread_mutex_unlock(&counter_lock);
+
+      if (!(i % 100))
+         sched_yield();
+   }
+
+   /* Each thread must have its own copy of the TLS variables */
+   return (void *)(long)(tls_var != n);
+}
+
+/*
+ * Threads created with pthread_create(): that means clone() with CLONE_VM,
+ * CLONE_THREAD, CLONE_SETTLS and CLONE_CHILD_CLEARTID, which pthread_join()
+ * relies on, through a futex.
+ */
+int cmd_clone1(int argc, char **argv)
+{
+   pthread_t threads[THREADS_COUNT];
+   void *ret;
+   int rc;
+
+   counter = 0;
+   tls_var = -1;
+   DEVSHELL_CMD_ASSERT(gettid_raw() == getpid());
+
+   for (int i = 0; i < THREADS_COUNT; i++) {
+      rc = pthread_create(&threads[i], NULL, counter_thread, (void *)(long)i);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   printf("Created %d threads, joining them..\n", THREADS_COUNT);
+
+   for (int i = 0; i < THREADS_COUNT; i++) {
+      DEVSHELL_CMD_ASSERT(pthread_join(threads[i], &ret) == 0);
+      DEVSHELL_CMD_ASSERT(ret == NULL);
+   }
+
+   printf("counter: %d\n", counter);
+   DEVSHELL_CMD_ASSERT(counter == THREADS_COUNT * THREAD_ITERS);
+   DEVSHELL_CMD_ASSERT(tls_var == -1);
+   return 0;
+}
+
+static void *exit_group_thread(void *arg)
+{
+   usleep(50 * 1000);
+   exit(42);              /* exit_group(): kills the main thread too */
+}
+
+static void *blocked_thread(void *arg)
+{
+   while (true)
+      pause();
+
+   return NULL;
+}
+
+/* exit() in a thread terminates the whole process with its exit code */
+int cmd_clone2(int argc, char **argv)
+{
+   pthread_t t1, t2;
+   pid_t childpid;
+   int wstatus, rc;
+
+   printf(STR_PARENT "fork()..\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+
+      if (pthread_create(&t1, NULL, blocked_thread, NULL))
+         exit(1);
+
+      if (pthread_create(&t2, NULL, exit_group_thread, NULL))
+         exit(1);
+
+      printf(STR_CHILD "main thread waiting forever..\n");
+
+      while (true)
+         pause();
+   }
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+
+   printf(STR_PARENT "child exit code: %d\n", WEXITSTATUS(wstatus));
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 42);
+   return 0;
+}
+
+/* A signal sent to a single thread with tgkill(), handled by that thread */
+static volatile int sig_tid;
+
+static void sigusr1_handler(int sig)
+{
+   sig_tid = gettid_raw();
+}
+
+static void *tgkill_thread(void *arg)
+{
+   volatile int *tid = arg;
+
+   *tid = gettid_raw();
+
+   while (!sig_tid)
+      usleep(10 * 1000);
+
+   return NULL;
+}
+
+int cmd_clone3(int argc, char **argv)
+{
+   volatile int thread_tid = 0;
+   struct sigaction sa = { .sa_handler = sigusr1_handler };
+   pthread_t t;
+   long rc;
+
+   sig_tid = 0;
+   DEVSHELL_CMD_ASSERT(sigaction(SIGUSR1, &sa, NULL) == 0);
+   DEVSHELL_CMD_ASSERT(pthread_create(&t, NULL, tgkill_thread,
+                                      (void *)&thread_tid) == 0);
+
+   while (!thread_tid)
+      usleep(10 * 1000);
+
+   DEVSHELL_CMD_ASSERT(thread_tid != getpid());
+
+   /* Wrong pid/tid pair */
+   rc = syscall(SYS_tgkill, getpid() + 1000, thread_tid, SIGUSR1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ESRCH);
+
+   rc = syscall(SYS_tgkill, getpid(), thread_tid, SIGUSR1);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   DEVSHELL_CMD_ASSERT(pthread_join(t, NULL) == 0);
+   printf("Signal handled by tid %d (thread: %d)\n", sig_tid, thread_tid);
+   DEVSHELL_CMD_ASSERT(sig_tid == thread_tid);
+
+   sa.sa_handler = SIG_DFL;
+   DEVSHELL_CMD_ASSERT(sigaction(SIGUSR1, &sa, NULL) == 0);
+   return 0;
+}
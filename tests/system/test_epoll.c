@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+
+#include "devshell.h"
+
+static int epoll_wait_nointr(int epfd, struct epoll_event *evs, int n, int ms)
+{
+   int rc;
+
+   do {
+      rc = epoll_wait(epfd, evs, n, ms);
+   } while (rc < 0 && errno == EINTR);
+
+   return rc;
+}
+
+/* Level-triggered, edge-triggered and one-shot items on pipes */
+int cmd_epoll1(int argc, char **argv)
+{
+   struct epoll_event ev, evs[4];
+   int p1[2], p2[2], p3[2];
+   int epfd, fd, rc;
+   char buf[16];
+
+   DEVSHELL_CMD_ASSERT(pipe(p1) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(p2) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(p3) == 0);
+
+   epfd = epoll_create1(EPOLL_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(epfd >= 0);
+   DEVSHELL_CMD_ASSERT(fcntl(epfd, F_GETFD) == FD_CLOEXEC);
+
+   ev = (struct epoll_event) { .events = EPOLLIN, .data.fd = p1[0] };
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, p1[0], &ev) == 0);
+
+   ev = (struct epoll_event) { .events = EPOLLIN|EPOLLET, .data.fd = p2[0] };
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, p2[0], &ev) == 0);
+
+   ev = (struct epoll_event){ .events = EPOLLIN|EPOLLONESHOT, .data.fd = p3[0] };
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, p3[0], &ev) == 0);
+
+   /* Error cases */
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, p1[0], &ev);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EEXIST);
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, p1[1], NULL);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, epfd, &ev);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   fd = open("/tmp/epoll_file", O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   rc = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EPERM);
+   close(fd);
+   unlink("/tmp/epoll_file");
+
+   /* Nothing is ready yet */
+   DEVSHELL_CMD_ASSERT(epoll_wait_nointr(epfd, evs, 4, 0) == 0);
+
+   DEVSHELL_CMD_ASSERT(write(p1[1], "a", 1) == 1);
+   DEVSHELL_CMD_ASSERT(write(p2[1], "b", 1) == 1);
+   DEVSHELL_CMD_ASSERT(write(p3[1], "c", 1) == 1);
+
+   rc = epoll_wait_nointr(epfd, evs, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 3);
+
+   for (int i = 0; i < rc; i++)
+      DEVSHELL_CMD_ASSERT(evs[i].events == EPOLLIN);
+
+   /* Only the level-triggered item is reported again */
+   rc = epoll_wait_nointr(epfd, evs, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].data.fd == p1[0]);
+
+   /* New data: an edge for p2, but p3 is disabled until EPOLL_CTL_MOD */
+   DEVSHELL_CMD_ASSERT(read(p1[0], buf, sizeof(buf)) == 1);
+   DEVSHELL_CMD_ASSERT(write(p2[1], "b", 1) == 1);
+   DEVSHELL_CMD_ASSERT(write(p3[1], "c", 1) == 1);
+
+   rc = epoll_wait_nointr(epfd, evs, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].data.fd == p2[0]);
+
+   ev = (struct epoll_event){ .events = EPOLLIN|EPOLLONESHOT, .data.fd = p3[0] };
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_MOD, p3[0], &ev) == 0);
+
+   rc = epoll_wait_nointr(epfd, evs, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].data.fd == p3[0]);
+
+   /* Closing the write end: EPOLLHUP on the read end */
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_DEL, p2[0], NULL) == 0);
+   close(p1[1]);
+
+   rc = epoll_wait_nointr(epfd, evs, 4, 0);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].data.fd == p1[0]);
+   DEVSHELL_CMD_ASSERT(evs[0].events & EPOLLHUP);
+
+   /* Closing a watched fd removes it from the interest set */
+   close(p1[0]);
+   DEVSHELL_CMD_ASSERT(epoll_wait_nointr(epfd, evs, 4, 0) == 0);
+
+   close(p2[0]); close(p2[1]);
+   close(p3[0]); close(p3[1]);
+   close(epfd);
+   return 0;
+}
+
+/* Blocking epoll_wait(), woken up by a child writing on a pipe */
+int cmd_epoll2(int argc, char **argv)
+{
+   struct epoll_event ev, evs[2];
+   int pipefd[2], wstatus;
+   int epfd, rc;
+   pid_t childpid;
+
+   DEVSHELL_CMD_ASSERT(pipe(pipefd) == 0);
+
+   epfd = epoll_create(1);
+   DEVSHELL_CMD_ASSERT(epfd >= 0);
+
+   ev = (struct epoll_event) { .events = EPOLLIN, .data.u32 = 1234 };
+   DEVSHELL_CMD_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev) == 0);
+
+   printf(STR_PARENT "epoll_wait() with 50ms timeout\n");
+   DEVSHELL_CMD_ASSERT(epoll_wait_nointr(epfd, evs, 2, 50) == 0);
+
+   printf(STR_PARENT "fork()..\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      usleep(100 * 1000);
+      printf(STR_CHILD "write() on the pipe\n");
+      exit(write(pipefd[1], "x", 1) == 1 ? 0 : 1);
+   }
+
+   printf(STR_PARENT "epoll_wait() with 3s timeout\n");
+   rc = epoll_wait_nointr(epfd, evs, 2, 3000);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].events == EPOLLIN);
+   DEVSHELL_CMD_ASSERT(evs[0].data.u32 == 1234);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   close(pipefd[0]);
+   close(pipefd[1]);
+   close(epfd);
+   return 0;
+}
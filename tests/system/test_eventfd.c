@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/eventfd.h>
+
+#include "devshell.h"
+
+/* Counter and semaphore modes, non-blocking reads and writes, poll() */
+int cmd_eventfd1(int argc, char **argv)
+{
+   struct pollfd pfd;
+   uint64_t val;
+   uint32_t small;
+   int efd, rc;
+
+   efd = eventfd(3, EFD_NONBLOCK | EFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+   DEVSHELL_CMD_ASSERT(fcntl(efd, F_GETFD) == FD_CLOEXEC);
+
+   /* Error cases */
+   rc = read(efd, &small, sizeof(small));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   val = UINT64_MAX;
+   rc = write(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   /* read() returns the whole counter and resets it */
+   DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 3);
+
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   pfd = (struct pollfd) { .fd = efd, .events = POLLIN | POLLOUT };
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 0) == 1);
+   DEVSHELL_CMD_ASSERT(pfd.revents == POLLOUT);
+
+   val = 2;
+   DEVSHELL_CMD_ASSERT(write(efd, &val, sizeof(val)) == sizeof(val));
+   val = 5;
+   DEVSHELL_CMD_ASSERT(write(efd, &val, sizeof(val)) == sizeof(val));
+
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 0) == 1);
+   DEVSHELL_CMD_ASSERT(pfd.revents == (POLLIN | POLLOUT));
+
+   /* The counter would overflow */
+   val = UINT64_MAX - 1;
+   rc = write(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 7);
+   close(efd);
+
+   /* Semaphore mode: each read() decrements the counter by 1 */
+   efd = eventfd(2, EFD_SEMAPHORE | EFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   for (int i = 0; i < 2; i++) {
+      DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+      DEVSHELL_CMD_ASSERT(val == 1);
+   }
+
+   rc = read(efd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+   close(efd);
+
+   rc = eventfd(0, 0x1234);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+   return 0;
+}
+
+/* A child wakes up the parent, blocked in select() and then in read() */
+int cmd_eventfd2(int argc, char **argv)
+{
+   struct timeval tv = { .tv_sec = 3 };
+   int efd, rc, wstatus;
+   pid_t childpid;
+   uint64_t val;
+   fd_set rfds;
+
+   efd = eventfd(0, 0);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   printf(STR_PARENT "fork()..\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+
+      val = 1;
+
+      for (int i = 0; i < 2; i++) {
+
+         usleep(100 * 1000);
+         printf(STR_CHILD "write() on the eventfd\n");
+
+         if (write(efd, &val, sizeof(val)) != sizeof(val))
+            exit(1);
+      }
+
+      exit(0);
+   }
+
+   FD_ZERO(&rfds);
+   FD_SET(efd, &rfds);
+
+   printf(STR_PARENT "select() with 3s timeout\n");
+   rc = select(efd + 1, &rfds, NULL, NULL, &tv);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(FD_ISSET(efd, &rfds));
+
+   DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 1);
+
+   printf(STR_PARENT "blocking read()\n");
+   DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 1);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   close(efd);
+   return 0;
+}
@@ -240,6 +240,125 @@ int cmd_fork1(int argc, char **argv)
    return 0;
 }
 
+static void cow_sync_wait(int fd)
+{
+   char c;
+   int rc = read(fd, &c, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+}
+
+static void cow_sync_signal(int fd)
+{
+   int rc = write(fd, "x", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+}
+
+/*
+ * Check that, after fork(), the parent and the child never see each other's
+ * writes, both when they touch pages in the same 4 MB region (sharing a page
+ * table) and in different ones, and that unmapping a range or exiting on one
+ * side leaves the other side's memory intact.
+ */
+int cmd_fork_cow(int argc, char **argv)
+{
+   int rc, pid, wstatus, p2c[2], c2p[2];
+   char *buf, *a0, *a1, *b0, *c0;
+
+   buf = mmap(NULL,
+              16 * MB,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1,
+              0);
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+
+   /* Three consecutive 4 MB regions: A, B and C */
+   a0 = (char *)(((unsigned long)buf + 4 * MB - 1) & ~(4 * MB - 1));
+   a1 = a0 + 2 * MB;
+   b0 = a0 + 4 * MB;
+   c0 = a0 + 8 * MB;
+
+   /* A and B contain actual data, C is still mapped to the zero page */
+   strcpy(a0, "parent-a0");
+   strcpy(a1, "parent-a1");
+   strcpy(b0, "parent-b0");
+
+   DEVSHELL_CMD_ASSERT(pipe(p2c) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(c2p) == 0);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+
+      strcpy(a0, "child-a0");
+      strcpy(b0, "child-b0");
+      cow_sync_signal(c2p[1]);
+
+      /* The parent wrote to a1 and c0, in its own copies */
+      cow_sync_wait(p2c[0]);
+      DEVSHELL_CMD_ASSERT(!strcmp(a0, "child-a0"));
+      DEVSHELL_CMD_ASSERT(!strcmp(a1, "parent-a1"));
+      DEVSHELL_CMD_ASSERT(!strcmp(b0, "child-b0"));
+      DEVSHELL_CMD_ASSERT(c0[0] == 0);
+
+      /* Unmap the whole region B and the first half of A */
+      DEVSHELL_CMD_ASSERT(munmap(b0, 4 * MB) == 0);
+      DEVSHELL_CMD_ASSERT(munmap(a0, 2 * MB) == 0);
+      cow_sync_signal(c2p[1]);
+
+      /* The parent unmapped the region C */
+      cow_sync_wait(p2c[0]);
+      DEVSHELL_CMD_ASSERT(!strcmp(a1, "parent-a1"));
+      DEVSHELL_CMD_ASSERT(c0[0] == 0);
+      strcpy(c0, "child-c0");
+      exit(0);
+   }
+
+   cow_sync_wait(c2p[0]);
+   DEVSHELL_CMD_ASSERT(!strcmp(a0, "parent-a0"));
+   DEVSHELL_CMD_ASSERT(!strcmp(a1, "parent-a1"));
+   DEVSHELL_CMD_ASSERT(!strcmp(b0, "parent-b0"));
+
+   strcpy(a1, "parent2-a1");
+   strcpy(c0, "parent-c0");
+   cow_sync_signal(p2c[1]);
+
+   /* The child unmapped B and half of A */
+   cow_sync_wait(c2p[0]);
+   DEVSHELL_CMD_ASSERT(!strcmp(a0, "parent-a0"));
+   DEVSHELL_CMD_ASSERT(!strcmp(a1, "parent2-a1"));
+   DEVSHELL_CMD_ASSERT(!strcmp(b0, "parent-b0"));
+   DEVSHELL_CMD_ASSERT(!strcmp(c0, "parent-c0"));
+
+   DEVSHELL_CMD_ASSERT(munmap(c0, 4 * MB) == 0);
+   strcpy(a1, "parent3-a1");
+   cow_sync_signal(p2c[1]);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+
+   /* The child has exited: our memory must be still intact */
+   DEVSHELL_CMD_ASSERT(!strcmp(a0, "parent-a0"));
+   DEVSHELL_CMD_ASSERT(!strcmp(a1, "parent3-a1"));
+   DEVSHELL_CMD_ASSERT(!strcmp(b0, "parent-b0"));
+
+   close(p2c[0]);
+   close(p2c[1]);
+   close(c2p[0]);
+   close(c2p[1]);
+
+   /* C is already unmapped and, after it, there's always something left */
+   rc = munmap(buf, (size_t)(c0 - buf));
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(c0 + 4 * MB, (size_t)(buf + 16 * MB - (c0 + 4 * MB)));
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
 int cmd_vfork0(int argc, char **argv)
 {
    static const char child_hello[] = "Hello from the child!!";
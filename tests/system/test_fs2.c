@@ -398,8 +398,7 @@ int cmd_fmmap5(int argc, char **argv)
 
    /*
     * This memory write will trigger a page-fault and the kernel should allocate
-    * on-the-fly the page (ramfs_block) for us and, ultimately, resume the
-    * write.
+    * on-the-fly the page for us and, ultimately, resume the write.
     */
    strcpy(vaddr + page_size, test_str2);
    close(fd);
@@ -575,3 +574,112 @@ int cmd_fmmap7(int argc, char **argv)
    unlink(test_file);
    return rc;
 }
+
+static void fmmap8_check_page(const char *vaddr, char exp, const char *what)
+{
+   const size_t page_size = getpagesize();
+
+   for (size_t i = 0; i < page_size; i++) {
+      if (vaddr[i] != exp) {
+         fprintf(stderr, "%s: got '%c' instead of '%c' at offset %zu\n",
+                 what, vaddr[i], exp, i);
+         DEVSHELL_CMD_ASSERT(false);
+      }
+   }
+}
+
+/* MAP_PRIVATE, MAP_POPULATE and user copies on not-yet-faulted pages */
+int cmd_fmmap8(int argc, char **argv)
+{
+   int fd, rc, pipefd[2];
+   char *vaddr, *vaddr2;
+   char buf[64];
+   char *page_size_buf;
+   const size_t page_size = getpagesize();
+   const size_t sparse_size = 64 * 1024 * 1024;
+
+   printf("Using '%s' as test file\n", test_file);
+   fd = open(test_file, O_CREAT | O_RDWR, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   page_size_buf = malloc(page_size);
+   DEVSHELL_CMD_ASSERT(page_size_buf != NULL);
+
+   for (int i = 0; i < 4; i++) {
+      memset(page_size_buf, 'A'+i, page_size);
+      rc = write(fd, page_size_buf, page_size);
+      DEVSHELL_CMD_ASSERT(rc == page_size);
+   }
+
+   printf("- Write to a private mapping\n");
+   vaddr = mmap(NULL, 4 * page_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   fmmap8_check_page(vaddr + page_size, 'B', "private mapping");
+   memset(vaddr + page_size, 'x', page_size);
+   fmmap8_check_page(vaddr + page_size, 'x', "private mapping");
+
+   printf("- Check that the file did not change\n");
+   rc = lseek(fd, page_size, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == page_size);
+   rc = read(fd, page_size_buf, page_size);
+   DEVSHELL_CMD_ASSERT(rc == page_size);
+   fmmap8_check_page(page_size_buf, 'B', "file after private write");
+
+   printf("- read() into a page of the mapping never touched before\n");
+   rc = lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = read(fd, vaddr + 2 * page_size, page_size);
+   DEVSHELL_CMD_ASSERT(rc == page_size);
+   fmmap8_check_page(vaddr + 2 * page_size, 'A', "read() into the mapping");
+
+   rc = munmap(vaddr, 4 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("- Populated shared mapping\n");
+   vaddr = mmap(NULL, 4 * page_size, PROT_READ,
+                MAP_SHARED | MAP_POPULATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   for (int i = 0; i < 4; i++)
+      fmmap8_check_page(vaddr + i * page_size, 'A'+i, "populated mapping");
+
+   printf("- write() from a page of a shared mapping never touched before\n");
+   vaddr2 = mmap(NULL, 4 * page_size, PROT_READ, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr2 != (void *)-1);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = write(pipefd[1], vaddr2 + 3 * page_size, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(buf));
+   rc = read(pipefd[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(buf));
+   DEVSHELL_CMD_ASSERT(buf[0] == 'D' && buf[sizeof(buf) - 1] == 'D');
+   close(pipefd[0]);
+   close(pipefd[1]);
+
+   printf("- Large sparse private mapping\n");
+   rc = ftruncate(fd, sparse_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   vaddr = mmap(NULL, sparse_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   DEVSHELL_CMD_ASSERT(vaddr[0] == 'A');
+   DEVSHELL_CMD_ASSERT(vaddr[sparse_size / 2] == 0);
+   vaddr[sparse_size - 1] = 'z';
+   DEVSHELL_CMD_ASSERT(vaddr[sparse_size - 1] == 'z');
+
+   rc = lseek(fd, -1, SEEK_END);
+   DEVSHELL_CMD_ASSERT(rc == sparse_size - 1);
+   rc = read(fd, buf, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1 && buf[0] == 0);
+
+   free(page_size_buf);
+   close(fd);
+   rc = unlink(test_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
@@ -14,6 +14,8 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -109,3 +111,221 @@ int cmd_fs_perf2(int argc, char **argv)
    DEVSHELL_CMD_ASSERT(rc == 0);
    return 0;
 }
+
+static u64
+fs_perf3_read_file(int fd, char *buf, size_t chunk, size_t file_size)
+{
+   u64 start, end;
+   size_t tot = 0;
+   int rc;
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   start = RDTSC();
+
+   while (tot < file_size) {
+      rc = read(fd, buf + tot, chunk);
+      DEVSHELL_CMD_ASSERT(rc == (int)MIN(chunk, file_size - tot));
+      tot += (size_t)rc;
+   }
+
+   end = RDTSC();
+   DEVSHELL_CMD_ASSERT(read(fd, buf, chunk) == 0);
+   return (end - start) / (file_size / KB);
+}
+
+/*
+ * Large-file throughput: write and read a big file with big and small
+ * requests. Reads and writes of any size must be served entirely by a single
+ * syscall on regular files.
+ */
+int cmd_fs_perf3(int argc, char **argv)
+{
+   const size_t file_size = 4 * MB;
+   const size_t big_chunk = 1 * MB;
+   const char *dest_dir = argc > 0 ? argv[0] : "/tmp";
+   char *wbuf, *rbuf;
+   u64 start, end;
+   char path[256];
+   struct iovec iov[2];
+   int fd, rc;
+
+   printf("Using '%s' as test dir\n", dest_dir);
+   sprintf(path, "%s/test_file", dest_dir);
+
+   wbuf = malloc(file_size);
+   rbuf = malloc(file_size);
+   DEVSHELL_CMD_ASSERT(wbuf != NULL && rbuf != NULL);
+
+   for (size_t i = 0; i < file_size; i++)
+      wbuf[i] = (char)('a' + (i * 7 + i / 4096) % 26);
+
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   start = RDTSC();
+
+   for (size_t off = 0; off < file_size; off += big_chunk) {
+      rc = write(fd, wbuf + off, big_chunk);
+      DEVSHELL_CMD_ASSERT(rc == (int)big_chunk);
+   }
+
+   end = RDTSC();
+   printf("write(), 1 MB chunks: %6llu cycles/KB\n",
+          (end - start) / (file_size / KB));
+
+   printf("read(),  4 KB chunks: %6llu cycles/KB\n",
+          fs_perf3_read_file(fd, rbuf, 4 * KB, file_size));
+   DEVSHELL_CMD_ASSERT(memcmp(rbuf, wbuf, file_size) == 0);
+
+   memset(rbuf, 0, file_size);
+   printf("read(),  1 MB chunks: %6llu cycles/KB\n",
+          fs_perf3_read_file(fd, rbuf, big_chunk, file_size));
+   DEVSHELL_CMD_ASSERT(memcmp(rbuf, wbuf, file_size) == 0);
+
+   memset(rbuf, 0, file_size);
+   printf("read(),  4 MB chunk:  %6llu cycles/KB\n",
+          fs_perf3_read_file(fd, rbuf, file_size, file_size));
+   DEVSHELL_CMD_ASSERT(memcmp(rbuf, wbuf, file_size) == 0);
+
+   /* readv() with two big buffers */
+   memset(rbuf, 0, file_size);
+   iov[0] = (struct iovec) { .iov_base = rbuf, .iov_len = file_size / 2 };
+   iov[1] = (struct iovec) {
+      .iov_base = rbuf + file_size / 2,
+      .iov_len = file_size / 2,
+   };
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   start = RDTSC();
+   rc = readv(fd, iov, 2);
+   end = RDTSC();
+
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   DEVSHELL_CMD_ASSERT(memcmp(rbuf, wbuf, file_size) == 0);
+   printf("readv(), 2 x 2 MB:    %6llu cycles/KB\n",
+          (end - start) / (file_size / KB));
+
+   close(fd);
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(rbuf);
+   free(wbuf);
+   return 0;
+}
+
+static void
+fs_perf4_check_file(const char *path, const char *data, char *buf, size_t len)
+{
+   int fd, rc;
+
+   fd = open(path, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   memset(buf, 0, len);
+   rc = read(fd, buf, len);
+   DEVSHELL_CMD_ASSERT(rc == (int)len);
+   DEVSHELL_CMD_ASSERT(memcmp(buf, data, len) == 0);
+   close(fd);
+}
+
+/* In-kernel file copies: sendfile() and copy_file_range() */
+int cmd_fs_perf4(int argc, char **argv)
+{
+   const size_t file_size = 4 * MB;
+   const size_t chunk = 64 * KB;
+   const char *dest_dir = argc > 0 ? argv[0] : "/tmp";
+   char src_path[256], dst_path[256];
+   char *data, *buf;
+   u64 start, end;
+   int src, dst, rc;
+   long long off;
+
+   printf("Using '%s' as test dir\n", dest_dir);
+   sprintf(src_path, "%s/test_src", dest_dir);
+   sprintf(dst_path, "%s/test_dst", dest_dir);
+
+   data = malloc(file_size);
+   buf = malloc(file_size);
+   DEVSHELL_CMD_ASSERT(data != NULL && buf != NULL);
+
+   for (size_t i = 0; i < file_size; i++)
+      data[i] = (char)('a' + (i * 7 + i / 4096) % 26);
+
+   src = open(src_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(src > 0);
+
+   rc = write(src, data, file_size);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+
+   /* Baseline: read() + write() through a user buffer */
+   dst = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(dst > 0);
+   lseek(src, 0, SEEK_SET);
+
+   start = RDTSC();
+
+   for (size_t tot = 0; tot < file_size; tot += chunk) {
+      rc = read(src, buf, chunk);
+      DEVSHELL_CMD_ASSERT(rc == (int)chunk);
+      rc = write(dst, buf, chunk);
+      DEVSHELL_CMD_ASSERT(rc == (int)chunk);
+   }
+
+   end = RDTSC();
+   close(dst);
+   printf("read() + write():  %6llu cycles/KB\n",
+          (end - start) / (file_size / KB));
+   fs_perf4_check_file(dst_path, data, buf, file_size);
+
+   /* sendfile(), using the file position of the source */
+   dst = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(dst > 0);
+   lseek(src, 0, SEEK_SET);
+
+   start = RDTSC();
+   rc = sendfile(dst, src, NULL, file_size);
+   end = RDTSC();
+
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   DEVSHELL_CMD_ASSERT(lseek(src, 0, SEEK_CUR) == (off_t)file_size);
+   close(dst);
+   printf("sendfile():        %6llu cycles/KB\n",
+          (end - start) / (file_size / KB));
+   fs_perf4_check_file(dst_path, data, buf, file_size);
+
+   /* copy_file_range(), with an explicit source offset */
+   dst = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(dst > 0);
+   off = 0;
+
+   start = RDTSC();
+   rc = syscall(SYS_copy_file_range, src, &off, dst, NULL, file_size, 0);
+   end = RDTSC();
+
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   DEVSHELL_CMD_ASSERT(off == (long long)file_size);
+   printf("copy_file_range(): %6llu cycles/KB\n",
+          (end - start) / (file_size / KB));
+
+   /* The copy must not be affected by writes to the source */
+   lseek(src, 10, SEEK_SET);
+   rc = write(src, "XYZ", 3);
+   DEVSHELL_CMD_ASSERT(rc == 3);
+   close(dst);
+   fs_perf4_check_file(dst_path, data, buf, file_size);
+
+   close(src);
+   rc = unlink(src_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = unlink(dst_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(buf);
+   free(data);
+   return 0;
+}
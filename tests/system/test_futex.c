@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "devshell.h"
+
+static long
+futex(uint32_t *uaddr, int op, uint32_t val,
+      const struct timespec *timeout, uint32_t *uaddr2, uint32_t val3)
+{
+   return syscall(SYS_futex, uaddr, op, val, timeout, uaddr2, val3);
+}
+
+/* Non-blocking cases: value mismatch, timeouts, WAKE_OP and error cases */
+int cmd_futex1(int argc, char **argv)
+{
+   static uint32_t f1 = 0, f2[2] = {0};
+   struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000 };
+   long rc;
+
+   /* The value is different: no wait */
+   rc = futex(&f1, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   printf("futex(FUTEX_WAIT) with 50ms timeout\n");
+   rc = futex(&f1, FUTEX_WAIT_PRIVATE, 0, &ts, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ETIMEDOUT);
+
+   rc = futex(&f1, FUTEX_WAIT, 0, &ts, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ETIMEDOUT);
+
+   /* Absolute timeout in the past */
+   ts = (struct timespec) { 0 };
+   rc = futex(&f1, FUTEX_WAIT_BITSET_PRIVATE, 0, &ts, NULL, 1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ETIMEDOUT);
+
+   /* Nobody is waiting */
+   DEVSHELL_CMD_ASSERT(futex(&f1, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0) == 0);
+
+   /* Error cases */
+   rc = futex((void *)((char *)f2 + 1), FUTEX_WAKE, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = futex(&f1, FUTEX_WAIT_BITSET, 0, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = futex(&f1, FUTEX_CMP_REQUEUE, 1, NULL, &f2[0], 1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* f2[0] += 5, nobody to wake up */
+   rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 1, (void *)1, &f2[0],
+              FUTEX_OP(FUTEX_OP_ADD, 5, FUTEX_OP_CMP_EQ, 0));
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(f2[0] == 5);
+
+   /* f2[0] |= 1 << 4 */
+   rc = futex(&f1, FUTEX_WAKE_OP_PRIVATE, 1, (void *)1, &f2[0],
+              FUTEX_OP((FUTEX_OP_OR | FUTEX_OP_OPARG_SHIFT),
+                       4, FUTEX_OP_CMP_GT, 0));
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(f2[0] == (5 | 16));
+   return 0;
+}
+
+/*
+ * A child waits on a futex in a MAP_SHARED file mapping, while the parent
+ * wakes it up: the two processes share the futex because they share the
+ * physical page, even if the key is computed in different address spaces.
+ */
+int cmd_futex2(int argc, char **argv)
+{
+   static const char *test_file = "/tmp/futex_test";
+   const size_t page_size = getpagesize();
+   volatile uint32_t *f;
+   int fd, wstatus;
+   pid_t childpid;
+   long rc;
+
+   fd = open(test_file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(ftruncate(fd, page_size) == 0);
+
+   f = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(f != (void *)-1);
+   close(fd);
+
+   *f = 0;
+
+   printf(STR_PARENT "fork()..\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+
+      printf(STR_CHILD "futex(FUTEX_WAIT)\n");
+
+      while (*f == 0) {
+
+         rc = futex((uint32_t *)f, FUTEX_WAIT, 0, NULL, NULL, 0);
+
+         if (rc < 0 && errno != EAGAIN && errno != EINTR) {
+            perror("futex");
+            exit(1);
+         }
+      }
+
+      printf(STR_CHILD "woken up, value: %u\n", *f);
+      exit(*f == 1 ? 0 : 1);
+   }
+
+   usleep(100 * 1000);
+
+   printf(STR_PARENT "set the value and futex(FUTEX_WAKE)\n");
+   *f = 1;
+   rc = futex((uint32_t *)f, FUTEX_WAKE, 1, NULL, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0 || rc == 1);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   munmap((void *)f, page_size);
+   unlink(test_file);
+   return 0;
+}
@@ -0,0 +1,486 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+
+#include "devshell.h"
+
+#ifndef SYS_io_uring_setup
+   #define SYS_io_uring_setup                     425
+   #define SYS_io_uring_enter                     426
+   #define SYS_io_uring_register                  427
+#endif
+
+/*
+ * The kernel headers of the toolchain predate io_uring: define here the subset
+ * of the interface we need, with the same layout and values as on Linux.
+ */
+
+struct io_uring_sqe {
+
+   uint8_t opcode;
+   uint8_t flags;
+   uint16_t ioprio;
+   int32_t fd;
+   uint64_t off;
+   uint64_t addr;
+   uint32_t len;
+   uint32_t op_flags;
+   uint64_t user_data;
+   uint64_t pad[3];
+};
+
+struct io_uring_cqe {
+
+   uint64_t user_data;
+   int32_t res;
+   uint32_t flags;
+};
+
+struct io_uring_params {
+
+   uint32_t sq_entries;
+   uint32_t cq_entries;
+   uint32_t flags;
+   uint32_t sq_thread_cpu;
+   uint32_t sq_thread_idle;
+   uint32_t features;
+   uint32_t wq_fd;
+   uint32_t resv[3];
+
+   struct {
+      uint32_t head, tail, ring_mask, ring_entries, flags, dropped, array;
+      uint32_t resv1;
+      uint64_t resv2;
+   } sq_off;
+
+   struct {
+      uint32_t head, tail, ring_mask, ring_entries, overflow, cqes, flags;
+      uint32_t resv1;
+      uint64_t resv2;
+   } cq_off;
+};
+
+struct k_timespec {
+   int64_t tv_sec;
+   int64_t tv_nsec;
+};
+
+#define IORING_OP_NOP                0
+#define IORING_OP_READV              1
+#define IORING_OP_WRITEV             2
+#define IORING_OP_FSYNC              3
+#define IORING_OP_POLL_ADD           6
+#define IORING_OP_TIMEOUT           11
+#define IORING_OP_OPENAT            18
+#define IORING_OP_CLOSE             19
+#define IORING_OP_READ              22
+#define IORING_OP_WRITE             23
+
+#define IORING_OFF_SQ_RING           0
+#define IORING_OFF_SQES              0x10000000
+#define IORING_ENTER_GETEVENTS       (1u << 0)
+#define IORING_SETUP_CQSIZE          (1u << 3)
+#define IORING_FEAT_SINGLE_MMAP      (1u << 0)
+#define IORING_FEAT_NODROP           (1u << 1)
+#define IORING_REGISTER_EVENTFD      4
+#define IORING_UNREGISTER_EVENTFD    5
+
+struct ring {
+
+   int fd;
+   uint32_t tail;                /* local SQ tail, published by ring_submit() */
+   uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+   uint32_t *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+   void *rings;
+   size_t rings_size;
+   size_t sqes_size;
+};
+
+static int
+ring_enter(struct ring *r, unsigned to_submit, unsigned min_compl, unsigned fl)
+{
+   return (int)syscall(SYS_io_uring_enter,
+                       r->fd, to_submit, min_compl, fl, NULL, 0);
+}
+
+static int ring_init(struct ring *r, unsigned entries, struct io_uring_params *p)
+{
+   char *rp;
+
+   memset(r, 0, sizeof(*r));
+
+   if ((r->fd = (int)syscall(SYS_io_uring_setup, entries, p)) < 0)
+      return -1;
+
+   r->rings_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+   r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+
+   r->rings = mmap(NULL, r->rings_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+
+   if (r->rings == MAP_FAILED)
+      return -1;
+
+   r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+
+   if (r->sqes == MAP_FAILED)
+      return -1;
+
+   rp = r->rings;
+   r->sq_head = (void *)(rp + p->sq_off.head);
+   r->sq_tail = (void *)(rp + p->sq_off.tail);
+   r->sq_mask = (void *)(rp + p->sq_off.ring_mask);
+   r->sq_array = (void *)(rp + p->sq_off.array);
+   r->cq_head = (void *)(rp + p->cq_off.head);
+   r->cq_tail = (void *)(rp + p->cq_off.tail);
+   r->cq_mask = (void *)(rp + p->cq_off.ring_mask);
+   r->cqes = (void *)(rp + p->cq_off.cqes);
+   r->tail = *r->sq_tail;
+   return 0;
+}
+
+static void ring_destroy(struct ring *r)
+{
+   munmap(r->sqes, r->sqes_size);
+   munmap(r->rings, r->rings_size);
+   close(r->fd);
+}
+
+static struct io_uring_sqe *
+ring_get_sqe(struct ring *r, int op, int fd, uint64_t user_data)
+{
+   const uint32_t idx = r->tail & *r->sq_mask;
+   struct io_uring_sqe *sqe = &r->sqes[idx];
+
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode = (uint8_t)op;
+   sqe->fd = fd;
+   sqe->user_data = user_data;
+
+   r->sq_array[idx] = idx;
+   r->tail++;
+   return sqe;
+}
+
+/* Publish the SQEs prepared with ring_get_sqe() and submit them */
+static int ring_submit(struct ring *r, unsigned wait_nr)
+{
+   const unsigned n = r->tail - *r->sq_tail;
+
+   __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+   return ring_enter(r, n, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+static unsigned ring_cq_ready(struct ring *r)
+{
+   return __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) - *r->cq_head;
+}
+
+/* Get the next CQE, waiting for it if necessary */
+static int ring_wait_cqe(struct ring *r, struct io_uring_cqe *cqe)
+{
+   const uint32_t head = *r->cq_head;
+   int rc;
+
+   if (!ring_cq_ready(r))
+      if ((rc = ring_enter(r, 0, 1, IORING_ENTER_GETEVENTS)) < 0)
+         return rc;
+
+   *cqe = r->cqes[head & *r->cq_mask];
+   __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+   return 0;
+}
+
+/* NOPs, positional and vectored reads/writes, openat(), close() and fsync() */
+int cmd_io_uring1(int argc, char **argv)
+{
+   const char *path = "/tmp/io_uring_file";
+   struct io_uring_params p = {0};
+   struct io_uring_sqe *sqe;
+   struct io_uring_cqe cqe;
+   struct iovec iov[2];
+   char buf[32], buf2[32];
+   struct ring r;
+   int fd, fd2 = -1, rc;
+
+   /* Setup */
+   rc = (int)syscall(SYS_io_uring_setup, 0, &p);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   p.flags = IORING_SETUP_CQSIZE;
+   p.cq_entries = 2;
+   rc = (int)syscall(SYS_io_uring_setup, 4, &p);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   memset(&p, 0, sizeof(p));
+   DEVSHELL_CMD_ASSERT(ring_init(&r, 5, &p) == 0);
+   DEVSHELL_CMD_ASSERT(p.sq_entries == 8 && p.cq_entries == 16);
+   DEVSHELL_CMD_ASSERT(p.features & IORING_FEAT_NODROP);
+   DEVSHELL_CMD_ASSERT(p.features & IORING_FEAT_SINGLE_MMAP);
+   DEVSHELL_CMD_ASSERT(fcntl(r.fd, F_GETFD) == FD_CLOEXEC);
+
+   /* A batch of NOPs */
+   printf("Submit 3 NOPs\n");
+
+   for (int i = 0; i < 3; i++)
+      ring_get_sqe(&r, IORING_OP_NOP, -1, 100 + i);
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 0) == 3);
+   DEVSHELL_CMD_ASSERT(*r.sq_head == r.tail);
+   DEVSHELL_CMD_ASSERT(ring_cq_ready(&r) == 3);
+
+   for (int i = 0; i < 3; i++) {
+      DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+      DEVSHELL_CMD_ASSERT(cqe.user_data == (uint64_t)(100 + i) && cqe.res == 0);
+   }
+
+   /* Positional write and read, then vectored ones */
+   printf("write, read, writev, readv on %s\n", path);
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd >= 0);
+
+   sqe = ring_get_sqe(&r, IORING_OP_WRITE, fd, 1);
+   sqe->addr = (uintptr_t)"hello io_uring";
+   sqe->len = 14;
+   sqe->off = 0;
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 1) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 1 && cqe.res == 14);
+
+   memset(buf, 0, sizeof(buf));
+   sqe = ring_get_sqe(&r, IORING_OP_READ, fd, 2);
+   sqe->addr = (uintptr_t)buf;
+   sqe->len = sizeof(buf);
+   sqe->off = 6;
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 1) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 2 && cqe.res == 8);
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, "io_uring"));
+
+   /* The positional write did not move the file position */
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == 0);
+
+   iov[0] = (struct iovec) { .iov_base = "AB", .iov_len = 2 };
+   iov[1] = (struct iovec) { .iov_base = "CD", .iov_len = 2 };
+   sqe = ring_get_sqe(&r, IORING_OP_WRITEV, fd, 3);
+   sqe->addr = (uintptr_t)iov;
+   sqe->len = 2;
+   sqe->off = 14;
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 1) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 3 && cqe.res == 4);
+
+   memset(buf, 0, sizeof(buf));
+   memset(buf2, 0, sizeof(buf2));
+   iov[0] = (struct iovec) { .iov_base = buf, .iov_len = 6 };
+   iov[1] = (struct iovec) { .iov_base = buf2, .iov_len = sizeof(buf2) };
+   sqe = ring_get_sqe(&r, IORING_OP_READV, fd, 4);
+   sqe->addr = (uintptr_t)iov;
+   sqe->len = 2;
+   sqe->off = (uint64_t)-1; /* the current position */
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 1) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 4 && cqe.res == 18);
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, "hello "));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf2, "io_uringABCD"));
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == 18);
+
+   /* openat() and close(), plus fsync(), completed by the worker thread */
+   printf("openat, fsync, close\n");
+   sqe = ring_get_sqe(&r, IORING_OP_OPENAT, -100 /* AT_FDCWD */, 5);
+   sqe->addr = (uintptr_t)path;
+   sqe->op_flags = O_RDONLY;
+
+   ring_get_sqe(&r, IORING_OP_FSYNC, fd, 6);
+
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 2) == 2);
+
+   for (int i = 0; i < 2; i++) {
+
+      DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+
+      if (cqe.user_data == 5)
+         fd2 = cqe.res;
+      else
+         DEVSHELL_CMD_ASSERT(cqe.user_data == 6 && cqe.res == 0);
+   }
+
+   DEVSHELL_CMD_ASSERT(fd2 >= 0);
+   DEVSHELL_CMD_ASSERT(read(fd2, buf, 5) == 5);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, "hello", 5));
+
+   ring_get_sqe(&r, IORING_OP_CLOSE, fd2, 7);
+   ring_get_sqe(&r, IORING_OP_CLOSE, r.fd, 8);
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 2) == 2);
+
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 7 && cqe.res == 0);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 8 && cqe.res == -EBADF);
+
+   rc = fcntl(fd2, F_GETFD);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   /* Errors are reported in the CQEs */
+   ring_get_sqe(&r, IORING_OP_READ, 1234, 9);
+   ring_get_sqe(&r, 200, -1, 10);
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 2) == 2);
+
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 9 && cqe.res == -EBADF);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 10 && cqe.res == -EINVAL);
+
+   rc = (int)syscall(SYS_io_uring_enter, fd, 0, 0, 0, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EOPNOTSUPP);
+
+   close(fd);
+   unlink(path);
+   ring_destroy(&r);
+   return 0;
+}
+
+/* Poll requests, timeouts and the eventfd notifications */
+int cmd_io_uring2(int argc, char **argv)
+{
+   struct io_uring_params p = {0};
+   struct k_timespec ts = {0};
+   struct io_uring_sqe *sqe;
+   struct io_uring_cqe cqe;
+   struct pollfd pfd;
+   int pipefd[2], efd, rc, wstatus;
+   pid_t childpid;
+   uint64_t val;
+   struct ring r;
+
+   DEVSHELL_CMD_ASSERT(ring_init(&r, 4, &p) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(pipefd) == 0);
+
+   /* A poll request completed when a child writes to the pipe */
+   sqe = ring_get_sqe(&r, IORING_OP_POLL_ADD, pipefd[0], 1);
+   sqe->op_flags = POLLIN;
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 0) == 1);
+   DEVSHELL_CMD_ASSERT(ring_cq_ready(&r) == 0);
+
+   printf(STR_PARENT "fork()..\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+
+      usleep(50 * 1000);
+      printf(STR_CHILD "write() on the pipe\n");
+
+      if (write(pipefd[1], "x", 1) != 1)
+         exit(1);
+
+      exit(0);
+   }
+
+   /* The ring fd itself can be polled, waiting for completions */
+   printf(STR_PARENT "poll() on the ring fd\n");
+   pfd = (struct pollfd) { .fd = r.fd, .events = POLLIN };
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 3000) == 1);
+
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 1 && (cqe.res & POLLIN));
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* Already ready: completed immediately */
+   sqe = ring_get_sqe(&r, IORING_OP_POLL_ADD, pipefd[0], 2);
+   sqe->op_flags = POLLIN;
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 0) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 2 && (cqe.res & POLLIN));
+
+   /* A plain timeout */
+   printf("Timeout, 30 ms\n");
+   ts.tv_nsec = 30 * 1000000LL;
+   sqe = ring_get_sqe(&r, IORING_OP_TIMEOUT, -1, 3);
+   sqe->addr = (uintptr_t)&ts;
+   sqe->len = 1;
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 1) == 1);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 3 && cqe.res == -ETIME);
+
+   /* A timeout completed by another completion, before expiring */
+   ts.tv_sec = 3;
+   sqe = ring_get_sqe(&r, IORING_OP_TIMEOUT, -1, 4);
+   sqe->addr = (uintptr_t)&ts;
+   sqe->len = 1;
+   sqe->off = 1;
+   ring_get_sqe(&r, IORING_OP_NOP, -1, 5);
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 2) == 2);
+
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 5 && cqe.res == 0);
+   DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+   DEVSHELL_CMD_ASSERT(cqe.user_data == 4 && cqe.res == 0);
+
+   /* Notifications through an eventfd */
+   printf("Register an eventfd\n");
+   efd = eventfd(0, EFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(efd >= 0);
+
+   rc = (int)syscall(SYS_io_uring_register, r.fd,
+                     IORING_REGISTER_EVENTFD, &pipefd[0], 1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = (int)syscall(SYS_io_uring_register, r.fd,
+                     IORING_REGISTER_EVENTFD, &efd, 1);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   ring_get_sqe(&r, IORING_OP_NOP, -1, 6);
+   ring_get_sqe(&r, IORING_OP_NOP, -1, 7);
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 0) == 2);
+
+   /* Tilck signals the eventfd once per CQE, Linux might once per batch */
+   DEVSHELL_CMD_ASSERT(read(efd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val >= 1 && val <= 2);
+
+   for (int i = 0; i < 2; i++)
+      DEVSHELL_CMD_ASSERT(ring_wait_cqe(&r, &cqe) == 0);
+
+   rc = (int)syscall(SYS_io_uring_register, r.fd,
+                     IORING_UNREGISTER_EVENTFD, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = (int)syscall(SYS_io_uring_register, r.fd,
+                     IORING_UNREGISTER_EVENTFD, NULL, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENXIO);
+
+   /* Closing the ring with a request in-flight cancels it */
+   sqe = ring_get_sqe(&r, IORING_OP_POLL_ADD, pipefd[1], 8);
+   sqe->op_flags = POLLIN;
+   DEVSHELL_CMD_ASSERT(ring_submit(&r, 0) == 1);
+
+   close(efd);
+   close(pipefd[0]);
+   close(pipefd[1]);
+   ring_destroy(&r);
+   return 0;
+}
@@ -8,12 +8,14 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <time.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -273,6 +275,70 @@ int cmd_cloexec(int argc, char **argv)
    return WEXITSTATUS(wstatus);
 }
 
+static void nice1_child(void)
+{
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == 0);
+
+   rc = nice(5);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == 5);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, getpid()) == 5);
+
+   /* The nice value is clamped in the [-20, 19] range */
+   rc = nice(100);
+   DEVSHELL_CMD_ASSERT(rc == 19);
+
+   rc = setpriority(PRIO_PROCESS, 0, -5);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == -5);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PGRP, 0) <= -5);
+
+   rc = setpriority(PRIO_PROCESS, 0, -100);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == -20);
+
+   /* Lots of yields with the highest priority must not starve anybody */
+   for (int i = 0; i < 100; i++)
+      sched_yield();
+
+   errno = 0;
+   rc = getpriority(PRIO_PROCESS, 123456);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ESRCH);
+
+   errno = 0;
+   rc = setpriority(1234, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   exit(0);
+}
+
+int cmd_nice1(int argc, char **argv)
+{
+   int wstatus;
+   int child_pid = fork();
+
+   if (child_pid < 0) {
+      printf("fork() failed\n");
+      return 1;
+   }
+
+   if (!child_pid)
+      nice1_child();
+
+   waitpid(child_pid, &wstatus, 0);
+
+   if (!WIFEXITED(wstatus)) {
+      printf("Test child killed by signal: %s\n", strsignal(WTERMSIG(wstatus)));
+      return 1;
+   }
+
+   /* The child's nice value must not affect the parent */
+   DEVSHELL_CMD_ASSERT(getpriority(PRIO_PROCESS, 0) == 0);
+   return WEXITSTATUS(wstatus);
+}
+
 /* Test scripts testing EXTRA components running on Tilck */
 
 static const char *extra_test_scripts[] = {
@@ -7,14 +7,20 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+#include <linux/kd.h>
 
 #include "devshell.h"
 #include "sysenter.h"
+#include "test_common.h"
 
 int cmd_brk(int argc, char **argv)
 {
@@ -49,6 +55,316 @@ int cmd_brk(int argc, char **argv)
    return 0;
 }
 
+static void get_self_rusage(struct rusage *ru)
+{
+   int rc = getrusage(RUSAGE_SELF, ru);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+}
+
+/*
+ * Check that anonymous memory is allocated on demand: reading it must neither
+ * allocate anything nor return anything but zeros, while writing to it must
+ * trigger minor faults and raise the peak RSS.
+ */
+static void check_demand_paging(char *buf, size_t size)
+{
+   const size_t touched = size / 2;
+   struct rusage ru0, ru1, ru2;
+
+   /* Write both the structs, before measuring anything */
+   get_self_rusage(&ru1);
+   get_self_rusage(&ru2);
+   get_self_rusage(&ru0);
+
+   for (size_t off = 0; off < size; off += 4096)
+      DEVSHELL_CMD_ASSERT(buf[off] == 0 && buf[off + 4095] == 0);
+
+   get_self_rusage(&ru1);
+   DEVSHELL_CMD_ASSERT(ru1.ru_maxrss == ru0.ru_maxrss);
+
+   for (size_t off = 0; off < touched; off += 4096)
+      buf[off] = 1;
+
+   get_self_rusage(&ru2);
+   DEVSHELL_CMD_ASSERT(ru2.ru_minflt > ru1.ru_minflt);
+   DEVSHELL_CMD_ASSERT(ru2.ru_maxrss - ru1.ru_maxrss >= (long)(touched / KB));
+
+   for (size_t off = 0; off < size; off += 4096) {
+      DEVSHELL_CMD_ASSERT(buf[off] == (off < touched));
+      DEVSHELL_CMD_ASSERT(buf[off + 1] == 0);
+   }
+}
+
+int cmd_brk2(int argc, char **argv)
+{
+   const size_t size = 8 * MB;
+   void *orig_brk = (void *)syscall(SYS_brk, 0);
+   void *b;
+
+   if (!running_on_tilck()) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   b = (void *)syscall(SYS_brk, orig_brk + size);
+   DEVSHELL_CMD_ASSERT(b == orig_brk + size);
+   check_demand_paging(orig_brk, size);
+
+   b = (void *)syscall(SYS_brk, orig_brk);
+   DEVSHELL_CMD_ASSERT(b == orig_brk);
+   return 0;
+}
+
+int cmd_mmap3(int argc, char **argv)
+{
+   const size_t size = 8 * MB;
+   int rc;
+
+   if (!running_on_tilck()) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   char *buf = mmap(NULL,
+                    size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE,
+                    -1,
+                    0);
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+   check_demand_paging(buf, size);
+
+   rc = munmap(buf, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+static void fill_big_page(char *buf)
+{
+   for (size_t off = 0; off < 4 * MB; off += 4096)
+      buf[off] = (char)(off >> 12);
+}
+
+static bool check_big_page(const char *buf, size_t from, size_t to)
+{
+   for (size_t off = from; off < to; off += 4096)
+      if (buf[off] != (char)(off >> 12))
+         return false;
+
+   return true;
+}
+
+/*
+ * After fork(), the big page is COW: on the child's first write, it must get
+ * split and only the written 4 KB page copied, so each further write to
+ * another page of the range has to cause its own fault.
+ */
+static void hugetlb_fork_child(char *buf)
+{
+   struct rusage ru0, ru1, ru2;
+
+   /* Our stack is COW as well: write the structs before measuring anything */
+   get_self_rusage(&ru1);
+   get_self_rusage(&ru2);
+   get_self_rusage(&ru0);
+
+   buf[10 * 4096] = 'c';
+   get_self_rusage(&ru1);
+   DEVSHELL_CMD_ASSERT(ru1.ru_minflt > ru0.ru_minflt);
+
+   buf[20 * 4096] = 'c';
+   get_self_rusage(&ru2);
+   DEVSHELL_CMD_ASSERT(ru2.ru_minflt > ru1.ru_minflt);
+
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 0, 10 * 4096));
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 11 * 4096, 20 * 4096));
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 21 * 4096, 4 * MB));
+   exit(0);
+}
+
+int cmd_hugetlb1(int argc, char **argv)
+{
+   const size_t size = 8 * MB;
+   struct rusage ru0, ru1, ru2;
+   int rc, pid, wstatus;
+   char *buf, *buf2;
+
+   if (!running_on_tilck()) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   buf = mmap(NULL,
+              size,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB,
+              -1,
+              0);
+
+   DEVSHELL_CMD_ASSERT(buf != (void *)-1);
+   DEVSHELL_CMD_ASSERT(((unsigned long)buf & (4 * MB - 1)) == 0);
+
+   buf2 = mmap(NULL,
+               size,
+               PROT_READ | PROT_WRITE,
+               MAP_ANONYMOUS | MAP_PRIVATE,
+               -1,
+               0);
+
+   DEVSHELL_CMD_ASSERT(buf2 != (void *)-1);
+
+   get_self_rusage(&ru1);
+   get_self_rusage(&ru2);
+   get_self_rusage(&ru0);
+
+   /* Without MAP_HUGETLB, a write allocates just one 4 KB page */
+   buf2[0] = 1;
+   get_self_rusage(&ru1);
+   DEVSHELL_CMD_ASSERT(ru1.ru_maxrss - ru0.ru_maxrss < 4 * MB / KB);
+
+   /* With it, the first write allocates the whole big page */
+   buf[0] = 1;
+   get_self_rusage(&ru2);
+
+   if (ru2.ru_maxrss - ru1.ru_maxrss < 4 * MB / KB) {
+      printf("No free 4 MB block: can't test the big pages\n");
+      munmap(buf2, size);
+      munmap(buf, size);
+      return 0;
+   }
+
+   /* Once the big page is there, writing to it doesn't cause any faults */
+   fill_big_page(buf);
+   get_self_rusage(&ru1);
+   DEVSHELL_CMD_ASSERT(ru1.ru_minflt == ru2.ru_minflt);
+
+   /* fork() with a big page: COW splitting */
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid)
+      hugetlb_fork_child(buf);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 0, 4 * MB));
+
+   /* The child is gone: we can write again to the big page */
+   buf[10 * 4096] = (char)10;
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 0, 4 * MB));
+
+   /* Partial munmap() of the big page */
+   rc = munmap(buf + 1 * MB, 1 * MB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 0, 1 * MB));
+   DEVSHELL_CMD_ASSERT(check_big_page(buf, 2 * MB, 4 * MB));
+
+   rc = test_sig(do_mm_read, buf + 1 * MB, SIGSEGV, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   buf[2 * MB] = 'x';
+   DEVSHELL_CMD_ASSERT(buf[2 * MB + 4096] == (char)((2 * MB + 4096) >> 12));
+
+   rc = munmap(buf, 1 * MB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(buf + 2 * MB, size - 2 * MB);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap(buf2, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
+/*
+ * Map the framebuffer twice (big pages, if it's large enough and its physical
+ * address is aligned), check that both the mappings see the same memory, also
+ * after fork() and after unmapping a part of one of them.
+ */
+int cmd_fbmmap1(int argc, char **argv)
+{
+   struct fb_fix_screeninfo fix;
+   volatile unsigned *m1, *m2;
+   unsigned saved[3];
+   size_t len, offs[3];
+   int fd, ttyfd, rc, pid, wstatus;
+
+   if ((fd = open("/dev/fb0", O_RDWR)) < 0) {
+      printf("No framebuffer: skipping the test\n");
+      return 0;
+   }
+
+   /* Don't let the console draw anything in the meanwhile (best-effort) */
+   if ((ttyfd = open("/dev/tty", O_RDWR)) >= 0)
+      ioctl(ttyfd, KDSETMODE, KD_GRAPHICS);
+
+   rc = ioctl(fd, FBIOGET_FSCREENINFO, &fix);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   len = fix.smem_len & ~(size_t)4095;
+   m1 = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(m1 != (void *)-1);
+   m2 = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   DEVSHELL_CMD_ASSERT(m2 != (void *)-1);
+
+   if (len >= 4 * MB && running_on_tilck()) {
+      DEVSHELL_CMD_ASSERT(((unsigned long)m1 & (4 * MB - 1)) == 0);
+      DEVSHELL_CMD_ASSERT(((unsigned long)m2 & (4 * MB - 1)) == 0);
+   }
+
+   offs[0] = 4096 / sizeof(unsigned);
+   offs[1] = len / 2 / sizeof(unsigned);
+   offs[2] = len / sizeof(unsigned) - 1;
+
+   for (int i = 0; i < 3; i++) {
+      saved[i] = m1[offs[i]];
+      m1[offs[i]] = 0xcafe0000 + (unsigned)i;
+      DEVSHELL_CMD_ASSERT(m2[offs[i]] == 0xcafe0000 + (unsigned)i);
+   }
+
+   /* The framebuffer is shared: the child's writes must reach the parent */
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+
+      for (int i = 0; i < 3; i++)
+         m2[offs[i]] = 0xbeef0000 + (unsigned)i;
+
+      exit(0);
+   }
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   for (int i = 0; i < 3; i++)
+      DEVSHELL_CMD_ASSERT(m1[offs[i]] == 0xbeef0000 + (unsigned)i);
+
+   /* Unmap the first page of m1: that splits its first big page, if any */
+   rc = munmap((void *)m1, 4096);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < 3; i++) {
+      m2[offs[i]] = saved[i];
+      DEVSHELL_CMD_ASSERT(m1[offs[i]] == saved[i]);
+   }
+
+   rc = munmap((void *)m1 + 4096, len - 4096);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = munmap((void *)m2, len);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   close(fd);
+
+   if (ttyfd >= 0) {
+      ioctl(ttyfd, KDSETMODE, KD_TEXT);
+      close(ttyfd);
+   }
+
+   return 0;
+}
+
 int cmd_mmap(int argc, char **argv)
 {
    const int iters_count = 10;
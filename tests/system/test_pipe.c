@@ -10,6 +10,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include "devshell.h"
 #include "test_common.h"
@@ -469,3 +471,93 @@ int cmd_pipe5(int argc, char **argv)
 
    return 0;
 }
+
+/* splice(), tee() and vmsplice() between files and pipes */
+int cmd_pipe6(int argc, char **argv)
+{
+   const char *src_path = "/tmp/splice_src";
+   const char *dst_path = "/tmp/splice_dst";
+   char data[3 * 4096], buf[4096];
+   struct iovec iov;
+   long long off, off2;
+   int p1[2], p2[2];
+   int src, dst, rc;
+
+   for (size_t i = 0; i < sizeof(data); i++)
+      data[i] = (char)('a' + (i * 7 + i / 4096) % 26);
+
+   src = open(src_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(src > 0);
+   dst = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(dst > 0);
+
+   rc = write(src, data, sizeof(data));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(data));
+
+   rc = pipe(p1);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = pipe(p2);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* file -> pipe, at an explicit offset */
+   off = 4096;
+   rc = syscall(SYS_splice, src, &off, p1[1], NULL, 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == 4096);
+   DEVSHELL_CMD_ASSERT(off == 2 * 4096);
+   DEVSHELL_CMD_ASSERT(lseek(src, 0, SEEK_CUR) == sizeof(data));
+
+   /* Duplicate the pipe's content into the other pipe */
+   rc = syscall(SYS_tee, p1[0], p2[1], 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == 4096);
+
+   rc = read(p2[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 4096);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, data + 4096, 4096));
+
+   /* pipe -> file, at an explicit offset: the data is still in p1 */
+   off2 = 100;
+   rc = syscall(SYS_splice, p1[0], NULL, dst, &off2, 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == 4096);
+   DEVSHELL_CMD_ASSERT(off2 == 100 + 4096);
+
+   rc = pread(dst, buf, sizeof(buf), 100);
+   DEVSHELL_CMD_ASSERT(rc == 4096);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, data + 4096, 4096));
+
+   /* vmsplice() on both the ends of a pipe */
+   iov = (struct iovec) { .iov_base = "hello", .iov_len = 5 };
+   rc = syscall(SYS_vmsplice, p1[1], &iov, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+
+   iov = (struct iovec) { .iov_base = buf, .iov_len = sizeof(buf) };
+   rc = syscall(SYS_vmsplice, p1[0], &iov, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == 5);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, "hello", 5));
+
+   /* Error cases */
+   rc = syscall(SYS_splice, src, NULL, dst, NULL, 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   off = 0;
+   rc = syscall(SYS_splice, p1[0], &off, dst, NULL, 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == ESPIPE);
+
+   rc = syscall(SYS_tee, p1[0], p1[1], 4096, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EINVAL);
+
+   rc = syscall(SYS_vmsplice, src, &iov, 1, 0);
+   DEVSHELL_CMD_ASSERT(rc == -1 && errno == EBADF);
+
+   close(p1[0]);
+   close(p1[1]);
+   close(p2[0]);
+   close(p2[1]);
+   close(src);
+   close(dst);
+
+   rc = unlink(src_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = unlink(dst_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+
+#include "devshell.h"
+
+/* Blocked signals read through a signalfd instead of being delivered */
+int cmd_signalfd1(int argc, char **argv)
+{
+   struct signalfd_siginfo si[2];
+   sigset_t set, old_set;
+   struct pollfd pfd;
+   pid_t childpid;
+   int sfd, rc;
+
+   sigemptyset(&set);
+   sigaddset(&set, SIGUSR1);
+   sigaddset(&set, SIGCHLD);
+
+   DEVSHELL_CMD_ASSERT(sigprocmask(SIG_BLOCK, &set, &old_set) == 0);
+
+   sfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(sfd >= 0);
+
+   rc = read(sfd, si, sizeof(si));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   rc = read(sfd, si, sizeof(si[0]) - 1);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   /* A signal sent to ourselves */
+   printf("kill(self, SIGUSR1)\n");
+   DEVSHELL_CMD_ASSERT(kill(getpid(), SIGUSR1) == 0);
+
+   pfd = (struct pollfd) { .fd = sfd, .events = POLLIN };
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 0) == 1);
+   DEVSHELL_CMD_ASSERT(pfd.revents == POLLIN);
+
+   DEVSHELL_CMD_ASSERT(read(sfd, si, sizeof(si)) == sizeof(si[0]));
+   DEVSHELL_CMD_ASSERT(si[0].ssi_signo == SIGUSR1);
+
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 0) == 0);
+
+   /* SIGCHLD, ignored by default, is still readable while blocked */
+   printf("Wait for SIGCHLD through the signalfd\n");
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      usleep(50 * 1000);
+      exit(0);
+   }
+
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 3000) == 1);
+   DEVSHELL_CMD_ASSERT(read(sfd, si, sizeof(si)) == sizeof(si[0]));
+   DEVSHELL_CMD_ASSERT(si[0].ssi_signo == SIGCHLD);
+   DEVSHELL_CMD_ASSERT(waitpid(childpid, NULL, 0) == childpid);
+
+   /* Change the mask of the existing signalfd */
+   sigemptyset(&set);
+   sigaddset(&set, SIGUSR1);
+   DEVSHELL_CMD_ASSERT(signalfd(sfd, &set, 0) == sfd);
+
+   DEVSHELL_CMD_ASSERT(kill(getpid(), SIGCHLD) == 0);
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 0) == 0);
+
+   close(sfd);
+   DEVSHELL_CMD_ASSERT(sigprocmask(SIG_SETMASK, &old_set, NULL) == 0);
+   return 0;
+}
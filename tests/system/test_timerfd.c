@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+
+#include "devshell.h"
+
+static void ms_to_timespec(int ms, struct timespec *ts)
+{
+   ts->tv_sec = ms / 1000;
+   ts->tv_nsec = (ms % 1000) * 1000000L;
+}
+
+/* One-shot, periodic and absolute timers on a timerfd */
+int cmd_timerfd1(int argc, char **argv)
+{
+   struct itimerspec its = {0}, old;
+   struct pollfd pfd;
+   struct timespec now;
+   uint64_t val;
+   int tfd, rc;
+
+   rc = timerfd_create(CLOCK_PROCESS_CPUTIME_ID, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+   DEVSHELL_CMD_ASSERT(tfd >= 0);
+
+   /* Disarmed timer */
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* One-shot timer, 50 ms */
+   printf("One-shot 50 ms timer\n");
+   ms_to_timespec(50, &its.it_value);
+   DEVSHELL_CMD_ASSERT(timerfd_settime(tfd, 0, &its, NULL) == 0);
+
+   DEVSHELL_CMD_ASSERT(timerfd_gettime(tfd, &old) == 0);
+   DEVSHELL_CMD_ASSERT(old.it_value.tv_sec || old.it_value.tv_nsec);
+
+   pfd = (struct pollfd) { .fd = tfd, .events = POLLIN };
+   DEVSHELL_CMD_ASSERT(poll(&pfd, 1, 3000) == 1);
+   DEVSHELL_CMD_ASSERT(pfd.revents == POLLIN);
+
+   DEVSHELL_CMD_ASSERT(read(tfd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 1);
+
+   rc = read(tfd, &val, sizeof(val));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EAGAIN);
+
+   /* Periodic timer: the expirations accumulate */
+   printf("Periodic 20 ms timer\n");
+   ms_to_timespec(20, &its.it_value);
+   ms_to_timespec(20, &its.it_interval);
+   DEVSHELL_CMD_ASSERT(timerfd_settime(tfd, 0, &its, NULL) == 0);
+
+   usleep(100 * 1000);
+   DEVSHELL_CMD_ASSERT(read(tfd, &val, sizeof(val)) == sizeof(val));
+   printf("Expirations after 100 ms: %llu\n", (unsigned long long)val);
+   DEVSHELL_CMD_ASSERT(val >= 3);
+
+   /* Disarm it, getting the old value */
+   its = (struct itimerspec) {0};
+   DEVSHELL_CMD_ASSERT(timerfd_settime(tfd, 0, &its, &old) == 0);
+   DEVSHELL_CMD_ASSERT(old.it_interval.tv_nsec == 20 * 1000000L);
+
+   DEVSHELL_CMD_ASSERT(timerfd_gettime(tfd, &old) == 0);
+   DEVSHELL_CMD_ASSERT(!old.it_value.tv_sec && !old.it_value.tv_nsec);
+   DEVSHELL_CMD_ASSERT(!old.it_interval.tv_sec && !old.it_interval.tv_nsec);
+   close(tfd);
+
+   /* Absolute timer on CLOCK_REALTIME, with a blocking read() */
+   printf("Absolute timer, blocking read()\n");
+   tfd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(tfd >= 0);
+
+   DEVSHELL_CMD_ASSERT(clock_gettime(CLOCK_REALTIME, &now) == 0);
+   its.it_value = now;
+   its.it_value.tv_nsec += 50 * 1000000L;
+
+   if (its.it_value.tv_nsec >= 1000000000L) {
+      its.it_value.tv_sec++;
+      its.it_value.tv_nsec -= 1000000000L;
+   }
+
+   rc = timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   DEVSHELL_CMD_ASSERT(read(tfd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 1);
+
+   /* An absolute time in the past expires immediately */
+   its.it_value = now;
+   DEVSHELL_CMD_ASSERT(timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, 0) == 0);
+   DEVSHELL_CMD_ASSERT(read(tfd, &val, sizeof(val)) == sizeof(val));
+   DEVSHELL_CMD_ASSERT(val == 1);
+
+   its.it_value.tv_nsec = 1000000000L;
+   rc = timerfd_settime(tfd, 0, &its, NULL);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   close(tfd);
+   return 0;
+}
+
+static volatile int alarm_count;
+
+static void alarm_handler(int sig)
+{
+   alarm_count++;
+}
+
+/* alarm(), setitimer() and getitimer() with ITIMER_REAL */
+int cmd_alarm1(int argc, char **argv)
+{
+   struct itimerval itv = {0}, old;
+   unsigned rem;
+   int rc;
+
+   alarm_count = 0;
+   signal(SIGALRM, &alarm_handler);
+
+   /* alarm() returns the seconds left of the previous alarm, if any */
+   DEVSHELL_CMD_ASSERT(alarm(10) == 0);
+   rem = alarm(0);
+   DEVSHELL_CMD_ASSERT(rem >= 9 && rem <= 10);
+   DEVSHELL_CMD_ASSERT(alarm(0) == 0);
+
+   /* One-shot, 50 ms */
+   printf("setitimer(ITIMER_REAL), 50 ms\n");
+   itv.it_value.tv_usec = 50 * 1000;
+   DEVSHELL_CMD_ASSERT(setitimer(ITIMER_REAL, &itv, NULL) == 0);
+
+   DEVSHELL_CMD_ASSERT(getitimer(ITIMER_REAL, &old) == 0);
+   DEVSHELL_CMD_ASSERT(old.it_value.tv_usec > 0);
+
+   pause();
+   DEVSHELL_CMD_ASSERT(alarm_count == 1);
+
+   DEVSHELL_CMD_ASSERT(getitimer(ITIMER_REAL, &old) == 0);
+   DEVSHELL_CMD_ASSERT(!old.it_value.tv_sec && !old.it_value.tv_usec);
+
+   /* Periodic, 20 ms */
+   printf("setitimer(ITIMER_REAL), periodic 20 ms\n");
+   itv.it_value.tv_usec = 20 * 1000;
+   itv.it_interval.tv_usec = 20 * 1000;
+   DEVSHELL_CMD_ASSERT(setitimer(ITIMER_REAL, &itv, NULL) == 0);
+
+   while (alarm_count < 4)
+      pause();
+
+   itv = (struct itimerval) {0};
+   DEVSHELL_CMD_ASSERT(setitimer(ITIMER_REAL, &itv, &old) == 0);
+   DEVSHELL_CMD_ASSERT(old.it_interval.tv_usec == 20 * 1000);
+
+   itv.it_value.tv_usec = 1000000;
+   rc = setitimer(ITIMER_REAL, &itv, NULL);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   signal(SIGALRM, SIG_DFL);
+   return 0;
+}
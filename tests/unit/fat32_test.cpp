@@ -4,6 +4,7 @@
 #include <iostream>
 #include <memory>
 #include <map>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "kernel_init_funcs.h"
@@ -12,6 +13,8 @@ extern "C" {
    #include <tilck/kernel/fs/fat32.h>
    #include <tilck/kernel/fs/vfs.h>
    #include <tilck/common/utils.h>
+   #include <tilck/common/fatz.h>
+   #include <tilck/common/lz4.h>
    #include <3rd_party/crc32.h>
 }
 
@@ -148,3 +151,64 @@ TEST(fat32, read_whole_file)
    uint32_t actual_file_crc = crc32(0, buf, fsize);
    ASSERT_EQ(fat_crc, actual_file_crc);
 }
+
+vector<char> build_fatz_image(struct fat_hdr *hdr)
+{
+   vector<char> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<char> buf(fat_calculate_used_bytes(hdr) + fatz_get_max_overhead(hdr));
+   u32 size;
+
+   size = fatz_build(hdr, buf.data(), buf.size(), wrkmem.data());
+   assert(size > 0);
+
+   buf.resize(size);
+   return buf;
+}
+
+TEST(fat32, fatz_image)
+{
+   struct fat_hdr *hdr = (struct fat_hdr *)
+      load_once_file(PROJ_BUILD_DIR "/test_fatpart");
+
+   vector<char> img = build_fatz_image(hdr);
+   struct fatz_hdr *zh = (struct fatz_hdr *)img.data();
+   const u32 cs = fat_get_cluster_size(hdr);
+   vector<char> data(cs);
+   u32 compressed = 0;
+
+   /*
+    * The test partition is mostly made of random data and its FAT is stored
+    * as it is: the image cannot be smaller, just not bigger than the bound.
+    */
+   ASSERT_TRUE(fatz_check_image(zh, img.size()));
+   ASSERT_LE(
+      zh->image_size,
+      fat_calculate_used_bytes(hdr) + fatz_get_max_overhead(hdr)
+   );
+   ASSERT_EQ(memcmp(fatz_get_fat_hdr(zh), hdr, zh->meta_size), 0);
+
+   for (u32 clu = 2; clu < zh->clusters + 2; clu++) {
+
+      ASSERT_TRUE(fatz_read_cluster(zh, clu, data.data()));
+      ASSERT_EQ(
+         memcmp(data.data(), fat_get_pointer_to_cluster_data(hdr, clu), cs), 0
+      ) << "Cluster: " << clu;
+
+      if (!fatz_is_raw_block(zh, clu)) {
+
+         u32 size;
+         fatz_get_block(zh, clu, &size);
+         ASSERT_LT(size, cs) << "Cluster: " << clu;
+         compressed++;
+      }
+   }
+
+   /* The clusters of the small text files must have been compressed */
+   ASSERT_GT(compressed, 0u);
+
+   /* A truncated image or a corrupted index must be rejected */
+   ASSERT_FALSE(fatz_check_image(zh, img.size() - 1));
+
+   fatz_get_index(zh)[0]++;
+   ASSERT_FALSE(fatz_check_image(zh, img.size()));
+}
@@ -104,6 +104,10 @@ void gdt_install() { }
 void idt_install() { }
 void irq_install() { }
 void hw_timer_setup() { }
+void hw_timer_oneshot() { }
+void hw_timer_oneshot_cut() { }
+void hw_timer_periodic() { }
+void hw_timer_oneshot_max_ticks() { }
 void irq_install_handler() { }
 void irq_uninstall_handler() { }
 void setup_sysenter_interface() { }
@@ -115,12 +119,14 @@ void pdir_destroy() { }
 void set_curr_pdir() { }
 void set_current_task_in_user_mode() { }
 void arch_specific_new_task_setup() { NOT_REACHED(); }
+void arch_specific_clone_setup() { NOT_REACHED(); }
 void arch_specific_free_task() { NOT_REACHED(); }
 void arch_specific_new_proc_setup() { NOT_REACHED(); }
 void arch_specific_free_proc() { NOT_REACHED(); }
 void fpu_context_begin() { }
 void fpu_context_end() { }
 void map_zero_pages() { NOT_REACHED(); }
+void map_zero_page() { NOT_REACHED(); }
 void dump_var_mtrrs() { }
 void set_page_rw() { }
 void poweroff() { NOT_REACHED(); }
@@ -128,6 +134,7 @@ int get_irq_num(void *ctx) { return -1; }
 int get_int_num(void *ctx) { return -1; }
 void retain_pageframes_mapped_at() { }
 void release_pageframes_mapped_at() { }
+bool are_pageframes_shared() { return false; }
 bool irq_is_masked() { NOT_REACHED(); return false; }
 
 void *hi_vmem_reserve(size_t size) { return NULL; }
@@ -20,11 +20,13 @@ extern "C" {
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/errno.h>
 
 #include <kernel/kmalloc/kmalloc_heap_struct.h> // kmalloc private header
 #include <kernel/kmalloc/kmalloc_block_node.h>  // kmalloc private header
 
 extern bool suppress_printk;
+void kmalloc_reset_caches_for_tests(void);
 
 extern bool kmalloc_initialized;
 extern struct kmalloc_heap first_heap_struct;
@@ -68,6 +70,7 @@ void init_kmalloc_for_tests()
    bzero(&heaps, sizeof(heaps));
    bzero(&used_heaps, sizeof(used_heaps));
    bzero(&max_tot_heap_mem_free, sizeof(max_tot_heap_mem_free));
+   kmalloc_reset_caches_for_tests();
 
    initialize_test_kernel_heap();
    suppress_printk = true;
@@ -149,6 +152,18 @@ ulong get_mapping(pdir_t *, void *vaddrp)
    return mappings[(ulong)vaddrp];
 }
 
+int get_mapping2(pdir_t *, void *vaddrp, ulong *pa_ref)
+{
+   ulong vaddr = (ulong)vaddrp & PAGE_MASK;
+   auto it = mappings.find(vaddr);
+
+   if (it == mappings.end() || it->second == INVALID_PADDR)
+      return -EFAULT;
+
+   *pa_ref = it->second | ((ulong)vaddrp & OFFSET_IN_PAGE_MASK);
+   return 0;
+}
+
 void *kmalloc(size_t size)
 {
    if (mock_kmalloc)
@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <random>
 #include <memory>
+#include <algorithm>
 
 #include <gtest/gtest.h>
 #include "mocks.h"
@@ -18,6 +19,7 @@ extern "C" {
    #include <tilck/common/utils.h>
 
    #include <tilck/kernel/kmalloc.h>
+   #include <tilck/kernel/kmalloc_debug.h>
    #include <tilck/kernel/paging.h>
    #include <tilck/kernel/self_tests.h>
 
@@ -180,6 +182,69 @@ TEST_F(kmalloc_test, chaos_test)
    }
 }
 
+static int cache_ctor_calls;
+
+static void cache_test_ctor(void *obj)
+{
+   memset(obj, 0xaa, 40);
+   cache_ctor_calls++;
+}
+
+TEST_F(kmalloc_test, object_cache)
+{
+   struct debug_kmalloc_cache_info ci;
+   vector<void *> objs;
+   struct kmalloc_cache *c;
+
+   cache_ctor_calls = 0;
+   c = kmalloc_create_cache("test", 40, &cache_test_ctor);
+   ASSERT_TRUE(c != NULL);
+
+   for (int i = 0; i < 1000; i++) {
+
+      u8 *obj = (u8 *)kmalloc_cache_alloc(c);
+      ASSERT_TRUE(obj != NULL);
+      ASSERT_EQ((ulong)obj % 8, 0u);
+
+      /* Every object handed out is in its constructed state */
+      for (int j = 0; j < 40; j++)
+         ASSERT_EQ(obj[j], 0xaa);
+
+      objs.push_back(obj);
+   }
+
+   ASSERT_TRUE(debug_kmalloc_get_cache_info(0, &ci));
+   EXPECT_STREQ(ci.name, "test");
+   EXPECT_EQ(ci.obj_size, 40u);
+   EXPECT_EQ(ci.objs_in_use, 1000u);
+   EXPECT_EQ(ci.allocs_count, 1000u);
+   EXPECT_EQ(ci.slabs_count, (1000 + ci.objs_per_slab - 1) / ci.objs_per_slab);
+   EXPECT_EQ((size_t)cache_ctor_calls, ci.slabs_count * ci.objs_per_slab);
+   EXPECT_FALSE(debug_kmalloc_get_cache_info(1, &ci));
+
+   sort(objs.begin(), objs.end());
+   ASSERT_TRUE(adjacent_find(objs.begin(), objs.end()) == objs.end());
+
+   for (size_t i = 0; i < objs.size(); i += 2)
+      kmalloc_cache_free(c, objs[i]);
+
+   for (size_t i = 1; i < objs.size(); i += 2)
+      kmalloc_cache_free(c, objs[i]);
+
+   ASSERT_TRUE(debug_kmalloc_get_cache_info(0, &ci));
+   EXPECT_EQ(ci.objs_in_use, 0u);
+   EXPECT_EQ(ci.peak_objs_in_use, 1000u);
+   EXPECT_EQ(ci.slabs_count, 1u);
+
+   /* The empty slab kept around is reused without calling the ctor again */
+   const int ctor_calls = cache_ctor_calls;
+   kmalloc_cache_free(c, kmalloc_cache_alloc(c));
+   EXPECT_EQ(cache_ctor_calls, ctor_calls);
+
+   kmalloc_destroy_cache(c);
+   EXPECT_FALSE(debug_kmalloc_get_cache_info(0, &ci));
+}
+
 #define COLOR_RED           "\033[31m"
 #define COLOR_YELLOW        "\033[93m"
 #define COLOR_BRIGHT_GREEN  "\033[92m"
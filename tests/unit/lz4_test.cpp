@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <cstring>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+
+using namespace std;
+using namespace testing;
+
+extern "C" {
+   #include <tilck/common/lz4.h>
+}
+
+static void lz4_check_round_trip(const vector<u8> &in)
+{
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> comp(in.size() + in.size() / 255 + 16);
+   vector<u8> out(in.size() + 1);
+   size_t clen;
+   long dlen;
+
+   clen = lz4_compress(in.data(), in.size(),
+                       comp.data(), comp.size(), wrkmem.data());
+   ASSERT_GT(clen, 0u);
+
+   dlen = lz4_decompress(comp.data(), clen, out.data(), out.size());
+   ASSERT_EQ(dlen, (long)in.size());
+   ASSERT_EQ(memcmp(out.data(), in.data(), in.size()), 0);
+}
+
+TEST(lz4, round_trip_small)
+{
+   for (size_t len = 0; len < 64; len++) {
+
+      vector<u8> in(len);
+
+      for (size_t i = 0; i < len; i++)
+         in[i] = (u8)(i % 3);
+
+      lz4_check_round_trip(in);
+   }
+}
+
+TEST(lz4, round_trip_repetitive)
+{
+   vector<u8> in(64 * KB);
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> comp(in.size());
+   const char *s = "Hello world, this is a string repeated many times. ";
+
+   for (size_t i = 0; i < in.size(); i++)
+      in[i] = (u8)s[i % strlen(s)];
+
+   lz4_check_round_trip(in);
+
+   /* Highly repetitive data must compress well */
+   size_t clen = lz4_compress(in.data(), in.size(),
+                              comp.data(), comp.size(), wrkmem.data());
+   ASSERT_GT(clen, 0u);
+   ASSERT_LT(clen, in.size() / 32);
+}
+
+TEST(lz4, round_trip_overlapping_matches)
+{
+   /* Runs of the same byte produce matches overlapping their own output */
+   vector<u8> in(4 * KB, 'a');
+
+   for (size_t i = 1000; i < 1500; i++)
+      in[i] = (u8)('b' + i % 2);
+
+   lz4_check_round_trip(in);
+}
+
+TEST(lz4, round_trip_random)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
+   uniform_int_distribution<int> dist(0, 255);
+   uniform_int_distribution<int> sym_dist(0, 3);
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int iter = 0; iter < 50; iter++) {
+
+      vector<u8> in(1 + engine() % (16 * KB));
+
+      /* Mix incompressible data with low-entropy data */
+      for (size_t i = 0; i < in.size(); i++)
+         in[i] = (u8)((iter % 2) ? dist(engine) : sym_dist(engine));
+
+      lz4_check_round_trip(in);
+   }
+}
+
+TEST(lz4, compress_does_not_fit)
+{
+   vector<u8> in(4 * KB);
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> comp(in.size());
+   default_random_engine engine(1234);
+
+   for (size_t i = 0; i < in.size(); i++)
+      in[i] = (u8)engine();
+
+   /* Random data does not compress: it cannot fit in less than its size */
+   ASSERT_EQ(lz4_compress(in.data(), in.size(),
+                          comp.data(), in.size() - 1, wrkmem.data()), 0u);
+}
+
+TEST(lz4, decompress_corrupted)
+{
+   vector<u8> in(4 * KB, 'x');
+   vector<u8> wrkmem(LZ4_WRKMEM_SIZE);
+   vector<u8> comp(in.size());
+   vector<u8> out(in.size());
+   size_t clen;
+
+   clen = lz4_compress(in.data(), in.size(),
+                       comp.data(), comp.size(), wrkmem.data());
+   ASSERT_GT(clen, 0u);
+
+   /* The output buffer is too small */
+   ASSERT_EQ(lz4_decompress(comp.data(), clen, out.data(), in.size() - 1), -1);
+
+   /* Truncated input */
+   for (size_t len = 1; len < clen; len++) {
+      long rc = lz4_decompress(comp.data(), len, out.data(), out.size());
+      ASSERT_TRUE(rc == -1 || rc < (long)in.size());
+   }
+
+   /* Match offset pointing before the beginning of the output */
+   const u8 bad[] = { 0x10, 'a', 0x05, 0x00, 0x00 };
+   ASSERT_EQ(lz4_decompress(bad, sizeof(bad), out.data(), out.size()), -1);
+
+   /* Zero offset */
+   const u8 bad2[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+   ASSERT_EQ(lz4_decompress(bad2, sizeof(bad2), out.data(), out.size()), -1);
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <random>
 #include <vector>
 #include <gtest/gtest.h>
@@ -248,3 +249,56 @@ TEST(ringbuf, read_write_bytes)
    ASSERT_TRUE(ringbuf_is_empty(&rb));
    ringbuf_destory(&rb);
 }
+
+TEST(ringbuf, read_write_chunks)
+{
+   struct ringbuf rb;
+   char buffer[9] = "--------";
+   u8 *ptr;
+   size_t n;
+
+   ringbuf_init(&rb, 8, 1, buffer);
+
+   ASSERT_EQ(ringbuf_get_read_chunk(&rb, &ptr), 0U);
+   ASSERT_EQ(ringbuf_get_write_chunk(&rb, &ptr), 8U);
+   ASSERT_EQ((char *)ptr, buffer);
+
+   memcpy(ptr, "12345", 5);
+   ringbuf_commit_bytes(&rb, 5);
+   ASSERT_EQ(ringbuf_get_elems(&rb), 5U);
+
+   n = ringbuf_get_read_chunk(&rb, &ptr);
+   ASSERT_EQ(n, 5U);
+   ASSERT_EQ(memcmp(ptr, "123", 3), 0);
+   ringbuf_consume_bytes(&rb, 3);
+
+   /* The free space is now in two chunks: [5, 8) and [0, 3) */
+   n = ringbuf_get_write_chunk(&rb, &ptr);
+   ASSERT_EQ(n, 3U);
+   memcpy(ptr, "678", 3);
+   ringbuf_commit_bytes(&rb, 3);
+
+   n = ringbuf_get_write_chunk(&rb, &ptr);
+   ASSERT_EQ(n, 3U);
+   ASSERT_EQ((char *)ptr, buffer);
+   memcpy(ptr, "9ab", 3);
+   ringbuf_commit_bytes(&rb, 3);
+
+   ASSERT_TRUE(ringbuf_is_full(&rb));
+   ASSERT_EQ(ringbuf_get_write_chunk(&rb, &ptr), 0U);
+   ASSERT_STREQ(buffer, "9ab45678");
+
+   /* The data is in two chunks as well: [3, 8) and [0, 3) */
+   n = ringbuf_get_read_chunk(&rb, &ptr);
+   ASSERT_EQ(n, 5U);
+   ASSERT_EQ(memcmp(ptr, "45678", 5), 0);
+   ringbuf_consume_bytes(&rb, 5);
+
+   n = ringbuf_get_read_chunk(&rb, &ptr);
+   ASSERT_EQ(n, 3U);
+   ASSERT_EQ(memcmp(ptr, "9ab", 3), 0);
+   ringbuf_consume_bytes(&rb, 3);
+
+   ASSERT_TRUE(ringbuf_is_empty(&rb));
+   ringbuf_destory(&rb);
+}
@@ -1,5 +1,10 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "vfs_test.h"
 
 using namespace std;
@@ -45,3 +50,437 @@ TEST_F(ramfs_perf, creat)
    for (int i = 0; i < 100; i++)
       create_test_file(i);
 }
+
+static int stat_path(const char *path)
+{
+   struct stat64 st;
+   return vfs_stat64(path, &st, true);
+}
+
+TEST_F(ramfs_perf, dcache)
+{
+   struct vfs_dcache_stats s1, s2;
+   fs_handle h;
+
+   ASSERT_EQ(vfs_mkdir("/dir", 0755), 0);
+   ASSERT_EQ(vfs_open("/dir/f1", &h, O_CREAT, 0644), 0);
+   vfs_close(h);
+
+   /* Positive entries: the second lookup must not reach ramfs */
+   ASSERT_EQ(stat_path("/dir/f1"), 0);
+   vfs_dcache_get_stats(&s1);
+   ASSERT_EQ(stat_path("/dir/f1"), 0);
+   vfs_dcache_get_stats(&s2);
+   EXPECT_EQ(s2.misses, s1.misses);
+   EXPECT_EQ(s2.hits, s1.hits + 2);
+
+   /* Negative entries */
+   ASSERT_EQ(stat_path("/dir/f2"), -ENOENT);
+   vfs_dcache_get_stats(&s1);
+   ASSERT_EQ(stat_path("/dir/f2"), -ENOENT);
+   vfs_dcache_get_stats(&s2);
+   EXPECT_EQ(s2.misses, s1.misses);
+
+   /* Creating, renaming and removing entries must invalidate the cache */
+   ASSERT_EQ(vfs_open("/dir/f2", &h, O_CREAT, 0644), 0);
+   vfs_close(h);
+   ASSERT_EQ(stat_path("/dir/f2"), 0);
+
+   ASSERT_EQ(vfs_rename("/dir/f2", "/dir/f3"), 0);
+   ASSERT_EQ(stat_path("/dir/f2"), -ENOENT);
+   ASSERT_EQ(stat_path("/dir/f3"), 0);
+
+   ASSERT_EQ(vfs_link("/dir/f3", "/dir/f4"), 0);
+   ASSERT_EQ(stat_path("/dir/f4"), 0);
+
+   ASSERT_EQ(vfs_unlink("/dir/f1"), 0);
+   ASSERT_EQ(stat_path("/dir/f1"), -ENOENT);
+
+   ASSERT_EQ(vfs_symlink("/dir/f3", "/dir/f1"), 0);
+   ASSERT_EQ(stat_path("/dir/f1"), 0);
+
+   ASSERT_EQ(vfs_unlink("/dir/f1"), 0);
+   ASSERT_EQ(vfs_unlink("/dir/f3"), 0);
+   ASSERT_EQ(vfs_unlink("/dir/f4"), 0);
+   ASSERT_EQ(vfs_rmdir("/dir"), 0);
+   ASSERT_EQ(stat_path("/dir"), -ENOENT);
+   ASSERT_EQ(stat_path("/dir/f3"), -ENOENT);
+
+   ASSERT_EQ(vfs_mkdir("/dir", 0755), 0);
+   ASSERT_EQ(stat_path("/dir"), 0);
+   ASSERT_EQ(stat_path("/dir/f3"), -ENOENT);
+}
+
+TEST_F(ramfs_perf, dcache_eviction)
+{
+   struct vfs_dcache_stats s1, s2;
+   char path[64];
+
+   for (int i = 0; i < 1000; i++)
+      create_test_file(i);
+
+   vfs_dcache_get_stats(&s1);
+
+   for (int i = 0; i < 1000; i++) {
+      sprintf(path, "/test_%d", i);
+      ASSERT_EQ(stat_path(path), 0);
+   }
+
+   vfs_dcache_get_stats(&s2);
+   EXPECT_GT(s2.evictions, s1.evictions);
+}
+
+TEST_F(ramfs_perf, rw_random)
+{
+   const size_t max_size = 3 * MB + 123;
+   vector<char> model, buf(256 * KB);
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   struct stat64 st;
+   fs_handle h;
+   ssize_t rc;
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+   ASSERT_EQ(vfs_open("/file", &h, O_CREAT | O_RDWR, 0644), 0);
+
+   for (int iter = 0; iter < 300; iter++) {
+
+      const size_t off = e() % max_size;
+      const size_t len = MIN(e() % buf.size(), max_size - off);
+
+      if (iter % 50 == 49) {
+
+         /* From time to time, truncate the file */
+         const size_t new_len = e() % (model.size() + 1);
+
+         ASSERT_EQ(vfs_ftruncate(h, (offt)new_len), 0);
+         model.resize(new_len);
+         continue;
+      }
+
+      for (size_t i = 0; i < len; i++)
+         buf[i] = (char)e();
+
+      ASSERT_EQ(vfs_seek(h, (s64)off, SEEK_SET), (offt)off);
+      ASSERT_EQ(vfs_write(h, buf.data(), len), (ssize_t)len);
+
+      if (model.size() < off + len)
+         model.resize(off + len);
+
+      memcpy(model.data() + off, buf.data(), len);
+   }
+
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   ASSERT_EQ((size_t)st.st_size, model.size());
+   ASSERT_LE((size_t)st.st_blocks * 512, (model.size() + 4095) & ~4095ul);
+
+   buf.resize(model.size() + 1);
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   rc = vfs_read(h, buf.data(), buf.size());
+   ASSERT_EQ(rc, (ssize_t)model.size());
+   ASSERT_TRUE(!memcmp(buf.data(), model.data(), model.size()));
+
+   ASSERT_EQ(vfs_ftruncate(h, 0), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   ASSERT_EQ(st.st_blocks, 0);
+   vfs_close(h);
+}
+
+static void check_file_content(fs_handle h, const vector<char> &model)
+{
+   vector<char> buf(model.size() + 1);
+
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   ASSERT_EQ(vfs_read(h, buf.data(), buf.size()), (ssize_t)model.size());
+   ASSERT_TRUE(!memcmp(buf.data(), model.data(), model.size()));
+}
+
+TEST_F(ramfs_perf, small_files)
+{
+   const int n = 1000;
+   vector<char> model;
+   struct stat64 st;
+   char path[64];
+   fs_handle h;
+
+   /* Many tiny files: their data is stored inline, with no pages */
+   for (int i = 0; i < n; i++) {
+
+      sprintf(path, "/small_%d", i);
+      ASSERT_EQ(vfs_open(path, &h, O_CREAT | O_WRONLY, 0644), 0);
+      ASSERT_EQ(vfs_write(h, path, strlen(path)), (ssize_t)strlen(path));
+      ASSERT_EQ(vfs_fstat64(h, &st), 0);
+      ASSERT_EQ(st.st_size, (s64)strlen(path));
+      ASSERT_EQ(st.st_blocks, 0);
+      vfs_close(h);
+   }
+
+   for (int i = 0; i < n; i++) {
+
+      sprintf(path, "/small_%d", i);
+      model.assign(path, path + strlen(path));
+
+      ASSERT_EQ(vfs_open(path, &h, O_RDONLY, 0), 0);
+      check_file_content(h, model);
+      vfs_close(h);
+      ASSERT_EQ(vfs_unlink(path), 0);
+   }
+
+   /* Grow a small file with writes past EOF, truncate and append */
+   ASSERT_EQ(vfs_open("/file", &h, O_CREAT | O_RDWR, 0644), 0);
+   model.clear();
+
+   for (size_t off = 0; off < 2 * PAGE_SIZE; off += 100) {
+
+      char s[] = "0123456789";
+
+      ASSERT_EQ(vfs_seek(h, (s64)off, SEEK_SET), (offt)off);
+      ASSERT_EQ(vfs_write(h, s, 10), 10);
+
+      if (model.size() < off + 10)
+         model.resize(off + 10);
+
+      memcpy(model.data() + off, s, 10);
+      check_file_content(h, model);
+
+      if (off == 300) {
+
+         ASSERT_EQ(vfs_ftruncate(h, 150), 0);
+         ASSERT_EQ(vfs_ftruncate(h, 450), 0);
+         model.resize(150);
+         model.resize(450);
+         check_file_content(h, model);
+
+         ASSERT_EQ(vfs_fstat64(h, &st), 0);
+         ASSERT_EQ(st.st_blocks, 0);
+      }
+   }
+
+   /* Now the file has been promoted to regular pages */
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   ASSERT_GT(st.st_blocks, 0);
+
+   ASSERT_EQ(vfs_ftruncate(h, 0), 0);
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   ASSERT_EQ(vfs_write(h, path, 3), 3);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   ASSERT_EQ(st.st_blocks, 0);
+
+   vfs_close(h);
+}
+
+struct dents_batch_ctx {
+   fs_handle h;
+   size_t max;
+   vector<string> names;
+   vector<offt> offs;
+};
+
+static int dents_batch_cb(struct vfs_dent64 *vde, void *arg)
+{
+   auto *ctx = (struct dents_batch_ctx *)arg;
+   auto *hb = (struct fs_handle_base *)ctx->h;
+
+   if (ctx->names.size() == ctx->max)
+      return 1; /* "buffer" full: the entry is not consumed */
+
+   /* Do what vfs_getdents_cb() does with the handle's position */
+   EXPECT_NE(vde->next_off, 0);
+   ctx->names.push_back(vde->name);
+   ctx->offs.push_back(vde->next_off);
+   hb->pos = vde->next_off;
+   return 0;
+}
+
+/* Read up to `max` entries from the current position of `h` */
+static void
+read_dents_batch(fs_handle h, size_t max, struct dents_batch_ctx &ctx)
+{
+   auto *hb = (struct fs_handle_base *)h;
+
+   ctx.h = h;
+   ctx.max = max;
+   ctx.names.clear();
+   ctx.offs.clear();
+
+   ASSERT_GE(hb->fs->fsops->getdents(h, &dents_batch_cb, &ctx), 0);
+}
+
+TEST_F(ramfs_perf, getdents_10k_entries)
+{
+   const int n = 10000;
+   struct dents_batch_ctx ctx;
+   vector<string> all_names;
+   vector<offt> all_offs;
+   set<string> seen;
+   char path[64];
+   fs_handle h;
+
+   ASSERT_EQ(vfs_mkdir("/d", 0755), 0);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "/d/f%d", i);
+      ASSERT_EQ(vfs_open(path, &h, O_CREAT, 0644), 0);
+      vfs_close(h);
+   }
+
+   ASSERT_EQ(vfs_open("/d", &h, O_RDONLY, 0), 0);
+
+   /* Read the whole directory in small batches */
+   do {
+
+      read_dents_batch(h, 37, ctx);
+      all_names.insert(all_names.end(), ctx.names.begin(), ctx.names.end());
+      all_offs.insert(all_offs.end(), ctx.offs.begin(), ctx.offs.end());
+
+   } while (!ctx.names.empty());
+
+   ASSERT_EQ(all_names.size(), (size_t)n + 2);   /* + "." and ".." */
+   seen.insert(all_names.begin(), all_names.end());
+   ASSERT_EQ(seen.size(), all_names.size());
+
+   for (size_t i = 1; i < all_offs.size(); i++)
+      ASSERT_GT(all_offs[i], all_offs[i - 1]);
+
+   /* Seek to the offsets returned (telldir/seekdir) and resume from there */
+   for (size_t i = 0; i + 1 < all_offs.size(); i += 97) {
+
+      ASSERT_EQ(vfs_seek(h, all_offs[i], SEEK_SET), all_offs[i]);
+      read_dents_batch(h, 1, ctx);
+      ASSERT_EQ(ctx.names.size(), 1u);
+      ASSERT_EQ(ctx.names[0], all_names[i + 1]);
+   }
+
+   /* Remove the entries while iterating: no entry is returned twice */
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   seen.clear();
+
+   do {
+
+      read_dents_batch(h, 1, ctx);
+
+      for (const string &name : ctx.names) {
+
+         ASSERT_TRUE(seen.insert(name).second);
+
+         if (name == "." || name == "..")
+            continue;
+
+         /* Remove the returned entry and the one following it */
+         sprintf(path, "/d/%s", name.c_str());
+         ASSERT_EQ(vfs_unlink(path), 0);
+
+         sprintf(path, "/d/f%d", atoi(name.c_str() + 1) + 1);
+
+         if (seen.find(path + 3) == seen.end())
+            vfs_unlink(path);      /* might not exist */
+      }
+
+   } while (!ctx.names.empty());
+
+   /* Exactly the even entries have been returned */
+   ASSERT_EQ(seen.size(), (size_t)n / 2 + 2);
+
+   for (int i = 0; i < n; i += 2) {
+      sprintf(path, "f%d", i);
+      ASSERT_TRUE(seen.find(path) != seen.end());
+   }
+
+   vfs_close(h);
+}
+
+static void
+read_whole_file(const char *path, vector<char> &buf)
+{
+   struct stat64 st;
+   fs_handle h;
+
+   ASSERT_EQ(vfs_open(path, &h, O_RDONLY, 0), 0);
+   ASSERT_EQ(vfs_fstat64(h, &st), 0);
+   buf.resize((size_t)st.st_size);
+   ASSERT_EQ(vfs_read(h, buf.data(), buf.size()), (ssize_t)buf.size());
+   vfs_close(h);
+}
+
+TEST_F(ramfs_perf, copy_range)
+{
+   const size_t size = 2 * MB + 123;
+   vector<char> data(size), buf;
+   struct stat64 st1, st2;
+   fs_handle src, dst;
+   offt in_off, out_off;
+   size_t mem_before;
+   ssize_t rc;
+
+   for (size_t i = 0; i < size; i++)
+      data[i] = (char)(i * 7 + i / 4096);
+
+   ASSERT_EQ(vfs_open("/src", &src, O_CREAT | O_RDWR, 0644), 0);
+   ASSERT_EQ(vfs_write(src, data.data(), size), (ssize_t)size);
+   ASSERT_EQ(vfs_open("/dst", &dst, O_CREAT | O_RDWR, 0644), 0);
+
+   /* Aligned copy: the pages are shared, almost no memory is used */
+   mem_before = kmalloc_get_max_tot_heap_free();
+   in_off = out_off = 0;
+   rc = vfs_transfer(src, &in_off, dst, &out_off, size + 1000);
+   ASSERT_EQ(rc, (ssize_t)size);
+   ASSERT_EQ(in_off, (offt)size);
+   ASSERT_EQ(out_off, (offt)size);
+   EXPECT_LT(mem_before - kmalloc_get_max_tot_heap_free(), 64 * KB);
+
+   ASSERT_EQ(vfs_fstat64(src, &st1), 0);
+   ASSERT_EQ(vfs_fstat64(dst, &st2), 0);
+   ASSERT_EQ(st1.st_size, st2.st_size);
+   ASSERT_EQ(st1.st_blocks, st2.st_blocks);
+
+   read_whole_file("/dst", buf);
+   ASSERT_TRUE(buf == data);
+
+   /* Writing to a shared page affects only the file written (COW) */
+   ASSERT_EQ(vfs_seek(src, 100, SEEK_SET), 100);
+   ASSERT_EQ(vfs_write(src, (void *)"XYZ", 3), 3);
+   read_whole_file("/dst", buf);
+   ASSERT_TRUE(buf == data);
+
+   memcpy(data.data() + 100, "XYZ", 3);
+   read_whole_file("/src", buf);
+   ASSERT_TRUE(buf == data);
+
+   /* Truncating one of the files, zeroes the tail of its private page */
+   ASSERT_EQ(vfs_ftruncate(dst, 5000), 0);
+   ASSERT_EQ(vfs_ftruncate(dst, 8192), 0);
+   read_whole_file("/src", buf);
+   ASSERT_TRUE(buf == data);
+   read_whole_file("/dst", buf);
+   ASSERT_EQ(buf.size(), 8192u);
+
+   for (size_t i = 5000; i < 8192; i++)
+      ASSERT_EQ(buf[i], 0);
+
+   /* Unaligned copy in the middle of the existing file */
+   in_off = 1;
+   out_off = 3;
+   rc = vfs_transfer(src, &in_off, dst, &out_off, 3 * PAGE_SIZE);
+   ASSERT_EQ(rc, (ssize_t)(3 * PAGE_SIZE));
+   read_whole_file("/dst", buf);
+   ASSERT_EQ(buf.size(), 3 * PAGE_SIZE + 3);
+   ASSERT_TRUE(!memcmp(buf.data() + 3, data.data() + 1, 3 * PAGE_SIZE));
+
+   /* Remove the source: the shared pages must survive in the other file */
+   vfs_close(src);
+   ASSERT_EQ(vfs_unlink("/src"), 0);
+
+   in_off = out_off = 0;
+   ASSERT_EQ(vfs_open("/dst2", &src, O_CREAT | O_RDWR, 0644), 0);
+   rc = vfs_transfer(dst, &in_off, src, &out_off, 1 * MB);
+   ASSERT_EQ(rc, (ssize_t)(3 * PAGE_SIZE + 3));
+   vfs_close(dst);
+   ASSERT_EQ(vfs_unlink("/dst"), 0);
+
+   read_whole_file("/dst2", buf);
+   ASSERT_EQ(buf.size(), 3 * PAGE_SIZE + 3);
+   ASSERT_TRUE(!memcmp(buf.data() + 3, data.data() + 1, 3 * PAGE_SIZE));
+   vfs_close(src);
+   ASSERT_EQ(vfs_unlink("/dst2"), 0);
+}
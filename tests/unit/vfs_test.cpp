@@ -56,6 +56,52 @@ TEST_F(vfs_misc, read_content_of_longname_file)
    ASSERT_STREQ("Content of file with a long name\n", data);
 }
 
+TEST_F(vfs_misc, dir_cache_lookup)
+{
+   const char *buf = load_once_file(TEST_FATPART_FILE);
+   struct fat_hdr *hdr = (struct fat_hdr *)buf;
+
+   const char *paths[] = {
+      "/testdir",
+      "/testdir/dir1/f1",
+      "/testdir/dir1/F1",
+      "/testdir/dir2/f4",
+      "/testdir/file.abc",
+      "/testdir/FILE.ABC",
+      "/testdir/file.ab",
+      "/testdir/file.a",
+      "/testdir/file.",
+      "/testdir/Aaa",
+      "/testdir/aaa",
+      "/testdir/BBB",
+      "/testdir/bbb",
+      "/testdir/12345678.xyz",
+      "/testdir/This_is_a_file_with_a_veeeery_long_name.txt",
+      "/testdir/this_is_a_file_with_a_veeeery_long_name.txt",
+      "/testdir/manyfiles/f11",
+      "/testdir/manyfiles/f19",
+      "/testdir/manyfiles/f1000",
+      "/testdir/nonexistent",
+      "/bigfile",
+   };
+
+   for (const char *path : paths) {
+
+      fs_handle h = NULL;
+      struct fat_entry *e = fat_search_entry(hdr, fat_unknown, path, NULL);
+      int rc = vfs_open(path, &h, O_RDONLY, 0);
+
+      if (!e) {
+         ASSERT_EQ(rc, -ENOENT) << "Path: " << path;
+         continue;
+      }
+
+      ASSERT_EQ(rc, 0) << "Path: " << path;
+      ASSERT_EQ(((struct fatfs_handle *)h)->e, e) << "Path: " << path;
+      vfs_close(h);
+   }
+}
+
 TEST_F(vfs_misc, fseek)
 {
    random_device rdev;
@@ -166,6 +212,158 @@ TEST_F(vfs_misc, fseek)
    close(fd);
 }
 
+TEST_F(vfs_misc, pread)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
+   const char *fatpart_file_path = "/bigfile";
+   const char *real_file_path = PROJ_BUILD_DIR "/test_sysroot/bigfile";
+   char buf_tilck[256];
+   char buf_linux[256];
+   fs_handle h = NULL;
+   int r;
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   int fd = open(real_file_path, O_RDONLY);
+   const off_t file_size = lseek(fd, 0, SEEK_END);
+
+   r = vfs_open(fatpart_file_path, &h, 0, O_RDONLY);
+   ASSERT_TRUE(r == 0);
+   ASSERT_TRUE(h != NULL);
+
+   uniform_int_distribution<off_t> off_dist(0, file_size + 64);
+   uniform_int_distribution<size_t> len_dist(0, sizeof(buf_tilck));
+
+   for (int i = 0; i < 10000; i++) {
+
+      const off_t off = off_dist(engine);
+      const size_t len = len_dist(engine);
+
+      memset(buf_linux, 0, sizeof(buf_linux));
+      memset(buf_tilck, 0, sizeof(buf_tilck));
+
+      ssize_t linux_read = pread(fd, buf_linux, len, off);
+      ssize_t tilck_read = vfs_pread(h, buf_tilck, len, off);
+
+      ASSERT_EQ(tilck_read, linux_read) << "Offset: " << off << endl;
+      ASSERT_EQ(memcmp(buf_tilck, buf_linux, sizeof(buf_linux)), 0)
+         << "Offset: " << off << endl;
+
+      /* pread() must not move the file's cursor */
+      ASSERT_EQ(vfs_seek(h, 0, SEEK_CUR), 0);
+   }
+
+   ASSERT_EQ(vfs_pread(h, buf_tilck, sizeof(buf_tilck), -1), -EINVAL);
+
+   vfs_close(h);
+   close(fd);
+}
+
+class vfs_misc_fatz : public vfs_test_base {
+
+protected:
+
+   struct fs *fat_fs;
+   vector<char> img;
+
+   void SetUp() override {
+
+      vfs_test_base::SetUp();
+
+      const char *buf = load_once_file(TEST_FATPART_FILE);
+      img = build_fatz_image((struct fat_hdr *)buf);
+      fat_fs = fat_mount_ramdisk(img.data(), img.size(), 0);
+      ASSERT_TRUE(fat_fs != NULL);
+
+      mp_init(fat_fs);
+   }
+
+   void TearDown() override {
+
+      fat_umount_ramdisk(fat_fs);
+      vfs_test_base::TearDown();
+   }
+};
+
+TEST_F(vfs_misc_fatz, read_content_of_longname_file)
+{
+   char data[128] = {0};
+   fs_handle h = NULL;
+   int r;
+
+   const char *file_path =
+      "/testdir/This_is_a_file_with_a_veeeery_long_name.txt";
+
+   r = vfs_open(file_path, &h, 0, O_RDONLY);
+   ASSERT_TRUE(r == 0);
+   ASSERT_TRUE(h != NULL);
+   ssize_t res = vfs_read(h, data, sizeof(data));
+   vfs_close(h);
+
+   EXPECT_GT(res, 0);
+   ASSERT_STREQ("Content of file with a long name\n", data);
+}
+
+TEST_F(vfs_misc_fatz, pread)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
+   const char *real_file_path = PROJ_BUILD_DIR "/test_sysroot/bigfile";
+   char buf_tilck[4096];
+   char buf_linux[4096];
+   fs_handle h = NULL;
+   ssize_t rc;
+   off_t off;
+   int r;
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   int fd = open(real_file_path, O_RDONLY);
+   const off_t file_size = lseek(fd, 0, SEEK_END);
+
+   r = vfs_open("/bigfile", &h, 0, O_RDONLY);
+   ASSERT_TRUE(r == 0);
+   ASSERT_TRUE(h != NULL);
+
+   /* Read the whole file sequentially: that requires evicting clusters */
+   for (off = 0; off < file_size; off += rc) {
+
+      rc = vfs_read(h, buf_tilck, sizeof(buf_tilck));
+      ASSERT_GT(rc, 0);
+      ASSERT_EQ(pread(fd, buf_linux, (size_t)rc, off), rc);
+      ASSERT_EQ(memcmp(buf_tilck, buf_linux, (size_t)rc), 0)
+         << "Offset: " << off << endl;
+   }
+
+   ASSERT_EQ(vfs_read(h, buf_tilck, sizeof(buf_tilck)), 0);
+
+   /* Then, read it in random order */
+   uniform_int_distribution<off_t> off_dist(0, file_size + 64);
+   uniform_int_distribution<size_t> len_dist(0, sizeof(buf_tilck));
+
+   for (int i = 0; i < 2000; i++) {
+
+      const size_t len = len_dist(engine);
+      off = off_dist(engine);
+
+      memset(buf_linux, 0, sizeof(buf_linux));
+      memset(buf_tilck, 0, sizeof(buf_tilck));
+
+      ssize_t linux_read = pread(fd, buf_linux, len, off);
+      ssize_t tilck_read = vfs_pread(h, buf_tilck, len, off);
+
+      ASSERT_EQ(tilck_read, linux_read) << "Offset: " << off << endl;
+      ASSERT_EQ(memcmp(buf_tilck, buf_linux, sizeof(buf_linux)), 0)
+         << "Offset: " << off << endl;
+   }
+
+   vfs_close(h);
+   close(fd);
+}
+
 class compute_abs_path_test :
    public TestWithParam<
       tuple<const char *, const char *, const char *>
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <vector>
 #include <gtest/gtest.h>
 #include "kernel_init_funcs.h"
 
@@ -19,6 +20,7 @@ extern "C" {
 // Implemented in fat32_test.cpp
 const char *load_once_file(const char *filepath, size_t *fsize = nullptr);
 void test_dump_buf(char *buf, const char *buf_name, int off, int count);
+std::vector<char> build_fatz_image(struct fat_hdr *hdr);
 
 class vfs_test_base : public ::testing::Test {
 
@@ -58,6 +58,7 @@ inline struct fs create_test_fs(const char *name, tfs_entry *root)
       .flags            = 0,
       .device_data      = root,
       .fsops            = &static_fsops_testfs,
+      .dcache_gen       = 0,     /* no dentry cache */
    };
 
    return fs;